@@ -0,0 +1,245 @@
+#include "action_map.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+bool IsSet(GUID const& guid) {
+  return !(guid == GUID {});
+}
+
+bool Matches(ActionMap::DeviceSelector const& selector, DirectInputContext::Device const& device) {
+  if (IsSet(selector.guid)) {
+    return device.guid == selector.guid;
+  }
+  return device.name == selector.product_name;
+}
+
+/// The `Input` of `device` that `input` refers to, or `nullptr` if the device has no such input.
+DirectInputContext::Input const* FindInput(ActionMap::InputRef const& input, DirectInputContext::Device const& device) {
+  std::vector<DirectInputContext::Input> const* inputs = nullptr;
+  switch (input.type) {
+  case DirectInputContext::InputType::kPOV: inputs = &device.povs; break;
+  case DirectInputContext::InputType::kAxis: inputs = &device.axes; break;
+  case DirectInputContext::InputType::kButton: inputs = &device.buttons; break;
+  }
+  return (input.index < inputs->size()) ? &(*inputs)[input.index] : nullptr;
+}
+
+}
+
+ActionMap::ActionId ActionMap::AddAction(std::string name) {
+  action_names_.push_back(std::move(name));
+  action_states_.emplace_back();
+  previous_down_.push_back(0);
+  return static_cast<ActionId>(action_names_.size() - 1);
+}
+
+void ActionMap::AddBinding(Binding binding) {
+  assert(binding.action < action_names_.size());
+  resolutions_.resize(resolutions_.size() + binding.chord.size());
+  bindings_.push_back(std::move(binding));
+  dirty_ = true;
+}
+
+void ActionMap::ClearBindings() {
+  bindings_.clear();
+  resolutions_.clear();
+  dirty_ = true;
+}
+
+bool ActionMap::Update(DirectInputContext const& context) {
+  DirectInputContext::DetectionStats const& stats = context.GetDetectionStats();
+  if (!dirty_ && stats.added_count == seen_added_count_ && stats.removed_count == seen_removed_count_) {
+    return false;
+  }
+  seen_added_count_ = stats.added_count;
+  seen_removed_count_ = stats.removed_count;
+
+  this->Rebuild(context.GetDevices());
+  return true;
+}
+
+void ActionMap::Rebuild(std::span<DirectInputContext::Device const> devices) {
+  // Resolve: keep what still resolves, match the rest.
+  size_t resolution_index = 0;
+  for (Binding const& binding : bindings_) {
+    for (InputRef const& input : binding.chord) {
+      Resolution& resolution = resolutions_[resolution_index++];
+
+      if (resolution.handle != DirectInputContext::DeviceHandle {}) {
+        bool const still_connected = std::any_of(
+          devices.begin(), devices.end(),
+          [&](DirectInputContext::Device const& device) {
+            return device.handle == resolution.handle;
+          }
+        );
+        if (still_connected) {
+          continue;
+        }
+        resolution = Resolution {};
+      }
+
+      auto it = std::find_if(
+        devices.begin(), devices.end(),
+        [&](DirectInputContext::Device const& device) {
+          return Matches(input.device, device);
+        }
+      );
+      if (it == devices.end()) {
+        continue;
+      }
+      if (DirectInputContext::Input const* found = FindInput(input, *it)) {
+        resolution = Resolution { .handle = it->handle, .offset = found->offset };
+      }
+    }
+  }
+
+  // Emit one instruction per input of every binding that fully resolved.
+  instructions_.clear();
+  program_.clear();
+  referenced_devices_.clear();
+
+  resolution_index = 0;
+  for (Binding const& binding : bindings_) {
+    std::span<Resolution const> const resolutions(resolutions_.data() + resolution_index, binding.chord.size());
+    resolution_index += binding.chord.size();
+
+    bool const resolved = !resolutions.empty() && std::all_of(
+      resolutions.begin(), resolutions.end(),
+      [](Resolution const& resolution) {
+        return resolution.handle != DirectInputContext::DeviceHandle {};
+      }
+    );
+    if (!resolved) {
+      continue;
+    }
+
+    program_.push_back(CompiledBinding {
+      .first_instruction = static_cast<uint32_t>(instructions_.size()),
+      .instruction_count = static_cast<uint32_t>(resolutions.size()),
+      .action = binding.action,
+      .scale = binding.scale,
+    });
+
+    for (size_t i = 0; i < resolutions.size(); ++i) {
+      auto it = std::find(referenced_devices_.begin(), referenced_devices_.end(), resolutions[i].handle);
+      if (it == referenced_devices_.end()) {
+        it = referenced_devices_.insert(it, resolutions[i].handle);
+      }
+
+      Opcode opcode = Opcode::kButton;
+      switch (binding.chord[i].type) {
+      case InputType::kPOV: opcode = Opcode::kPov; break;
+      case InputType::kAxis: opcode = Opcode::kAxis; break;
+      case InputType::kButton: opcode = Opcode::kButton; break;
+      }
+
+      instructions_.push_back(Instruction {
+        .state_index = static_cast<uint32_t>(it - referenced_devices_.begin()),
+        .offset = resolutions[i].offset,
+        .opcode = opcode,
+        .threshold = binding.chord[i].threshold,
+      });
+    }
+  }
+
+  states_.resize(referenced_devices_.size());
+  dirty_ = false;
+}
+
+void ActionMap::Evaluate(DirectInputContext const& context) {
+  for (size_t i = 0; i < referenced_devices_.size(); ++i) {
+    DirectInputContext::Device const* device = context.GetDevice(referenced_devices_[i]);
+    if (device != nullptr) {
+      states_[i] = device->LoadState();
+    }
+    else {
+      // Gone since the last `Update`: read as released, with its POVs centered.
+      states_[i] = DIJOYSTATE2 {};
+      std::memset(states_[i].rgdwPOV, 0xFF, sizeof(states_[i].rgdwPOV));
+    }
+  }
+  this->Run(states_);
+}
+
+void ActionMap::Evaluate(std::span<DIJOYSTATE2 const> states) {
+  assert(states.size() >= referenced_devices_.size());
+  this->Run(states);
+}
+
+bool ActionMap::IsDown(Instruction const& instruction, DIJOYSTATE2 const& state) {
+  BYTE const* const bytes = reinterpret_cast<BYTE const*>(&state) + instruction.offset;
+
+  switch (instruction.opcode) {
+  case Opcode::kButton:
+    return (*bytes & 0x80) != 0;
+
+  case Opcode::kAxis: {
+    LONG raw;
+    std::memcpy(&raw, bytes, sizeof(LONG));
+    float const value = static_cast<float>(raw) / static_cast<float>(DirectInputContext::kAxisMax);
+    return (instruction.threshold >= 0.0f) ? value >= instruction.threshold : value <= instruction.threshold;
+  }
+
+  case Opcode::kPov: {
+    DWORD raw;
+    std::memcpy(&raw, bytes, sizeof(DWORD));
+    // > The position is indicated in hundredths of a degree clockwise from north (away from the user). The center position is normally reported as -1.
+    if ((raw & 0xFFFF) == 0xFFFF) {
+      return false;
+    }
+    int32_t const direction = static_cast<int32_t>(instruction.threshold);
+    int32_t const difference = std::abs(static_cast<int32_t>(raw % 36000) - direction) % 36000;
+    return std::min(difference, 36000 - difference) <= 4500;
+  }
+  }
+  return false;
+}
+
+void ActionMap::Run(std::span<DIJOYSTATE2 const> states) {
+  for (size_t i = 0; i < action_states_.size(); ++i) {
+    previous_down_[i] = action_states_[i].down;
+    action_states_[i].value = 0.0f;
+    action_states_[i].down = false;
+  }
+
+  for (CompiledBinding const& binding : program_) {
+    Instruction const* const instructions = instructions_.data() + binding.first_instruction;
+    uint32_t const modifier_count = binding.instruction_count - 1;
+
+    bool held = true;
+    for (uint32_t i = 0; i < modifier_count; ++i) {
+      held = held && IsDown(instructions[i], states[instructions[i].state_index]);
+    }
+    if (!held) {
+      continue;
+    }
+
+    Instruction const& input = instructions[modifier_count];
+    DIJOYSTATE2 const& state = states[input.state_index];
+    bool const down = IsDown(input, state);
+    float value = down ? 1.0f : 0.0f;
+    if (input.opcode == Opcode::kAxis) {
+      LONG raw;
+      std::memcpy(&raw, reinterpret_cast<BYTE const*>(&state) + input.offset, sizeof(LONG));
+      value = std::clamp(static_cast<float>(raw) / static_cast<float>(DirectInputContext::kAxisMax), -1.0f, 1.0f);
+    }
+    value *= binding.scale;
+
+    ActionState& action = action_states_[binding.action];
+    action.down = action.down || down;
+    if (std::abs(value) > std::abs(action.value)) {
+      action.value = value;
+    }
+  }
+
+  for (size_t i = 0; i < action_states_.size(); ++i) {
+    ActionState& action = action_states_[i];
+    action.pressed = action.down && previous_down_[i] == 0;
+    action.released = !action.down && previous_down_[i] != 0;
+  }
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/// Maps device inputs to game actions, e.g. "fire" to button 0 of a given stick, or "throttle" to an axis of whichever throttle is connected.
+///
+/// Bindings are compiled into a flat program of instructions, each reading one input of one device's state at a fixed offset,
+/// so that `Evaluate` resolves every action in one linear pass: it costs one step per bound input, and involves no lookup at all.
+/// Only the devices some binding refers to are read, once each.
+///
+///   ActionMap actions;
+///   ActionMap::ActionId const fire = actions.AddAction("fire");
+///   actions.AddBinding(ActionMap::Binding { .action = fire, .chord = { { .device = { .product_name = "Stick" }, .type = InputType::kButton, .index = 0 } } });
+///   ...
+///   context.UpdateDetection();
+///   context.UpdateState();
+///   actions.Update(context);
+///   actions.Evaluate(context);
+///   if (actions.GetAction(fire).pressed) { ... }
+class ActionMap final {
+public:
+  using ActionId = uint32_t;
+  using InputType = DirectInputContext::InputType;
+
+  /// Which device an input belongs to: a specific device by its instance `guid` if it is set, otherwise the first connected device whose `Device::name`,
+  /// i.e. product name, is `product_name`, so that a binding applies to any unit of a given model.
+  struct DeviceSelector final {
+    GUID guid {};
+    std::string product_name {};
+  };
+
+  struct InputRef final {
+    DeviceSelector device;
+    InputType type = InputType::kButton;
+    /// Into `Device::povs`, `axes` or `buttons`, according to `type`.
+    DWORD index = 0;
+    /// When an axis is read as a button, it is down when its value in [-1, 1] is beyond `threshold` in the threshold's direction,
+    /// e.g. 0.5 for "more than half way up" and -0.5 for "more than half way down".
+    /// When a POV is read as a button, it is down when it points within 45 degrees of `threshold`, in hundredths of degrees clockwise from north.
+    float threshold = 0.5f;
+  };
+
+  struct Binding final {
+    ActionId action = 0;
+    /// Every input but the last is a modifier that must be held (read as a button); the last one is the input itself, and sets the action's value.
+    /// A binding is inactive while any of its devices is disconnected.
+    std::vector<InputRef> chord;
+    /// Multiplies the value, e.g. -1 to invert an axis, or to have a button push an axis action the other way.
+    float scale = 1.0f;
+  };
+
+  struct ActionState final {
+    /// An axis as [-1, 1] (times `Binding::scale`), a button or POV as 0 or 1. The binding with the largest magnitude wins.
+    float value = 0.0f;
+    /// Whether any binding is down: a button is held, an axis is beyond its threshold, a POV points the right way.
+    bool down = false;
+    /// `down` changed since the previous `Evaluate`.
+    bool pressed = false;
+    bool released = false;
+  };
+
+  ActionId AddAction(std::string name);
+  void AddBinding(Binding binding);
+  void ClearBindings();
+
+  /// Re-resolves the bindings if devices were added or removed since the previous call (see `DirectInputContext::GetDetectionStats`), e.g. after every `UpdateDetection`.
+  /// Returns `true` if the program was rebuilt.
+  bool Update(DirectInputContext const& context);
+  /// Resolves the bindings against `devices` and rebuilds the program.
+  /// Inputs already resolved to a device that is still there stay as they are; only the others are matched against `devices`.
+  void Rebuild(std::span<DirectInputContext::Device const> devices);
+
+  /// Reads the state of every device in `GetReferencedDevices` from `context`, and evaluates every action.
+  void Evaluate(DirectInputContext const& context);
+  /// Evaluates every action from `states`, one per `GetReferencedDevices` entry, e.g. synthetic states.
+  void Evaluate(std::span<DIJOYSTATE2 const> states);
+
+  /// The devices the program reads, in the order `Evaluate` expects their states.
+  std::span<DirectInputContext::DeviceHandle const> GetReferencedDevices() const {
+    return referenced_devices_;
+  }
+
+  ActionState const& GetAction(ActionId action) const {
+    return action_states_[action];
+  }
+
+  std::string const& GetActionName(ActionId action) const {
+    return action_names_[action];
+  }
+
+  size_t GetActionCount() const {
+    return action_names_.size();
+  }
+
+  /// Number of instructions `Evaluate` runs, i.e. of inputs in the bindings whose devices are connected.
+  size_t GetInstructionCount() const {
+    return instructions_.size();
+  }
+
+private:
+  enum class Opcode : uint8_t {
+    kButton,
+    kAxis,
+    kPov,
+  };
+
+  struct Instruction final {
+    /// Into the states `Evaluate` reads.
+    uint32_t state_index;
+    /// Byte offset into `DIJOYSTATE2`.
+    uint32_t offset;
+    Opcode opcode;
+    float threshold;
+  };
+
+  struct CompiledBinding final {
+    uint32_t first_instruction;
+    /// The last one is the input itself; the ones before it are modifiers.
+    uint32_t instruction_count;
+    ActionId action;
+    float scale;
+  };
+
+  /// `bindings_[binding].chord[input]` resolved to a device, or not.
+  struct Resolution final {
+    DirectInputContext::DeviceHandle handle {};
+    /// Byte offset into `DIJOYSTATE2`.
+    DWORD offset = 0;
+  };
+
+  /// Reads `instruction` as a button.
+  static bool IsDown(Instruction const& instruction, DIJOYSTATE2 const& state);
+  void Run(std::span<DIJOYSTATE2 const> states);
+
+  std::vector<std::string> action_names_;
+  std::vector<ActionState> action_states_;
+  /// `ActionState::down` as of the previous `Evaluate`, for the edges.
+  std::vector<uint8_t> previous_down_;
+  std::vector<Binding> bindings_;
+  /// One per input of every binding, in order.
+  std::vector<Resolution> resolutions_;
+
+  std::vector<Instruction> instructions_;
+  std::vector<CompiledBinding> program_;
+  std::vector<DirectInputContext::DeviceHandle> referenced_devices_;
+  /// Filled by `Evaluate(DirectInputContext const&)`.
+  std::vector<DIJOYSTATE2> states_;
+
+  uint64_t seen_added_count_ = 0;
+  uint64_t seen_removed_count_ = 0;
+  bool dirty_ = true;
+};
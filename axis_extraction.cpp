@@ -0,0 +1,77 @@
+#include "axis_extraction.h"
+#include "simd_config.h"
+
+#include <algorithm>
+#include <cassert>
+
+void GatherAxes(DIJOYSTATE2 const& state, std::span<uint8_t const> gather_table, LONG* out_values) {
+  // `DIJOYSTATE2` starts with `LONG`s, so viewing it as an array of them lets every axis be fetched without branching on its offset.
+  LONG const* words = reinterpret_cast<LONG const*>(&state);
+
+  for (size_t i = 0; i < gather_table.size(); ++i) {
+    out_values[i] = words[gather_table[i]];
+  }
+}
+
+void NarrowAxes(std::span<LONG const> values, std::span<int16_t> out_values) {
+  assert(out_values.size() >= values.size());
+
+  size_t const count = values.size();
+  size_t i = 0;
+
+#if CONFIG_USE_SSE2
+  for (; i + 8 <= count; i += 8) {
+    __m128i const lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(values.data() + i));
+    __m128i const hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(values.data() + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out_values.data() + i), _mm_packs_epi32(lo, hi));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    out_values[i] = static_cast<int16_t>(std::clamp<LONG>(values[i], INT16_MIN, INT16_MAX));
+  }
+}
+
+void NormalizeAxes(std::span<LONG const> values, std::span<float> out_values, LONG min, LONG max, AxisNormalization normalization) {
+  assert(out_values.size() >= values.size());
+  assert(max > min);
+
+  // `value * scale + bias`.
+  float const range = static_cast<float>(max) - static_cast<float>(min);
+  float scale = 0.0f;
+  float bias = 0.0f;
+  float lower = 0.0f;
+  switch (normalization) {
+  case AxisNormalization::kSigned:
+    scale = 2.0f / range;
+    bias = -(static_cast<float>(max) + static_cast<float>(min)) / range;
+    lower = -1.0f;
+    break;
+  case AxisNormalization::kUnsigned:
+    scale = 1.0f / range;
+    bias = -static_cast<float>(min) / range;
+    lower = 0.0f;
+    break;
+  }
+  float const upper = 1.0f;
+
+  size_t const count = values.size();
+  size_t i = 0;
+
+#if CONFIG_USE_SSE2
+  __m128 const scale4 = _mm_set1_ps(scale);
+  __m128 const bias4 = _mm_set1_ps(bias);
+  __m128 const lower4 = _mm_set1_ps(lower);
+  __m128 const upper4 = _mm_set1_ps(upper);
+  for (; i + 4 <= count; i += 4) {
+    __m128 const v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(values.data() + i)));
+    __m128 const normalized = _mm_add_ps(_mm_mul_ps(v, scale4), bias4);
+    _mm_storeu_ps(out_values.data() + i, _mm_min_ps(_mm_max_ps(normalized, lower4), upper4));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    float const normalized = static_cast<float>(values[i]) * scale + bias;
+    out_values[i] = std::min(std::max(normalized, lower), upper);
+  }
+}
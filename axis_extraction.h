@@ -0,0 +1,27 @@
+#pragma once
+
+#include "direct_input_compat.h"
+
+#include <cstdint>
+#include <span>
+
+enum class AxisNormalization : uint32_t {
+  /// `[min, max]` to `[-1, 1]`, e.g. for sticks.
+  kSigned,
+  /// `[min, max]` to `[0, 1]`, e.g. for pedals and throttles.
+  kUnsigned,
+};
+
+/// Converts a `DIJOYSTATE2` byte offset of an axis into an entry of a gather table, i.e. the index of the `LONG` it refers to.
+inline uint8_t ToAxisGatherIndex(DWORD offset) {
+  return static_cast<uint8_t>(offset / sizeof(LONG));
+}
+
+/// Copies the axes of `state` listed in `gather_table` (see `ToAxisGatherIndex`) into `out_values`, in order.
+void GatherAxes(DIJOYSTATE2 const& state, std::span<uint8_t const> gather_table, LONG* out_values);
+
+/// Saturates each value to `int16_t`.
+void NarrowAxes(std::span<LONG const> values, std::span<int16_t> out_values);
+
+/// Maps each value from `[min, max]` as specified by `normalization`, clamping values that fall outside.
+void NormalizeAxes(std::span<LONG const> values, std::span<float> out_values, LONG min, LONG max, AxisNormalization normalization);
@@ -0,0 +1,312 @@
+#include "axis_processing.h"
+#include "simd_config.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <unordered_map>
+
+namespace {
+
+/// The cutoff of an axis without a filter: high enough that the smoothing factor rounds to 1, i.e. the filter passes the value through.
+constexpr float kNoFilterCutoff = 1e30f;
+/// Keeps the filters finite if `Process` is called twice within the same clock tick.
+constexpr float kMinDeltaTime = 1e-6f;
+/// Below this, a filter's speed estimate is flushed to 0, and its value snaps to its input.
+/// Otherwise both decay into denormals while the axis rests (at 0, e.g. in a deadzone), which are many times slower to compute with.
+constexpr float kFlushThreshold = 1e-12f;
+
+/// The exponential smoothing factor of a low-pass filter with a cutoff of `cutoff_hz`, for samples `dt_seconds` apart.
+float GetSmoothingFactor(float cutoff_hz, float dt_seconds) {
+  float const tau = 1.0f / (2.0f * std::numbers::pi_v<float> * cutoff_hz);
+  return 1.0f / (1.0f + tau / dt_seconds);
+}
+
+}
+
+void AxisPipeline::Compile(std::span<AxisProcessing const> axes, std::span<uint64_t const> keys, LONG min, LONG max) {
+  assert(axes.size() == keys.size());
+  assert(max > min);
+
+  size_t const count = axes.size();
+  size_t const padded_count = (count + 3) & ~size_t(3);
+
+  // Carry the filter state of the axes that were already there over.
+  std::unordered_map<uint64_t, size_t> previous_indices;
+  previous_indices.reserve(keys_.size());
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    previous_indices.emplace(keys_[i], i);
+  }
+
+  std::vector<float> filter_value(padded_count);
+  std::vector<float> filter_derivative(padded_count);
+  std::vector<float> filter_primed(padded_count);
+  for (size_t i = 0; i < count; ++i) {
+    auto it = previous_indices.find(keys[i]);
+    if (it != previous_indices.end()) {
+      filter_value[i] = filter_value_[it->second];
+      filter_derivative[i] = filter_derivative_[it->second];
+      filter_primed[i] = filter_primed_[it->second];
+    }
+  }
+  filter_value_ = std::move(filter_value);
+  filter_derivative_ = std::move(filter_derivative);
+  filter_primed_ = std::move(filter_primed);
+
+  keys_.assign(keys.begin(), keys.end());
+
+  // The padding lanes are processed too, with parameters that keep them finite, and their results are discarded.
+  for (std::vector<float>* array : { &scale_, &bias_, &lower_, &inner_deadzone_, &inverse_span_, &linear_weight_, &cubic_weight_, &curve_base_, &gain_, &beta_ }) {
+    array->assign(padded_count, 0.0f);
+  }
+  for (std::vector<float>& array : curve_slopes_) {
+    array.assign(padded_count, 0.0f);
+  }
+  min_cutoff_.assign(padded_count, kNoFilterCutoff);
+  derivative_cutoff_.assign(padded_count, 1.0f);
+
+  float const range = static_cast<float>(max) - static_cast<float>(min);
+  for (size_t i = 0; i < count; ++i) {
+    AxisProcessing const& axis = axes[i];
+
+    // Same mapping as `NormalizeAxes`, with the inversion folded in.
+    float scale = 0.0f;
+    float bias = 0.0f;
+    switch (axis.normalization) {
+    case AxisNormalization::kSigned:
+      scale = 2.0f / range;
+      bias = -(static_cast<float>(max) + static_cast<float>(min)) / range;
+      lower_[i] = -1.0f;
+      if (axis.inverted) {
+        scale = -scale;
+        bias = -bias;
+      }
+      break;
+    case AxisNormalization::kUnsigned:
+      scale = 1.0f / range;
+      bias = -static_cast<float>(min) / range;
+      lower_[i] = 0.0f;
+      if (axis.inverted) {
+        scale = -scale;
+        bias = 1.0f - bias;
+      }
+      break;
+    }
+    scale_[i] = scale;
+    bias_[i] = bias;
+
+    inner_deadzone_[i] = axis.inner_deadzone;
+    inverse_span_[i] = 1.0f / std::max(1.0f - axis.inner_deadzone - axis.outer_deadzone, kMinDeltaTime);
+
+    linear_weight_[i] = 1.0f - axis.cubic_blend;
+    cubic_weight_[i] = axis.cubic_blend;
+
+    // The piecewise-linear curve as a sum of ramps, one per segment, each clamped to its segment's quarter of the magnitude.
+    curve_base_[i] = axis.curve_points[0];
+    for (size_t j = 0; j < curve_slopes_.size(); ++j) {
+      curve_slopes_[j][i] = (axis.curve_points[j + 1] - axis.curve_points[j]) * 4.0f;
+    }
+
+    gain_[i] = axis.gain;
+
+    switch (axis.filter) {
+    case AxisProcessing::Filter::kNone:
+      break;
+    case AxisProcessing::Filter::kExponential:
+      min_cutoff_[i] = axis.min_cutoff_hz;
+      break;
+    case AxisProcessing::Filter::kOneEuro:
+      min_cutoff_[i] = axis.min_cutoff_hz;
+      beta_[i] = axis.beta;
+      derivative_cutoff_[i] = axis.derivative_cutoff_hz;
+      break;
+    }
+  }
+}
+
+void AxisPipeline::ResetFilters() {
+  std::fill(filter_primed_.begin(), filter_primed_.end(), 0.0f);
+}
+
+void AxisPipeline::Process(std::span<LONG const> raw_values, std::span<float> out_values, float dt_seconds) {
+  size_t const count = keys_.size();
+  assert(raw_values.size() >= count);
+  assert(out_values.size() >= count);
+
+  dt_seconds = std::max(dt_seconds, kMinDeltaTime);
+  float const rate = 1.0f / dt_seconds;
+  // A smoothing factor of `cutoff / (cutoff + rate / 2π)` is `GetSmoothingFactor` with a single division.
+  float const rate_over_2pi = rate / (2.0f * std::numbers::pi_v<float>);
+
+#if CONFIG_USE_SSE2
+  __m128 const sign_mask = _mm_set1_ps(-0.0f);
+  __m128 const zero = _mm_setzero_ps();
+  __m128 const one = _mm_set1_ps(1.0f);
+  __m128 const quarter = _mm_set1_ps(0.25f);
+  __m128 const rate4 = _mm_set1_ps(rate);
+  __m128 const rate_over_2pi4 = _mm_set1_ps(rate_over_2pi);
+  __m128 const flush_threshold4 = _mm_set1_ps(kFlushThreshold);
+
+  auto ProcessBlock = [&](size_t i, __m128i raw) -> __m128 {
+    // Normalize (and invert).
+    __m128 x = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(raw), _mm_loadu_ps(&scale_[i])), _mm_loadu_ps(&bias_[i]));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_loadu_ps(&lower_[i])), one);
+
+    __m128 const sign = _mm_and_ps(x, sign_mask);
+    __m128 m = _mm_andnot_ps(sign_mask, x);
+
+    // Deadzones.
+    m = _mm_mul_ps(_mm_sub_ps(m, _mm_loadu_ps(&inner_deadzone_[i])), _mm_loadu_ps(&inverse_span_[i]));
+    m = _mm_min_ps(_mm_max_ps(m, zero), one);
+
+    // Cubic curve.
+    m = _mm_mul_ps(m, _mm_add_ps(_mm_loadu_ps(&linear_weight_[i]), _mm_mul_ps(_mm_loadu_ps(&cubic_weight_[i]), _mm_mul_ps(m, m))));
+
+    // Piecewise-linear curve.
+    __m128 y = _mm_loadu_ps(&curve_base_[i]);
+    __m128 segment_start = zero;
+    for (std::vector<float> const& slopes : curve_slopes_) {
+      __m128 const t = _mm_min_ps(_mm_max_ps(_mm_sub_ps(m, segment_start), zero), quarter);
+      y = _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(&slopes[i]), t));
+      segment_start = _mm_add_ps(segment_start, quarter);
+    }
+
+    // Gain and saturation.
+    y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(y, _mm_loadu_ps(&gain_[i])), zero), one);
+    x = _mm_or_ps(y, sign);
+
+    // Filter. An axis that is not primed yet starts from its current value.
+    __m128 const primed = _mm_loadu_ps(&filter_primed_[i]);
+    __m128 const previous = _mm_add_ps(x, _mm_mul_ps(primed, _mm_sub_ps(_mm_loadu_ps(&filter_value_[i]), x)));
+    __m128 const previous_derivative = _mm_mul_ps(primed, _mm_loadu_ps(&filter_derivative_[i]));
+
+    __m128 const dx = _mm_mul_ps(_mm_sub_ps(x, previous), rate4);
+    __m128 const derivative_cutoff = _mm_loadu_ps(&derivative_cutoff_[i]);
+    __m128 const derivative_alpha = _mm_div_ps(derivative_cutoff, _mm_add_ps(derivative_cutoff, rate_over_2pi4));
+    __m128 derivative = _mm_add_ps(previous_derivative, _mm_mul_ps(derivative_alpha, _mm_sub_ps(dx, previous_derivative)));
+    derivative = _mm_and_ps(derivative, _mm_cmpgt_ps(_mm_andnot_ps(sign_mask, derivative), flush_threshold4));
+
+    __m128 const cutoff = _mm_add_ps(_mm_loadu_ps(&min_cutoff_[i]), _mm_mul_ps(_mm_loadu_ps(&beta_[i]), _mm_andnot_ps(sign_mask, derivative)));
+    __m128 const alpha = _mm_div_ps(cutoff, _mm_add_ps(cutoff, rate_over_2pi4));
+    __m128 value = _mm_add_ps(previous, _mm_mul_ps(alpha, _mm_sub_ps(x, previous)));
+    __m128 const settling = _mm_cmpgt_ps(_mm_andnot_ps(sign_mask, _mm_sub_ps(value, x)), flush_threshold4);
+    value = _mm_or_ps(_mm_and_ps(settling, value), _mm_andnot_ps(settling, x));
+
+    _mm_storeu_ps(&filter_value_[i], value);
+    _mm_storeu_ps(&filter_derivative_[i], derivative);
+    _mm_storeu_ps(&filter_primed_[i], one);
+    return value;
+  };
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i const raw = _mm_loadu_si128(reinterpret_cast<__m128i const*>(raw_values.data() + i));
+    _mm_storeu_ps(out_values.data() + i, ProcessBlock(i, raw));
+  }
+  if (i < count) {
+    // The parameters are padded, but not the caller's arrays.
+    LONG raw[4] = {};
+    float out[4];
+    std::copy(raw_values.data() + i, raw_values.data() + count, raw);
+    _mm_storeu_ps(out, ProcessBlock(i, _mm_loadu_si128(reinterpret_cast<__m128i const*>(raw))));
+    std::copy(out, out + (count - i), out_values.data() + i);
+  }
+#else
+  for (size_t i = 0; i < count; ++i) {
+    float x = static_cast<float>(raw_values[i]) * scale_[i] + bias_[i];
+    x = std::min(std::max(x, lower_[i]), 1.0f);
+
+    float m = std::abs(x);
+    m = std::min(std::max((m - inner_deadzone_[i]) * inverse_span_[i], 0.0f), 1.0f);
+    m = m * (linear_weight_[i] + cubic_weight_[i] * m * m);
+
+    float y = curve_base_[i];
+    for (size_t j = 0; j < curve_slopes_.size(); ++j) {
+      y += curve_slopes_[j][i] * std::min(std::max(m - 0.25f * static_cast<float>(j), 0.0f), 0.25f);
+    }
+    y = std::min(std::max(y * gain_[i], 0.0f), 1.0f);
+    x = std::copysign(y, x);
+
+    float const previous = x + filter_primed_[i] * (filter_value_[i] - x);
+    float const previous_derivative = filter_primed_[i] * filter_derivative_[i];
+    float const dx = (x - previous) * rate;
+    float const derivative_alpha = derivative_cutoff_[i] / (derivative_cutoff_[i] + rate_over_2pi);
+    float derivative = previous_derivative + derivative_alpha * (dx - previous_derivative);
+    if (std::abs(derivative) <= kFlushThreshold) {
+      derivative = 0.0f;
+    }
+    float const cutoff = min_cutoff_[i] + beta_[i] * std::abs(derivative);
+    float const alpha = cutoff / (cutoff + rate_over_2pi);
+    float value = previous + alpha * (x - previous);
+    if (std::abs(value - x) <= kFlushThreshold) {
+      value = x;
+    }
+
+    filter_value_[i] = value;
+    filter_derivative_[i] = derivative;
+    filter_primed_[i] = 1.0f;
+    out_values[i] = value;
+  }
+#endif
+}
+
+float AxisPipeline::ProcessReference(AxisProcessing const& axis, LONG raw_value, LONG min, LONG max, float dt_seconds, FilterState& state) {
+  float const t = (static_cast<float>(raw_value) - static_cast<float>(min)) / (static_cast<float>(max) - static_cast<float>(min));
+
+  float x = 0.0f;
+  switch (axis.normalization) {
+  case AxisNormalization::kSigned:
+    x = std::clamp(t * 2.0f - 1.0f, -1.0f, 1.0f);
+    if (axis.inverted) {
+      x = -x;
+    }
+    break;
+  case AxisNormalization::kUnsigned:
+    x = std::clamp(t, 0.0f, 1.0f);
+    if (axis.inverted) {
+      x = 1.0f - x;
+    }
+    break;
+  }
+
+  float magnitude = std::abs(x);
+
+  float const live_span = 1.0f - axis.inner_deadzone - axis.outer_deadzone;
+  if (magnitude <= axis.inner_deadzone) {
+    magnitude = 0.0f;
+  }
+  else if (magnitude >= 1.0f - axis.outer_deadzone || live_span <= 0.0f) {
+    magnitude = 1.0f;
+  }
+  else {
+    magnitude = (magnitude - axis.inner_deadzone) / live_span;
+  }
+
+  magnitude = (1.0f - axis.cubic_blend) * magnitude + axis.cubic_blend * magnitude * magnitude * magnitude;
+
+  size_t const segment = std::min(static_cast<size_t>(magnitude * 4.0f), size_t(3));
+  float const segment_t = magnitude * 4.0f - static_cast<float>(segment);
+  magnitude = axis.curve_points[segment] + (axis.curve_points[segment + 1] - axis.curve_points[segment]) * segment_t;
+
+  magnitude = std::clamp(magnitude * axis.gain, 0.0f, 1.0f);
+  float const value = (x < 0.0f) ? -magnitude : magnitude;
+
+  if (axis.filter == AxisProcessing::Filter::kNone) {
+    return value;
+  }
+  if (!state.primed) {
+    state = FilterState { .value = value, .derivative = 0.0f, .primed = true };
+    return value;
+  }
+
+  dt_seconds = std::max(dt_seconds, kMinDeltaTime);
+  float cutoff = axis.min_cutoff_hz;
+  if (axis.filter == AxisProcessing::Filter::kOneEuro) {
+    float const dx = (value - state.value) / dt_seconds;
+    state.derivative += GetSmoothingFactor(axis.derivative_cutoff_hz, dt_seconds) * (dx - state.derivative);
+    cutoff += axis.beta * std::abs(state.derivative);
+  }
+  state.value += GetSmoothingFactor(cutoff, dt_seconds) * (value - state.value);
+  return state.value;
+}
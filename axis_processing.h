@@ -0,0 +1,101 @@
+#pragma once
+
+#include "direct_input_compat.h"
+#include "axis_extraction.h"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// How one axis is conditioned in software, in this order:
+/// normalization and inversion, inner and outer deadzone, cubic curve, piecewise-linear curve, gain (saturating at full deflection), then filtering.
+/// Everything but filtering works on the magnitude and keeps the sign, so it is symmetric around the center of a `kSigned` axis,
+/// and measured from the rest position of a `kUnsigned` one.
+/// The defaults do nothing, i.e. produce the same values as `DirectInputContext::ExtractAxes`.
+struct AxisProcessing final {
+  enum class Filter : uint32_t {
+    kNone,
+    /// Exponential moving average with a cutoff of `min_cutoff_hz`, so that it behaves the same at any update rate.
+    kExponential,
+    /// The "1€ filter" (Casiez et al., 2012): smooths slow movement heavily and fast movement lightly, for low jitter without lag.
+    kOneEuro,
+  };
+
+  AxisNormalization normalization = AxisNormalization::kSigned;
+  bool inverted = false;
+
+  /// Fraction of the magnitude around the rest position that reads as 0.
+  float inner_deadzone = 0.0f;
+  /// Fraction of the magnitude at the end of the travel that reads as full deflection.
+  float outer_deadzone = 0.0f;
+
+  /// Blends the response from linear (0) to cubic (1), for finer control around the center.
+  float cubic_blend = 0.0f;
+  /// The response at magnitudes 0, 0.25, 0.5, 0.75 and 1, interpolated linearly in between. Each in [0, 1].
+  std::array<float, 5> curve_points { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f };
+
+  /// Scales the response; the output saturates at full deflection, so a gain above 1 reaches it before the end of the travel.
+  float gain = 1.0f;
+
+  Filter filter = Filter::kNone;
+  /// The cutoff frequency of `kExponential`, and the minimum cutoff of `kOneEuro`: lower is smoother.
+  float min_cutoff_hz = 1.0f;
+  /// `kOneEuro` only: how fast the cutoff rises with the speed of the axis: higher lags less.
+  float beta = 0.0f;
+  /// `kOneEuro` only: the cutoff frequency used to smooth the speed.
+  float derivative_cutoff_hz = 1.0f;
+};
+
+/// Runs `AxisProcessing` over many axes at once.
+/// `Compile` flattens each setting into an array with one entry per axis, so that `Process` is a single branchless pass that handles 4 axes per instruction,
+/// whatever mix of settings they have.
+class AxisPipeline final {
+public:
+  struct FilterState final {
+    float value = 0.0f;
+    float derivative = 0.0f;
+    bool primed = false;
+  };
+
+  /// One `AxisProcessing` per axis, for raw values in `[min, max]`.
+  /// `keys` identify the axes: an axis whose key was also compiled before keeps its filter state, so that recompiling (e.g. on hot-plug) does not disturb it.
+  void Compile(std::span<AxisProcessing const> axes, std::span<uint64_t const> keys, LONG min, LONG max);
+
+  size_t GetAxisCount() const {
+    return keys_.size();
+  }
+
+  /// Processes one sample of every axis. `dt_seconds` is the time since the previous call, for the filters; an axis's first sample is passed through as is.
+  void Process(std::span<LONG const> raw_values, std::span<float> out_values, float dt_seconds);
+
+  /// Forgets every filter's history.
+  void ResetFilters();
+
+  /// The same processing for a single axis, written straightforwardly, against which `Process` can be verified.
+  static float ProcessReference(AxisProcessing const& axis, LONG raw_value, LONG min, LONG max, float dt_seconds, FilterState& state);
+
+private:
+  std::vector<uint64_t> keys_;
+
+  // One entry per axis, padded to a multiple of 4.
+  std::vector<float> scale_;
+  std::vector<float> bias_;
+  std::vector<float> lower_;
+  std::vector<float> inner_deadzone_;
+  std::vector<float> inverse_span_;
+  std::vector<float> linear_weight_;
+  std::vector<float> cubic_weight_;
+  std::vector<float> curve_base_;
+  std::array<std::vector<float>, 4> curve_slopes_;
+  std::vector<float> gain_;
+  std::vector<float> min_cutoff_;
+  std::vector<float> beta_;
+  std::vector<float> derivative_cutoff_;
+
+  // Filter state, likewise.
+  std::vector<float> filter_value_;
+  std::vector<float> filter_derivative_;
+  /// 0 or 1.
+  std::vector<float> filter_primed_;
+};
@@ -0,0 +1,57 @@
+//
+// Compares reading every axis of every device through the per-call `Device::GetAxisValue` accessor (normalizing each value by hand,
+// like the gauge in `main.cpp` used to), against the bulk `DirectInputContext::ExtractAxes`.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  size_t const device_count = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 64;
+
+  DirectInputContext context;
+  if (!context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(device_count)), DirectInputContext::Config {})) {
+    return 1;
+  }
+  context.UpdateState();
+
+  size_t const axis_count = context.GetAxisCount();
+  std::printf("%zu devices, %zu axes\n", context.GetDevices().size(), axis_count);
+
+  std::vector<float> floats(axis_count);
+  std::vector<int16_t> shorts(axis_count);
+
+  PrintBenchmarkResult(RunBenchmark("GetAxisValue + scalar normalization", [&]() {
+    float* out = floats.data();
+    for (DirectInputContext::Device const& device : context.GetDevices()) {
+      for (DWORD i = 0; i < device.axes.size(); ++i) {
+        LONG const value = device.GetAxisValue(i);
+        *out++ = static_cast<float>(value - DirectInputContext::kAxisMin) / static_cast<float>(DirectInputContext::kAxisMax - DirectInputContext::kAxisMin);
+      }
+    }
+    DoNotOptimize(floats.data()[0]);
+  }));
+
+  PrintBenchmarkResult(RunBenchmark("ExtractAxes (float, [0, 1])", [&]() {
+    context.ExtractAxes(floats, AxisNormalization::kUnsigned);
+    DoNotOptimize(floats.data()[0]);
+  }));
+
+  PrintBenchmarkResult(RunBenchmark("ExtractAxes (float, [-1, 1])", [&]() {
+    context.ExtractAxes(floats, AxisNormalization::kSigned);
+    DoNotOptimize(floats.data()[0]);
+  }));
+
+  PrintBenchmarkResult(RunBenchmark("ExtractAxes (int16)", [&]() {
+    context.ExtractAxes(shorts);
+    DoNotOptimize(shorts.data()[0]);
+  }));
+
+  context.Shutdown();
+  return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+//
+// Minimal timing harness shared by the benchmarks in this directory.
+//
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <utility>
+
+struct BenchmarkResult final {
+  std::string name;
+  uint64_t iterations = 0;
+  double ns_per_op = 0.0;
+  /// Heap allocations per call; see `GetAllocationCount`.
+  double allocations_per_op = 0.0;
+  /// How many items (e.g. devices) one call processes, for throughput. Set by the caller.
+  uint64_t items_per_op = 1;
+
+  double GetItemsPerSecond() const {
+    return (ns_per_op > 0.0) ? static_cast<double>(items_per_op) * 1e9 / ns_per_op : 0.0;
+  }
+};
+
+/// Number of `operator new` calls so far in the process, counted by `allocation_counter.cpp`.
+uint64_t GetAllocationCount();
+
+/// Keeps the compiler from optimizing away a computation whose result is otherwise unused.
+template<typename T>
+inline void DoNotOptimize(T const& value) {
+#if defined(_MSC_VER)
+  // Reading through a volatile pointer forces the value to be materialized.
+  static_cast<void>(*static_cast<volatile char const*>(static_cast<void const*>(&value)));
+#else
+  asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+/// Calls `body` in batches of doubling size until one batch takes at least `min_duration`, and reports the time per call of that batch.
+template<typename F>
+BenchmarkResult RunBenchmark(std::string name, F&& body, std::chrono::nanoseconds min_duration = std::chrono::milliseconds(200)) {
+  using Clock = std::chrono::steady_clock;
+
+  // Warm up caches and branch predictors.
+  body();
+
+  uint64_t iterations = 1;
+  while (true) {
+    uint64_t const start_allocations = GetAllocationCount();
+    Clock::time_point const start = Clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+      body();
+    }
+    std::chrono::nanoseconds const elapsed = Clock::now() - start;
+    uint64_t const allocations = GetAllocationCount() - start_allocations;
+
+    if (elapsed >= min_duration || iterations >= (uint64_t(1) << 40)) {
+      return BenchmarkResult {
+        .name = std::move(name),
+        .iterations = iterations,
+        .ns_per_op = static_cast<double>(elapsed.count()) / static_cast<double>(iterations),
+        .allocations_per_op = static_cast<double>(allocations) / static_cast<double>(iterations),
+      };
+    }
+    iterations *= 2;
+  }
+}
+
+inline void PrintBenchmarkResult(BenchmarkResult const& result) {
+  std::printf(
+    "%-48s %14.1f ns/op %10.2f allocs/op %14.0f items/s %12llu iterations\n",
+    result.name.c_str(), result.ns_per_op, result.allocations_per_op, result.GetItemsPerSecond(), static_cast<unsigned long long>(result.iterations)
+  );
+}
+
+/// Writes `results` as a JSON array of objects, one per result, so that runs can be compared by scripts.
+/// Names are expected not to need escaping.
+inline bool WriteBenchmarkResultsJson(char const* path, std::span<BenchmarkResult const> results) {
+  FILE* file = std::fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+
+  std::fprintf(file, "[\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    BenchmarkResult const& result = results[i];
+    std::fprintf(
+      file,
+      "  {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"allocations_per_op\": %.3f, \"items_per_op\": %llu, \"items_per_second\": %.1f}%s\n",
+      result.name.c_str(), static_cast<unsigned long long>(result.iterations), result.ns_per_op, result.allocations_per_op,
+      static_cast<unsigned long long>(result.items_per_op), result.GetItemsPerSecond(), (i + 1 < results.size()) ? "," : ""
+    );
+  }
+  std::fprintf(file, "]\n");
+
+  return std::fclose(file) == 0;
+}
@@ -0,0 +1,371 @@
+//
+// Soak test: a farm of synthetic devices behind a `DirectInputContext`, updated at a fixed rate for as long as asked, while devices arrive and
+// depart at random, their axes jitter and flaky ones drop out with `DIERR_INPUTLOST` (see `SyntheticBackend::DeviceSpec`).
+// Every interval and at the end, reports the update latency (`UpdateDetection` and `UpdateState` of a frame) at p50, p99 and p99.9,
+// resident memory, and heap allocations, and fails if they exceed the thresholds. Ctrl+C ends the run early, with the final report.
+//
+// Usage: device_farm_soak [--devices <count>] [--rate <Hz>] [--duration <s>] [--report-interval <s>] [--workers <count>] [--seed <n>]
+//                         [--arrivals <per s>] [--departures <per s>] [--noise <axis units>] [--flaky <percent of devices>] [--input-lost <per million polls>]
+//                         [--max-p99 <us>] [--max-p999 <us>] [--max-rss-growth <KiB>] [--max-steady-allocs <count>] [--json <path>]
+// Defaults to 128 devices updated at 1000 Hz for 10 s, reporting every 2 s; 2 arrivals and 2 departures per second, noise of 64, and 10% of
+// devices flaky, losing input once per 10000 polls. The first interval is a warm-up: memory growth and the allocations of frames that did not
+// (re)open devices ("steady" allocations) are counted from its end. Thresholds default to a p99 of 1000 us (the frame budget at 1 kHz),
+// a p99.9 of 2000 us, 8192 KiB of growth and no steady allocation. Resident memory is only known on Linux. Exits with 1 if a threshold is exceeded.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "latency_histogram.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+std::atomic<bool> g_interrupted { false };
+
+void OnInterrupt(int) {
+  g_interrupted.store(true, std::memory_order_relaxed);
+}
+
+/// Resident set size in KiB, or 0 where unknown.
+uint64_t GetResidentKiB() {
+#if defined(__linux__)
+  FILE* file = std::fopen("/proc/self/statm", "r");
+  if (file == nullptr) {
+    return 0;
+  }
+  unsigned long long size_pages = 0;
+  unsigned long long resident_pages = 0;
+  int const read = std::fscanf(file, "%llu %llu", &size_pages, &resident_pages);
+  std::fclose(file);
+  return (read == 2) ? resident_pages * static_cast<uint64_t>(::sysconf(_SC_PAGESIZE)) / 1024 : 0;
+#else
+  return 0;
+#endif
+}
+
+uint32_t NextRandom(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/// Turns a rate per second into whole events per frame, carrying the fraction over.
+struct EventRate final {
+  double per_frame = 0.0;
+  double debt = 0.0;
+
+  size_t Take() {
+    debt += per_frame;
+    size_t const count = static_cast<size_t>(debt);
+    debt -= static_cast<double>(count);
+    return count;
+  }
+};
+
+/// Flips a random device whose connection is not `connected` yet. Returns `false` if there is none.
+bool ToggleRandomDevice(SyntheticBackend& backend, size_t device_count, bool connected, uint32_t& random) {
+  size_t const start = NextRandom(random) % device_count;
+  for (size_t i = 0; i < device_count; ++i) {
+    size_t const index = (start + i) % device_count;
+    if (backend.IsConnected(index) != connected) {
+      backend.SetConnected(index, connected);
+      return true;
+    }
+  }
+  return false;
+}
+
+void PrintLatency(char const* label, LatencySummary const& latency) {
+  std::printf(
+    "%s p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us",
+    label, latency.p50_ns / 1e3, latency.p99_ns / 1e3, latency.p999_ns / 1e3, latency.max_ns / 1e3
+  );
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t device_count = 128;
+  uint32_t rate_hz = 1000;
+  double duration_s = 10.0;
+  double report_interval_s = 2.0;
+  size_t worker_count = 0;
+  uint32_t seed = 1;
+  double arrivals_per_s = 2.0;
+  double departures_per_s = 2.0;
+  LONG noise = 64;
+  uint32_t flaky_percent = 10;
+  uint32_t input_lost_per_million = 100;
+  double max_p99_us = 1000.0;
+  double max_p999_us = 2000.0;
+  uint64_t max_rss_growth_kib = 8192;
+  uint64_t max_steady_allocations = 0;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    auto Next = [&]() { return (i + 1 < argc) ? argv[++i] : "0"; };
+    if (std::strcmp(argv[i], "--devices") == 0) {
+      device_count = std::max<size_t>(std::strtoul(Next(), nullptr, 10), 1);
+    } else if (std::strcmp(argv[i], "--rate") == 0) {
+      rate_hz = std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(Next(), nullptr, 10)), 1);
+    } else if (std::strcmp(argv[i], "--duration") == 0) {
+      duration_s = std::strtod(Next(), nullptr);
+    } else if (std::strcmp(argv[i], "--report-interval") == 0) {
+      report_interval_s = std::max(std::strtod(Next(), nullptr), 0.1);
+    } else if (std::strcmp(argv[i], "--workers") == 0) {
+      worker_count = std::strtoul(Next(), nullptr, 10);
+    } else if (std::strcmp(argv[i], "--seed") == 0) {
+      seed = std::max<uint32_t>(static_cast<uint32_t>(std::strtoul(Next(), nullptr, 10)), 1);
+    } else if (std::strcmp(argv[i], "--arrivals") == 0) {
+      arrivals_per_s = std::strtod(Next(), nullptr);
+    } else if (std::strcmp(argv[i], "--departures") == 0) {
+      departures_per_s = std::strtod(Next(), nullptr);
+    } else if (std::strcmp(argv[i], "--noise") == 0) {
+      noise = static_cast<LONG>(std::strtol(Next(), nullptr, 10));
+    } else if (std::strcmp(argv[i], "--flaky") == 0) {
+      flaky_percent = std::min<uint32_t>(static_cast<uint32_t>(std::strtoul(Next(), nullptr, 10)), 100);
+    } else if (std::strcmp(argv[i], "--input-lost") == 0) {
+      input_lost_per_million = static_cast<uint32_t>(std::strtoul(Next(), nullptr, 10));
+    } else if (std::strcmp(argv[i], "--max-p99") == 0) {
+      max_p99_us = std::strtod(Next(), nullptr);
+    } else if (std::strcmp(argv[i], "--max-p999") == 0) {
+      max_p999_us = std::strtod(Next(), nullptr);
+    } else if (std::strcmp(argv[i], "--max-rss-growth") == 0) {
+      max_rss_growth_kib = std::strtoull(Next(), nullptr, 10);
+    } else if (std::strcmp(argv[i], "--max-steady-allocs") == 0) {
+      max_steady_allocations = std::strtoull(Next(), nullptr, 10);
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      json_path = Next();
+    } else {
+      std::fprintf(stderr, "Unknown argument \"%s\"\n", argv[i]);
+      return 1;
+    }
+  }
+
+  // The farm: every device may come and go, and every `100 / flaky_percent`th one also loses input now and then.
+  std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(device_count, seed);
+  size_t flaky_count = 0;
+  for (size_t i = 0; i < specs.size(); ++i) {
+    specs[i].axis_noise = noise;
+    if ((i * flaky_percent) % 100 + flaky_percent >= 100) {
+      specs[i].input_lost_per_million = input_lost_per_million;
+      ++flaky_count;
+    }
+  }
+
+  auto backend_owner = std::make_unique<SyntheticBackend>(specs);
+  SyntheticBackend& backend = *backend_owner;
+  DirectInputContext::Config config {};
+  config.polling_worker_count = static_cast<DWORD>(worker_count);
+  DirectInputContext context;
+  if (!context.Initialize(std::move(backend_owner), config)) {
+    std::fprintf(stderr, "Failed to initialize %zu synthetic devices\n", device_count);
+    return 1;
+  }
+
+  std::printf(
+    "--- %zu devices (%zu flaky, %u per million polls), %u Hz, %zu polling workers, %.1f arrivals/s, %.1f departures/s, noise %ld, %.0f s ---\n",
+    device_count, flaky_count, input_lost_per_million, rate_hz, worker_count, arrivals_per_s, departures_per_s, static_cast<long>(noise), duration_s
+  );
+
+  std::signal(SIGINT, OnInterrupt);
+  std::signal(SIGTERM, OnInterrupt);
+
+  using Clock = std::chrono::steady_clock;
+  auto const interval = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / rate_hz;
+  auto const report_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(report_interval_s));
+  Clock::time_point const start = Clock::now();
+  Clock::time_point const end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration_s));
+
+  // Neither rolls over: the interval's is replaced after each report.
+  auto interval_latency = std::make_unique<LatencyHistogram>(std::chrono::nanoseconds::max());
+  auto run_latency = std::make_unique<LatencyHistogram>(std::chrono::nanoseconds::max());
+
+  EventRate arrivals { .per_frame = arrivals_per_s / rate_hz };
+  EventRate departures { .per_frame = departures_per_s / rate_hz };
+  uint32_t random = seed;
+
+  uint64_t frame_count = 0;
+  uint64_t overrun_count = 0;
+  uint64_t arrival_count = 0;
+  uint64_t departure_count = 0;
+  uint64_t steady_allocations = 0;
+  uint64_t baseline_rss_kib = 0;
+  uint64_t peak_rss_kib = 0;
+  uint64_t const start_allocations = GetAllocationCount();
+  bool warmed_up = false;
+
+  uint64_t report_frame_count = 0;
+  uint64_t report_arrival_count = 0;
+  uint64_t report_departure_count = 0;
+  uint64_t report_allocations = start_allocations;
+  DirectInputContext::PollingStats report_polling {};
+
+  auto Report = [&](Clock::time_point now) {
+    LatencySummary const latency = interval_latency->Summarize();
+    DirectInputContext::PollingStats const polling = context.GetPollingStats();
+    uint64_t const rss_kib = GetResidentKiB();
+    uint64_t const allocations = GetAllocationCount();
+    peak_rss_kib = std::max(peak_rss_kib, rss_kib);
+
+    std::printf(
+      "[%7.1f s] %3zu devices %6llu frames ",
+      std::chrono::duration<double>(now - start).count(), context.GetDevices().size(), static_cast<unsigned long long>(frame_count - report_frame_count)
+    );
+    PrintLatency("", latency);
+    std::printf(
+      "  +%llu -%llu devices  %llu input lost  %llu failed polls  rss %llu KiB  %llu allocs (%llu steady)\n",
+      static_cast<unsigned long long>(arrival_count - report_arrival_count), static_cast<unsigned long long>(departure_count - report_departure_count),
+      static_cast<unsigned long long>(polling.input_lost_count - report_polling.input_lost_count),
+      static_cast<unsigned long long>(polling.failed_poll_count - report_polling.failed_poll_count),
+      static_cast<unsigned long long>(rss_kib), static_cast<unsigned long long>(allocations - report_allocations),
+      static_cast<unsigned long long>(steady_allocations)
+    );
+    std::fflush(stdout);
+
+    if (!warmed_up) {
+      warmed_up = true;
+      baseline_rss_kib = rss_kib;
+    }
+    report_frame_count = frame_count;
+    report_arrival_count = arrival_count;
+    report_departure_count = departure_count;
+    report_allocations = allocations;
+    report_polling = polling;
+    interval_latency = std::make_unique<LatencyHistogram>(std::chrono::nanoseconds::max());
+  };
+
+  Clock::time_point next_frame = start;
+  Clock::time_point next_report = start + report_interval;
+  while (!g_interrupted.load(std::memory_order_relaxed)) {
+    Clock::time_point const now = Clock::now();
+    if (now >= end) {
+      break;
+    }
+    if (now >= next_report) {
+      Report(now);
+      next_report += report_interval;
+    }
+
+    // Plug and unplug, as `WM_DEVICECHANGE` would tell.
+    bool plugged = false;
+    for (size_t i = arrivals.Take(); i > 0 && ToggleRandomDevice(backend, device_count, true, random); --i) {
+      ++arrival_count;
+      plugged = true;
+    }
+    for (size_t i = departures.Take(); i > 0 && ToggleRandomDevice(backend, device_count, false, random); --i) {
+      ++departure_count;
+      plugged = true;
+    }
+    if (plugged) {
+      context.NotifyDeviceChange();
+    }
+
+    uint64_t const frame_allocations = GetAllocationCount();
+    uint64_t const frame_start = GetMonotonicTimeNs();
+    bool const detected = context.UpdateDetection();
+    context.UpdateState();
+    uint64_t const frame_end = GetMonotonicTimeNs();
+    interval_latency->Record(frame_end - frame_start, frame_end);
+    run_latency->Record(frame_end - frame_start, frame_end);
+    if (warmed_up && !detected) {
+      steady_allocations += GetAllocationCount() - frame_allocations;
+    }
+    ++frame_count;
+
+    next_frame += interval;
+    Clock::time_point const after = Clock::now();
+    if (after > next_frame) {
+      // Don't try to catch up on missed frames; that would only update in a burst.
+      ++overrun_count;
+      next_frame = after;
+      continue;
+    }
+    std::this_thread::sleep_until(next_frame);
+  }
+  Report(Clock::now());
+
+  // Once detection catches up, the context has exactly the devices plugged in.
+  context.NotifyDeviceChange();
+  context.UpdateDetection();
+  size_t connected_count = 0;
+  for (size_t i = 0; i < device_count; ++i) {
+    connected_count += backend.IsConnected(i) ? 1 : 0;
+  }
+
+  LatencySummary const latency = run_latency->Summarize();
+  DirectInputContext::DetectionStats const detection = context.GetDetectionStats();
+  DirectInputContext::PollingStats const polling = context.GetPollingStats();
+  uint64_t const rss_growth_kib = (peak_rss_kib > baseline_rss_kib) ? peak_rss_kib - baseline_rss_kib : 0;
+
+  std::printf("--- %llu frames (%llu overruns) ---\n", static_cast<unsigned long long>(frame_count), static_cast<unsigned long long>(overrun_count));
+  PrintLatency("update", latency);
+  std::printf("\n");
+  std::printf(
+    "devices: %llu arrived, %llu departed; %llu added, %llu removed, %llu failed to open; %zu connected, %zu in the context\n",
+    static_cast<unsigned long long>(arrival_count), static_cast<unsigned long long>(departure_count),
+    static_cast<unsigned long long>(detection.added_count), static_cast<unsigned long long>(detection.removed_count),
+    static_cast<unsigned long long>(detection.open_failure_count), connected_count, context.GetDevices().size()
+  );
+  std::printf(
+    "polls: %llu DIERR_INPUTLOST, %llu DIERR_NOTACQUIRED, %llu failed\n",
+    static_cast<unsigned long long>(polling.input_lost_count), static_cast<unsigned long long>(polling.not_acquired_count),
+    static_cast<unsigned long long>(polling.failed_poll_count)
+  );
+  std::printf(
+    "memory: %llu KiB after warm-up, %llu KiB at peak (+%llu KiB); %llu allocations, %llu of them steady\n",
+    static_cast<unsigned long long>(baseline_rss_kib), static_cast<unsigned long long>(peak_rss_kib), static_cast<unsigned long long>(rss_growth_kib),
+    static_cast<unsigned long long>(GetAllocationCount() - start_allocations), static_cast<unsigned long long>(steady_allocations)
+  );
+
+  bool ok = true;
+  auto Check = [&ok](bool passed, char const* what) {
+    std::printf("%s: %s\n", passed ? "PASS" : "FAIL", what);
+    ok = ok && passed;
+  };
+  Check(latency.p99_ns <= max_p99_us * 1e3, "update p99 within --max-p99");
+  Check(latency.p999_ns <= max_p999_us * 1e3, "update p99.9 within --max-p999");
+  Check(rss_growth_kib <= max_rss_growth_kib, "memory growth within --max-rss-growth");
+  Check(steady_allocations <= max_steady_allocations, "steady allocations within --max-steady-allocs");
+  Check(context.GetDevices().size() == connected_count, "the context has every connected device and no other");
+
+  std::pair<char const*, uint64_t> const percentiles[] = {
+    { "Update p50", latency.p50_ns }, { "Update p99", latency.p99_ns }, { "Update p99.9", latency.p999_ns }, { "Update max", latency.max_ns },
+  };
+  std::vector<BenchmarkResult> results;
+  for (auto const& [name, value] : percentiles) {
+    results.push_back(BenchmarkResult {
+      .name = std::string(name) + "/" + std::to_string(device_count),
+      .iterations = frame_count,
+      .ns_per_op = static_cast<double>(value),
+      .allocations_per_op = static_cast<double>(steady_allocations) / static_cast<double>(std::max<uint64_t>(frame_count, 1)),
+      .items_per_op = device_count,
+    });
+  }
+
+  context.Shutdown();
+
+  if (!ok) {
+    return 1;
+  }
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+//
+// Measures the per-frame paths of `DirectInputContext` against synthetic device populations, without hardware.
+//
+// Usage: direct_input_benchmark [device count...] [--json <path>]
+// Defaults to populations of 1, 16, 64 and 256 devices. With `--json`, the results are also written to `path`.
+//
+
+#include "benchmark.h"
+
+#include "action_map.h"
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+void RunPopulation(size_t device_count, bool buffered_input, std::vector<BenchmarkResult>& results) {
+  DirectInputContext context;
+  DirectInputContext::Config config {};
+  config.buffered_input = buffered_input;
+  if (!context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(device_count)), config)) {
+    std::fprintf(stderr, "Failed to initialize %zu synthetic devices\n", device_count);
+    return;
+  }
+  context.UpdateState();
+
+  std::string const suffix = std::string(buffered_input ? "/buffered/" : "/") + std::to_string(device_count);
+  uint64_t const devices = context.GetDevices().size();
+
+  auto Run = [&](char const* name, uint64_t items_per_op, auto&& body) {
+    BenchmarkResult result = RunBenchmark(name + suffix, body);
+    result.items_per_op = items_per_op;
+    PrintBenchmarkResult(result);
+    results.push_back(std::move(result));
+  };
+
+  Run("UpdateState", devices, [&]() {
+    context.UpdateState();
+  });
+
+  if (buffered_input) {
+    // The rest does not depend on how state is read.
+    context.Shutdown();
+    return;
+  }
+
+  Run("UpdateDetection (idle)", 1, [&]() {
+    DoNotOptimize(context.UpdateDetection());
+  });
+
+  Run("UpdateDetection (enumerate, no changes)", devices, [&]() {
+    context.NotifyDeviceChange();
+    DoNotOptimize(context.UpdateDetection());
+  });
+
+  Run("GetDeviceGuids", devices, [&]() {
+    std::vector<GUID> guids = context.GetDeviceGuids();
+    DoNotOptimize(guids.data());
+  });
+
+  std::vector<GUID> const guids = context.GetDeviceGuids();
+  Run("GetDevice (GUID)", devices, [&]() {
+    for (GUID const& guid : guids) {
+      DoNotOptimize(context.GetDevice(guid));
+    }
+  });
+
+  std::vector<DirectInputContext::DeviceHandle> handles;
+  for (DirectInputContext::Device const& device : context.GetDevices()) {
+    handles.push_back(device.handle);
+  }
+  Run("GetDevice (handle)", devices, [&]() {
+    for (DirectInputContext::DeviceHandle handle : handles) {
+      DoNotOptimize(context.GetDevice(handle));
+    }
+  });
+
+  Run("GetAxisValue (all axes)", context.GetAxisCount(), [&]() {
+    for (DirectInputContext::Device const& device : context.GetDevices()) {
+      for (DWORD i = 0; i < device.axes.size(); ++i) {
+        DoNotOptimize(device.GetAxisValue(i));
+      }
+    }
+  });
+
+  Run("GetGuidString", devices, [&]() {
+    for (DirectInputContext::Device const& device : context.GetDevices()) {
+      std::string guid = device.GetGuidString();
+      DoNotOptimize(guid.data());
+    }
+  });
+
+  // One action per button and axis of every device, with a modifier on every other button binding.
+  ActionMap actions;
+  for (DirectInputContext::Device const& device : context.GetDevices()) {
+    for (DWORD i = 0; i < device.axes.size(); ++i) {
+      ActionMap::InputRef const input { .device = { .guid = device.guid }, .type = DirectInputContext::InputType::kAxis, .index = i };
+      actions.AddBinding(ActionMap::Binding { .action = actions.AddAction("axis"), .chord = { input } });
+    }
+    for (DWORD i = 0; i < device.buttons.size(); ++i) {
+      ActionMap::InputRef const input { .device = { .guid = device.guid }, .type = DirectInputContext::InputType::kButton, .index = i };
+      ActionMap::InputRef const modifier { .device = { .guid = device.guid }, .type = DirectInputContext::InputType::kButton, .index = 0 };
+      ActionMap::Binding binding { .action = actions.AddAction("button"), .chord = { input } };
+      if (i % 2 == 1) {
+        binding.chord.insert(binding.chord.begin(), modifier);
+      }
+      actions.AddBinding(std::move(binding));
+    }
+  }
+  actions.Update(context);
+  Run("ActionMap::Evaluate (per instruction)", actions.GetInstructionCount(), [&]() {
+    actions.Evaluate(context);
+    DoNotOptimize(actions.GetAction(0));
+  });
+
+  // What an application typically does every frame.
+  std::vector<float> axes(context.GetAxisCount());
+  Run("Frame (detection, state, ExtractAxes)", devices, [&]() {
+    context.UpdateDetection();
+    context.UpdateState();
+    context.ExtractAxes(axes, AxisNormalization::kSigned);
+    DoNotOptimize(axes.data()[0]);
+  });
+
+  context.Shutdown();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> device_counts;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      device_counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+  }
+  if (device_counts.empty()) {
+    device_counts = { 1, 16, 64, 256 };
+  }
+
+  std::vector<BenchmarkResult> results;
+  for (size_t device_count : device_counts) {
+    std::printf("--- %zu devices ---\n", device_count);
+    RunPopulation(device_count, false, results);
+    RunPopulation(device_count, true, results);
+  }
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+//
+// Measures the frame hitch of plugging devices in: a 1 kHz loop of `UpdateDetection` and `UpdateState` runs while devices whose opening blocks
+// for a while are connected, with devices opened on the calling thread, then with `Config::async_device_open`.
+// Reports the worst frame, how long until every device was available, and how long each stage of opening took.
+//
+// Usage: hotplug_benchmark [device count] [--open-latency <ms>] [--json <path>]
+// Defaults to 4 devices whose opening blocks for 30 ms.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  size_t device_count = 4;
+  std::chrono::milliseconds open_latency { 30 };
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--open-latency") == 0 && i + 1 < argc) {
+      open_latency = std::chrono::milliseconds(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      device_count = std::strtoul(argv[i], nullptr, 10);
+    }
+  }
+
+  std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(device_count);
+  for (SyntheticBackend::DeviceSpec& spec : specs) {
+    spec.open_latency = open_latency;
+  }
+  std::printf("--- %zu devices, %lld ms to open each ---\n", device_count, static_cast<long long>(open_latency.count()));
+
+  std::vector<BenchmarkResult> results;
+  for (bool const async : { false, true }) {
+    auto backend = std::make_unique<SyntheticBackend>(specs);
+    SyntheticBackend& synthetic = *backend;
+    synthetic.SetConnectedCount(0);
+
+    DirectInputContext context;
+    DirectInputContext::Config config {};
+    config.async_device_open = async;
+    if (!context.Initialize(std::move(backend), config)) {
+      std::fprintf(stderr, "Failed to initialize the synthetic backend\n");
+      return 1;
+    }
+
+    // Plug everything in at once, and run frames until all of it is there.
+    synthetic.SetConnectedCount(device_count);
+    context.NotifyDeviceChange();
+
+    using Clock = std::chrono::steady_clock;
+    auto const interval = std::chrono::milliseconds(1);
+    Clock::time_point const start = Clock::now();
+    Clock::time_point next_frame = start;
+    std::chrono::nanoseconds worst_frame { 0 };
+    uint64_t frame_count = 0;
+    uint64_t pending_frame_count = 0;
+    while (context.GetDevices().size() < device_count && Clock::now() - start < std::chrono::seconds(10)) {
+      Clock::time_point const frame_start = Clock::now();
+      context.UpdateDetection();
+      context.UpdateState();
+      worst_frame = std::max<std::chrono::nanoseconds>(worst_frame, Clock::now() - frame_start);
+      ++frame_count;
+      if (!context.GetPendingDevices().empty()) {
+        ++pending_frame_count;
+      }
+
+      next_frame += interval;
+      std::this_thread::sleep_until(next_frame);
+    }
+    std::chrono::nanoseconds const total = Clock::now() - start;
+
+    char const* const mode = async ? "async" : "sync";
+    std::printf(
+      "%-6s worst frame %8.2f ms, all %zu devices available after %8.2f ms (%llu frames, %llu with devices pending)\n",
+      mode, worst_frame.count() / 1e6, context.GetDevices().size(), total.count() / 1e6,
+      static_cast<unsigned long long>(frame_count), static_cast<unsigned long long>(pending_frame_count)
+    );
+
+    // Every device was opened the same way: show the stages of the slowest.
+    auto slowest = std::max_element(
+      context.GetDevices().begin(), context.GetDevices().end(),
+      [](DirectInputContext::Device const& lhs, DirectInputContext::Device const& rhs) {
+        return lhs.open_timings.end_ns - lhs.open_timings.requested_ns < rhs.open_timings.end_ns - rhs.open_timings.requested_ns;
+      }
+    );
+    if (slowest != context.GetDevices().end()) {
+      DirectInputContext::OpenTimings const& timings = slowest->open_timings;
+      std::printf("       slowest device: queued %.2f ms, opened in %.2f ms:", (timings.start_ns - timings.requested_ns) / 1e6, (timings.end_ns - timings.start_ns) / 1e6);
+      for (size_t i = 0; i < timings.stage_ns.size(); ++i) {
+        if (timings.stage_ns[i] != 0) {
+          std::printf(" %s %.2f ms", DirectInputContext::GetOpenStageName(static_cast<DirectInputContext::OpenStage>(i)), timings.stage_ns[i] / 1e6);
+        }
+      }
+      std::printf("\n");
+    }
+
+    BenchmarkResult result {
+      .name = std::string("Hot-plug worst frame (") + mode + ")/" + std::to_string(device_count),
+      .iterations = frame_count,
+      .ns_per_op = static_cast<double>(worst_frame.count()),
+    };
+    results.push_back(std::move(result));
+
+    context.Shutdown();
+  }
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
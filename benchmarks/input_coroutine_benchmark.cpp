@@ -0,0 +1,167 @@
+//
+// Measures a frame with thousands of suspended `InputScheduler` coroutines, while their inputs are idle and while one of them changes every frame,
+// against the same number of state machines polled every frame. The coroutines themselves are tested by `tests/input_coroutines_test.cpp`.
+//
+// Usage: input_coroutine_benchmark [coroutine count...] [--json <path>]
+// Defaults to 1000 and 10000 coroutines over 16 devices.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "input_coroutines.h"
+#include "synthetic_backend.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using DeviceHandle = DirectInputContext::DeviceHandle;
+
+/// Counts how many coroutine frames are alive.
+struct FrameCounter final {
+  int& count;
+  explicit FrameCounter(int& count) : count(count) { ++count; }
+  ~FrameCounter() { --count; }
+};
+
+InputTask PressForever(InputScheduler& scheduler, DeviceHandle device, DWORD button, int& frame_count, uint64_t& press_count) {
+  FrameCounter const counter(frame_count);
+  while (co_await scheduler.NextPress(device, button)) {
+    ++press_count;
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> coroutine_counts;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      coroutine_counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+  }
+  if (coroutine_counts.empty()) {
+    coroutine_counts = { 1000, 10000 };
+  }
+
+  constexpr size_t kDeviceCount = 16;
+  std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(kDeviceCount);
+  for (SyntheticBackend::DeviceSpec& spec : specs) {
+    spec.event_driven = true;
+  }
+
+  std::vector<BenchmarkResult> results;
+  for (size_t coroutine_count : coroutine_counts) {
+    std::printf("--- %zu coroutines, %zu devices ---\n", coroutine_count, kDeviceCount);
+
+    auto backend = std::make_unique<SyntheticBackend>(specs);
+    SyntheticBackend& synthetic = *backend;
+    DirectInputContext context;
+    if (!context.Initialize(std::move(backend), DirectInputContext::Config {})) {
+      std::fprintf(stderr, "Failed to initialize the synthetic backend\n");
+      return 1;
+    }
+
+    // Each coroutine, or state machine, waits for presses of a random button of a random device.
+    struct Machine final {
+      DeviceHandle device;
+      DWORD button;
+      bool down = false;
+    };
+    std::vector<Machine> machines;
+    std::mt19937 random(1);
+    std::span<DirectInputContext::Device const> const devices = context.GetDevices();
+    while (machines.size() < coroutine_count) {
+      size_t const index = random() % devices.size();
+      if (!devices[index].buttons.empty()) {
+        machines.push_back(Machine { .device = devices[index].handle, .button = static_cast<DWORD>(random() % devices[index].buttons.size()) });
+      }
+    }
+
+    // Button 0 of the first device that has buttons toggles every frame.
+    size_t toggled_index = 0;
+    while (specs[toggled_index].button_count == 0) {
+      ++toggled_index;
+    }
+    DeviceHandle const toggled_handle = context.FindDevice(SyntheticBackend::MakeDeviceGuid(toggled_index));
+    DIJOYSTATE2 toggled_state {};
+    std::memset(toggled_state.rgdwPOV, 0xFF, sizeof(toggled_state.rgdwPOV));
+    auto Toggle = [&]() {
+      toggled_state.rgbButtons[0] ^= 0x80;
+      synthetic.SetDeviceState(toggled_index, toggled_state);
+    };
+
+    uint64_t polled_presses = 0;
+    auto PollMachines = [&]() {
+      for (Machine& machine : machines) {
+        DirectInputContext::Device const* device = context.GetDevice(machine.device);
+        bool const down = device->GetButtonValue(machine.button) != 0;
+        polled_presses += (down && !machine.down) ? 1 : 0;
+        machine.down = down;
+      }
+    };
+
+    auto Record = [&](BenchmarkResult result) {
+      result.items_per_op = coroutine_count;
+      PrintBenchmarkResult(result);
+      results.push_back(std::move(result));
+    };
+    std::string const count = std::to_string(coroutine_count);
+
+    Record(RunBenchmark("Polled state machines (idle)/" + count, [&]() {
+      context.UpdateState();
+      PollMachines();
+    }));
+    Record(RunBenchmark("Polled state machines (one button toggling)/" + count, [&]() {
+      Toggle();
+      context.UpdateState();
+      PollMachines();
+    }));
+
+    {
+      int frame_count = 0;
+      uint64_t press_count = 0;
+      InputScheduler scheduler(context);
+      for (Machine const& machine : machines) {
+        scheduler.Start(PressForever(scheduler, machine.device, machine.button, frame_count, press_count));
+      }
+
+      Record(RunBenchmark("Suspended coroutines (idle)/" + count, [&]() {
+        context.UpdateState();
+        scheduler.Update();
+      }));
+      Record(RunBenchmark("Suspended coroutines (one button toggling)/" + count, [&]() {
+        Toggle();
+        context.UpdateState();
+        scheduler.Update();
+      }));
+
+      size_t waiting_on_toggled = 0;
+      for (Machine const& machine : machines) {
+        waiting_on_toggled += (machine.device == toggled_handle && machine.button == 0) ? 1 : 0;
+      }
+      std::printf(
+        "%zu coroutines wait on the toggled button; %llu presses resumed in all, %zu waits suspended\n",
+        waiting_on_toggled, static_cast<unsigned long long>(press_count), scheduler.GetWaitCount()
+      );
+    }
+    DoNotOptimize(polled_presses);
+
+    context.Shutdown();
+  }
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+//
+// Measures `InputHistory` (`Config::input_history_capacity`): recording, time lookups and windowed button queries over a full history.
+// Its behaviour is tested by `tests/input_history_test.cpp`.
+//
+// Usage: input_history_benchmark [capacity] [--json <path>]
+// Defaults to a capacity of 1024 samples.
+//
+
+#include "benchmark.h"
+
+#include "input_history.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kMs = 1'000'000;
+
+/// Two axes (X and Y), one POV and 16 buttons.
+PackedStateLayout MakeLayout() {
+  DWORD const axis_offsets[] = { DIJOFS_X, DIJOFS_Y };
+  return PackedStateLayout(axis_offsets, 1, 16);
+}
+
+bool ButtonDown(PackedStateLayout const& layout, PackedState const& state, DWORD index) {
+  return PackedStateLayout::DecodeButton(state.bytes[layout.GetButtonOffset(index)], index) != 0;
+}
+
+void SetButton(PackedStateLayout const& layout, PackedState& state, DWORD index, bool down) {
+  uint8_t& bits = state.bytes[layout.GetButtonOffset(index)];
+  bits = down ? (bits | (1 << (index % 8))) : (bits & ~(1 << (index % 8)));
+}
+
+void SetAxis(PackedStateLayout const& layout, PackedState& state, DWORD index, int16_t value) {
+  std::memcpy(state.bytes + layout.GetAxisOffset(index), &value, sizeof(value));
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t capacity = 1024;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      capacity = std::strtoul(argv[i], nullptr, 10);
+    }
+  }
+
+  // A full history: one change every 2 ms, for 2 s.
+  PackedStateLayout const layout = MakeLayout();
+  InputHistory history(layout, capacity, 2000 * kMs);
+  PackedState state {};
+  uint64_t now = 0;
+  for (size_t i = 0; i < capacity; ++i) {
+    now += 2 * kMs;
+    SetButton(layout, state, 3, i % 4 == 0);
+    SetAxis(layout, state, 0, static_cast<int16_t>(i * 37));
+    history.Record(now, now - kMs, state);
+  }
+  std::printf("%zu samples of %zu bytes, covering %.0f ms\n", history.GetSize(), sizeof(InputHistory::Sample), (now - history.GetStartTime()) / 1e6);
+
+  std::vector<BenchmarkResult> results;
+  auto Run = [&](std::string const& name, auto&& body) {
+    BenchmarkResult result = RunBenchmark(name + "/" + std::to_string(capacity), body);
+    PrintBenchmarkResult(result);
+    results.push_back(std::move(result));
+  };
+
+  uint64_t t = history.GetStartTime();
+  auto NextTime = [&]() {
+    t = (t + 7 * kMs + 13 >= now) ? history.GetStartTime() : t + 7 * kMs + 13;
+    return t;
+  };
+  Run("InputHistory::Find", [&]() {
+    DoNotOptimize(history.Find(NextTime()));
+  });
+  Run("InputHistory::GetAxisValueAt", [&]() {
+    LONG value = 0;
+    DoNotOptimize(history.GetAxisValueAt(0, NextTime(), value));
+    DoNotOptimize(value);
+  });
+  Run("InputHistory::WasPressed (150 ms)", [&]() {
+    DoNotOptimize(history.WasPressed(3, now - 150 * kMs, now));
+  });
+  Run("InputHistory::Record", [&]() {
+    now += kMs;
+    SetButton(layout, state, 3, !ButtonDown(layout, state, 3));
+    DoNotOptimize(history.Record(now, now - kMs, state));
+  });
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
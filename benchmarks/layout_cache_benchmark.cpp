@@ -0,0 +1,138 @@
+//
+// Measures `Initialize` with synthetic devices whose input discovery blocks for a while, without `Config::layout_cache_path`, with a cold cache
+// (a first run, which discovers every layout and saves the cache) and with a warm one, and then a `DeviceLayoutCache::Find`.
+// The cache itself is tested by `tests/device_layout_cache_test.cpp`.
+//
+// Usage: layout_cache_benchmark [device count] [--discovery-latency <us>] [--cache <path>] [--json <path>]
+// Defaults to 16 devices whose discovery blocks for 2000 us, and a cache file in the temporary directory.
+//
+
+#include "benchmark.h"
+
+#include "device_layout_cache.h"
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// Opens every device of `specs`, and returns how long `Initialize` took. `out_context` is left initialized.
+std::chrono::nanoseconds Open(DirectInputContext& out_context, std::vector<SyntheticBackend::DeviceSpec> const& specs, std::string const& cache_path) {
+  DirectInputContext::Config config {};
+  config.layout_cache_path = cache_path;
+
+  auto const start = std::chrono::steady_clock::now();
+  if (!out_context.Initialize(std::make_unique<SyntheticBackend>(specs), config)) {
+    std::fprintf(stderr, "Failed to initialize the synthetic backend\n");
+    std::exit(1);
+  }
+  return std::chrono::steady_clock::now() - start;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t device_count = 16;
+  std::chrono::microseconds discovery_latency { 2000 };
+  std::string cache_path = (std::filesystem::temp_directory_path() / "layout_cache_benchmark.dilc").string();
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--discovery-latency") == 0 && i + 1 < argc) {
+      discovery_latency = std::chrono::microseconds(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      cache_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      device_count = std::strtoul(argv[i], nullptr, 10);
+    }
+  }
+
+  std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(device_count);
+  for (SyntheticBackend::DeviceSpec& spec : specs) {
+    spec.discovery_latency = discovery_latency;
+  }
+  std::filesystem::remove(cache_path);
+
+  // Without a cache, as a baseline.
+  DirectInputContext reference;
+  std::chrono::nanoseconds const uncached_time = Open(reference, specs, "");
+
+  // Devices of the same model share a layout.
+  std::vector<GUID> models;
+  for (SyntheticBackend::DeviceSpec const& spec : specs) {
+    GUID const product_guid = SyntheticBackend::MakeProductGuid(spec);
+    if (std::find(models.begin(), models.end(), product_guid) == models.end()) {
+      models.push_back(product_guid);
+    }
+  }
+
+  // Cold: the first device of each model is discovered, the others already use its layout, and all of them are saved on `Shutdown`.
+  std::chrono::nanoseconds cold_time {};
+  {
+    DirectInputContext context;
+    cold_time = Open(context, specs, cache_path);
+    context.Shutdown();
+  }
+  std::error_code ec;
+  uintmax_t const cache_size = std::filesystem::file_size(cache_path, ec);
+  if (ec) {
+    std::fprintf(stderr, "No cache file was written to %s\n", cache_path.c_str());
+    return 1;
+  }
+
+  // Warm: every layout comes from the cache.
+  std::chrono::nanoseconds warm_time {};
+  DeviceLayoutCache::Stats warm_stats {};
+  {
+    DirectInputContext context;
+    warm_time = Open(context, specs, cache_path);
+    warm_stats = context.GetLayoutCache()->GetStats();
+    context.Shutdown();
+  }
+
+  std::printf("%zu devices of %zu models, %lld us to discover each layout; the cache file is %ju bytes\n", device_count, models.size(), static_cast<long long>(discovery_latency.count()), cache_size);
+  std::printf("Initialize without a cache %8.2f ms\n", uncached_time.count() / 1e6);
+  std::printf("Initialize, cold cache     %8.2f ms\n", cold_time.count() / 1e6);
+  std::printf(
+    "Initialize, warm cache     %8.2f ms (%llu hits, %llu misses, %llu stale)\n", warm_time.count() / 1e6,
+    static_cast<unsigned long long>(warm_stats.hit_count), static_cast<unsigned long long>(warm_stats.miss_count), static_cast<unsigned long long>(warm_stats.stale_count)
+  );
+
+  std::vector<BenchmarkResult> results;
+  DeviceLayoutCache cache;
+  if (!cache.Load(cache_path)) {
+    std::fprintf(stderr, "Failed to load %s\n", cache_path.c_str());
+    return 1;
+  }
+  SyntheticBackend::DeviceSpec const& spec = specs.front();
+  GUID const product_guid = SyntheticBackend::MakeProductGuid(spec);
+  DIDEVCAPS caps {};
+  caps.dwSize = sizeof(DIDEVCAPS);
+  caps.dwAxes = spec.axis_count;
+  caps.dwButtons = spec.button_count;
+  caps.dwPOVs = spec.pov_count;
+  DirectInputContext::Device device;
+  BenchmarkResult result = RunBenchmark("DeviceLayoutCache::Find (mapped)", [&]() {
+    bool const found = cache.Find(product_guid, caps, device);
+    DoNotOptimize(found);
+  });
+  PrintBenchmarkResult(result);
+  results.push_back(std::move(result));
+
+  reference.Shutdown();
+  std::filesystem::remove(cache_path);
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
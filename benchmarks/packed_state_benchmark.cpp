@@ -0,0 +1,110 @@
+//
+// Compares publishing and snapshotting device state as full `DIJOYSTATE2`s against `PackedState`s (see `Device::packed_layout`).
+// That every input survives packing and unpacking is tested by `tests/packed_state_test.cpp`.
+//
+// Usage: packed_state_benchmark [device count] [--json <path>]
+// Defaults to 16 devices.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "packed_state.h"
+#include "seqlock.h"
+#include "synthetic_backend.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  size_t device_count = 16;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      device_count = std::strtoul(argv[i], nullptr, 10);
+    }
+  }
+
+  DirectInputContext context;
+  if (!context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(device_count)), DirectInputContext::Config {})) {
+    std::fprintf(stderr, "Failed to initialize %zu synthetic devices\n", device_count);
+    return 1;
+  }
+
+  size_t const devices = context.GetDevices().size();
+  size_t packed_size = 0;
+  for (DirectInputContext::Device const& device : context.GetDevices()) {
+    packed_size += device.packed_layout.GetSize();
+  }
+
+  context.UpdateState();
+
+  std::printf(
+    "%zu devices: %zu bytes per sample, %.1f bytes per packed state on average (%zu bytes per PackedSample)\n",
+    devices, sizeof(DirectInputContext::Sample), double(packed_size) / double(devices), sizeof(DirectInputContext::PackedSample)
+  );
+
+  std::vector<BenchmarkResult> results;
+  auto Run = [&](std::string const& name, auto&& body) {
+    BenchmarkResult result = RunBenchmark(name + "/" + std::to_string(devices), body);
+    result.items_per_op = devices;
+    PrintBenchmarkResult(result);
+    results.push_back(std::move(result));
+  };
+
+  // What the polling thread does per device at the end of every poll, and what a reader does per device.
+  std::vector<std::unique_ptr<SeqLock<DirectInputContext::Sample>>> full(devices);
+  std::vector<std::unique_ptr<SeqLock<DirectInputContext::PackedSample>>> packed(devices);
+  for (size_t i = 0; i < devices; ++i) {
+    full[i] = std::make_unique<SeqLock<DirectInputContext::Sample>>();
+    packed[i] = std::make_unique<SeqLock<DirectInputContext::PackedSample>>();
+  }
+  std::span<DirectInputContext::Device const> const device_span = context.GetDevices();
+
+  Run("Publish DIJOYSTATE2", [&]() {
+    for (size_t i = 0; i < devices; ++i) {
+      full[i]->Store(DirectInputContext::Sample { .state = device_span[i].state, .times = device_span[i].times });
+    }
+  });
+  Run("Publish PackedState (Pack + Store)", [&]() {
+    for (size_t i = 0; i < devices; ++i) {
+      DirectInputContext::PackedSample sample { .times = device_span[i].times };
+      device_span[i].packed_layout.Pack(device_span[i].state, sample.state);
+      packed[i]->Store(sample);
+    }
+  });
+  Run("Snapshot DIJOYSTATE2", [&]() {
+    for (size_t i = 0; i < devices; ++i) {
+      DirectInputContext::Sample const sample = full[i]->Load();
+      DoNotOptimize(sample.state.lX);
+    }
+  });
+  Run("Snapshot PackedState", [&]() {
+    for (size_t i = 0; i < devices; ++i) {
+      DirectInputContext::PackedSample const sample = packed[i]->Load();
+      DoNotOptimize(sample.state.bytes[0]);
+    }
+  });
+  Run("Snapshot PackedState + Unpack", [&]() {
+    for (size_t i = 0; i < devices; ++i) {
+      DIJOYSTATE2 state;
+      device_span[i].packed_layout.Unpack(packed[i]->Load().state, state);
+      DoNotOptimize(state.lX);
+    }
+  });
+
+  context.Shutdown();
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
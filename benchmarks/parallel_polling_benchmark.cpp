@@ -0,0 +1,73 @@
+//
+// Measures how `UpdateState` scales with `Config::polling_worker_count` when every `Poll` blocks for a while, as on rigs with many USB devices.
+//
+// Usage: parallel_polling_benchmark [device count...] [--latency <us>] [--json <path>]
+// Defaults to 4, 10 and 20 devices whose every `Poll` blocks for 200 us, each polled serially and with 1, 3, 7 and 15 workers (plus the calling thread).
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> device_counts;
+  std::chrono::microseconds latency { 200 };
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+      latency = std::chrono::microseconds(std::strtoul(argv[++i], nullptr, 10));
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      device_counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+  }
+  if (device_counts.empty()) {
+    device_counts = { 4, 10, 20 };
+  }
+
+  std::vector<BenchmarkResult> results;
+  for (size_t device_count : device_counts) {
+    std::printf("--- %zu devices, %lld us per poll ---\n", device_count, static_cast<long long>(latency.count()));
+
+    std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(device_count);
+    for (SyntheticBackend::DeviceSpec& spec : specs) {
+      spec.poll_latency = latency;
+    }
+
+    for (DWORD worker_count : { 0u, 1u, 3u, 7u, 15u }) {
+      DirectInputContext context;
+      DirectInputContext::Config config {};
+      config.polling_worker_count = worker_count;
+      if (!context.Initialize(std::make_unique<SyntheticBackend>(specs), config)) {
+        std::fprintf(stderr, "Failed to initialize %zu synthetic devices\n", device_count);
+        return 1;
+      }
+
+      std::string const name = (worker_count == 0)
+        ? "UpdateState (serial)/" + std::to_string(device_count)
+        : "UpdateState (" + std::to_string(worker_count) + " workers)/" + std::to_string(device_count);
+      BenchmarkResult result = RunBenchmark(name, [&]() {
+        context.UpdateState();
+      });
+      result.items_per_op = device_count;
+      PrintBenchmarkResult(result);
+      results.push_back(std::move(result));
+
+      context.Shutdown();
+    }
+  }
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,257 @@
+//
+// Measures `DirectInputContext::Subscribe` with hundreds of subscriptions, drained by consumer threads while the main thread polls:
+// the cost of a poll with the changes found once and fanned out, against every subsystem re-scanning every device after each poll as before.
+// Synthetic devices change on every poll, so nearly every subscription gets a batch each time. What the subscriptions receive is tested by
+// `tests/subscription_test.cpp`.
+//
+// Usage: subscription_benchmark [subscription count...] [--devices <count>] [--polls <count>] [--threads <count>] [--json <path>]
+// Defaults to 64, 256 and 512 subscriptions on 16 devices, 2000 polls and 4 consumer threads.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using InputType = DirectInputContext::InputType;
+
+/// What a subsystem knows of the inputs it follows, keyed by `MakeKey`.
+struct Mirror final {
+  DirectInputContext::Subscription* subscription = nullptr;
+  std::unordered_map<uint64_t, LONG> values;
+  uint64_t change_count = 0;
+};
+
+uint64_t MakeKey(DirectInputContext::DeviceHandle device, InputType type, DWORD index) {
+  return (uint64_t(device.index) << 32) | (uint64_t(type) << 16) | index;
+}
+
+/// A mix of what subsystems ask for: everything from one device, every button, two axes of one device with a threshold, and the first POVs and buttons.
+DirectInputContext::SubscriptionFilter MakeFilter(size_t i, std::span<DirectInputContext::Device const> devices) {
+  DirectInputContext::Device const& device = devices[(i / 4) % devices.size()];
+  DirectInputContext::SubscriptionFilter filter {};
+  switch (i % 4) {
+  case 0:
+    filter.device = device.handle;
+    break;
+  case 1:
+    filter.input_types = 1u << static_cast<uint32_t>(InputType::kButton);
+    break;
+  case 2:
+    filter.guid = device.guid;
+    filter.input_types = 1u << static_cast<uint32_t>(InputType::kAxis);
+    filter.indices = ButtonBits { { 0b11, 0 } };
+    filter.axis_threshold = 1024;
+    break;
+  default:
+    filter.input_types = (1u << static_cast<uint32_t>(InputType::kPOV)) | (1u << static_cast<uint32_t>(InputType::kButton));
+    filter.indices = ButtonBits { { 0xFF, 0 } };
+    break;
+  }
+  return filter;
+}
+
+bool Matches(DirectInputContext::SubscriptionFilter const& filter, DirectInputContext::Device const& device) {
+  if (filter.device != DirectInputContext::DeviceHandle {}) {
+    return filter.device == device.handle;
+  }
+  return filter.guid == GUID {} || filter.guid == device.guid;
+}
+
+/// Calls `f(type, index, value)` for every input of `device` that `filter` selects.
+template<typename F>
+void ForEachSelectedInput(DirectInputContext::SubscriptionFilter const& filter, DirectInputContext::Device const& device, F&& f) {
+  if (!Matches(filter, device)) {
+    return;
+  }
+  auto Selected = [&](InputType type, DWORD index) {
+    return (filter.input_types & (1u << static_cast<uint32_t>(type))) != 0 && filter.indices.Test(index);
+  };
+  for (DWORD i = 0; i < device.povs.size(); ++i) {
+    if (Selected(InputType::kPOV, i)) {
+      f(InputType::kPOV, i, static_cast<LONG>(device.GetPovValue(i)));
+    }
+  }
+  for (DWORD i = 0; i < device.axes.size(); ++i) {
+    if (Selected(InputType::kAxis, i)) {
+      f(InputType::kAxis, i, device.GetAxisValue(i));
+    }
+  }
+  for (DWORD i = 0; i < device.buttons.size(); ++i) {
+    if (Selected(InputType::kButton, i)) {
+      f(InputType::kButton, i, static_cast<LONG>(device.GetButtonValue(i)));
+    }
+  }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<size_t> subscription_counts;
+  size_t device_count = 16;
+  size_t poll_count = 2000;
+  size_t thread_count = 4;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--devices") == 0 && i + 1 < argc) {
+      device_count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--polls") == 0 && i + 1 < argc) {
+      poll_count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      thread_count = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      subscription_counts.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+  }
+  if (subscription_counts.empty()) {
+    subscription_counts = { 64, 256, 512 };
+  }
+
+  std::vector<SyntheticBackend::DeviceSpec> const specs = SyntheticBackend::MakePopulation(device_count);
+
+  std::vector<BenchmarkResult> results;
+  auto Report = [&](std::string name, uint64_t start_ns, size_t subscription_count) {
+    BenchmarkResult result {
+      .name = std::move(name) + "/" + std::to_string(subscription_count),
+      .iterations = poll_count,
+      .ns_per_op = static_cast<double>(GetMonotonicTimeNs() - start_ns) / static_cast<double>(poll_count),
+      .items_per_op = device_count,
+    };
+    PrintBenchmarkResult(result);
+    results.push_back(std::move(result));
+  };
+
+  for (size_t subscription_count : subscription_counts) {
+    std::printf("--- %zu subscriptions, %zu devices, %zu consumer threads ---\n", subscription_count, device_count, thread_count);
+
+    DirectInputContext context;
+    if (!context.Initialize(std::make_unique<SyntheticBackend>(specs), DirectInputContext::Config {})) {
+      std::fprintf(stderr, "Failed to initialize %zu synthetic devices\n", device_count);
+      return 1;
+    }
+    std::span<DirectInputContext::Device const> const devices = context.GetDevices();
+
+    // The baseline: polling alone.
+    uint64_t start = GetMonotonicTimeNs();
+    for (size_t i = 0; i < poll_count; ++i) {
+      context.UpdateState();
+    }
+    Report("UpdateState", start, subscription_count);
+
+    // As before: after every poll, each subsystem compares every input of every device against its own copy.
+    {
+      std::vector<std::vector<LONG>> copies(subscription_count);
+      uint64_t change_count = 0;
+      start = GetMonotonicTimeNs();
+      for (size_t i = 0; i < poll_count; ++i) {
+        context.UpdateState();
+        for (size_t s = 0; s < subscription_count; ++s) {
+          DirectInputContext::SubscriptionFilter const filter = MakeFilter(s, devices);
+          std::vector<LONG>& copy = copies[s];
+          size_t next = 0;
+          for (DirectInputContext::Device const& device : devices) {
+            ForEachSelectedInput(filter, device, [&](InputType, DWORD, LONG value) {
+              if (next == copy.size()) {
+                copy.push_back(value);
+              }
+              else if (copy[next] != value) {
+                copy[next] = value;
+                ++change_count;
+              }
+              ++next;
+            });
+          }
+        }
+      }
+      Report("UpdateState + re-scan per subsystem", start, subscription_count);
+      DoNotOptimize(change_count);
+    }
+
+    // Subscribed: changes are found once, and each consumer thread drains its share of the subscriptions.
+    std::vector<Mirror> mirrors(subscription_count);
+    for (size_t s = 0; s < subscription_count; ++s) {
+      DirectInputContext::SubscriptionFilter const filter = MakeFilter(s, devices);
+      mirrors[s].subscription = context.Subscribe(filter, 1 << 14);
+      for (DirectInputContext::Device const& device : devices) {
+        ForEachSelectedInput(filter, device, [&](InputType type, DWORD index, LONG value) {
+          mirrors[s].values[MakeKey(device.handle, type, index)] = value;
+        });
+      }
+    }
+
+    std::atomic<bool> stop { false };
+    std::vector<std::thread> consumers;
+    for (size_t t = 0; t < thread_count; ++t) {
+      consumers.emplace_back([&, t]() {
+        DirectInputContext::InputChange changes[256];
+        while (true) {
+          bool const stopping = stop.load(std::memory_order_acquire);
+          size_t drained = 0;
+          for (size_t s = t; s < mirrors.size(); s += thread_count) {
+            Mirror& mirror = mirrors[s];
+            for (size_t count; (count = mirror.subscription->Drain(changes)) > 0; drained += count) {
+              for (size_t i = 0; i < count; ++i) {
+                mirror.values[MakeKey(changes[i].device, changes[i].type, changes[i].index)] = changes[i].value;
+              }
+              mirror.change_count += count;
+            }
+          }
+          if (stopping) {
+            // Everything pushed before `stop` was set has been drained.
+            break;
+          }
+          if (drained == 0) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+
+    start = GetMonotonicTimeNs();
+    for (size_t i = 0; i < poll_count; ++i) {
+      context.UpdateState();
+    }
+    Report("UpdateState + subscriptions", start, subscription_count);
+
+    stop.store(true, std::memory_order_release);
+    for (std::thread& consumer : consumers) {
+      consumer.join();
+    }
+
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    for (Mirror const& mirror : mirrors) {
+      delivered += mirror.change_count;
+      dropped += mirror.subscription->GetDroppedCount();
+    }
+    std::printf(
+      "%llu changes delivered (%.0f per poll), %llu dropped\n",
+      static_cast<unsigned long long>(delivered), static_cast<double>(delivered) / static_cast<double>(poll_count),
+      static_cast<unsigned long long>(dropped)
+    );
+
+    for (Mirror const& mirror : mirrors) {
+      context.Unsubscribe(mirror.subscription);
+    }
+    context.Shutdown();
+  }
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+//
+// Measures what a trace zone costs on a hot path (`TraceZone`, which `TRACE_ZONE` expands to with `CONFIG_USE_TRACING`), a counter, and a poll of
+// synthetic devices as this build instruments it. Then how long a trace dump takes while writer threads record more zones than their buffers hold.
+// What the dump holds is tested by `tests/trace_test.cpp`.
+//
+// Usage: trace_benchmark [writer thread count] [--devices <count>] [--trace <path>] [--json <path>]
+// Defaults to 4 writer threads, 16 devices and a trace file in the temporary directory.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr char const* kWriterNames[] = { "Writer 0", "Writer 1", "Writer 2", "Writer 3", "Writer 4", "Writer 5", "Writer 6", "Writer 7" };
+constexpr uint64_t kMinZonesPerWriter = kTraceBufferCapacity + kTraceBufferCapacity / 2;
+constexpr size_t kConcurrentDumpCount = 4;
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t writer_count = 4;
+  size_t device_count = 16;
+  std::string trace_path = (std::filesystem::temp_directory_path() / "trace_benchmark.json").string();
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--devices") == 0 && i + 1 < argc) {
+      device_count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      writer_count = std::clamp<size_t>(std::strtoul(argv[i], nullptr, 10), 1, std::size(kWriterNames));
+    }
+  }
+
+  std::printf("CONFIG_USE_TRACING=%d, %" PRIu64 " events per thread\n", CONFIG_USE_TRACING, kTraceBufferCapacity);
+
+  std::vector<BenchmarkResult> results;
+  auto Run = [&](std::string name, auto&& body, uint64_t items_per_op = 1) {
+    BenchmarkResult result = RunBenchmark(std::move(name), body);
+    result.items_per_op = items_per_op;
+    PrintBenchmarkResult(result);
+    results.push_back(std::move(result));
+  };
+
+  // What a zone costs over the two clock reads it needs anyway.
+  Run("GetMonotonicTimeNs x2", []() {
+    DoNotOptimize(GetMonotonicTimeNs());
+    DoNotOptimize(GetMonotonicTimeNs());
+  });
+  Run("TraceZone", []() {
+    TraceZone const zone("BenchmarkZone");
+  });
+  int64_t counter = 0;
+  Run("RecordTraceCounter", [&counter]() {
+    RecordTraceCounter("BenchmarkCounter", ++counter);
+  });
+
+  {
+    DirectInputContext context;
+    if (!context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(device_count)), DirectInputContext::Config {})) {
+      std::fprintf(stderr, "Failed to initialize %zu synthetic devices\n", device_count);
+      return 1;
+    }
+    Run(CONFIG_USE_TRACING ? "UpdateState (traced)" : "UpdateState (not traced)", [&context]() {
+      context.UpdateState();
+    }, device_count);
+    context.Shutdown();
+  }
+
+  // Writers wrap around their buffers while the trace is dumped over and over.
+  std::atomic<bool> stop { false };
+  std::vector<std::thread> writers;
+  for (size_t t = 0; t < writer_count; ++t) {
+    writers.emplace_back([&stop, t]() {
+      SetTraceThreadName(kWriterNames[t]);
+      for (uint64_t index = 0; index < kMinZonesPerWriter || !stop.load(std::memory_order_relaxed); ++index) {
+        RecordTraceZone("WriterZone", index * 1000, index * 1000 + index % 1000);
+      }
+    });
+  }
+
+  uint64_t dump_ns = 0;
+  for (size_t i = 0; i < kConcurrentDumpCount; ++i) {
+    uint64_t const start = GetMonotonicTimeNs();
+    if (!WriteChromeTrace(trace_path.c_str())) {
+      std::fprintf(stderr, "Failed to write %s\n", trace_path.c_str());
+      return 1;
+    }
+    dump_ns += GetMonotonicTimeNs() - start;
+  }
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  std::printf("%zu dumps while writing, %.1f ms each\n", kConcurrentDumpCount, static_cast<double>(dump_ns) / static_cast<double>(kConcurrentDumpCount) / 1e6);
+
+  std::filesystem::remove(trace_path);
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+//
+// Measures `WaitForInput` against event-driven synthetic devices (`SyntheticBackend::DeviceSpec::event_driven`, signaled through an `eventfd` on Linux):
+// how long after a device's state is set the waiting thread returns with it, and how much CPU waiting costs while nothing happens,
+// compared with calling `UpdateState` in a loop. What the wait returns is tested by `tests/wait_for_input_test.cpp`.
+//
+// Usage: wait_for_input_benchmark [device count] [--changes <count>] [--json <path>]
+// Defaults to 8 devices and 2000 changes.
+//
+
+#include "benchmark.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// CPU time of the whole process, in seconds.
+double GetCpuSeconds() {
+  return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  size_t device_count = 8;
+  size_t change_count = 2000;
+  char const* json_path = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--changes") == 0 && i + 1 < argc) {
+      change_count = std::strtoul(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      device_count = std::strtoul(argv[i], nullptr, 10);
+    }
+  }
+
+  std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(device_count);
+  for (SyntheticBackend::DeviceSpec& spec : specs) {
+    spec.event_driven = true;
+  }
+  auto backend = std::make_unique<SyntheticBackend>(specs);
+  SyntheticBackend& synthetic = *backend;
+
+  DirectInputContext context;
+  if (!context.Initialize(std::move(backend), DirectInputContext::Config {})) {
+    std::fprintf(stderr, "Failed to initialize the synthetic backend\n");
+    return 1;
+  }
+  context.UpdateState();
+
+  // Nothing happens: the wait lasts its whole timeout.
+  auto const idle_timeout = std::chrono::milliseconds(500);
+  double const idle_cpu_start = GetCpuSeconds();
+  uint64_t const idle_start = GetMonotonicTimeNs();
+  context.WaitForInput(idle_timeout);
+  double const idle_wall = (GetMonotonicTimeNs() - idle_start) / 1e9;
+  double const idle_cpu = GetCpuSeconds() - idle_cpu_start;
+
+  // The same, polling in a loop.
+  double const spin_cpu_start = GetCpuSeconds();
+  uint64_t const spin_start = GetMonotonicTimeNs();
+  while (GetMonotonicTimeNs() - spin_start < static_cast<uint64_t>(std::chrono::nanoseconds(idle_timeout).count())) {
+    context.UpdateState();
+  }
+  double const spin_wall = (GetMonotonicTimeNs() - spin_start) / 1e9;
+  double const spin_cpu = GetCpuSeconds() - spin_cpu_start;
+
+  // Another thread changes one device at a time, at random intervals, and waits for the waiting thread to see it before the next one.
+  std::atomic<uint64_t> set_time_ns { 0 };
+  std::atomic<size_t> seen_count { 0 };
+  std::vector<uint64_t> latencies;
+  latencies.reserve(change_count);
+
+  std::thread changer([&]() {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> delay_us(50, 500);
+    DIJOYSTATE2 state {};
+    std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+    for (size_t i = 0; i < change_count; ++i) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us(random)));
+      size_t const index = random() % device_count;
+      state.lX = static_cast<LONG>(i % 30000) + 1;
+      state.rgbButtons[0] = (i % 2 == 0) ? 0x80 : 0;
+
+      set_time_ns.store(GetMonotonicTimeNs(), std::memory_order_release);
+      synthetic.SetDeviceState(index, state);
+      while (seen_count.load(std::memory_order_acquire) <= i) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  double const active_cpu_start = GetCpuSeconds();
+  uint64_t const active_start = GetMonotonicTimeNs();
+  for (size_t i = 0; i < change_count; ) {
+    std::span<DirectInputContext::DeviceHandle const> const changed = context.WaitForInput(std::chrono::seconds(1));
+    if (changed.empty()) {
+      continue;
+    }
+    uint64_t const now = GetMonotonicTimeNs();
+    latencies.push_back(now - set_time_ns.load(std::memory_order_acquire));
+    seen_count.store(++i, std::memory_order_release);
+  }
+  changer.join();
+  double const active_wall = (GetMonotonicTimeNs() - active_start) / 1e9;
+  double const active_cpu = GetCpuSeconds() - active_cpu_start;
+
+  std::sort(latencies.begin(), latencies.end());
+  auto Percentile = [&](double p) {
+    return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))] / 1e3;
+  };
+  std::printf("--- %zu event-driven devices ---\n", device_count);
+  std::printf("Idle for %.2f s: WaitForInput used %5.1f%% of a core, an UpdateState loop %5.1f%%\n", idle_wall, 100.0 * idle_cpu / idle_wall, 100.0 * spin_cpu / spin_wall);
+  std::printf(
+    "%zu changes over %.2f s (%5.1f%% of a core): woke after p50 %.1f us, p99 %.1f us, max %.1f us\n",
+    change_count, active_wall, 100.0 * active_cpu / active_wall, Percentile(0.5), Percentile(0.99), latencies.back() / 1e3
+  );
+
+  std::vector<BenchmarkResult> results;
+  results.push_back(BenchmarkResult {
+    .name = "WaitForInput wake-up p50/" + std::to_string(device_count),
+    .iterations = latencies.size(),
+    .ns_per_op = static_cast<double>(latencies[latencies.size() / 2]),
+  });
+  results.push_back(BenchmarkResult {
+    .name = "WaitForInput wake-up p99/" + std::to_string(device_count),
+    .iterations = latencies.size(),
+    .ns_per_op = Percentile(0.99) * 1e3,
+  });
+
+  context.Shutdown();
+
+  if (json_path != nullptr && !WriteBenchmarkResultsJson(json_path, results)) {
+    std::fprintf(stderr, "Failed to write %s\n", json_path);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+#include "button_bits.h"
+#include "simd_config.h"
+
+ButtonBits PackButtons(BYTE const* buttons) {
+  ButtonBits bits;
+
+#if CONFIG_USE_SSE2
+  // `_mm_movemask_epi8` gathers the high bit of each of 16 bytes, which is exactly DirectInput's "pressed" bit.
+  for (DWORD w = 0; w < 2; ++w) {
+    uint64_t word = 0;
+    for (DWORD chunk = 0; chunk < 4; ++chunk) {
+      __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(buttons + w * 64 + chunk * 16));
+      word |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(v))) << (chunk * 16);
+    }
+    bits.words[w] = word;
+  }
+#else
+  for (DWORD i = 0; i < ButtonBits::kButtonCount; ++i) {
+    bits.words[i / 64] |= static_cast<uint64_t>(buttons[i] >> 7) << (i % 64);
+  }
+#endif
+
+  return bits;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "direct_input_compat.h"
+
+#include <bit>
+#include <cstdint>
+
+/// One bit per entry of `DIJOYSTATE2::rgbButtons`, i.e. per button index.
+struct ButtonBits final {
+  static inline constexpr DWORD kButtonCount = 128;
+
+  uint64_t words[2] = {};
+
+  bool Test(DWORD index) const {
+    return ((words[index / 64] >> (index % 64)) & 1) != 0;
+  }
+
+  bool Any() const {
+    return (words[0] | words[1]) != 0;
+  }
+
+  DWORD Count() const {
+    return static_cast<DWORD>(std::popcount(words[0]) + std::popcount(words[1]));
+  }
+
+  /// The lowest set index, or `kButtonCount` if none is set.
+  DWORD FindFirst() const {
+    if (words[0] != 0) {
+      return static_cast<DWORD>(std::countr_zero(words[0]));
+    }
+    if (words[1] != 0) {
+      return 64 + static_cast<DWORD>(std::countr_zero(words[1]));
+    }
+    return kButtonCount;
+  }
+
+  /// Calls `f(DWORD index)` for each set index, in ascending order. Costs one iteration per set bit, not per button.
+  template<typename F>
+  void ForEach(F&& f) const {
+    for (DWORD w = 0; w < 2; ++w) {
+      uint64_t bits = words[w];
+      while (bits != 0) {
+        f(w * 64 + static_cast<DWORD>(std::countr_zero(bits)));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  friend ButtonBits operator&(ButtonBits const& lhs, ButtonBits const& rhs) {
+    return ButtonBits { { lhs.words[0] & rhs.words[0], lhs.words[1] & rhs.words[1] } };
+  }
+  friend ButtonBits operator|(ButtonBits const& lhs, ButtonBits const& rhs) {
+    return ButtonBits { { lhs.words[0] | rhs.words[0], lhs.words[1] | rhs.words[1] } };
+  }
+  friend ButtonBits operator^(ButtonBits const& lhs, ButtonBits const& rhs) {
+    return ButtonBits { { lhs.words[0] ^ rhs.words[0], lhs.words[1] ^ rhs.words[1] } };
+  }
+  friend ButtonBits operator~(ButtonBits const& v) {
+    return ButtonBits { { ~v.words[0], ~v.words[1] } };
+  }
+  friend bool operator==(ButtonBits const& lhs, ButtonBits const& rhs) = default;
+};
+
+/// Which buttons are down, and which went down or up since the previous update.
+struct ButtonEdges final {
+  ButtonBits down;
+  ButtonBits pressed;
+  ButtonBits released;
+
+  /// Buttons that were either pressed or released.
+  ButtonBits GetChanged() const {
+    return pressed | released;
+  }
+};
+
+/// Bit `i` is set if `buttons[i]` has its high bit (0x80, "pressed") set.
+ButtonBits PackButtons(BYTE const* buttons);
+
+/// Compares the buttons now `down` against `previous_down`.
+inline ButtonEdges ComputeButtonEdges(ButtonBits const& previous_down, ButtonBits const& down) {
+  return ButtonEdges {
+    .down = down,
+    .pressed = down & ~previous_down,
+    .released = previous_down & ~down,
+  };
+}
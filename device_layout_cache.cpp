@@ -0,0 +1,389 @@
+#include "device_layout_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#if !defined(_WIN32)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+//
+// File format, version 1 (all integers in the machine's byte order, which is little-endian on every platform this runs on):
+//
+//   FileHeader
+//   Entry[entry_count]                          sorted by `product`, compared bytewise
+//   DirectInputContext::Input[input_count]      each entry's POVs, axes and buttons, from its `first_input`
+//
+// Every record has a fixed size, recorded in the header, and 4-byte alignment, so the whole file is used in place from a read-only mapping.
+// `checksum` covers everything after the header.
+//
+
+namespace {
+
+constexpr char kMagic[4] = { 'D', 'I', 'L', 'C' };
+
+struct FileHeader final {
+  char magic[4];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t entry_size;
+  uint32_t input_size;
+  uint32_t entry_count;
+  uint32_t input_count;
+  uint32_t reserved;
+  uint64_t checksum;
+};
+
+static_assert(std::is_trivially_copyable_v<DirectInputContext::Input>);
+static_assert(sizeof(DirectInputContext::Input) == 12);
+
+bool GuidLess(GUID const& lhs, GUID const& rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(GUID)) < 0;
+}
+
+/// FNV-1a.
+uint64_t ComputeChecksum(uint8_t const* data, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001B3ull;
+  }
+  return hash;
+}
+
+}
+
+DeviceLayoutCache::~DeviceLayoutCache() noexcept {
+  this->Unmap();
+}
+
+bool DeviceLayoutCache::CapsMatch(DIDEVCAPS const& lhs, DIDEVCAPS const& rhs) {
+  // `dwFlags` also tells whether the device is attached, and the force-feedback fields say nothing about the inputs.
+  return
+    lhs.dwDevType == rhs.dwDevType &&
+    lhs.dwAxes == rhs.dwAxes &&
+    lhs.dwButtons == rhs.dwButtons &&
+    lhs.dwPOVs == rhs.dwPOVs &&
+    lhs.dwFirmwareRevision == rhs.dwFirmwareRevision &&
+    lhs.dwHardwareRevision == rhs.dwHardwareRevision;
+}
+
+bool DeviceLayoutCache::Load(std::string path) {
+  std::lock_guard lock(mutex_);
+
+  stored_.clear();
+  path_ = std::move(path);
+  return this->Map();
+}
+
+bool DeviceLayoutCache::Map() {
+  this->Unmap();
+
+  void const* data = nullptr;
+  size_t size = 0;
+#if defined(_WIN32)
+  HANDLE const file = ::CreateFileA(path_.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER file_size {};
+  HANDLE mapping = nullptr;
+  if (::GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+    mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  }
+  // The mapping keeps the file open.
+  ::CloseHandle(file);
+  if (mapping == nullptr) {
+    return false;
+  }
+  data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr) {
+    ::CloseHandle(mapping);
+    return false;
+  }
+  size = static_cast<size_t>(file_size.QuadPart);
+  mapping_handle_ = mapping;
+#else
+  int const fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status {};
+  if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  size = static_cast<size_t>(status.st_size);
+  data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid without the descriptor.
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+#endif
+  mapping_ = data;
+  mapping_size_ = size;
+
+  // Validate everything up front, so that lookups can trust the file.
+  auto Reject = [this](char const* reason) {
+    std::clog << "DeviceLayoutCache: Ignoring \"" << path_ << "\": " << reason << std::endl;
+    this->Unmap();
+    return false;
+  };
+
+  if (size < sizeof(FileHeader)) {
+    return Reject("too small");
+  }
+  FileHeader const& header = *static_cast<FileHeader const*>(data);
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    return Reject("not a layout cache");
+  }
+  if (header.version != kVersion) {
+    return Reject("another version");
+  }
+  if (header.header_size != sizeof(FileHeader) || header.entry_size != sizeof(Entry) || header.input_size != sizeof(DirectInputContext::Input)) {
+    return Reject("unexpected record sizes");
+  }
+  uint64_t const expected_size = sizeof(FileHeader) + uint64_t(header.entry_count) * sizeof(Entry) + uint64_t(header.input_count) * sizeof(DirectInputContext::Input);
+  if (expected_size != size) {
+    return Reject("truncated");
+  }
+  uint8_t const* const bytes = static_cast<uint8_t const*>(data);
+  if (ComputeChecksum(bytes + sizeof(FileHeader), size - sizeof(FileHeader)) != header.checksum) {
+    return Reject("checksum mismatch");
+  }
+
+  Entry const* const entries = reinterpret_cast<Entry const*>(bytes + sizeof(FileHeader));
+  for (uint32_t i = 0; i < header.entry_count; ++i) {
+    Entry const& entry = entries[i];
+    uint64_t const end = uint64_t(entry.first_input) + entry.pov_count + entry.axis_count + entry.button_count;
+    if (end > header.input_count || entry.name[kNameSize - 1] != '\0') {
+      return Reject("malformed entry");
+    }
+    if (i > 0 && !GuidLess(entries[i - 1].product, entry.product)) {
+      return Reject("entries out of order");
+    }
+  }
+
+  mapped_entries_ = entries;
+  mapped_entry_count_ = header.entry_count;
+  mapped_inputs_ = reinterpret_cast<DirectInputContext::Input const*>(entries + header.entry_count);
+  mapped_input_count_ = header.input_count;
+  return true;
+}
+
+bool DeviceLayoutCache::Save() {
+  std::lock_guard lock(mutex_);
+
+  if (path_.empty()) {
+    return false;
+  }
+
+  // Merge: the stored entries, and the mapped ones they do not replace.
+  struct Source final {
+    Entry const* entry;
+    DirectInputContext::Input const* inputs;
+  };
+  std::vector<Source> sources;
+  sources.reserve(stored_.size() + mapped_entry_count_);
+  for (StoredEntry const& stored : stored_) {
+    sources.push_back(Source { .entry = &stored.entry, .inputs = stored.inputs.data() });
+  }
+  for (uint32_t i = 0; i < mapped_entry_count_; ++i) {
+    if (this->FindStored(mapped_entries_[i].product) == nullptr) {
+      sources.push_back(Source { .entry = &mapped_entries_[i], .inputs = mapped_inputs_ + mapped_entries_[i].first_input });
+    }
+  }
+  std::sort(
+    sources.begin(), sources.end(),
+    [](Source const& lhs, Source const& rhs) {
+      return GuidLess(lhs.entry->product, rhs.entry->product);
+    }
+  );
+
+  std::vector<Entry> entries;
+  std::vector<DirectInputContext::Input> inputs;
+  entries.reserve(sources.size());
+  for (Source const& source : sources) {
+    Entry& entry = entries.emplace_back(*source.entry);
+    entry.first_input = static_cast<uint32_t>(inputs.size());
+    inputs.insert(inputs.end(), source.inputs, source.inputs + entry.pov_count + entry.axis_count + entry.button_count);
+  }
+
+  std::vector<uint8_t> image(sizeof(FileHeader) + entries.size() * sizeof(Entry) + inputs.size() * sizeof(DirectInputContext::Input));
+  uint8_t* const payload = image.data() + sizeof(FileHeader);
+  if (!entries.empty()) {
+    std::memcpy(payload, entries.data(), entries.size() * sizeof(Entry));
+  }
+  if (!inputs.empty()) {
+    std::memcpy(payload + entries.size() * sizeof(Entry), inputs.data(), inputs.size() * sizeof(DirectInputContext::Input));
+  }
+
+  FileHeader header {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.header_size = sizeof(FileHeader);
+  header.entry_size = sizeof(Entry);
+  header.input_size = sizeof(DirectInputContext::Input);
+  header.entry_count = static_cast<uint32_t>(entries.size());
+  header.input_count = static_cast<uint32_t>(inputs.size());
+  header.checksum = ComputeChecksum(payload, image.size() - sizeof(FileHeader));
+  std::memcpy(image.data(), &header, sizeof(FileHeader));
+
+  // Everything now lives in `image`; let go of the old file (Windows does not replace a mapped one), and replace it atomically.
+  // On failure, the old file is mapped again, and the stored entries are kept for the next `Save`.
+  this->Unmap();
+
+  std::string const temporary_path = path_ + ".tmp";
+  {
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<char const*>(image.data()), static_cast<std::streamsize>(image.size()));
+    if (!file) {
+      std::clog << "DeviceLayoutCache: Failed to write \"" << temporary_path << "\"." << std::endl;
+      this->Map();
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temporary_path, path_, ec);
+  if (ec) {
+    std::clog << "DeviceLayoutCache: Failed to replace \"" << path_ << "\": " << ec.message() << std::endl;
+    std::filesystem::remove(temporary_path, ec);
+    this->Map();
+    return false;
+  }
+
+  stored_.clear();
+  return this->Map();
+}
+
+bool DeviceLayoutCache::Find(GUID const& product, DIDEVCAPS const& caps, DirectInputContext::Device& out_device) {
+  std::lock_guard lock(mutex_);
+
+  Entry const* entry = nullptr;
+  DirectInputContext::Input const* inputs = nullptr;
+  if (StoredEntry const* stored = this->FindStored(product)) {
+    entry = &stored->entry;
+    inputs = stored->inputs.data();
+  }
+  else if (Entry const* mapped = this->FindMapped(product)) {
+    entry = mapped;
+    inputs = mapped_inputs_ + mapped->first_input;
+  }
+
+  if (entry == nullptr) {
+    ++stats_.miss_count;
+    return false;
+  }
+  if (!CapsMatch(entry->caps, caps)) {
+    ++stats_.stale_count;
+    return false;
+  }
+
+  CopyLayout(*entry, inputs, out_device);
+  ++stats_.hit_count;
+  return true;
+}
+
+void DeviceLayoutCache::Store(GUID const& product, DirectInputContext::Device const& device) {
+  StoredEntry stored {};
+  stored.entry.product = product;
+  stored.entry.caps = device.caps;
+  stored.entry.pov_count = static_cast<uint32_t>(device.povs.size());
+  stored.entry.axis_count = static_cast<uint32_t>(device.axes.size());
+  stored.entry.button_count = static_cast<uint32_t>(device.buttons.size());
+  device.name.copy(stored.entry.name, kNameSize - 1);
+  stored.inputs.reserve(device.povs.size() + device.axes.size() + device.buttons.size());
+  stored.inputs.insert(stored.inputs.end(), device.povs.begin(), device.povs.end());
+  stored.inputs.insert(stored.inputs.end(), device.axes.begin(), device.axes.end());
+  stored.inputs.insert(stored.inputs.end(), device.buttons.begin(), device.buttons.end());
+
+  std::lock_guard lock(mutex_);
+  auto it = std::find_if(
+    stored_.begin(), stored_.end(),
+    [&product](StoredEntry const& entry) {
+      return entry.entry.product == product;
+    }
+  );
+  if (it != stored_.end()) {
+    *it = std::move(stored);
+  }
+  else {
+    stored_.push_back(std::move(stored));
+  }
+}
+
+bool DeviceLayoutCache::IsDirty() const {
+  std::lock_guard lock(mutex_);
+  return !stored_.empty();
+}
+
+size_t DeviceLayoutCache::GetSize() const {
+  std::lock_guard lock(mutex_);
+  size_t size = stored_.size();
+  for (uint32_t i = 0; i < mapped_entry_count_; ++i) {
+    if (this->FindStored(mapped_entries_[i].product) == nullptr) {
+      ++size;
+    }
+  }
+  return size;
+}
+
+DeviceLayoutCache::Stats DeviceLayoutCache::GetStats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+void DeviceLayoutCache::CopyLayout(Entry const& entry, DirectInputContext::Input const* inputs, DirectInputContext::Device& out_device) {
+  out_device.name = entry.name;
+  out_device.povs.assign(inputs, inputs + entry.pov_count);
+  inputs += entry.pov_count;
+  out_device.axes.assign(inputs, inputs + entry.axis_count);
+  inputs += entry.axis_count;
+  out_device.buttons.assign(inputs, inputs + entry.button_count);
+}
+
+void DeviceLayoutCache::Unmap() {
+  if (mapping_ != nullptr) {
+#if defined(_WIN32)
+    ::UnmapViewOfFile(mapping_);
+    ::CloseHandle(mapping_handle_);
+    mapping_handle_ = nullptr;
+#else
+    ::munmap(const_cast<void*>(mapping_), mapping_size_);
+#endif
+  }
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  mapped_entries_ = nullptr;
+  mapped_entry_count_ = 0;
+  mapped_inputs_ = nullptr;
+  mapped_input_count_ = 0;
+}
+
+DeviceLayoutCache::Entry const* DeviceLayoutCache::FindMapped(GUID const& product) const {
+  Entry const* const end = mapped_entries_ + mapped_entry_count_;
+  Entry const* it = std::lower_bound(
+    mapped_entries_, end, product,
+    [](Entry const& entry, GUID const& product) {
+      return GuidLess(entry.product, product);
+    }
+  );
+  return (it != end && it->product == product) ? it : nullptr;
+}
+
+DeviceLayoutCache::StoredEntry const* DeviceLayoutCache::FindStored(GUID const& product) const {
+  auto it = std::find_if(
+    stored_.begin(), stored_.end(),
+    [&product](StoredEntry const& entry) {
+      return entry.entry.product == product;
+    }
+  );
+  return (it != stored_.end()) ? &*it : nullptr;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// The layouts of known device models (product name, `DIDEVCAPS` and sorted `Input` tables), persisted to a file,
+/// so that a backend opening a device it has seen before can skip discovering its inputs one by one (see `Config::layout_cache_path`).
+/// Layouts are keyed by product GUID, and a cached layout is only used if the capabilities the device reports now still match the cached ones.
+///
+/// The file is read in place from a read-only mapping: a header, the entries sorted by product GUID, and then every entry's inputs,
+/// all fixed-size records (see `device_layout_cache.cpp`). A file of another version, or a damaged one, is ignored and rewritten on `Save`.
+///
+/// Safe to use from several threads, e.g. `OpenDevice` on the opening thread of `Config::async_device_open`.
+class DeviceLayoutCache final {
+public:
+  static inline constexpr uint32_t kVersion = 1;
+  /// Including the terminating null character. Longer product names are truncated.
+  static inline constexpr size_t kNameSize = 128;
+
+  struct Stats final {
+    /// `Find` calls that returned a layout.
+    uint64_t hit_count = 0;
+    /// `Find` calls for a product not in the cache.
+    uint64_t miss_count = 0;
+    /// `Find` calls for a product in the cache whose capabilities no longer match, e.g. after a firmware update.
+    uint64_t stale_count = 0;
+  };
+
+  DeviceLayoutCache() = default;
+  ~DeviceLayoutCache() noexcept;
+
+  DeviceLayoutCache(DeviceLayoutCache const&) = delete;
+  DeviceLayoutCache& operator=(DeviceLayoutCache const&) = delete;
+
+  /// Maps the cache file at `path`, which `Save` writes back to. Returns `false` if it does not exist or is not a valid cache,
+  /// in which case the cache starts empty.
+  bool Load(std::string path);
+  /// Writes every layout, loaded and stored, to the file `Load` was given, replacing it atomically. Returns `false` on failure.
+  bool Save();
+
+  /// If a layout for `product` is cached and was captured with the same capabilities as `caps`, fills out `name`, `povs`, `buttons` and `axes` of `out_device`
+  /// and returns `true`.
+  bool Find(GUID const& product, DIDEVCAPS const& caps, DirectInputContext::Device& out_device);
+  /// Caches the layout of `device` (`name`, `caps`, `povs`, `buttons` and `axes`) as that of `product`, replacing any previous one.
+  void Store(GUID const& product, DirectInputContext::Device const& device);
+
+  /// Layouts were stored since the latest `Load` or `Save`.
+  bool IsDirty() const;
+  size_t GetSize() const;
+  Stats GetStats() const;
+
+  /// Whether two `DIDEVCAPS` describe the same layout: the same type, inputs and revisions.
+  static bool CapsMatch(DIDEVCAPS const& lhs, DIDEVCAPS const& rhs);
+
+private:
+  /// One model's layout, as stored in the file. Its inputs are `pov_count` POVs, then `axis_count` axes, then `button_count` buttons, from `first_input`.
+  struct Entry final {
+    GUID product {};
+    DIDEVCAPS caps {};
+    uint32_t first_input = 0;
+    uint32_t pov_count = 0;
+    uint32_t axis_count = 0;
+    uint32_t button_count = 0;
+    char name[kNameSize] {};
+  };
+
+  struct StoredEntry final {
+    /// `first_input` is not used.
+    Entry entry;
+    std::vector<DirectInputContext::Input> inputs;
+  };
+
+  /// Fills out `out_device` from `entry` and its inputs.
+  static void CopyLayout(Entry const& entry, DirectInputContext::Input const* inputs, DirectInputContext::Device& out_device);
+
+  /// Maps and validates the file at `path_`. Called with `mutex_` held.
+  bool Map();
+  void Unmap();
+  Entry const* FindMapped(GUID const& product) const;
+  StoredEntry const* FindStored(GUID const& product) const;
+
+  mutable std::mutex mutex_;
+  std::string path_;
+
+  /// The loaded file, or `nullptr`.
+  void const* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+#if defined(_WIN32)
+  void* mapping_handle_ = nullptr;
+#endif
+  /// Into `mapping_`.
+  Entry const* mapped_entries_ = nullptr;
+  uint32_t mapped_entry_count_ = 0;
+  DirectInputContext::Input const* mapped_inputs_ = nullptr;
+  uint32_t mapped_input_count_ = 0;
+
+  /// Stored since `Load`; they take precedence over the mapped ones.
+  std::vector<StoredEntry> stored_;
+  Stats stats_ {};
+};
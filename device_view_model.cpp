@@ -0,0 +1,145 @@
+#include "device_view_model.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+namespace {
+
+std::string FormatPovValue(DWORD value) {
+  // > The position is indicated in hundredths of a degree clockwise from north (away from the user).
+  return std::format("{}", value / 100);
+}
+
+std::string FormatAxisValue(LONG value) {
+  return std::format("{} ([{}, {}])", value, DirectInputContext::kAxisMin, DirectInputContext::kAxisMax);
+}
+
+float ToGauge(LONG value) {
+  return static_cast<float>(value - DirectInputContext::kAxisMin) / static_cast<float>(DirectInputContext::kAxisMax - DirectInputContext::kAxisMin);
+}
+
+}
+
+DeviceViewModel::DeviceRow const* DeviceViewModel::FindRow(DirectInputContext::DeviceHandle handle) const {
+  auto it = std::find_if(
+    rows_.begin(), rows_.end(),
+    [handle](DeviceRow const& row) {
+      return row.handle == handle;
+    }
+  );
+  return (it != rows_.end()) ? &*it : nullptr;
+}
+
+bool DeviceViewModel::Update(DirectInputContext const& context) {
+  std::span<DirectInputContext::Device const> const devices = context.GetDevices();
+
+  bool changed = false;
+
+  if (context.GetPendingDevices().size() != pending_count_) {
+    pending_count_ = context.GetPendingDevices().size();
+    changed = true;
+  }
+
+  // The rows follow the devices' order. It only changes on hot-plug, so in the common case every row is already in place.
+  bool const same_devices = rows_.size() == devices.size() && std::equal(
+    rows_.begin(), rows_.end(), devices.begin(),
+    [](DeviceRow const& row, DirectInputContext::Device const& device) {
+      return row.handle == device.handle;
+    }
+  );
+  if (!same_devices) {
+    std::vector<DeviceRow> rows;
+    rows.reserve(devices.size());
+    for (DirectInputContext::Device const& device : devices) {
+      auto it = std::find_if(
+        rows_.begin(), rows_.end(),
+        [&device](DeviceRow const& row) {
+          return row.handle == device.handle;
+        }
+      );
+      if (it != rows_.end()) {
+        rows.push_back(std::move(*it));
+      }
+      else {
+        BuildRow(device, rows.emplace_back());
+      }
+    }
+    rows_ = std::move(rows);
+    changed = true;
+  }
+
+  for (size_t i = 0; i < devices.size(); ++i) {
+    DIJOYSTATE2 const state = devices[i].LoadState();
+    if (std::memcmp(&state, &rows_[i].state, sizeof(DIJOYSTATE2)) != 0) {
+      changed |= UpdateValues(devices[i], state, rows_[i]);
+    }
+  }
+
+  if (changed) {
+    ++version_;
+  }
+  return changed;
+}
+
+void DeviceViewModel::BuildRow(DirectInputContext::Device const& device, DeviceRow& out_row) {
+  out_row.handle = device.handle;
+  out_row.name = device.name;
+  out_row.guid = device.GetGuidString();
+  out_row.pov_count = device.caps.dwPOVs;
+  out_row.axis_count = device.caps.dwAxes;
+  out_row.button_count = device.caps.dwButtons;
+
+  // Formatted from a zero state here; `Update` then formats whatever differs from it.
+  out_row.state = DIJOYSTATE2 {};
+  for (DWORD i = 0; i < device.povs.size(); ++i) {
+    out_row.povs.push_back(PovRow { .label = std::format("POV {}", i), .value_text = FormatPovValue(0) });
+  }
+  for (DWORD i = 0; i < device.axes.size(); ++i) {
+    out_row.axes.push_back(AxisRow { .label = std::format("Axis {} ({})", i, device.GetAxisName(i)), .value_text = FormatAxisValue(0), .gauge = ToGauge(0) });
+  }
+  for (DWORD i = 0; i < device.buttons.size(); ++i) {
+    out_row.buttons.push_back(ButtonRow { .label = std::format("Button {}", i), .pressed = false });
+  }
+}
+
+bool DeviceViewModel::UpdateValues(DirectInputContext::Device const& device, DIJOYSTATE2 const& state, DeviceRow& row) {
+  bool changed = false;
+
+  for (DWORD i = 0; i < device.povs.size(); ++i) {
+    DWORD const offset = device.povs[i].offset;
+    DWORD value;
+    DWORD previous_value;
+    std::memcpy(&value, reinterpret_cast<BYTE const*>(&state) + offset, sizeof(DWORD));
+    std::memcpy(&previous_value, reinterpret_cast<BYTE const*>(&row.state) + offset, sizeof(DWORD));
+    if (value != previous_value) {
+      row.povs[i].value_text = FormatPovValue(value);
+      changed = true;
+    }
+  }
+
+  for (DWORD i = 0; i < device.axes.size(); ++i) {
+    DWORD const offset = device.axes[i].offset;
+    LONG value;
+    LONG previous_value;
+    std::memcpy(&value, reinterpret_cast<BYTE const*>(&state) + offset, sizeof(LONG));
+    std::memcpy(&previous_value, reinterpret_cast<BYTE const*>(&row.state) + offset, sizeof(LONG));
+    if (value != previous_value) {
+      row.axes[i].value_text = FormatAxisValue(value);
+      row.axes[i].gauge = ToGauge(value);
+      changed = true;
+    }
+  }
+
+  for (DWORD i = 0; i < device.buttons.size(); ++i) {
+    bool const pressed = (reinterpret_cast<BYTE const*>(&state)[device.buttons[i].offset] & 0x80) != 0;
+    if (pressed != row.buttons[i].pressed) {
+      row.buttons[i].pressed = pressed;
+      changed = true;
+    }
+  }
+
+  // Whatever else changed (e.g. bits DirectInput does not report for this device) is not shown.
+  row.state = state;
+  return changed;
+}
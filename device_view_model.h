@@ -0,0 +1,80 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/// What the example's window shows of each device, with every label formatted ahead of time.
+/// `Update` only reformats what changed, so drawing a frame allocates and formats nothing, and tells whether there is anything new to draw at all.
+/// Independent of any UI library, so it can be driven and inspected without a window.
+class DeviceViewModel final {
+public:
+  struct PovRow final {
+    std::string label;
+    /// Degrees, clockwise from north.
+    std::string value_text;
+  };
+
+  struct AxisRow final {
+    std::string label;
+    /// The raw value and range.
+    std::string value_text;
+    /// The value in [0, 1].
+    float gauge = 0.0f;
+  };
+
+  struct ButtonRow final {
+    std::string label;
+    bool pressed = false;
+  };
+
+  struct DeviceRow final {
+    DirectInputContext::DeviceHandle handle {};
+    std::string name;
+    std::string guid;
+    DWORD pov_count = 0;
+    DWORD axis_count = 0;
+    DWORD button_count = 0;
+
+    std::vector<PovRow> povs;
+    std::vector<AxisRow> axes;
+    std::vector<ButtonRow> buttons;
+
+    /// The state the rows were last formatted from.
+    DIJOYSTATE2 state {};
+  };
+
+  /// Brings the rows up to date with `context`, typically after `UpdateDetection` and `UpdateState`.
+  /// Returns `true` if anything shown changed: a device was added or removed, started or finished opening, or one of its values changed.
+  bool Update(DirectInputContext const& context);
+
+  /// In `DirectInputContext::GetDevices` order.
+  std::span<DeviceRow const> GetRows() const {
+    return rows_;
+  }
+
+  /// Devices still being opened in the background (see `DirectInputContext::GetPendingDevices`), to show as "connecting".
+  size_t GetPendingCount() const {
+    return pending_count_;
+  }
+
+  /// `nullptr` if the device is gone.
+  DeviceRow const* FindRow(DirectInputContext::DeviceHandle handle) const;
+
+  /// Incremented by every `Update` that returns `true`.
+  uint64_t GetVersion() const {
+    return version_;
+  }
+
+private:
+  static void BuildRow(DirectInputContext::Device const& device, DeviceRow& out_row);
+  /// Returns `true` if any value changed.
+  static bool UpdateValues(DirectInputContext::Device const& device, DIJOYSTATE2 const& state, DeviceRow& row);
+
+  std::vector<DeviceRow> rows_;
+  size_t pending_count_ = 0;
+  uint64_t version_ = 0;
+};
@@ -0,0 +1,443 @@
+//
+// Huge thanks to the following resources:
+// - SDL2's SDL joystick: https://github.com/libsdl-org/SDL/blob/release-2.24.x/src/joystick/windows/SDL_dinputjoystick.c
+//
+
+#include "direct_input_backend.h"
+#include "device_layout_cache.h"
+#include "trace.h"
+
+#include <iostream>
+#include <algorithm>
+
+#pragma comment(lib, "dinput8.lib")
+
+/// 0: Use `CoCreateInstance` to create `IDirectInput8`.
+/// 1: Use `DirectInput8Create` to create `IDirectInput8`.
+#if !defined(CONFIG_USE_DIRECTINPUT8CREATE)
+# define CONFIG_USE_DIRECTINPUT8CREATE (1)
+#endif
+
+namespace {
+
+std::string ToMultiByteImpl(wchar_t const* str) {
+  int const size = WideCharToMultiByte(CP_UTF8, 0, str, -1, nullptr, 0, nullptr, nullptr);
+  if (size == 0) {
+    return "";
+  }
+  std::string result(size, '\0');
+  WideCharToMultiByte(CP_UTF8, 0, str, -1, result.data(), size, nullptr, nullptr);
+  return result;
+}
+
+std::string ToMultiByte(TCHAR const* str) {
+#ifdef UNICODE
+  return ToMultiByteImpl(str);
+#else
+  return str;
+#endif
+}
+
+#if !defined(UNICODE)
+std::string ToMultiByte(wchar_t const* str) {
+  return ToMultiByteImpl(str);
+}
+#endif
+
+// `IDirectInput8` could be `IDirectInput8A` or `IDirectInput8W`, depending on whether `UNICODE` is defined.
+IDirectInput8* CreateDirectInput8() {
+  // Could be `IID_IDirectInput8A` or `IID_IDirectInput8W`.
+  IID const& iid = IID_IDirectInput8;
+
+  HMODULE hModule = GetModuleHandle(nullptr);
+
+  IDirectInput8* pDI = NULL;
+
+#if CONFIG_USE_DIRECTINPUT8CREATE
+  // Use `DirectInput8Create`.
+
+  HRESULT hr = DirectInput8Create(hModule, DIRECTINPUT_VERSION, iid, (void**)&pDI, nullptr);
+  if (FAILED(hr)) {
+    return nullptr;
+  }
+  
+  return pDI;
+
+#else
+  // Use `CoCreateInstance`.
+
+  HRESULT hr = CoInitialize(nullptr);
+  if (FAILED(hr)) {
+    return nullptr;
+  }
+
+  hr = CoCreateInstance(CLSID_DirectInput8, nullptr, CLSCTX_INPROC_SERVER, iid, (void**)&pDI);
+  if (FAILED(hr)) {
+    return nullptr;
+  }
+
+  hr = pDI->Initialize(hModule, DIRECTINPUT_VERSION);
+  if (FAILED(hr)) {
+    return nullptr;
+  }
+#endif
+
+  return pDI;
+}
+
+void ReleaseDirectInput8(IDirectInput8* pDI) {
+  if (pDI != nullptr) {
+    pDI->Release();
+  }
+
+#if !CONFIG_USE_DIRECTINPUT8CREATE
+  CoUninitialize();
+#endif
+}
+
+/// Owns an `IDirectInputDevice8`, and the event it signals on new input.
+class DirectInputDeviceSource final : public DirectInputContext::DeviceSource {
+public:
+  /// `pDevice` must not be acquired yet.
+  DirectInputDeviceSource(IDirectInputDevice8* pDevice, DIDEVCAPS const& caps) : pDevice_(pDevice) {
+    // A polled device only signals from `Poll`, so waiting on it would never return: leave it to `Config::wait_poll_interval_ms`.
+    if ((caps.dwFlags & (DIDC_POLLEDDEVICE | DIDC_POLLEDDATAFORMAT)) == 0 && signal_.GetHandle() != kNoInputNotification) {
+      notifying_ = SUCCEEDED(pDevice_->SetEventNotification(signal_.GetHandle()));
+    }
+  }
+  ~DirectInputDeviceSource() noexcept override {
+    if (notifying_) {
+      pDevice_->Unacquire();
+      pDevice_->SetEventNotification(nullptr);
+    }
+    pDevice_->Release();
+  }
+
+  DirectInputDeviceSource(DirectInputDeviceSource const&) = delete;
+  DirectInputDeviceSource(DirectInputDeviceSource&&) = delete;
+  DirectInputDeviceSource& operator=(DirectInputDeviceSource const&) = delete;
+  DirectInputDeviceSource& operator=(DirectInputDeviceSource&&) = delete;
+
+  HRESULT Acquire() override {
+    return pDevice_->Acquire();
+  }
+
+  HRESULT Poll() override {
+    return pDevice_->Poll();
+  }
+
+  HRESULT GetDeviceState(DIJOYSTATE2& out_state) override {
+    return pDevice_->GetDeviceState(sizeof(DIJOYSTATE2), &out_state);
+  }
+
+  HRESULT ReadBufferedEvents(DIDEVICEOBJECTDATA* out_data, DWORD& inout_count) override {
+    return pDevice_->GetDeviceData(sizeof(DIDEVICEOBJECTDATA), out_data, &inout_count, 0);
+  }
+
+  /// An auto-reset event: the wait that it ends unsignals it.
+  InputNotificationHandle GetNotificationHandle() override {
+    return notifying_ ? signal_.GetHandle() : kNoInputNotification;
+  }
+
+private:
+  /// Could be `IDirectInputDevice8A` or `IDirectInputDevice8W`, depending on whether `UNICODE` is defined.
+  IDirectInputDevice8* pDevice_ = nullptr;
+  InputSignal signal_;
+  bool notifying_ = false;
+};
+
+}
+
+bool DirectInputBackend::Initialize(DirectInputContext::Config const& config) {
+  config_ = config;
+
+  pDI_ = CreateDirectInput8();
+  return pDI_ != nullptr;
+}
+
+void DirectInputBackend::Shutdown() {
+  if (pDI_ == nullptr) {
+    return;
+  }
+
+  ReleaseDirectInput8(pDI_);
+  pDI_ = nullptr;
+}
+
+void DirectInputBackend::EnumerateDevices(std::vector<GUID>& out_guids) {
+  auto DIEnumDevicesCallback = [](LPCDIDEVICEINSTANCE lpddi, LPVOID pvRef) -> BOOL {
+    std::vector<GUID>& device_guids = *static_cast<std::vector<GUID>*>(pvRef);
+
+    device_guids.emplace_back(lpddi->guidInstance);
+
+    return DIENUM_CONTINUE;
+  };
+
+  std::lock_guard lock(pDI_mutex_);
+  TRACE_ZONE("EnumDevices");
+  pDI_->EnumDevices(DI8DEVCLASS_GAMECTRL, DIEnumDevicesCallback, &out_guids, DIEDFL_ATTACHEDONLY);
+}
+
+std::unique_ptr<DirectInputContext::DeviceSource> DirectInputBackend::OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) {
+  using Input = DirectInputContext::Input;
+  using InputType = DirectInputContext::InputType;
+  static constexpr LONG kAxisMin = DirectInputContext::kAxisMin;
+  static constexpr LONG kAxisMax = DirectInputContext::kAxisMax;
+  using OpenStage = DirectInputContext::OpenStage;
+
+  DirectInputContext::OpenTimings& timings = out_device.open_timings;
+  uint64_t stage_start = GetMonotonicTimeNs();
+
+  IDirectInputDevice8* pDevice = nullptr;
+  HRESULT hr = S_OK;
+  {
+    std::lock_guard lock(pDI_mutex_);
+    TRACE_ZONE("CreateDevice");
+    hr = pDI_->CreateDevice(guid, &pDevice, nullptr);
+  }
+  timings.EndStage(OpenStage::kCreateDevice, stage_start);
+  if (FAILED(hr)) {
+    std::clog << "IDirectInput8::CreateDevice failed." << std::endl;
+    return nullptr;
+  }
+
+  // Acquire shared access to the device (exclusive access would be required for FFB).
+  hr = pDevice->SetCooperativeLevel(nullptr, DISCL_NONEXCLUSIVE | DISCL_BACKGROUND);
+  timings.EndStage(OpenStage::kCooperativeLevel, stage_start);
+  if (FAILED(hr)) {
+    pDevice->Release();
+    return nullptr;
+  }
+
+  // Extended joystick state format.
+  hr = pDevice->SetDataFormat(&c_dfDIJoystick2);
+  if (FAILED(hr)) {
+    pDevice->Release();
+    return nullptr;
+  }
+
+  // Let the driver buffer changes between two `UpdateState` calls. This has to happen before the device is acquired.
+  if (config_.buffered_input) {
+    DIPROPDWORD dipdw {};
+    dipdw.diph.dwSize = sizeof(DIPROPDWORD);
+    dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+    dipdw.diph.dwObj = 0;
+    dipdw.diph.dwHow = DIPH_DEVICE;
+    dipdw.dwData = config_.device_buffer_size;
+
+    hr = pDevice->SetProperty(DIPROP_BUFFERSIZE, &dipdw.diph);
+    if (FAILED(hr)) {
+      std::clog << "IDirectInputDevice8::SetProperty(DIPROP_BUFFERSIZE) failed." << std::endl;
+    }
+  }
+  timings.EndStage(OpenStage::kDataFormat, stage_start);
+
+  // Get capabilities using `IDirectInputDevice8::GetCapabilities`.
+  DIDEVCAPS caps {};
+  {
+    caps.dwSize = sizeof(DIDEVCAPS);
+
+    hr = pDevice->GetCapabilities(&caps);
+    timings.EndStage(OpenStage::kCapabilities, stage_start);
+    if (FAILED(hr)) {
+      pDevice->Release();
+      return nullptr;
+    }
+  }
+
+  // A known model: its layout is cached, so only the properties have to be set, for all axes at once.
+  GUID product_guid {};
+  if (layout_cache_ != nullptr) {
+    DIDEVICEINSTANCE instance {};
+    instance.dwSize = sizeof(DIDEVICEINSTANCE);
+    if (SUCCEEDED(pDevice->GetDeviceInfo(&instance))) {
+      product_guid = instance.guidProduct;
+    }
+
+    if (product_guid != GUID_NULL && layout_cache_->Find(product_guid, caps, out_device)) {
+      DIPROPRANGE diprg {};
+      diprg.diph.dwSize = sizeof(DIPROPRANGE);
+      diprg.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+      diprg.diph.dwObj = 0;
+      diprg.diph.dwHow = DIPH_DEVICE;
+      diprg.lMin = kAxisMin;
+      diprg.lMax = kAxisMax;
+      pDevice->SetProperty(DIPROP_RANGE, &diprg.diph);
+
+      DIPROPDWORD dipdw {};
+      dipdw.diph.dwSize = sizeof(DIPROPDWORD);
+      dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+      dipdw.diph.dwObj = 0;
+      dipdw.diph.dwHow = DIPH_DEVICE;
+      dipdw.dwData = 0;
+      pDevice->SetProperty(DIPROP_DEADZONE, &dipdw.diph);
+      timings.EndStage(OpenStage::kObjects, stage_start);
+
+      out_device.caps = caps;
+      timings.layout_cached = true;
+      return std::make_unique<DirectInputDeviceSource>(pDevice, caps);
+    }
+  }
+
+  std::string product_name;
+  {
+    DIPROPSTRING dipstr {};
+    dipstr.diph.dwSize = sizeof(DIPROPSTRING);
+    dipstr.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+    dipstr.diph.dwObj = 0;
+    dipstr.diph.dwHow = DIPH_DEVICE;
+
+    hr = pDevice->GetProperty(DIPROP_PRODUCTNAME, &dipstr.diph);
+    if (FAILED(hr)) {
+      pDevice->Release();
+      return nullptr;
+    }
+
+    product_name = ToMultiByte(dipstr.wsz);
+  }
+  timings.EndStage(OpenStage::kProductName, stage_start);
+
+  // Enumerate device objects (POVs, axes and buttons) using `IDirectInputDevice8::EnumObjects` to set properties.
+  struct InputInfo final {
+    std::vector<Input> povs;
+    std::vector<Input> buttons;
+    std::vector<Input> axes;
+    DWORD slider_count = 0;
+  } input_info;
+  {
+    struct Capture final {
+      IDirectInputDevice8* pDevice = nullptr;
+      InputInfo& input_info;
+    };
+
+    auto DIEnumDeviceObjectsCallback = [](LPCDIDEVICEOBJECTINSTANCE lpddoi, LPVOID pvRef) -> BOOL {
+      Capture const& capture = *static_cast<Capture const*>(pvRef);
+
+      if (lpddoi->dwType & DIDFT_POV) {
+        DWORD const index = static_cast<DWORD>(capture.input_info.povs.size());
+
+        capture.input_info.povs.push_back(Input{
+          .type = InputType::kPOV,
+          .index = index,
+          .offset = static_cast<DWORD>(DIJOFS_POV(index)),
+        });
+      }
+      else if (lpddoi->dwType & DIDFT_BUTTON) {
+        DWORD const index = static_cast<DWORD>(capture.input_info.buttons.size());
+
+        capture.input_info.buttons.push_back(Input{
+          .type = InputType::kButton,
+          .index = index,
+          .offset = static_cast<DWORD>(DIJOFS_BUTTON(index)),
+        });
+      }
+      else if (lpddoi->dwType & DIDFT_AXIS) {
+        DWORD const index = static_cast<DWORD>(capture.input_info.axes.size());
+
+        DWORD offset = 0;
+        if (lpddoi->guidType == GUID_XAxis) {
+          offset = DIJOFS_X;
+        }
+        else if (lpddoi->guidType == GUID_YAxis) {
+          offset = DIJOFS_Y;
+        }
+        else if (lpddoi->guidType == GUID_ZAxis) {
+          offset = DIJOFS_Z;
+        }
+        else if (lpddoi->guidType == GUID_RxAxis) {
+          offset = DIJOFS_RX;
+        }
+        else if (lpddoi->guidType == GUID_RyAxis) {
+          offset = DIJOFS_RY;
+        }
+        else if (lpddoi->guidType == GUID_RzAxis) {
+          offset = DIJOFS_RZ;
+        }
+        else if (lpddoi->guidType == GUID_Slider) {
+          DWORD const slider_index = capture.input_info.slider_count++;
+          offset = DIJOFS_SLIDER(slider_index);
+        }
+        else {
+          return DIENUM_CONTINUE;
+        }
+
+        capture.input_info.axes.push_back(Input{
+          .type = InputType::kAxis,
+          .index = index,
+          .offset = offset,
+        });
+
+        // Set the range for the axis.
+        {
+          DIPROPRANGE diprg {};
+          diprg.diph.dwSize = sizeof(DIPROPRANGE);
+          diprg.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+          diprg.diph.dwObj = lpddoi->dwType;
+          diprg.diph.dwHow = DIPH_BYID;
+          diprg.lMin = kAxisMin;
+          diprg.lMax = kAxisMax;
+
+          capture.pDevice->SetProperty(DIPROP_RANGE, &diprg.diph);
+        }
+
+        // Set the dead zone for the axis to 0.
+        {
+          DIPROPDWORD dipdw {};
+          dipdw.diph.dwSize = sizeof(DIPROPDWORD);
+          dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+          dipdw.diph.dwObj = lpddoi->dwType;
+          dipdw.diph.dwHow = DIPH_BYID;
+          dipdw.dwData = 0;
+
+          capture.pDevice->SetProperty(DIPROP_DEADZONE, &dipdw.diph);
+        }
+      }
+
+      return DIENUM_CONTINUE;
+    };
+
+    Capture capture {
+      .pDevice = pDevice,
+      .input_info = input_info,
+    };
+
+    // Enumerate POVs (hats), axes and buttons.
+    {
+      TRACE_ZONE("EnumObjects");
+      pDevice->EnumObjects(DIEnumDeviceObjectsCallback, &capture, DIDFT_POV | DIDFT_AXIS | DIDFT_BUTTON);
+    }
+
+    // Sort by the offset into `DIJOYSTATE2`, so we can index into `DIJOYSTATE2` using a consistent index.
+    std::sort(
+      input_info.povs.begin(), input_info.povs.end(),
+      [](Input const& lhs, Input const& rhs) {
+        return lhs.offset < rhs.offset;
+      }
+    );
+    std::sort(
+      input_info.buttons.begin(), input_info.buttons.end(),
+      [](Input const& lhs, Input const& rhs) {
+        return lhs.offset < rhs.offset;
+      }
+    );
+    std::sort(
+      input_info.axes.begin(), input_info.axes.end(),
+      [](Input const& lhs, Input const& rhs) {
+        return lhs.offset < rhs.offset;
+      }
+    );
+  }
+  timings.EndStage(OpenStage::kObjects, stage_start);
+
+  out_device.name = product_name;
+  out_device.caps = caps;
+  out_device.povs = std::move(input_info.povs);
+  out_device.buttons = std::move(input_info.buttons);
+  out_device.axes = std::move(input_info.axes);
+
+  if (layout_cache_ != nullptr && product_guid != GUID_NULL) {
+    layout_cache_->Store(product_guid, out_device);
+  }
+
+  return std::make_unique<DirectInputDeviceSource>(pDevice, caps);
+}
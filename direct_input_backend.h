@@ -0,0 +1,31 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <mutex>
+
+/// Enumerates and opens game controllers through `IDirectInput8`.
+class DirectInputBackend final : public DirectInputContext::Backend {
+public:
+  DirectInputBackend() = default;
+  ~DirectInputBackend() noexcept override = default;
+
+  DirectInputBackend(DirectInputBackend const&) = delete;
+  DirectInputBackend(DirectInputBackend&&) = delete;
+  DirectInputBackend& operator=(DirectInputBackend const&) = delete;
+  DirectInputBackend& operator=(DirectInputBackend&&) = delete;
+
+  bool Initialize(DirectInputContext::Config const& config) override;
+  void Shutdown() override;
+
+  void EnumerateDevices(std::vector<GUID>& out_guids) override;
+  std::unique_ptr<DirectInputContext::DeviceSource> OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) override;
+
+private:
+  DirectInputContext::Config config_ {};
+
+  /// Could be `IDirectInput8A` or `IDirectInput8W`.
+  IDirectInput8* pDI_ = nullptr;
+  /// `EnumerateDevices` and `OpenDevice` may run concurrently (see `Config::async_device_open`); only their calls on `pDI_` are serialized.
+  std::mutex pDI_mutex_;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+//
+// Pulls in the DirectInput headers on Windows.
+//
+// On other platforms, declares the small subset of Windows/DirectInput types the platform-independent parts of this
+// project are written against (`DIJOYSTATE2`, `DIDEVCAPS`, `DIDEVICEOBJECTDATA`, `DIJOFS_*`, ...),
+// so that they can be built and exercised with synthetic devices.
+// Layouts and values match `dinput.h`.
+//
+
+#if defined(_WIN32)
+
+#if !defined(NOMINMAX)
+# define NOMINMAX
+#endif
+
+#if !defined(DIRECTINPUT_VERSION)
+# define DIRECTINPUT_VERSION 0x0800
+#endif
+#include <initguid.h>
+#include <dinput.h>
+
+#else
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+using BYTE = uint8_t;
+using WORD = uint16_t;
+using DWORD = uint32_t;
+using LONG = int32_t;
+using HRESULT = int32_t;
+using UINT_PTR = uintptr_t;
+
+struct GUID {
+  uint32_t Data1;
+  uint16_t Data2;
+  uint16_t Data3;
+  uint8_t Data4[8];
+};
+
+inline bool operator==(GUID const& lhs, GUID const& rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(GUID)) == 0;
+}
+
+#define SUCCEEDED(hr) (static_cast<HRESULT>(hr) >= 0)
+#define FAILED(hr) (static_cast<HRESULT>(hr) < 0)
+
+#define S_OK static_cast<HRESULT>(0x00000000)
+#define S_FALSE static_cast<HRESULT>(0x00000001)
+#define E_FAIL static_cast<HRESULT>(0x80004005)
+
+#define DI_OK S_OK
+#define DI_BUFFEROVERFLOW S_FALSE
+#define DIERR_INPUTLOST static_cast<HRESULT>(0x8007001E)
+#define DIERR_NOTACQUIRED static_cast<HRESULT>(0x8007000C)
+#define DIERR_UNPLUGGED static_cast<HRESULT>(0x80040209)
+
+struct DIJOYSTATE2 {
+  LONG lX;
+  LONG lY;
+  LONG lZ;
+  LONG lRx;
+  LONG lRy;
+  LONG lRz;
+  LONG rglSlider[2];
+  DWORD rgdwPOV[4];
+  BYTE rgbButtons[128];
+  LONG lVX;
+  LONG lVY;
+  LONG lVZ;
+  LONG lVRx;
+  LONG lVRy;
+  LONG lVRz;
+  LONG rglVSlider[2];
+  LONG lAX;
+  LONG lAY;
+  LONG lAZ;
+  LONG lARx;
+  LONG lARy;
+  LONG lARz;
+  LONG rglASlider[2];
+  LONG lFX;
+  LONG lFY;
+  LONG lFZ;
+  LONG lFRx;
+  LONG lFRy;
+  LONG lFRz;
+  LONG rglFSlider[2];
+};
+
+struct DIDEVCAPS {
+  DWORD dwSize;
+  DWORD dwFlags;
+  DWORD dwDevType;
+  DWORD dwAxes;
+  DWORD dwButtons;
+  DWORD dwPOVs;
+  DWORD dwFFSamplePeriod;
+  DWORD dwFFMinTimeResolution;
+  DWORD dwFirmwareRevision;
+  DWORD dwHardwareRevision;
+  DWORD dwFFDriverVersion;
+};
+
+struct DIDEVICEOBJECTDATA {
+  DWORD dwOfs;
+  DWORD dwData;
+  DWORD dwTimeStamp;
+  DWORD dwSequence;
+  UINT_PTR uAppData;
+};
+
+#define DIJOFS_X offsetof(DIJOYSTATE2, lX)
+#define DIJOFS_Y offsetof(DIJOYSTATE2, lY)
+#define DIJOFS_Z offsetof(DIJOYSTATE2, lZ)
+#define DIJOFS_RX offsetof(DIJOYSTATE2, lRx)
+#define DIJOFS_RY offsetof(DIJOYSTATE2, lRy)
+#define DIJOFS_RZ offsetof(DIJOYSTATE2, lRz)
+#define DIJOFS_SLIDER(n) (offsetof(DIJOYSTATE2, rglSlider) + (n) * sizeof(LONG))
+#define DIJOFS_POV(n) (offsetof(DIJOYSTATE2, rgdwPOV) + (n) * sizeof(DWORD))
+#define DIJOFS_BUTTON(n) (offsetof(DIJOYSTATE2, rgbButtons) + (n))
+
+/// Only ever handled through pointers outside of the Windows-specific code.
+struct IDirectInput8;
+struct IDirectInputDevice8;
+
+#endif
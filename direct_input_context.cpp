@@ -1,425 +1,1047 @@
-//
-// Huge thanks to the following resources:
-// - SDL2's SDL joystick: https://github.com/libsdl-org/SDL/blob/release-2.24.x/src/joystick/windows/SDL_dinputjoystick.c
-//
-
 #include "direct_input_context.h"
+#include "device_layout_cache.h"
+#include "trace.h"
+
+#if defined(_WIN32)
+# include "direct_input_backend.h"
+# include <timeapi.h>
+# pragma comment(lib, "winmm.lib") // `timeBeginPeriod`.
+#elif defined(__linux__)
+# include "evdev_backend.h"
+#endif
 
 #include <iostream>
 #include <format>
 #include <algorithm>
-
-#pragma comment(lib, "dinput8.lib")
-#pragma comment(lib, "Rpcrt4.lib") // `UuidHash`.
-
-/// 0: Use `CoCreateInstance` to create `IDirectInput8`.
-/// 1: Use `DirectInput8Create` to create `IDirectInput8`.
-#if !defined(CONFIG_USE_DIRECTINPUT8CREATE)
-# define CONFIG_USE_DIRECTINPUT8CREATE (1)
-#endif
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 
 namespace {
 
-std::string ToMultiByteImpl(wchar_t const* str) {
-  int const size = WideCharToMultiByte(CP_UTF8, 0, str, -1, nullptr, 0, nullptr, nullptr);
-  if (size == 0) {
-    return "";
+bool GuidLess(GUID const& lhs, GUID const& rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(GUID)) < 0;
+}
+
+SharedDeviceInfo MakeSharedDeviceInfo(DirectInputContext::Device const& device) {
+  SharedDeviceInfo info {
+    .generation = device.handle.generation,
+    .pov_count = static_cast<uint32_t>(device.povs.size()),
+    .axis_count = static_cast<uint32_t>(device.axes.size()),
+    .button_count = static_cast<uint32_t>(device.buttons.size()),
+    .guid = device.guid,
+  };
+  for (size_t i = 0; i < device.axes.size() && i < std::size(info.axis_offsets); ++i) {
+    info.axis_offsets[i] = device.axes[i].offset;
   }
-  std::string result(size, '\0');
-  WideCharToMultiByte(CP_UTF8, 0, str, -1, result.data(), size, nullptr, nullptr);
-  return result;
+  device.name.copy(info.name, sizeof(info.name) - 1);
+  return info;
 }
 
-std::string ToMultiByte(TCHAR const* str) {
-#ifdef UNICODE
-  return ToMultiByteImpl(str);
-#else
-  return str;
-#endif
 }
 
-#if !defined(UNICODE)
-std::string ToMultiByte(wchar_t const* str) {
-  return ToMultiByteImpl(str);
+std::string DirectInputContext::Device::GetGuidString() const {
+  // Same format as `StringFromGUID2`.
+  GUID const& g = this->guid;
+  return std::format(
+    "{{{:08X}-{:04X}-{:04X}-{:02X}{:02X}-{:02X}{:02X}{:02X}{:02X}{:02X}{:02X}}}",
+    static_cast<uint32_t>(g.Data1), g.Data2, g.Data3,
+    g.Data4[0], g.Data4[1], g.Data4[2], g.Data4[3], g.Data4[4], g.Data4[5], g.Data4[6], g.Data4[7]
+  );
 }
-#endif
 
-// `IDirectInput8` could be `IDirectInput8A` or `IDirectInput8W`, depending on whether `UNICODE` is defined.
-IDirectInput8* CreateDirectInput8() {
-  // Could be `IID_IDirectInput8A` or `IID_IDirectInput8W`.
-  IID const& iid = IID_IDirectInput8;
+char const* DirectInputContext::Device::GetAxisName(DWORD index) const {
+  Input const& input = this->axes[index];
 
-  HMODULE hModule = GetModuleHandle(nullptr);
+  switch (input.offset) {
+  case DIJOFS_X: return "X";
+  case DIJOFS_Y: return "Y";
+  case DIJOFS_Z: return "Z";
+  case DIJOFS_RX: return "Rx";
+  case DIJOFS_RY: return "Ry";
+  case DIJOFS_RZ: return "Rz";
+  case DIJOFS_SLIDER(0): return "Slider 0";
+  case DIJOFS_SLIDER(1): return "Slider 1";
+  default: return "Unknown";
+  };
+}
 
-  IDirectInput8* pDI = NULL;
+template<typename T>
+T DirectInputContext::Device::LoadStateField(DWORD offset) const {
+  T value;
+  std::memcpy(&value, reinterpret_cast<BYTE const*>(&this->state) + offset, sizeof(T));
+  return value;
+}
 
-#if CONFIG_USE_DIRECTINPUT8CREATE
-  // Use `DirectInput8Create`.
+DIJOYSTATE2 DirectInputContext::Device::LoadState() const {
+  if (this->published_state != nullptr) {
+    DIJOYSTATE2 state;
+    this->packed_layout.Unpack(this->published_state->Load().state, state);
+    return state;
+  }
+  return this->state;
+}
 
-  HRESULT hr = DirectInput8Create(hModule, DIRECTINPUT_VERSION, iid, (void**)&pDI, nullptr);
-  if (FAILED(hr)) {
-    return nullptr;
+DirectInputContext::Sample DirectInputContext::Device::LoadSample() const {
+  if (this->published_state != nullptr) {
+    PackedSample const sample = this->published_state->Load();
+    Sample result { .times = sample.times };
+    this->packed_layout.Unpack(sample.state, result.state);
+    return result;
   }
-  
-  return pDI;
+  return Sample { .state = this->state, .times = this->times };
+}
 
-#else
-  // Use `CoCreateInstance`.
+DirectInputContext::PackedSample DirectInputContext::Device::LoadPackedSample() const {
+  if (this->published_state != nullptr) {
+    return this->published_state->Load();
+  }
+  PackedSample sample { .times = this->times };
+  this->packed_layout.Pack(this->state, sample.state);
+  return sample;
+}
 
-  HRESULT hr = CoInitialize(nullptr);
-  if (FAILED(hr)) {
-    return nullptr;
+DirectInputContext::SampleTimes DirectInputContext::Device::LoadSampleTimes() const {
+  if (this->published_state != nullptr) {
+    return this->published_state->Load().times;
   }
+  return this->times;
+}
 
-  hr = CoCreateInstance(CLSID_DirectInput8, nullptr, CLSCTX_INPROC_SERVER, iid, (void**)&pDI);
-  if (FAILED(hr)) {
-    return nullptr;
+// With the polling thread, each of these is one atomic load of the word of `PackedSample` the value is in.
+// `PackedSample::state` comes first, so its offsets are those of `packed_layout`.
+
+DWORD DirectInputContext::Device::GetPovValue(DWORD index) const {
+  if (this->published_state != nullptr) {
+    return PackedStateLayout::DecodePov(this->published_state->LoadField<uint16_t>(this->packed_layout.GetPovOffset(index)));
   }
 
-  hr = pDI->Initialize(hModule, DIRECTINPUT_VERSION);
-  if (FAILED(hr)) {
-    return nullptr;
+  Input const& input = this->povs[index];
+  return this->LoadStateField<DWORD>(input.offset);
+}
+
+LONG DirectInputContext::Device::GetAxisValue(DWORD index) const {
+  if (this->published_state != nullptr) {
+    return PackedStateLayout::DecodeAxis(this->published_state->LoadField<int16_t>(this->packed_layout.GetAxisOffset(index)));
   }
-#endif
 
-  return pDI;
+  Input const& input = this->axes[index];
+  // `offset` is the byte offset of one of the `LONG` axis fields of `DIJOYSTATE2`.
+  return this->LoadStateField<LONG>(input.offset);
 }
 
-void ReleaseDirectInput8(IDirectInput8* pDI) {
-  if (pDI != nullptr) {
-    pDI->Release();
+BYTE DirectInputContext::Device::GetButtonValue(DWORD index) const {
+  if (this->published_state != nullptr) {
+    return PackedStateLayout::DecodeButton(this->published_state->LoadField<uint8_t>(this->packed_layout.GetButtonOffset(index)), index);
   }
 
-#if !CONFIG_USE_DIRECTINPUT8CREATE
-  CoUninitialize();
-#endif
+  Input const& input = this->buttons[index];
+  return this->LoadStateField<BYTE>(input.offset);
 }
 
+DirectInputContext::Input const* DirectInputContext::Device::FindInput(DWORD offset) const {
+  std::vector<Input> const* inputs = nullptr;
+  if (offset >= DIJOFS_BUTTON(0) && offset < DIJOFS_BUTTON(128)) {
+    inputs = &this->buttons;
+  }
+  else if (offset >= DIJOFS_POV(0) && offset < DIJOFS_POV(4)) {
+    inputs = &this->povs;
+  }
+  else {
+    inputs = &this->axes;
+  }
+
+  // All three are sorted by `offset`.
+  auto it = std::lower_bound(
+    inputs->begin(), inputs->end(), offset,
+    [](Input const& input, DWORD offset) {
+      return input.offset < offset;
+    }
+  );
+  if (it == inputs->end() || it->offset != offset) {
+    return nullptr;
+  }
+  return &*it;
 }
 
-std::string DirectInputContext::Device::GetGuidString() const {
-  wchar_t guid_str[39] = { 0 };
-  ::StringFromGUID2(this->guid, guid_str, 39);
-  return ToMultiByte(guid_str);
+char const* DirectInputContext::GetOpenStageName(OpenStage stage) {
+  switch (stage) {
+  case OpenStage::kCreateDevice: return "CreateDevice";
+  case OpenStage::kCooperativeLevel: return "CooperativeLevel";
+  case OpenStage::kDataFormat: return "DataFormat";
+  case OpenStage::kCapabilities: return "Capabilities";
+  case OpenStage::kProductName: return "ProductName";
+  case OpenStage::kObjects: return "Objects";
+  case OpenStage::kCount: break;
+  }
+  return "Unknown";
 }
 
-char const* DirectInputContext::Device::GetAxisName(DWORD index) const {
-  Input const& input = this->axes[index];
+void DirectInputContext::OpenTimings::EndStage(OpenStage stage, uint64_t& inout_stage_start_ns) {
+  uint64_t const now = GetMonotonicTimeNs();
+  this->stage_ns[static_cast<size_t>(stage)] += now - inout_stage_start_ns;
+  inout_stage_start_ns = now;
+}
 
-  switch (input.offset) {
-  case DIJOFS_X: return "X";
-  case DIJOFS_Y: return "Y";
-  case DIJOFS_Z: return "Z";
-  case DIJOFS_RX: return "Rx";
-  case DIJOFS_RY: return "Ry";
-  case DIJOFS_RZ: return "Rz";
-  case DIJOFS_SLIDER(0): return "Slider 0";
-  case DIJOFS_SLIDER(1): return "Slider 1";
-  default: return "Unknown";
-  };
+DirectInputContext::Subscription::Subscription(SubscriptionFilter const& filter, size_t capacity)
+  : filter_(filter)
+  , queue_(capacity)
+{
 }
 
-DWORD DirectInputContext::Device::GetPovValue(DWORD index) const {
-  Input const& input = this->povs[index];
+// Here rather than in the header, where `DeviceLayoutCache` is incomplete.
+DirectInputContext::DirectInputContext() = default;
 
-  return this->state.rgdwPOV[(input.offset - DIJOFS_POV(0)) / sizeof(DWORD)];
+DirectInputContext::~DirectInputContext() noexcept {
+  this->Shutdown();
 }
 
-LONG DirectInputContext::Device::GetAxisValue(DWORD index) const {
-  Input const& input = this->axes[index];
-  
-  switch (input.offset) {
-  case DIJOFS_X: return this->state.lX;
-  case DIJOFS_Y: return this->state.lY;
-  case DIJOFS_Z: return this->state.lZ;
-  case DIJOFS_RX: return this->state.lRx;
-  case DIJOFS_RY: return this->state.lRy;
-  case DIJOFS_RZ: return this->state.lRz;
-  case DIJOFS_SLIDER(0): return this->state.rglSlider[0];
-  case DIJOFS_SLIDER(1): return this->state.rglSlider[1];
-  default: return 0;
-  }
+bool DirectInputContext::Initialize(Config const& config) {
+#if defined(_WIN32)
+  return this->Initialize(std::make_unique<DirectInputBackend>(), config);
+#elif defined(__linux__)
+  return this->Initialize(std::make_unique<EvdevBackend>(), config);
+#else
+  (void)config;
+  std::clog << "DirectInputContext: No default backend on this platform." << std::endl;
+  return false;
+#endif
 }
 
-BYTE DirectInputContext::Device::GetButtonValue(DWORD index) const {
-  Input const& input = this->buttons[index];
+bool DirectInputContext::Initialize(std::unique_ptr<Backend> backend, Config const& config) {
+  config_ = config;
 
-  return this->state.rgbButtons[(input.offset - DIJOFS_BUTTON(0)) / sizeof(BYTE)];
-}
+  if (!config_.shared_memory_name.empty() && !shared_state_.Create(config_.shared_memory_name, config_.shared_memory_device_capacity)) {
+    return false;
+  }
+
+  if (!config_.layout_cache_path.empty()) {
+    layout_cache_ = std::make_unique<DeviceLayoutCache>();
+    if (layout_cache_->Load(config_.layout_cache_path)) {
+      std::clog << std::format("Loaded {} device layouts from \"{}\".", layout_cache_->GetSize(), config_.layout_cache_path) << std::endl;
+    }
+    backend->SetLayoutCache(layout_cache_.get());
+  }
 
-bool DirectInputContext::Initialize() {
-  pDI_ = CreateDirectInput8();
-  if (pDI_ == nullptr) {
+  if (!backend->Initialize(config_)) {
+    shared_state_.Close();
+    layout_cache_.reset();
     return false;
   }
+  backend_ = std::move(backend);
 
+  if (config_.polling_worker_count > 0) {
+    polling_workers_ = std::make_unique<WorkerPool>(config_.polling_worker_count);
+  }
+
+  if (config_.async_device_open) {
+    open_thread_exit_ = false;
+    device_open_thread_ = std::thread(&DirectInputContext::DeviceOpenThreadMain, this);
+  }
+
+  this->NotifyDeviceChange();
   this->UpdateDetection();
 
-  std::cout << std::format("Found {} devices:", devices_.size()) << std::endl;
-  for (auto const& [ guid, device ] : devices_) {
-    wchar_t guid_str[39] = { 0 };
-    ::StringFromGUID2(guid, guid_str, 39);
+  if (!pending_devices_.empty()) {
+    std::clog << std::format("Opening {} devices in the background.", pending_devices_.size()) << std::endl;
+  }
+  std::clog << std::format("Found {} devices:", devices_.GetSize()) << std::endl;
+  for (Device const& device : devices_.GetValues()) {
+    std::clog << std::format(" \"{}\" ({})", device.name, device.GetGuidString()) << std::endl;
+    std::clog << std::format("  {} POVs (Hats)", device.caps.dwPOVs) << std::endl;
+    std::clog << std::format("  {} Axes", device.caps.dwAxes) << std::endl;
+    std::clog << std::format("  {} Buttons", device.caps.dwButtons) << std::endl;
+  }
 
-    std::cout << std::format(" \"{}\" ({})", device.name, ToMultiByte(guid_str)) << std::endl;
-    std::cout << std::format("  {} POVs (Hats)", device.caps.dwPOVs) << std::endl;
-    std::cout << std::format("  {} Axes", device.caps.dwAxes) << std::endl;
-    std::cout << std::format("  {} Buttons", device.caps.dwButtons) << std::endl;
+  if (config_.polling_rate_hz > 0) {
+    polling_thread_exit_.store(false, std::memory_order_relaxed);
+    polling_thread_ = std::thread(&DirectInputContext::PollingThreadMain, this);
   }
 
   return true;
 }
 
 void DirectInputContext::Shutdown() {
-  // Release `IDirectInputDevice8` for each device.
-  for (auto& [ guid, device ] : devices_) {
-    device.pDevice->Release();
+  if (polling_thread_.joinable()) {
+    polling_thread_exit_.store(true, std::memory_order_relaxed);
+    polling_thread_.join();
   }
-  devices_.clear();
 
-  ReleaseDirectInput8(pDI_);
-  pDI_ = nullptr;
-}
+  polling_workers_.reset();
 
-void DirectInputContext::UpdateDetection() {
-  std::vector<GUID> device_guids;
+  if (device_open_thread_.joinable()) {
+    {
+      std::lock_guard lock(open_mutex_);
+      open_thread_exit_ = true;
+    }
+    open_condition_.notify_one();
+    device_open_thread_.join();
+  }
+  open_requests_.clear();
+  opened_devices_.clear();
+  opened_devices_ready_.store(false, std::memory_order_relaxed);
+  pending_devices_.clear();
+  pending_request_ids_.clear();
+
+  // Release each `DeviceSource` before the backend that created them.
+  devices_.Clear();
+  device_index_.clear();
+  subscriptions_.clear();
+  axis_scratch_.clear();
+
+  shared_state_.Close();
+  shared_slot_generations_.clear();
+
+  if (backend_ != nullptr) {
+    backend_->Shutdown();
+    backend_.reset();
+  }
 
-  // Use `IDirectInput8::EnumDevices` to populate `device_names`.
-  {
-    auto DIEnumDevicesCallback = [](LPCDIDEVICEINSTANCE lpddi, LPVOID pvRef) -> BOOL {
-      std::vector<GUID>& device_guids = *static_cast<std::vector<GUID>*>(pvRef);
+  if (layout_cache_ != nullptr) {
+    if (layout_cache_->IsDirty()) {
+      layout_cache_->Save();
+    }
+    layout_cache_.reset();
+  }
+}
 
-      device_guids.emplace_back(lpddi->guidInstance);
+DirectInputContext::DeviceHandle DirectInputContext::FindDevice(GUID const& guid) const {
+  auto it = std::lower_bound(
+    device_index_.begin(), device_index_.end(), guid,
+    [](DeviceIndexEntry const& entry, GUID const& guid) {
+      return GuidLess(entry.guid, guid);
+    }
+  );
+  if (it == device_index_.end() || !(it->guid == guid)) {
+    return DeviceHandle {};
+  }
+  return it->handle;
+}
 
-      return DIENUM_CONTINUE;
-    };
+bool DirectInputContext::UpdateDetection() {
+  using Clock = std::chrono::steady_clock;
 
-    pDI_->EnumDevices(DI8DEVCLASS_GAMECTRL, DIEnumDevicesCallback, &device_guids, DIEDFL_ATTACHEDONLY);
+  ++detection_stats_.update_count;
+
+  Clock::time_point const now = Clock::now();
+  bool const requested = detection_requested_.exchange(false, std::memory_order_acquire);
+  bool const fallback_due =
+    config_.detection_fallback_interval_ms > 0 &&
+    now - last_enumeration_time_ >= std::chrono::milliseconds(config_.detection_fallback_interval_ms);
+  bool const enumerate = requested || fallback_due;
+  bool const opened = opened_devices_ready_.load(std::memory_order_acquire);
+  if (!enumerate && !opened) {
+    return false;
   }
 
-  // Remove devices that are no longer present.
-  {
-    auto it = std::erase_if(
-      devices_,
-      [&device_guids](std::pair<GUID, Device> const& kvp) {
-        GUID const& guid = kvp.first;
+  TRACE_ZONE("UpdateDetection");
+
+  device_changes_.added.clear();
+  device_changes_.removed.clear();
 
-        return std::find(device_guids.begin(), device_guids.end(), guid) == device_guids.end();
+  std::vector<DeviceIndexEntry> removed;
+  std::vector<GUID> found;
+  if (enumerate) {
+    last_enumeration_time_ = now;
+    ++detection_stats_.enumeration_count;
+    if (!requested) {
+      ++detection_stats_.fallback_enumeration_count;
+    }
+
+    enumerated_guids_.clear();
+    {
+      TRACE_ZONE("EnumerateDevices");
+      backend_->EnumerateDevices(enumerated_guids_);
+    }
+
+    // Sort, so that it can be merged against `device_index_`.
+    std::sort(enumerated_guids_.begin(), enumerated_guids_.end(), GuidLess);
+
+    // Both lists are sorted by GUID, so a single merge pass tells which devices were removed and which were found.
+    auto existing_it = device_index_.begin();
+    for (GUID const& guid : enumerated_guids_) {
+      while (existing_it != device_index_.end() && GuidLess(existing_it->guid, guid)) {
+        removed.push_back(*existing_it++);
       }
-    );
+      if (existing_it != device_index_.end() && existing_it->guid == guid) {
+        ++existing_it;
+        continue;
+      }
+      found.push_back(guid);
+    }
+    removed.insert(removed.end(), existing_it, device_index_.end());
+
+    if (device_open_thread_.joinable()) {
+      // Forget the pending devices that are gone, and don't ask for the others again.
+      std::lock_guard lock(open_mutex_);
+      for (size_t i = pending_devices_.size(); i-- > 0;) {
+        if (std::binary_search(enumerated_guids_.begin(), enumerated_guids_.end(), pending_devices_[i].guid, GuidLess)) {
+          std::erase(found, pending_devices_[i].guid);
+          continue;
+        }
+        uint64_t const id = pending_request_ids_[i];
+        std::erase_if(open_requests_, [id](OpenRequest const& request) { return request.id == id; });
+        pending_devices_.erase(pending_devices_.begin() + i);
+        pending_request_ids_.erase(pending_request_ids_.begin() + i);
+      }
+    }
   }
 
-  for (GUID const& device_guid : device_guids) {
-    if (devices_.find(device_guid) != devices_.end()) {
-      continue;
-    }
+  // Remove devices that are no longer present.
+  if (!removed.empty()) {
+    std::lock_guard lock(devices_mutex_);
 
-    IDirectInputDevice8* pDevice = nullptr;
-    HRESULT hr = pDI_->CreateDevice(device_guid, &pDevice, nullptr);
-    if (FAILED(hr)) {
-      std::cout << "IDirectInput8::CreateDevice failed." << std::endl;
-      continue;
+    for (DeviceIndexEntry const& entry : removed) {
+      devices_.Erase(entry.handle);
+      device_changes_.removed.push_back(entry.guid);
     }
+  }
 
-    std::string product_name;
+  auto InsertDevice = [this](Device&& device) {
+    GUID const guid = device.guid;
     {
-      DIPROPSTRING dipstr {};
-      dipstr.diph.dwSize = sizeof(DIPROPSTRING);
-      dipstr.diph.dwHeaderSize = sizeof(DIPROPHEADER);
-      dipstr.diph.dwObj = 0;
-      dipstr.diph.dwHow = DIPH_DEVICE;
-
-      hr = pDevice->GetProperty(DIPROP_PRODUCTNAME, &dipstr.diph);
-      if (FAILED(hr)) {
-        pDevice->Release();
-        continue;
+      std::lock_guard lock(devices_mutex_);
+      DeviceHandle const handle = devices_.Insert(std::move(device));
+      Device& inserted = *devices_.Get(handle);
+      inserted.handle = handle;
+      for (std::unique_ptr<Subscription> const& subscription : subscriptions_) {
+        this->BindSubscription(inserted, *subscription);
       }
+    }
+    device_changes_.added.push_back(guid);
+  };
 
-      product_name = ToMultiByte(dipstr.wsz);
+  // Open new devices, or have the opening thread do it. The ones that fail to open are not reported as added, and are retried on the next enumeration.
+  uint64_t const requested_ns = GetMonotonicTimeNs();
+  for (GUID const& device_guid : found) {
+    Device device {};
+    device.guid = device_guid;
+    if (config_.buffered_input) {
+      device.events = InputEventRing(config_.event_ring_capacity);
     }
+    device.open_timings.requested_ns = requested_ns;
 
-    // Acquire shared access to the device (exclusive access would be required for FFB).
-    hr = pDevice->SetCooperativeLevel(nullptr, DISCL_NONEXCLUSIVE | DISCL_BACKGROUND);
-    if (FAILED(hr)) {
-      pDevice->Release();
+    if (device_open_thread_.joinable()) {
+      uint64_t const id = next_open_request_id_++;
+      pending_devices_.push_back(PendingDevice { .guid = device_guid, .requested_ns = requested_ns });
+      pending_request_ids_.push_back(id);
+
+      std::lock_guard lock(open_mutex_);
+      open_requests_.push_back(OpenRequest { .id = id, .device = std::move(device) });
       continue;
     }
 
-    // Extended joystick state format.
-    hr = pDevice->SetDataFormat(&c_dfDIJoystick2);
-    if (FAILED(hr)) {
-      pDevice->Release();
+    if (!this->OpenDevice(device)) {
+      ++detection_stats_.open_failure_count;
       continue;
     }
+    InsertDevice(std::move(device));
+  }
+  if (device_open_thread_.joinable() && !found.empty()) {
+    open_condition_.notify_one();
+  }
 
-    // Get capabilities using `IDirectInputDevice8::GetCapabilities`.
-    DIDEVCAPS caps {};
+  // Add what the opening thread has finished with.
+  if (opened) {
+    std::vector<OpenRequest> results;
     {
-      caps.dwSize = sizeof(DIDEVCAPS);
+      std::lock_guard lock(open_mutex_);
+      results.swap(opened_devices_);
+      opened_devices_ready_.store(false, std::memory_order_relaxed);
+    }
 
-      hr = pDevice->GetCapabilities(&caps);
-      if (FAILED(hr)) {
-        pDevice->Release();
+    for (OpenRequest& result : results) {
+      auto it = std::find(pending_request_ids_.begin(), pending_request_ids_.end(), result.id);
+      if (it == pending_request_ids_.end()) {
+        // Unplugged while it was being opened.
         continue;
       }
+      pending_devices_.erase(pending_devices_.begin() + (it - pending_request_ids_.begin()));
+      pending_request_ids_.erase(it);
+
+      if (result.device.source == nullptr) {
+        ++detection_stats_.open_failure_count;
+        continue;
+      }
+      InsertDevice(std::move(result.device));
     }
+  }
 
-    // Enumerate device objects (POVs, axes and buttons) using `IDirectInputDevice8::EnumObjects` to set properties.
-    struct InputInfo final {
-      std::vector<Input> povs;
-      std::vector<Input> buttons;
-      std::vector<Input> axes;
-      DWORD slider_count = 0;
-    } input_info;
-    {
-      struct Capture final {
-        IDirectInputDevice8* pDevice = nullptr;
-        InputInfo& input_info;
-      };
-
-      auto DIEnumDeviceObjectsCallback = [](LPCDIDEVICEOBJECTINSTANCE lpddoi, LPVOID pvRef) -> BOOL {
-        Capture const& capture = *static_cast<Capture const*>(pvRef);
-
-        if (lpddoi->dwType & DIDFT_POV) {
-          DWORD const index = static_cast<DWORD>(capture.input_info.povs.size());
-
-          capture.input_info.povs.push_back(Input{
-            .type = InputType::kPOV,
-            .index = index,
-            .offset = static_cast<DWORD>(DIJOFS_POV(index)),
-          });
-        }
-        else if (lpddoi->dwType & DIDFT_BUTTON) {
-          DWORD const index = static_cast<DWORD>(capture.input_info.buttons.size());
-
-          capture.input_info.buttons.push_back(Input{
-            .type = InputType::kButton,
-            .index = index,
-            .offset = static_cast<DWORD>(DIJOFS_BUTTON(index)),
-          });
-        }
-        else if (lpddoi->dwType & DIDFT_AXIS) {
-          DWORD const index = static_cast<DWORD>(capture.input_info.axes.size());
+  // Rebuild the index and axis layout, only if something changed.
+  if (!removed.empty() || !device_changes_.added.empty()) {
+    this->UpdateAxisLayout();
+    input_wait_set_dirty_ = true;
 
-          DWORD offset = 0;
-          if (lpddoi->guidType == GUID_XAxis) {
-            offset = DIJOFS_X;
-          }
-          else if (lpddoi->guidType == GUID_YAxis) {
-            offset = DIJOFS_Y;
-          }
-          else if (lpddoi->guidType == GUID_ZAxis) {
-            offset = DIJOFS_Z;
-          }
-          else if (lpddoi->guidType == GUID_RxAxis) {
-            offset = DIJOFS_RX;
-          }
-          else if (lpddoi->guidType == GUID_RyAxis) {
-            offset = DIJOFS_RY;
-          }
-          else if (lpddoi->guidType == GUID_RzAxis) {
-            offset = DIJOFS_RZ;
-          }
-          else if (lpddoi->guidType == GUID_Slider) {
-            DWORD const slider_index = capture.input_info.slider_count++;
-            offset = DIJOFS_SLIDER(slider_index);
-          }
-          else {
-            return DIENUM_CONTINUE;
-          }
+    device_index_.clear();
+    device_index_.reserve(devices_.GetSize());
+    for (Device const& device : devices_.GetValues()) {
+      device_index_.push_back(DeviceIndexEntry { .guid = device.guid, .handle = device.handle });
+    }
+    std::sort(
+      device_index_.begin(), device_index_.end(),
+      [](DeviceIndexEntry const& lhs, DeviceIndexEntry const& rhs) {
+        return GuidLess(lhs.guid, rhs.guid);
+      }
+    );
 
-          capture.input_info.axes.push_back(Input{
-            .type = InputType::kAxis,
-            .index = index,
-            .offset = offset,
-          });
-
-          // Set the range for the axis.
-          {
-            DIPROPRANGE diprg {};
-            diprg.diph.dwSize = sizeof(DIPROPRANGE);
-            diprg.diph.dwHeaderSize = sizeof(DIPROPHEADER);
-            diprg.diph.dwObj = lpddoi->dwType;
-            diprg.diph.dwHow = DIPH_BYID;
-            diprg.lMin = kAxisMin;
-            diprg.lMax = kAxisMax;
-
-            capture.pDevice->SetProperty(DIPROP_RANGE, &diprg.diph);
-          }
+    if (shared_state_.IsOpen()) {
+      this->PublishSharedLayout();
+    }
+  }
 
-          // Set the dead zone for the axis to 0.
-          {
-            DIPROPDWORD dipdw {};
-            dipdw.diph.dwSize = sizeof(DIPROPDWORD);
-            dipdw.diph.dwHeaderSize = sizeof(DIPROPHEADER);
-            dipdw.diph.dwObj = lpddoi->dwType;
-            dipdw.diph.dwHow = DIPH_BYID;
-            dipdw.dwData = 0;
+  detection_stats_.added_count += device_changes_.added.size();
+  detection_stats_.removed_count += device_changes_.removed.size();
 
-            capture.pDevice->SetProperty(DIPROP_DEADZONE, &dipdw.diph);
-          }
-        }
+  return true;
+}
 
-        return DIENUM_CONTINUE;
-      };
+bool DirectInputContext::OpenDevice(Device& device) const {
+  TRACE_ZONE("OpenDevice");
+  device.open_timings.start_ns = GetMonotonicTimeNs();
+  device.source = backend_->OpenDevice(device.guid, device);
+  device.open_timings.end_ns = GetMonotonicTimeNs();
+  if (device.source == nullptr) {
+    return false;
+  }
 
-      Capture capture {
-        .pDevice = pDevice,
-        .input_info = input_info,
-      };
+  std::vector<DWORD> axis_offsets;
+  axis_offsets.reserve(device.axes.size());
+  device.axis_gather.reserve(device.axes.size());
+  for (Input const& input : device.axes) {
+    axis_offsets.push_back(input.offset);
+    device.axis_gather.push_back(ToAxisGatherIndex(input.offset));
+  }
+  device.packed_layout = PackedStateLayout(axis_offsets, static_cast<DWORD>(device.povs.size()), static_cast<DWORD>(device.buttons.size()));
 
-      // Enumerate POVs (hats), axes and buttons.
-      pDevice->EnumObjects(DIEnumDeviceObjectsCallback, &capture, DIDFT_POV | DIDFT_AXIS | DIDFT_BUTTON);
+  if (config_.input_history_capacity > 0) {
+    device.history = InputHistory(device.packed_layout, config_.input_history_capacity, uint64_t(config_.input_history_retention_ms) * 1'000'000);
+  }
+  if (config_.polling_rate_hz > 0) {
+    PackedSample sample {};
+    device.packed_layout.Pack(device.state, sample.state);
+    device.published_state = std::make_unique<SeqLock<PackedSample>>(sample);
+  }
+  device.latency = std::make_unique<LatencyStats>();
+  return true;
+}
 
-      // Sort by the offset into `DIJOYSTATE2`, so we can index into `DIJOYSTATE2` using a consistent index.
-      std::sort(
-        input_info.povs.begin(), input_info.povs.end(),
-        [](Input const& lhs, Input const& rhs) {
-          return lhs.offset < rhs.offset;
-        }
-      );
-      std::sort(
-        input_info.buttons.begin(), input_info.buttons.end(),
-        [](Input const& lhs, Input const& rhs) {
-          return lhs.offset < rhs.offset;
-        }
-      );
-      std::sort(
-        input_info.axes.begin(), input_info.axes.end(),
-        [](Input const& lhs, Input const& rhs) {
-          return lhs.offset < rhs.offset;
+void DirectInputContext::DeviceOpenThreadMain() {
+  TRACE_THREAD_NAME("Device Open");
+
+  std::unique_lock lock(open_mutex_);
+  while (true) {
+    open_condition_.wait(lock, [this]() {
+      return open_thread_exit_ || !open_requests_.empty();
+    });
+    if (open_thread_exit_) {
+      return;
+    }
+
+    OpenRequest request = std::move(open_requests_.front());
+    open_requests_.erase(open_requests_.begin());
+
+    lock.unlock();
+    this->OpenDevice(request.device);
+    lock.lock();
+
+    opened_devices_.push_back(std::move(request));
+    opened_devices_ready_.store(true, std::memory_order_release);
+    // Have `WaitForInput` return, so that `UpdateDetection` adds the device.
+    input_wait_set_.Wake();
+  }
+}
+
+void DirectInputContext::PublishSharedLayout() {
+  uint32_t const capacity = shared_state_.GetDeviceCapacity();
+  shared_slot_generations_.resize(capacity);
+
+  std::vector<Device const*> slot_devices(capacity);
+  for (Device const& device : devices_.GetValues()) {
+    if (device.handle.index < capacity) {
+      slot_devices[device.handle.index] = &device;
+    }
+    else {
+      std::clog << std::format("DirectInputContext: \"{}\" does not fit in the shared-memory region ({} slots) and is not published.", device.name, capacity) << std::endl;
+    }
+  }
+
+  for (uint32_t slot = 0; slot < capacity; ++slot) {
+    Device const* const device = slot_devices[slot];
+    uint32_t const generation = (device != nullptr) ? device->handle.generation : 0;
+    if (generation == shared_slot_generations_[slot]) {
+      continue;
+    }
+
+    if (device != nullptr) {
+      shared_state_.SetDeviceInfo(slot, MakeSharedDeviceInfo(*device));
+    }
+    else {
+      shared_state_.ClearDevice(slot);
+    }
+    shared_slot_generations_[slot] = generation;
+  }
+}
+
+void DirectInputContext::UpdateAxisLayout() {
+  // Erasing from `devices_` moves devices around, so every `axis_base` has to be reassigned.
+  uint32_t axis_count = 0;
+  for (Device& device : devices_.GetValues()) {
+    device.axis_base = axis_count;
+    axis_count += static_cast<uint32_t>(device.axis_gather.size());
+  }
+  axis_scratch_.resize(axis_count);
+  axis_pipeline_dirty_ = true;
+}
+
+void DirectInputContext::GatherAllAxes() const {
+  LONG* out = axis_scratch_.data();
+  for (Device const& device : devices_.GetValues()) {
+    if (device.published_state != nullptr) {
+      device.packed_layout.UnpackAxes(device.published_state->Load().state, out + device.axis_base);
+    }
+    else {
+      GatherAxes(device.state, device.axis_gather, out + device.axis_base);
+    }
+  }
+}
+
+void DirectInputContext::ExtractAxes(std::span<int16_t> out_values) const {
+  this->GatherAllAxes();
+  NarrowAxes(axis_scratch_, out_values);
+}
+
+void DirectInputContext::ExtractAxes(std::span<float> out_values, AxisNormalization normalization) const {
+  this->GatherAllAxes();
+  NormalizeAxes(axis_scratch_, out_values, kAxisMin, kAxisMax, normalization);
+}
+
+void DirectInputContext::SetAxisProcessing(GUID const& guid, DWORD axis_index, AxisProcessing const& processing) {
+  auto it = std::find_if(
+    axis_processing_.begin(), axis_processing_.end(),
+    [&](AxisProcessingEntry const& entry) {
+      return entry.guid == guid && entry.axis_index == axis_index;
+    }
+  );
+  if (it != axis_processing_.end()) {
+    it->processing = processing;
+  }
+  else {
+    axis_processing_.push_back(AxisProcessingEntry { .guid = guid, .axis_index = axis_index, .processing = processing });
+  }
+  axis_pipeline_dirty_ = true;
+}
+
+void DirectInputContext::ClearAxisProcessing() {
+  axis_processing_.clear();
+  axis_pipeline_dirty_ = true;
+}
+
+void DirectInputContext::ExtractProcessedAxes(std::span<float> out_values) {
+  if (axis_pipeline_dirty_) {
+    this->CompileAxisPipeline();
+  }
+
+  uint64_t const now = GetMonotonicTimeNs();
+  float const dt_seconds = (last_axis_processing_ns_ != 0) ? static_cast<float>(now - last_axis_processing_ns_) * 1e-9f : 0.0f;
+  last_axis_processing_ns_ = now;
+
+  this->GatherAllAxes();
+  axis_pipeline_.Process(axis_scratch_, out_values, dt_seconds);
+}
+
+void DirectInputContext::CompileAxisPipeline() {
+  std::vector<AxisProcessing> axes;
+  std::vector<uint64_t> keys;
+  axes.reserve(axis_scratch_.size());
+  keys.reserve(axis_scratch_.size());
+
+  for (Device const& device : devices_.GetValues()) {
+    for (DWORD i = 0; i < device.axis_gather.size(); ++i) {
+      auto it = std::find_if(
+        axis_processing_.begin(), axis_processing_.end(),
+        [&](AxisProcessingEntry const& entry) {
+          return entry.guid == device.guid && entry.axis_index == i;
         }
       );
+      axes.push_back((it != axis_processing_.end()) ? it->processing : AxisProcessing {});
+      // Unique per connection of the device, so that the filters start over when it is reconnected.
+      keys.push_back((uint64_t(device.handle.generation) << 32) | (uint64_t(device.handle.index) << 8) | i);
     }
-
-    devices_[device_guid] = Device {
-      .guid = device_guid,
-      .name = product_name,
-      .pDevice = pDevice,
-      .caps = caps,
-      .povs = std::move(input_info.povs),
-      .buttons = std::move(input_info.buttons),
-      .axes = std::move(input_info.axes),
-    };
   }
+
+  axis_pipeline_.Compile(axes, keys, kAxisMin, kAxisMax);
+  axis_pipeline_dirty_ = false;
 }
 
 void DirectInputContext::UpdateState() {
-  for (auto& [ guid, device ] : devices_) {
-    HRESULT hr = device.pDevice->Poll();
-    if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
-      device.pDevice->Acquire();
-      hr = device.pDevice->Poll();
-      if (FAILED(hr)) {
-        continue;
+  if (backend_ == nullptr) {
+    return;
+  }
+
+  if (polling_thread_.joinable()) {
+    // The polling thread does the polling; just measure how stale its latest samples are by now.
+    constexpr size_t kPollEndOffset = offsetof(PackedSample, times) + offsetof(SampleTimes, poll_end_ns);
+    uint64_t const now = GetMonotonicTimeNs();
+    for (Device const& device : devices_.GetValues()) {
+      uint64_t const poll_end = device.published_state->LoadField<uint64_t>(kPollEndOffset);
+      if (poll_end != 0 && now >= poll_end) {
+        device.latency->sample_age.Record(now - poll_end, now);
       }
     }
+    return;
+  }
+
+  this->PollDevices();
+}
+
+std::span<DirectInputContext::DeviceHandle const> DirectInputContext::WaitForInput(std::chrono::nanoseconds timeout) {
+  changed_devices_.clear();
+  if (backend_ == nullptr || polling_thread_.joinable()) {
+    return changed_devices_;
+  }
+
+  if (input_wait_set_dirty_) {
+    notification_handles_.clear();
+    input_wait_needs_polling_ = false;
+    for (Device& device : devices_.GetValues()) {
+      InputNotificationHandle const handle = device.source->GetNotificationHandle();
+      notification_handles_.push_back(handle);
+      input_wait_needs_polling_ = input_wait_needs_polling_ || handle == kNoInputNotification;
+    }
+    // Devices left out of the set, past what can be waited on, are polled like those that cannot notify.
+    if (!input_wait_set_.SetHandles(notification_handles_)) {
+      input_wait_needs_polling_ = true;
+    }
+    input_wait_set_dirty_ = false;
+  }
+
+  // Poll first, as input may have arrived since the previous call, and again after every wait: a notification only says that something
+  // may have changed, and devices that cannot notify are only ever found changed by polling them.
+  uint64_t const start = GetMonotonicTimeNs();
+  uint64_t const deadline = start + static_cast<uint64_t>(std::max<int64_t>(timeout.count(), 0));
+  std::chrono::nanoseconds const poll_interval = std::chrono::milliseconds(config_.wait_poll_interval_ms);
+  while (true) {
+    this->PollDevices();
+    for (Device const& device : devices_.GetValues()) {
+      if (device.times.last_change_ns >= start) {
+        changed_devices_.push_back(device.handle);
+      }
+    }
+    if (!changed_devices_.empty()) {
+      break;
+    }
+
+    uint64_t const now = GetMonotonicTimeNs();
+    if (now >= deadline || input_wait_interrupted_.load(std::memory_order_acquire) ||
+        detection_requested_.load(std::memory_order_acquire) || opened_devices_ready_.load(std::memory_order_acquire)) {
+      break;
+    }
+
+    std::chrono::nanoseconds wait(deadline - now);
+    if (input_wait_needs_polling_) {
+      wait = std::min(wait, poll_interval);
+    }
+    // Woken up, this goes around once more to find out why.
+    input_wait_set_.Wait(wait);
+  }
+
+  input_wait_interrupted_.store(false, std::memory_order_relaxed);
+  return changed_devices_;
+}
+
+DirectInputContext::Subscription* DirectInputContext::Subscribe(SubscriptionFilter const& filter, size_t queue_capacity) {
+  auto subscription = std::make_unique<Subscription>(filter, queue_capacity);
+
+  std::lock_guard lock(devices_mutex_);
+  for (Device& device : devices_.GetValues()) {
+    this->BindSubscription(device, *subscription);
+  }
+  subscriptions_.push_back(std::move(subscription));
+  return subscriptions_.back().get();
+}
+
+void DirectInputContext::Unsubscribe(Subscription* subscription) {
+  std::lock_guard lock(devices_mutex_);
+  for (Device& device : devices_.GetValues()) {
+    std::erase_if(device.subscriptions, [subscription](SubscriptionBinding const& binding) { return binding.subscription == subscription; });
+  }
+  std::erase_if(subscriptions_, [subscription](std::unique_ptr<Subscription> const& entry) { return entry.get() == subscription; });
+}
 
-    DIJOYSTATE2 state {};
-    hr = device.pDevice->GetDeviceState(sizeof(DIJOYSTATE2), &state);
+void DirectInputContext::PollDevices() {
+  TRACE_ZONE("PollDevices");
+  {
+    TRACE_ZONE("BeginPoll");
+    backend_->BeginPoll();
+  }
+
+  std::span<Device> const devices = devices_.GetValues();
+  uint64_t poll_end = 0;
+
+  if (polling_workers_ != nullptr && devices.size() > 1) {
+    // Each device is timed on its own, as they are polled concurrently.
+    polling_workers_->ParallelFor(devices.size(), [this, devices](size_t index) {
+      Device& device = devices[index];
+      uint64_t const poll_start = GetMonotonicTimeNs();
+      bool changed = false;
+      bool const updated = this->PollDevice(device, changed);
+      this->FinishPoll(device, updated, changed, poll_start, GetMonotonicTimeNs());
+    });
+    poll_end = GetMonotonicTimeNs();
+  }
+  else {
+    // One clock read per device: each poll starts when the previous one ended (including its bookkeeping).
+    uint64_t poll_start = GetMonotonicTimeNs();
+    for (Device& device : devices) {
+      bool changed = false;
+      bool const updated = this->PollDevice(device, changed);
+      poll_end = GetMonotonicTimeNs();
+      this->FinishPoll(device, updated, changed, poll_start, poll_end);
+      poll_start = poll_end;
+    }
+    poll_end = poll_start;
+  }
+
+  if (!subscriptions_.empty()) {
+    TRACE_ZONE("PublishChanges");
+    this->PublishChanges();
+  }
+
+  if (shared_state_.IsOpen()) {
+    shared_state_.SetHeartbeat(poll_end);
+  }
+}
+
+void DirectInputContext::FinishPoll(Device& device, bool updated, bool changed, uint64_t poll_start, uint64_t poll_end) {
+  uint64_t const previous_poll_end = device.times.poll_end_ns;
+  device.times.poll_start_ns = poll_start;
+  device.times.poll_end_ns = poll_end;
+  if (changed) {
+    device.times.last_change_ns = poll_end;
+  }
+  device.latency->poll_duration.Record(poll_end - poll_start, poll_end);
+
+  ButtonBits const down = PackButtons(device.state.rgbButtons);
+  bool const record_history = device.history.GetCapacity() > 0 && (changed || device.history.GetSize() == 0);
+  if (updated && (device.published_state != nullptr || record_history)) {
+    PackedSample sample { .times = device.times };
+    device.packed_layout.Pack(device.state, down, sample.state);
+    if (device.published_state != nullptr) {
+      device.published_state->Store(sample);
+    }
+    if (record_history) {
+      device.history.Record(poll_end, (previous_poll_end != 0) ? previous_poll_end : poll_end, sample.state);
+    }
+  }
+  if (updated && shared_state_.IsOpen() && device.handle.index < shared_state_.GetDeviceCapacity()) {
+    shared_state_.SetDeviceState(device.handle.index, SharedDeviceState {
+      .generation = device.handle.generation,
+      .poll_end_ns = device.times.poll_end_ns,
+      .last_change_ns = device.times.last_change_ns,
+      .state = device.state,
+    });
+  }
+
+  // If the poll failed, `state` did not change, and so no button did either.
+  device.button_edges = ComputeButtonEdges(device.button_edges.down, down);
+}
+
+void DirectInputContext::BindSubscription(Device& device, Subscription& subscription) {
+  SubscriptionFilter const& filter = subscription.filter_;
+  bool const matches = (filter.device != DeviceHandle {}) ? filter.device == device.handle : (filter.guid == GUID {} || filter.guid == device.guid);
+  if (!matches) {
+    return;
+  }
+
+  // Until now nothing compared against `reported_state`, so it may be stale.
+  if (device.subscriptions.empty()) {
+    device.packed_layout.Pack(device.state, device.button_edges.down, device.reported_state);
+  }
+  SubscriptionBinding binding { .subscription = &subscription };
+  device.packed_layout.UnpackAxes(device.reported_state, binding.reported_axes.data());
+  device.subscriptions.push_back(binding);
+}
+
+void DirectInputContext::PublishChanges() {
+  for (Device& device : devices_.GetValues()) {
+    // `reported_state` is as of the previous poll, so a device that this poll did not find changed has nothing to report.
+    if (device.subscriptions.empty() || device.times.last_change_ns != device.times.poll_end_ns) {
+      continue;
+    }
+
+    PackedState state;
+    PackedStateLayout const& layout = device.packed_layout;
+    layout.Pack(device.state, device.button_edges.down, state);
+    if (std::memcmp(&state, &device.reported_state, sizeof(PackedState)) == 0) {
+      continue;
+    }
+
+    // Find what changed once, for every subscription.
+    input_changes_.clear();
+    auto Push = [this, &device](InputType type, DWORD index, LONG value) {
+      input_changes_.push_back(InputChange { .device = device.handle, .type = type, .index = index, .value = value, .time_ns = device.times.poll_end_ns });
+    };
+    for (DWORD i = 0; i < layout.GetAxisCount(); ++i) {
+      int16_t before, after;
+      std::memcpy(&before, device.reported_state.bytes + layout.GetAxisOffset(i), sizeof(int16_t));
+      std::memcpy(&after, state.bytes + layout.GetAxisOffset(i), sizeof(int16_t));
+      if (before != after) {
+        Push(InputType::kAxis, i, PackedStateLayout::DecodeAxis(after));
+      }
+    }
+    for (DWORD i = 0; i < layout.GetPovCount(); ++i) {
+      uint16_t before, after;
+      std::memcpy(&before, device.reported_state.bytes + layout.GetPovOffset(i), sizeof(uint16_t));
+      std::memcpy(&after, state.bytes + layout.GetPovOffset(i), sizeof(uint16_t));
+      if (before != after) {
+        Push(InputType::kPOV, i, static_cast<LONG>(PackedStateLayout::DecodePov(after)));
+      }
+    }
+    for (DWORD i = 0; i < layout.GetButtonCount(); i += 8) {
+      uint32_t const offset = layout.GetButtonOffset(i);
+      for (uint32_t bits = device.reported_state.bytes[offset] ^ state.bytes[offset]; bits != 0; bits &= bits - 1) {
+        DWORD const index = i + static_cast<DWORD>(std::countr_zero(bits));
+        Push(InputType::kButton, index, PackedStateLayout::DecodeButton(state.bytes[offset], index));
+      }
+    }
+    device.reported_state = state;
+
+    for (SubscriptionBinding& binding : device.subscriptions) {
+      Subscription& subscription = *binding.subscription;
+      SubscriptionFilter const& filter = subscription.filter_;
+      bool const had_pending = !subscription.pending_.empty();
+      for (InputChange const& change : input_changes_) {
+        if ((filter.input_types & (1u << static_cast<uint32_t>(change.type))) == 0 || !filter.indices.Test(change.index)) {
+          continue;
+        }
+        if (change.type == InputType::kAxis) {
+          LONG& reported = binding.reported_axes[change.index];
+          if (std::abs(change.value - reported) < filter.axis_threshold) {
+            continue;
+          }
+          reported = change.value;
+        }
+        subscription.pending_.push_back(change);
+      }
+      if (!had_pending && !subscription.pending_.empty()) {
+        notified_subscriptions_.push_back(&subscription);
+      }
+    }
+  }
+
+  // One batch per subscription, so that each one's consumer sees the poll's changes all at once.
+  for (Subscription* subscription : notified_subscriptions_) {
+    size_t const pushed = subscription->queue_.Push(subscription->pending_);
+    if (pushed < subscription->pending_.size()) {
+      subscription->dropped_count_.fetch_add(subscription->pending_.size() - pushed, std::memory_order_relaxed);
+    }
+    subscription->pending_.clear();
+  }
+  notified_subscriptions_.clear();
+}
+
+bool DirectInputContext::PollDevice(Device& device, bool& out_changed) {
+  DeviceSource& source = *device.source;
+
+  auto Poll = [&source]() {
+    TRACE_ZONE("Poll");
+    return source.Poll();
+  };
+
+  bool acquired = false;
+  HRESULT hr = Poll();
+  if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
+    if (hr == DIERR_INPUTLOST) {
+      // The device was working until now, so it may have been unplugged; have `UpdateDetection` find out.
+      this->NotifyDeviceChange();
+      input_lost_count_.fetch_add(1, std::memory_order_relaxed);
+      TRACE_COUNTER("DIERR_INPUTLOST", input_lost_count_.load(std::memory_order_relaxed));
+    }
+    else {
+      not_acquired_count_.fetch_add(1, std::memory_order_relaxed);
+      TRACE_COUNTER("DIERR_NOTACQUIRED", not_acquired_count_.load(std::memory_order_relaxed));
+    }
+    {
+      TRACE_ZONE("Acquire");
+      source.Acquire();
+    }
+    acquired = true;
+    hr = Poll();
     if (FAILED(hr)) {
+      this->CountFailedPoll();
+      return false;
+    }
+  }
+
+  if (config_.buffered_input) {
+    // Replay every buffered change onto `device.state`, in order.
+    TRACE_ZONE("DrainInputEvents");
+    uint64_t const event_count = device.event_stats.event_count;
+    hr = DrainInputEvents(source, device.events, device.event_stats, &device.state);
+    out_changed = device.event_stats.event_count != event_count;
+    if (hr == DI_OK && !acquired) {
+      return true;
+    }
+    // Events were lost (or the read failed), more came than `device.events` holds, or the device has just been (re)acquired and changes made
+    // before that never made it into the buffer. Either way `device.state` may be stale: resynchronize from a snapshot.
+  }
+
+  DIJOYSTATE2 state {};
+  {
+    TRACE_ZONE("GetDeviceState");
+    hr = source.GetDeviceState(state);
+  }
+  if (FAILED(hr)) {
+    this->CountFailedPoll();
+    return false;
+  }
+
+  out_changed = out_changed || std::memcmp(&device.state, &state, sizeof(DIJOYSTATE2)) != 0;
+  device.state = state;
+  return true;
+}
+
+void DirectInputContext::CountFailedPoll() {
+  failed_poll_count_.fetch_add(1, std::memory_order_relaxed);
+  TRACE_COUNTER("Failed Polls", failed_poll_count_.load(std::memory_order_relaxed));
+}
+
+void DirectInputContext::PollingThreadMain() {
+  using Clock = std::chrono::steady_clock;
+
+  TRACE_THREAD_NAME("Polling");
+
+#if defined(_WIN32)
+  // The default timer resolution (~15.6 ms) would cap us at 64 Hz.
+  ::timeBeginPeriod(1);
+#endif
+
+  auto const interval = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / config_.polling_rate_hz;
+
+  Clock::time_point next_poll_time = Clock::now();
+  while (!polling_thread_exit_.load(std::memory_order_relaxed)) {
+    {
+      std::lock_guard lock(devices_mutex_);
+      this->PollDevices();
+    }
+    poll_count_.fetch_add(1, std::memory_order_relaxed);
+
+    next_poll_time += interval;
+
+    Clock::time_point const now = Clock::now();
+    if (now > next_poll_time) {
+      // Don't try to catch up on missed polls; that would only poll in a burst.
+      overrun_count_.fetch_add(1, std::memory_order_relaxed);
+      next_poll_time = now;
       continue;
     }
 
-    device.state = state;
+    std::this_thread::sleep_until(next_poll_time);
   }
+
+#if defined(_WIN32)
+  ::timeEndPeriod(1);
+#endif
 }
@@ -1,19 +1,33 @@
 #pragma once
 
-#include <unordered_map>
+#include "direct_input_compat.h"
+#include "axis_extraction.h"
+#include "axis_processing.h"
+#include "button_bits.h"
+#include "input_event_buffer.h"
+#include "input_history.h"
+#include "input_notification.h"
+#include "latency_histogram.h"
+#include "packed_state.h"
+#include "seqlock.h"
+#include "shared_state.h"
+#include "slot_map.h"
+#include "spsc_queue.h"
+#include "worker_pool.h"
+
+#include <array>
+#include <condition_variable>
+#include <span>
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
-#if !defined(NOMINMAX)
-# define NOMINMAX
-#endif
-
-#if !defined(DIRECTINPUT_VERSION)
-# define DIRECTINPUT_VERSION 0x0800
-#endif
-#include <initguid.h>
-#include <dinput.h>
+class DeviceLayoutCache;
 
 class DirectInputContext final {
 public:
@@ -36,69 +50,583 @@ public:
     DWORD offset;
   };
 
+  /// An opened device. Mirrors the `IDirectInputDevice8` calls made in `UpdateState`,
+  /// so that a `Backend` other than DirectInput (or a fake one) can stand in for it.
+  class DeviceSource : public BufferedInputSource {
+  public:
+    virtual HRESULT Acquire() = 0;
+    virtual HRESULT Poll() = 0;
+    virtual HRESULT GetDeviceState(DIJOYSTATE2& out_state) = 0;
+
+    /// What the device signals when it has new input, for `WaitForInput` to block on, or `kNoInputNotification` if it has to be polled.
+    /// Reading the input (`Poll` and `GetDeviceState`, or `ReadBufferedEvents`) must unsignal it, unless the wait that it ends does (an auto-reset event).
+    virtual InputNotificationHandle GetNotificationHandle() {
+      return kNoInputNotification;
+    }
+  };
+
+  /// Stays valid for as long as the device stays connected. A reconnected device gets a new handle.
+  using DeviceHandle = SlotMapHandle;
+
+  /// When a device's `state` was sampled, in `GetMonotonicTimeNs` nanoseconds.
+  struct SampleTimes final {
+    /// Before `Poll`, and after `GetDeviceState` (or reading the buffered events) returned.
+    /// Devices are polled back to back, so a device's poll starts when the previous device's ended.
+    uint64_t poll_start_ns = 0;
+    uint64_t poll_end_ns = 0;
+    /// `poll_end_ns` of the latest poll that found `state` changed.
+    uint64_t last_change_ns = 0;
+  };
+
+  /// `state` and `times` as one unit.
+  struct Sample final {
+    DIJOYSTATE2 state {};
+    SampleTimes times {};
+  };
+
+  /// `Sample` with the state packed to the device's inputs (see `Device::packed_layout`), as published by the polling thread.
+  struct PackedSample final {
+    PackedState state {};
+    SampleTimes times {};
+  };
+
+  struct LatencyStats final {
+    /// From `SampleTimes::poll_start_ns` to `poll_end_ns`, for every poll.
+    LatencyHistogram poll_duration;
+    /// Only with `Config::polling_rate_hz`: how old the latest sample is when `UpdateState` is called,
+    /// i.e. how stale the values the application reads that frame are.
+    LatencyHistogram sample_age;
+  };
+
+  /// The steps of opening a device, in order, as DirectInput has them. Other backends report the nearest equivalent, or leave a stage out.
+  enum class OpenStage : uint32_t {
+    /// `IDirectInput8::CreateDevice`.
+    kCreateDevice,
+    /// `SetCooperativeLevel`.
+    kCooperativeLevel,
+    /// `SetDataFormat`, and `SetProperty(DIPROP_BUFFERSIZE)` with `Config::buffered_input`.
+    kDataFormat,
+    /// `GetCapabilities`.
+    kCapabilities,
+    /// `GetProperty(DIPROP_PRODUCTNAME)`. Skipped when the layout is cached (see `Config::layout_cache_path`).
+    kProductName,
+    /// `EnumObjects`, including the `SetProperty(DIPROP_RANGE)` and `SetProperty(DIPROP_DEADZONE)` calls for every axis.
+    /// When the layout is cached, just those two calls, once for all axes.
+    kObjects,
+    kCount,
+  };
+
+  static char const* GetOpenStageName(OpenStage stage);
+
+  /// How long opening a device took, in `GetMonotonicTimeNs` nanoseconds.
+  struct OpenTimings final {
+    /// When `UpdateDetection` found the device, and when opening it started and ended.
+    /// With `Config::async_device_open`, the device becomes available in the first `UpdateDetection` after `end_ns`.
+    uint64_t requested_ns = 0;
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0;
+    /// Time spent in each `OpenStage`; 0 for the stages the backend does not have.
+    std::array<uint64_t, static_cast<size_t>(OpenStage::kCount)> stage_ns {};
+    /// The layout came from `Config::layout_cache_path` rather than from discovering the inputs.
+    bool layout_cached = false;
+
+    /// For backends: records the time from `inout_stage_start_ns` to now as `stage`, and sets `inout_stage_start_ns` to now, where the next stage starts.
+    void EndStage(OpenStage stage, uint64_t& inout_stage_start_ns);
+  };
+
+  /// Bit `1 << InputType` of each type, for `SubscriptionFilter::input_types`.
+  static inline constexpr uint32_t kAllInputTypes =
+    (1u << static_cast<uint32_t>(InputType::kPOV)) | (1u << static_cast<uint32_t>(InputType::kAxis)) | (1u << static_cast<uint32_t>(InputType::kButton));
+
+  /// Which changes a `Subscription` receives. Each field narrows it down; by default, every change of every device.
+  struct SubscriptionFilter final {
+    /// Only this device, if valid.
+    DeviceHandle device {};
+    /// Otherwise only the devices with this instance GUID, if it is not zero. Unlike `device`, this matches the device again once it is reconnected.
+    GUID guid {};
+    /// Bit `1 << InputType` of each type of input to report.
+    uint32_t input_types = kAllInputTypes;
+    /// Which inputs of each type to report, by index in `Device::povs`, `axes` and `buttons`.
+    ButtonBits indices { { ~uint64_t(0), ~uint64_t(0) } };
+    /// An axis is only reported once it is at least this far from the value last reported to the subscription, so that jitter does not flood it.
+    LONG axis_threshold = 0;
+  };
+
+  /// An input that a poll found changed.
+  struct InputChange final {
+    DeviceHandle device {};
+    InputType type = InputType::kAxis;
+    DWORD index = 0;
+    /// The new value, as `Device::GetAxisValue` or `GetButtonValue` return it, or `GetPovValue` as a `LONG` (centered is -1).
+    LONG value = 0;
+    /// `SampleTimes::poll_end_ns` of the poll.
+    uint64_t time_ns = 0;
+  };
+
+  /// Receives the changes that match its filter through a lock-free queue, from the thread that polls (`UpdateState`, `WaitForInput` or the polling thread)
+  /// to the one subscriber thread that drains it. Each poll pushes its changes in one batch, with at most one change per input.
+  class Subscription final {
+  public:
+    /// `capacity` is rounded up to a power of two.
+    Subscription(SubscriptionFilter const& filter, size_t capacity);
+
+    SubscriptionFilter const& GetFilter() const {
+      return filter_;
+    }
+
+    /// Moves up to `out_changes.size()` changes out, oldest first, and returns how many. Must only be called from one thread at a time.
+    size_t Drain(std::span<InputChange> out_changes) {
+      return queue_.Pop(out_changes);
+    }
+
+    /// Number of changes dropped because the queue was full. The changes after a drop no longer tell the whole story:
+    /// resynchronize from `Device::LoadState` when this grows.
+    uint64_t GetDroppedCount() const {
+      return dropped_count_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    friend class DirectInputContext;
+
+    SubscriptionFilter filter_;
+    SpscQueue<InputChange> queue_;
+    /// The changes found by the current poll, pushed together at its end.
+    std::vector<InputChange> pending_;
+    std::atomic<uint64_t> dropped_count_ { 0 };
+  };
+
+  /// A `Subscription` whose filter matches a device, and the axis values last reported to it, for `SubscriptionFilter::axis_threshold`.
+  struct SubscriptionBinding final {
+    Subscription* subscription = nullptr;
+    std::array<LONG, PackedState::kMaxAxes> reported_axes {};
+  };
+
   struct Device final {
     GUID guid {};
+    DeviceHandle handle {};
     std::string name;
-    /// Could be `IDirectInputDevice8A` or `IDirectInputDevice8W`, depending on whether `UNICODE` is defined.
-    IDirectInputDevice8* pDevice = nullptr;
+    std::unique_ptr<DeviceSource> source;
     DIDEVCAPS caps {};
 
     std::vector<Input> povs;
     std::vector<Input> buttons;
     std::vector<Input> axes;
 
+    /// `axes` compiled for `GatherAxes` when the device is opened.
+    std::vector<uint8_t> axis_gather;
+    /// Where this device's axes start in the output of `DirectInputContext::ExtractAxes`.
+    uint32_t axis_base = 0;
+    /// `povs`, `axes` and `buttons` compiled into a `PackedState` layout when the device is opened.
+    PackedStateLayout packed_layout;
+
     /// Updated in `UpdateState`.
+    /// When `Config::polling_rate_hz` is set, this belongs to the polling thread: read through `LoadState` and the `Get*Value` accessors instead.
     DIJOYSTATE2 state {};
+    /// `state.rgbButtons` as bits, and which of them changed since the previous `UpdateState`, e.g.
+    /// `button_edges.pressed.Any()`, `button_edges.pressed.FindFirst()` or `button_edges.GetChanged().ForEach(...)`.
+    /// Like `state`, this belongs to the polling thread if there is one.
+    ButtonEdges button_edges {};
+    /// When `state` was sampled. Like `state`, this belongs to the polling thread if there is one: read through `LoadSampleTimes` instead.
+    SampleTimes times {};
+    /// Only set when `Config::polling_rate_hz` is set. `state` (packed) and `times` as of the end of the latest poll.
+    std::unique_ptr<SeqLock<PackedSample>> published_state;
+    /// Always set. Recorded without locks or allocations; read with `LatencyHistogram::Summarize` from any thread.
+    std::unique_ptr<LatencyStats> latency;
+    OpenTimings open_timings {};
+
+    /// Only filled when `Config::buffered_input` is enabled.
+    /// Every change read from the device buffer in `UpdateState`, including those that came and went between two calls.
+    /// Like `state`, this belongs to the polling thread if there is one.
+    InputEventRing events;
+    BufferedInputStats event_stats;
+
+    /// Only filled when `Config::input_history_capacity` is set. Every change of state found by a poll, e.g.
+    /// `history.WasPressed(3, now - 150'000'000, now)` or `history.GetAxisValueAt(0, t, value)`.
+    /// Like `state`, this belongs to the polling thread if there is one.
+    InputHistory history;
+
+    /// The subscriptions whose filter matches this device, and its state (packed) when they were last told about it.
+    /// Like `state`, these belong to the polling thread if there is one.
+    std::vector<SubscriptionBinding> subscriptions;
+    PackedState reported_state {};
 
     std::string GetGuidString() const;
     char const* GetAxisName(DWORD index) const;
 
+    /// Finds the POV, axis or button at `offset`, e.g. to resolve `BufferedInputEvent::offset` into an index.
+    Input const* FindInput(DWORD offset) const;
+
+    /// A consistent copy of `state`. Safe to call from any thread while the polling thread is running.
+    /// With the polling thread, this is unpacked from `published_state`: only the device's inputs are set, buttons read `0x80` or 0,
+    /// and every other field is zero.
+    DIJOYSTATE2 LoadState() const;
+    /// `state` and `times` from the same poll.
+    Sample LoadSample() const;
+    /// The same, packed: cheaper to read, copy and keep than a `Sample`. Read it with `packed_layout`.
+    PackedSample LoadPackedSample() const;
+    SampleTimes LoadSampleTimes() const;
+
+    /// These are safe to call from any thread while the polling thread is running, and never block.
+    /// Each value is read atomically, but two calls may observe two different polls: use `LoadState` to read several consistently.
     DWORD GetPovValue(DWORD index) const;
     LONG GetAxisValue(DWORD index) const;
     BYTE GetButtonValue(DWORD index) const;
+
+  private:
+    template<typename T>
+    T LoadStateField(DWORD offset) const;
   };
 
-  DirectInputContext() = default;
-  ~DirectInputContext() noexcept = default;
+  struct Config final {
+    /// Read changes from the DirectInput device buffer (`GetDeviceData`) instead of only taking a snapshot (`GetDeviceState`) each `UpdateState`,
+    /// so that presses shorter than the update interval are not lost. See `Device::events`.
+    bool buffered_input = false;
+    /// `DIPROP_BUFFERSIZE`: How many events the driver holds for us between two `UpdateState` calls.
+    DWORD device_buffer_size = 256;
+    /// Capacity of `Device::events`.
+    DWORD event_ring_capacity = 1024;
+
+    /// When non-zero, each device keeps its latest changes of state in `Device::history`, up to this many (rounded up to a power of two).
+    DWORD input_history_capacity = 0;
+    /// How far back `Device::history` goes, if its capacity allows.
+    DWORD input_history_retention_ms = 1000;
+
+    /// When non-zero, `Initialize` starts a thread that polls every device this many times per second, independently of the caller's frame rate,
+    /// and publishes each `Device::state` so it can be read from any thread. `UpdateState` then does nothing.
+    DWORD polling_rate_hz = 0;
+
+    /// When non-zero, devices are polled concurrently, on this many persistent worker threads along with the thread that polls (`UpdateState` or the polling thread),
+    /// so that a poll takes as long as the slowest device rather than as long as all of them together.
+    /// Only worth it when `Poll` blocks in the driver, e.g. with many USB devices. Each device is still polled by one thread at a time.
+    DWORD polling_worker_count = 0;
+
+    /// When set, `UpdateDetection` does not open new devices itself, which can take tens to hundreds of milliseconds each:
+    /// a background thread opens and configures them, and a later `UpdateDetection` adds each one once it is ready, all at once.
+    /// In the meantime they are listed by `GetPendingDevices`.
+    bool async_device_open = false;
+
+    /// While `WaitForInput` blocks, devices without a notification handle (see `DeviceSource::GetNotificationHandle`) are still polled this often.
+    DWORD wait_poll_interval_ms = 10;
+
+    /// `UpdateDetection` only enumerates devices after `NotifyDeviceChange`, or when this many milliseconds have passed since it last did,
+    /// in case a notification was missed. 0 disables the fallback.
+    DWORD detection_fallback_interval_ms = 3000;
+
+    /// When not empty, every device's layout and latest state are also published into a shared-memory region of this name,
+    /// which other processes read with `SharedStateReader`. `Initialize` fails if the region cannot be created.
+    std::string shared_memory_name;
+    /// Number of device slots in the region. A device whose `DeviceHandle::index` does not fit is not published.
+    DWORD shared_memory_device_capacity = 64;
+
+    /// When not empty, the layouts of the devices opened are cached in this file (see `DeviceLayoutCache`), which `Shutdown` updates,
+    /// so that the next time a device of a known model is opened, here or in a later run, the backend can skip discovering its inputs.
+    std::string layout_cache_path;
+  };
+
+  struct PollingStats final {
+    /// Number of times the polling thread polled all devices.
+    uint64_t poll_count = 0;
+    /// Number of polls that took longer than the polling interval.
+    uint64_t overrun_count = 0;
+    /// Of every device poll, with or without the polling thread: how many times `Poll` returned `DIERR_INPUTLOST` or `DIERR_NOTACQUIRED`,
+    /// and the device was acquired again; and how many polls failed regardless, leaving the device's state as it was.
+    uint64_t input_lost_count = 0;
+    uint64_t not_acquired_count = 0;
+    uint64_t failed_poll_count = 0;
+  };
+
+  /// What the latest device enumeration in `UpdateDetection` changed.
+  struct DeviceChanges final {
+    std::vector<GUID> added;
+    std::vector<GUID> removed;
+  };
+
+  struct DetectionStats final {
+    /// Number of `UpdateDetection` calls.
+    uint64_t update_count = 0;
+    /// Number of times devices were actually enumerated.
+    uint64_t enumeration_count = 0;
+    /// Of `enumeration_count`, how many were due to the fallback interval rather than a notification.
+    uint64_t fallback_enumeration_count = 0;
+    uint64_t added_count = 0;
+    uint64_t removed_count = 0;
+    /// Number of devices that failed to open. They are retried on the next enumeration.
+    uint64_t open_failure_count = 0;
+  };
+
+  /// A device found by `UpdateDetection` and being opened in the background; see `Config::async_device_open`.
+  struct PendingDevice final {
+    GUID guid {};
+    /// `OpenTimings::requested_ns`.
+    uint64_t requested_ns = 0;
+  };
+
+  /// Enumerates and opens devices. `DirectInputBackend` is the default on Windows, `EvdevBackend` on Linux.
+  class Backend {
+  public:
+    virtual ~Backend() = default;
+
+    virtual bool Initialize(Config const& config) = 0;
+    virtual void Shutdown() = 0;
+
+    /// Appends the instance GUIDs of all attached game controllers to `out_guids`.
+    virtual void EnumerateDevices(std::vector<GUID>& out_guids) = 0;
+    /// Opens and configures the device, filling out `name`, `caps`, `povs`, `buttons` and `axes` (sorted by `offset`) of `out_device`,
+    /// and the stages of `out_device.open_timings` it has. Returns `nullptr` on failure.
+    /// With `Config::async_device_open`, this is called on a background thread, possibly while `EnumerateDevices` or `BeginPoll` run on others.
+    virtual std::unique_ptr<DeviceSource> OpenDevice(GUID const& guid, Device& out_device) = 0;
+
+    /// Called before each round of `DeviceSource::Poll` calls, on the polling thread if any, e.g. to read the input of all devices in one batch.
+    virtual void BeginPoll() {}
+
+    /// Set before `Initialize` when `Config::layout_cache_path` is set. `OpenDevice` may look up and store device layouts there.
+    void SetLayoutCache(DeviceLayoutCache* cache) {
+      layout_cache_ = cache;
+    }
+
+  protected:
+    DeviceLayoutCache* layout_cache_ = nullptr;
+  };
+
+  DirectInputContext();
+  ~DirectInputContext() noexcept;
 
   DirectInputContext(DirectInputContext const&) = delete;
   DirectInputContext(DirectInputContext&&) = delete;
   DirectInputContext& operator=(DirectInputContext const&) = delete;
   DirectInputContext& operator=(DirectInputContext&&) = delete;
 
-  bool Initialize();
+  /// Uses the platform's default `Backend`.
+  bool Initialize() { return this->Initialize(Config {}); }
+  bool Initialize(Config const& config);
+  bool Initialize(std::unique_ptr<Backend> backend, Config const& config);
   void Shutdown();
 
-  void UpdateDetection();
+  /// Enumerates devices and opens/closes them as needed, but only if `NotifyDeviceChange` was called or the fallback interval has passed
+  /// (see `Config::detection_fallback_interval_ms`); otherwise this returns immediately, so it is cheap to call every frame.
+  /// With `Config::async_device_open`, this also adds the devices opened in the background since the previous call.
+  /// Returns `true` if devices were enumerated or the background thread finished opening some, in which case `GetDeviceChanges` tells what changed.
+  bool UpdateDetection();
   void UpdateState();
 
-  std::vector<GUID> GetDeviceGuids() const {
-    std::vector<GUID> guids;
-    guids.reserve(devices_.size());
-    for (auto const& [guid, device] : devices_) {
-      guids.push_back(guid);
-    }
-    return guids;
+  /// Instead of calling `UpdateState` in a loop: blocks until a device signals new input, then polls every device like `UpdateState`
+  /// and returns the handles of those whose state changed since the call, or an empty span after `timeout`.
+  /// Also returns early, possibly with no device, when `UpdateDetection` has something to do (after `NotifyDeviceChange`, or once devices
+  /// opened in the background are ready) or upon `InterruptWaitForInput`; call `UpdateDetection` before waiting again.
+  /// Must be called on the thread that calls `UpdateDetection`. With `Config::polling_rate_hz`, the polling thread polls, and this returns immediately.
+  /// The span is valid until the next call.
+  std::span<DeviceHandle const> WaitForInput(std::chrono::nanoseconds timeout);
+  /// Makes the current or next `WaitForInput` return early. Can be called from any thread, e.g. to stop a service.
+  void InterruptWaitForInput() {
+    input_wait_interrupted_.store(true, std::memory_order_release);
+    input_wait_set_.Wake();
+  }
+
+  /// From the next poll on, every change that matches `filter` is pushed to the returned subscription, to be drained on another thread.
+  /// Changes are found once per poll for all subscriptions, and only on the devices that some subscription matches; each subscription then
+  /// only costs anything when one of its devices changed. Valid until `Unsubscribe` or `Shutdown`.
+  /// Must be called on the thread that calls `UpdateDetection`.
+  Subscription* Subscribe(SubscriptionFilter const& filter, size_t queue_capacity = 4096);
+  /// Must be called on the thread that calls `UpdateDetection`, once the subscriber has stopped draining `subscription`.
+  void Unsubscribe(Subscription* subscription);
+
+  /// Requests device enumeration on the next `UpdateDetection`, e.g. upon `WM_DEVICECHANGE`. Can be called from any thread.
+  void NotifyDeviceChange() {
+    detection_requested_.store(true, std::memory_order_release);
+    input_wait_set_.Wake();
+  }
+
+  /// Valid until the next `UpdateDetection` that returns `true`.
+  DeviceChanges const& GetDeviceChanges() const {
+    return device_changes_;
+  }
+
+  DetectionStats const& GetDetectionStats() const {
+    return detection_stats_;
+  }
+
+  /// Only with `Config::async_device_open`: the devices found but not opened yet, e.g. to show them as "connecting".
+  /// Invalidated by `UpdateDetection`.
+  std::span<PendingDevice const> GetPendingDevices() const {
+    return pending_devices_;
+  }
+
+  /// Only with `Config::layout_cache_path`, otherwise `nullptr`.
+  DeviceLayoutCache const* GetLayoutCache() const {
+    return layout_cache_.get();
+  }
+
+  PollingStats GetPollingStats() const {
+    return PollingStats {
+      .poll_count = poll_count_.load(std::memory_order_relaxed),
+      .overrun_count = overrun_count_.load(std::memory_order_relaxed),
+      .input_lost_count = input_lost_count_.load(std::memory_order_relaxed),
+      .not_acquired_count = not_acquired_count_.load(std::memory_order_relaxed),
+      .failed_poll_count = failed_poll_count_.load(std::memory_order_relaxed),
+    };
   }
 
+  /// All connected devices, contiguous and in no particular order.
+  /// Does not allocate; invalidated by `UpdateDetection`.
+  std::span<Device const> GetDevices() const {
+    return devices_.GetValues();
+  }
+
+  /// Returns `nullptr` if the device has been disconnected since `handle` was obtained.
+  Device const* GetDevice(DeviceHandle handle) const {
+    return devices_.Get(handle);
+  }
+
+  /// Binary search; prefer holding on to `Device::handle`.
+  DeviceHandle FindDevice(GUID const& guid) const;
+
   Device const* GetDevice(GUID const& guid) const {
-    auto it = devices_.find(guid);
-    if (it == devices_.end()) {
-      return nullptr;
+    return devices_.Get(this->FindDevice(guid));
+  }
+
+  /// Total number of axes over all devices, i.e. the number of values `ExtractAxes` writes.
+  size_t GetAxisCount() const {
+    return axis_scratch_.size();
+  }
+
+  /// Writes every axis of every device into `out_values` in one pass, device after device in `GetDevices` order,
+  /// each device's axes starting at `Device::axis_base`. `out_values` must hold at least `GetAxisCount` values.
+  /// Must be called on the thread that calls `UpdateDetection`.
+  void ExtractAxes(std::span<int16_t> out_values) const;
+  void ExtractAxes(std::span<float> out_values, AxisNormalization normalization) const;
+
+  /// Sets how `ExtractProcessedAxes` conditions axis `axis_index` (in `Device::axes` order) of the device `guid`, whenever it is connected.
+  void SetAxisProcessing(GUID const& guid, DWORD axis_index, AxisProcessing const& processing);
+  void ClearAxisProcessing();
+
+  /// Like `ExtractAxes`, but each axis is processed as set with `SetAxisProcessing` (by default, normalized like `AxisNormalization::kSigned`),
+  /// all of them in one vectorized pass; see `AxisPipeline`. The filters advance by the time since the previous call, so call this once per update.
+  /// Must be called on the thread that calls `UpdateDetection`.
+  void ExtractProcessedAxes(std::span<float> out_values);
+
+  /// Allocates; prefer `GetDevices`.
+  std::vector<GUID> GetDeviceGuids() const {
+    std::vector<GUID> guids;
+    guids.reserve(devices_.GetSize());
+    for (Device const& device : devices_.GetValues()) {
+      guids.push_back(device.guid);
     }
-    return &it->second;
+    return guids;
   }
 
 private:
-  struct GuidHasher final {
-    size_t operator()(GUID const& v) const noexcept {
-      RPC_STATUS status = RPC_S_OK;
-      return ::UuidHash(const_cast<GUID*>(&v), &status);
-    }
+  struct DeviceIndexEntry final {
+    GUID guid;
+    DeviceHandle handle;
+  };
+
+  struct AxisProcessingEntry final {
+    GUID guid;
+    DWORD axis_index;
+    AxisProcessing processing;
+  };
+
+  /// A device for the opening thread to open, and what became of it.
+  struct OpenRequest final {
+    uint64_t id = 0;
+    Device device;
   };
 
-  /// Could be `IDirectInput8A` or `IDirectInput8W`.
-  IDirectInput8* pDI_ = nullptr;
+  /// Opens `device.guid` through the backend and prepares everything `UpdateDetection` would, so that inserting it is all that is left.
+  /// Returns `false` on failure. Does not touch the context's state, so it can run on the opening thread.
+  bool OpenDevice(Device& device) const;
+  void DeviceOpenThreadMain();
+  void PollDevices();
+  /// Returns `true` if `device.state` was updated, and sets `out_changed` if it differs from before.
+  bool PollDevice(Device& device, bool& out_changed);
+  /// Counts a poll that left the device's state as it was.
+  void CountFailedPoll();
+  /// Timestamps and publishes what `PollDevice` read.
+  void FinishPoll(Device& device, bool updated, bool changed, uint64_t poll_start, uint64_t poll_end);
+  /// Pushes what changed since the previous poll to the subscriptions of each device.
+  void PublishChanges();
+  /// Adds `subscription` to `device.subscriptions` if its filter matches.
+  void BindSubscription(Device& device, Subscription& subscription);
+  void UpdateAxisLayout();
+  /// Publishes which device is in which slot of `shared_state_`, for the slots that changed.
+  void PublishSharedLayout();
+  void GatherAllAxes() const;
+  void CompileAxisPipeline();
+  void PollingThreadMain();
+
+  Config config_ {};
+
+  std::unique_ptr<Backend> backend_;
+  /// Only with `Config::layout_cache_path`. Outlives `backend_`.
+  std::unique_ptr<DeviceLayoutCache> layout_cache_;
+
+  SlotMap<Device> devices_;
+  /// Sorted by `guid`. Only used on the hot-plug path (and by `FindDevice`).
+  std::vector<DeviceIndexEntry> device_index_;
+
+  std::atomic<bool> detection_requested_ { true };
+  std::chrono::steady_clock::time_point last_enumeration_time_ {};
+  /// Reused across enumerations, so that `UpdateDetection` does not allocate unless devices changed.
+  std::vector<GUID> enumerated_guids_;
+  DeviceChanges device_changes_;
+  DetectionStats detection_stats_;
+
+  /// Only with `Config::async_device_open`. Requests go from `UpdateDetection` to the opening thread through `open_requests_`, and back through `opened_devices_`.
+  /// `pending_devices_` and `pending_request_ids_` (in the same order) belong to `UpdateDetection`: a result whose request is no longer pending,
+  /// because the device was unplugged meanwhile, is dropped.
+  std::thread device_open_thread_;
+  std::mutex open_mutex_;
+  std::condition_variable open_condition_;
+  std::vector<OpenRequest> open_requests_;
+  std::vector<OpenRequest> opened_devices_;
+  bool open_thread_exit_ = false;
+  /// Set by the opening thread when `opened_devices_` is not empty, so that `UpdateDetection` only locks when there is something to add.
+  std::atomic<bool> opened_devices_ready_ { false };
+  std::vector<PendingDevice> pending_devices_;
+  std::vector<uint64_t> pending_request_ids_;
+  uint64_t next_open_request_id_ = 1;
+
+  /// One value per axis of every device; see `ExtractAxes`.
+  mutable std::vector<LONG> axis_scratch_;
+
+  std::vector<AxisProcessingEntry> axis_processing_;
+  AxisPipeline axis_pipeline_;
+  /// Set when devices or `axis_processing_` changed, so that `ExtractProcessedAxes` recompiles `axis_pipeline_`.
+  bool axis_pipeline_dirty_ = true;
+  uint64_t last_axis_processing_ns_ = 0;
+
+  /// Held by the polling thread while it polls, and by `UpdateDetection` while it adds or removes devices.
+  std::mutex devices_mutex_;
+  std::thread polling_thread_;
+  /// Only with `Config::polling_worker_count`.
+  std::unique_ptr<WorkerPool> polling_workers_;
+  std::atomic<bool> polling_thread_exit_ { false };
+  std::atomic<uint64_t> poll_count_ { 0 };
+  std::atomic<uint64_t> overrun_count_ { 0 };
+  /// Counted by `PollDevice`, which may run on several polling workers at once.
+  std::atomic<uint64_t> input_lost_count_ { 0 };
+  std::atomic<uint64_t> not_acquired_count_ { 0 };
+  std::atomic<uint64_t> failed_poll_count_ { 0 };
+
+  /// What `WaitForInput` blocks on: every device's notification handle, gathered again whenever devices were added or removed.
+  /// Woken whenever `WaitForInput` may have to return early; a wake-up left over from before the call is told apart by these flags.
+  InputWaitSet input_wait_set_;
+  std::atomic<bool> input_wait_interrupted_ { false };
+  bool input_wait_set_dirty_ = true;
+  /// Whether some device has no notification handle, or one that did not fit in `input_wait_set_`, and has to be polled while waiting.
+  bool input_wait_needs_polling_ = false;
+  std::vector<InputNotificationHandle> notification_handles_;
+  /// What the latest `WaitForInput` returned.
+  std::vector<DeviceHandle> changed_devices_;
+
+  /// Changed, like `Device::subscriptions`, only with `devices_mutex_` held.
+  std::vector<std::unique_ptr<Subscription>> subscriptions_;
+  /// For `PublishChanges`: the changes of one device, and the subscriptions that got some.
+  std::vector<InputChange> input_changes_;
+  std::vector<Subscription*> notified_subscriptions_;
 
-  std::unordered_map<GUID, Device, GuidHasher> devices_;
+  /// Only open with `Config::shared_memory_name`. Device infos are published by `UpdateDetection`, states by `PollDevices`.
+  SharedStatePublisher shared_state_;
+  /// `DeviceHandle::generation` of the device published in each slot, or 0.
+  std::vector<uint32_t> shared_slot_generations_;
 };
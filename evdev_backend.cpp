@@ -0,0 +1,725 @@
+#include "evdev_backend.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+/// Recognizable in `GetGuidString`: "evdv" for device nodes, "strm" for streams.
+constexpr std::array<uint8_t, 4> kNodeGuidMarker = { 'e', 'v', 'd', 'v' };
+constexpr std::array<uint8_t, 4> kStreamGuidMarker = { 's', 't', 'r', 'm' };
+
+constexpr DWORD kMaxButtons = 128;
+constexpr DWORD kMaxPovs = 4;
+
+/// The axis slots of `DIJOYSTATE2`, in the order other absolute axes are assigned to whichever is left.
+constexpr std::array<DWORD, 8> kAxisOffsets = {
+  DIJOFS_X, DIJOFS_Y, DIJOFS_Z, DIJOFS_RX, DIJOFS_RY, DIJOFS_RZ, DIJOFS_SLIDER(0), DIJOFS_SLIDER(1),
+};
+
+/// The axis slot an absolute axis naturally maps to, or -1.
+int GetPreferredAxisSlot(uint16_t code) {
+  switch (code) {
+  case ABS_X: return 0;
+  case ABS_Y: return 1;
+  case ABS_Z: return 2;
+  case ABS_RX: return 3;
+  case ABS_RY: return 4;
+  case ABS_RZ: return 5;
+  case ABS_THROTTLE: return 6;
+  case ABS_RUDDER: return 7;
+  default: return -1;
+  }
+}
+
+bool IsHat(uint16_t code) {
+  return code >= ABS_HAT0X && code <= ABS_HAT3Y;
+}
+
+/// `ABS_MT_*` and friends describe touch surfaces, not joysticks.
+bool IsJoystickAbs(uint16_t code) {
+  return code <= ABS_MISC;
+}
+
+/// Joystick and gamepad buttons first, then the rest, so that the "main" buttons get the low indices.
+bool KeyOrderLess(uint16_t lhs, uint16_t rhs) {
+  bool const lhs_joystick = lhs >= BTN_JOYSTICK;
+  bool const rhs_joystick = rhs >= BTN_JOYSTICK;
+  if (lhs_joystick != rhs_joystick) {
+    return lhs_joystick;
+  }
+  return lhs < rhs;
+}
+
+template<size_t N>
+bool TestBit(std::array<unsigned long, N> const& bits, size_t index) {
+  constexpr size_t kBitsPerWord = sizeof(unsigned long) * 8;
+  return index / kBitsPerWord < N && ((bits[index / kBitsPerWord] >> (index % kBitsPerWord)) & 1) != 0;
+}
+
+constexpr size_t kBitsPerLong = sizeof(unsigned long) * 8;
+using AbsBits = std::array<unsigned long, (ABS_CNT + kBitsPerLong - 1) / kBitsPerLong>;
+using KeyBits = std::array<unsigned long, (KEY_CNT + kBitsPerLong - 1) / kBitsPerLong>;
+
+/// Like udev's `ID_INPUT_JOYSTICK`: joystick or gamepad buttons, or absolute axes without the buttons of a touchpad, tablet or mouse.
+bool IsJoystick(AbsBits const& abs_bits, KeyBits const& key_bits) {
+  for (size_t code = BTN_JOYSTICK; code < BTN_DIGI; ++code) {
+    if (TestBit(key_bits, code)) {
+      return true;
+    }
+  }
+  for (size_t code = BTN_TRIGGER_HAPPY1; code <= BTN_TRIGGER_HAPPY40; ++code) {
+    if (TestBit(key_bits, code)) {
+      return true;
+    }
+  }
+
+  if (TestBit(key_bits, BTN_TOUCH) || TestBit(key_bits, BTN_TOOL_PEN) || TestBit(key_bits, BTN_MOUSE)) {
+    return false;
+  }
+  return TestBit(abs_bits, ABS_X) || TestBit(abs_bits, ABS_THROTTLE) || TestBit(abs_bits, ABS_RUDDER) || TestBit(abs_bits, ABS_WHEEL);
+}
+
+/// Queries what the device node behind `fd` reports, including the current values. Returns `false` if it is not a joystick.
+bool QueryLayout(int fd, EvdevLayout& out_layout) {
+  TRACE_ZONE("QueryLayout");
+
+  AbsBits abs_bits {};
+  KeyBits key_bits {};
+  if (::ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits.data()) < 0) {
+    abs_bits.fill(0);
+  }
+  if (::ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits.data()) < 0) {
+    key_bits.fill(0);
+  }
+  if (!IsJoystick(abs_bits, key_bits)) {
+    return false;
+  }
+
+  out_layout = {};
+  for (uint16_t code = 0; code <= ABS_MISC; ++code) {
+    input_absinfo info {};
+    if (TestBit(abs_bits, code) && ::ioctl(fd, EVIOCGABS(code), &info) >= 0) {
+      out_layout.abs_axes.push_back(EvdevLayout::AbsAxis { .code = code, .minimum = info.minimum, .maximum = info.maximum, .value = info.value });
+    }
+  }
+  for (uint16_t code = BTN_MISC; code < KEY_CNT; ++code) {
+    if (TestBit(key_bits, code)) {
+      out_layout.keys.push_back(code);
+    }
+  }
+  return true;
+}
+
+/// Instance GUIDs are derived from the event node number and the device id, so they stay the same for as long as the device stays plugged in.
+GUID MakeNodeGuid(uint32_t node_number, input_id const& id) {
+  GUID guid {};
+  guid.Data1 = node_number + 1;
+  guid.Data2 = id.vendor;
+  guid.Data3 = id.product;
+  guid.Data4[0] = static_cast<uint8_t>(id.bustype);
+  guid.Data4[1] = static_cast<uint8_t>(id.bustype >> 8);
+  guid.Data4[2] = static_cast<uint8_t>(id.version);
+  guid.Data4[3] = static_cast<uint8_t>(id.version >> 8);
+  std::copy(kNodeGuidMarker.begin(), kNodeGuidMarker.end(), guid.Data4 + 4);
+  return guid;
+}
+
+GUID MakeStreamGuid(size_t stream_index) {
+  GUID guid {};
+  guid.Data1 = static_cast<uint32_t>(stream_index + 1);
+  std::copy(kStreamGuidMarker.begin(), kStreamGuidMarker.end(), guid.Data4 + 4);
+  return guid;
+}
+
+}
+
+// ------------------------------------------------------------------------------------------------
+// EvdevDeviceSource
+//
+
+/// Turns the `input_event`s of one device into its `DIJOYSTATE2` and, with `Config::buffered_input`, DirectInput-style buffered events.
+class EvdevBackend::EvdevDeviceSource final : public DirectInputContext::DeviceSource {
+public:
+  /// What an `EV_ABS` code maps to.
+  struct AbsTarget final {
+    enum class Kind : uint8_t { kNone, kAxis, kHatX, kHatY };
+
+    Kind kind = Kind::kNone;
+    /// Axis: `DIJOYSTATE2` offset; hat: POV index.
+    DWORD target = 0;
+    int32_t minimum = 0;
+    int32_t maximum = 0;
+  };
+
+  EvdevDeviceSource(EvdevBackend& backend, int fd, bool is_node, DWORD buffer_size)
+    : backend_(backend), fd_(fd), is_node_(is_node), buffer_size_(buffer_size)
+  {
+  }
+
+  ~EvdevDeviceSource() noexcept override {
+    backend_.UnregisterSource(this);
+  }
+
+  int GetFd() const {
+    return fd_;
+  }
+
+  /// Maps `layout` onto `out_device` and sets the initial state.
+  void Configure(EvdevLayout const& layout, DirectInputContext::Device& out_device) {
+    using Input = DirectInputContext::Input;
+    using InputType = DirectInputContext::InputType;
+
+    // Axes: first the ones with a natural slot, then the others in whatever slot is left.
+    std::array<bool, kAxisOffsets.size()> used_slots {};
+    std::vector<EvdevLayout::AbsAxis const*> other_axes;
+    for (EvdevLayout::AbsAxis const& axis : layout.abs_axes) {
+      if (!IsJoystickAbs(axis.code) || IsHat(axis.code)) {
+        continue;
+      }
+      int const slot = GetPreferredAxisSlot(axis.code);
+      if (slot >= 0 && !used_slots[slot]) {
+        used_slots[slot] = true;
+        this->MapAxis(axis, kAxisOffsets[slot]);
+      }
+      else {
+        other_axes.push_back(&axis);
+      }
+    }
+    for (EvdevLayout::AbsAxis const* axis : other_axes) {
+      auto it = std::find(used_slots.begin(), used_slots.end(), false);
+      if (it == used_slots.end()) {
+        break;
+      }
+      *it = true;
+      this->MapAxis(*axis, kAxisOffsets[it - used_slots.begin()]);
+    }
+    for (size_t slot = 0; slot < kAxisOffsets.size(); ++slot) {
+      if (used_slots[slot]) {
+        out_device.axes.push_back(Input { .type = InputType::kAxis, .index = static_cast<DWORD>(out_device.axes.size()), .offset = kAxisOffsets[slot] });
+      }
+    }
+
+    // POVs: one per hat with either axis, numbered in hat order.
+    std::array<int, kMaxPovs> hat_povs = { -1, -1, -1, -1 };
+    for (EvdevLayout::AbsAxis const& axis : layout.abs_axes) {
+      if (IsHat(axis.code)) {
+        hat_povs[(axis.code - ABS_HAT0X) / 2] = 0;
+      }
+    }
+    DWORD pov_count = 0;
+    for (int& pov : hat_povs) {
+      if (pov >= 0) {
+        pov = static_cast<int>(pov_count++);
+      }
+    }
+    for (EvdevLayout::AbsAxis const& axis : layout.abs_axes) {
+      if (IsHat(axis.code)) {
+        DWORD const pov = static_cast<DWORD>(hat_povs[(axis.code - ABS_HAT0X) / 2]);
+        abs_targets_[axis.code] = AbsTarget {
+          .kind = ((axis.code - ABS_HAT0X) % 2 == 0) ? AbsTarget::Kind::kHatX : AbsTarget::Kind::kHatY,
+          .target = pov,
+          .minimum = axis.minimum,
+          .maximum = axis.maximum,
+        };
+      }
+    }
+    for (DWORD i = 0; i < pov_count; ++i) {
+      out_device.povs.push_back(Input { .type = InputType::kPOV, .index = i, .offset = static_cast<DWORD>(DIJOFS_POV(i)) });
+      state_.rgdwPOV[i] = 0xFFFFFFFF;
+    }
+
+    // Buttons.
+    std::vector<uint16_t> keys = layout.keys;
+    std::sort(keys.begin(), keys.end(), KeyOrderLess);
+    keys.resize(std::min<size_t>(keys.size(), kMaxButtons));
+    key_buttons_.assign(KEY_CNT, -1);
+    for (DWORD i = 0; i < keys.size(); ++i) {
+      if (keys[i] < KEY_CNT) {
+        key_buttons_[keys[i]] = static_cast<int16_t>(i);
+        out_device.buttons.push_back(Input { .type = InputType::kButton, .index = i, .offset = static_cast<DWORD>(DIJOFS_BUTTON(i)) });
+      }
+    }
+
+    out_device.caps = {};
+    out_device.caps.dwSize = sizeof(DIDEVCAPS);
+    out_device.caps.dwAxes = static_cast<DWORD>(out_device.axes.size());
+    out_device.caps.dwButtons = static_cast<DWORD>(out_device.buttons.size());
+    out_device.caps.dwPOVs = pov_count;
+
+    for (EvdevLayout::AbsAxis const& axis : layout.abs_axes) {
+      this->ApplyAbs(axis.code, axis.value, 0, false);
+    }
+    if (is_node_) {
+      this->ReadKeyState();
+    }
+  }
+
+  HRESULT Acquire() override {
+    if (lost_) {
+      return DIERR_INPUTLOST;
+    }
+    acquired_ = true;
+    return DI_OK;
+  }
+
+  /// Everything was already read by `EvdevBackend::BeginPoll`.
+  HRESULT Poll() override {
+    if (lost_) {
+      return DIERR_INPUTLOST;
+    }
+    return acquired_ ? DI_OK : DIERR_NOTACQUIRED;
+  }
+
+  HRESULT GetDeviceState(DIJOYSTATE2& out_state) override {
+    if (!acquired_) {
+      return DIERR_NOTACQUIRED;
+    }
+    out_state = state_;
+    return DI_OK;
+  }
+
+  /// A node polls readable while it has unread events, which `EvdevBackend::BeginPoll` reads. A stream standing in for a device may poll readable
+  /// for good once it ends, so it is polled instead.
+  InputNotificationHandle GetNotificationHandle() override {
+    return is_node_ ? fd_ : kNoInputNotification;
+  }
+
+  HRESULT ReadBufferedEvents(DIDEVICEOBJECTDATA* out_data, DWORD& inout_count) override {
+    DWORD const count = std::min<DWORD>(inout_count, static_cast<DWORD>(buffer_.size() - buffer_read_index_));
+    std::copy_n(buffer_.begin() + buffer_read_index_, count, out_data);
+    buffer_read_index_ += count;
+    inout_count = count;
+
+    if (buffer_read_index_ == buffer_.size()) {
+      buffer_.clear();
+      buffer_read_index_ = 0;
+    }
+
+    bool const overflowed = buffer_overflowed_;
+    buffer_overflowed_ = false;
+    return overflowed ? DI_BUFFEROVERFLOW : DI_OK;
+  }
+
+  /// Reads and applies everything available without blocking, or with `single_report`, only the events up to and including the next `SYN_REPORT`,
+  /// leaving the rest for the next call. Returns `false` once there is nothing more to ever read: the end of a file or pipe, or an unplugged device.
+  bool ReadAvailable(bool single_report) {
+    while (true) {
+      if (single_report && this->ApplyPendingEvents(true)) {
+        return true;
+      }
+
+      size_t const requested = sizeof(read_buffer_) - pending_bytes_;
+      ssize_t const size = ::read(fd_, read_buffer_.data() + pending_bytes_, requested);
+      if (size < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN) {
+          return true;
+        }
+        // `ENODEV`: unplugged.
+        lost_ = true;
+        return false;
+      }
+      if (size == 0) {
+        // End of a file or of a pipe whose writer is gone. Keep the last state.
+        return false;
+      }
+
+      pending_bytes_ += static_cast<size_t>(size);
+      if (this->ApplyPendingEvents(single_report)) {
+        return true;
+      }
+
+      if (static_cast<size_t>(size) < requested) {
+        // Short read: drained, no need for a call that would only return `EAGAIN`.
+        return true;
+      }
+    }
+  }
+
+private:
+  void MapAxis(EvdevLayout::AbsAxis const& axis, DWORD offset) {
+    abs_targets_[axis.code] = AbsTarget {
+      .kind = AbsTarget::Kind::kAxis,
+      .target = offset,
+      .minimum = axis.minimum,
+      .maximum = axis.maximum,
+    };
+  }
+
+  /// Applies the whole events in `read_buffer_`, or with `single_report`, those up to and including the first `SYN_REPORT`.
+  /// Returns whether it stopped at one.
+  bool ApplyPendingEvents(bool single_report) {
+    size_t const event_count = pending_bytes_ / sizeof(input_event);
+    size_t applied_count = 0;
+    bool reported = false;
+    while (applied_count < event_count && !reported) {
+      input_event event;
+      std::memcpy(&event, read_buffer_.data() + applied_count * sizeof(input_event), sizeof(input_event));
+      this->ApplyEvent(event);
+      ++applied_count;
+      reported = single_report && event.type == EV_SYN && event.code == SYN_REPORT;
+    }
+
+    // Pipes may deliver part of an event; keep it for the next read.
+    pending_bytes_ -= applied_count * sizeof(input_event);
+    std::memmove(read_buffer_.data(), read_buffer_.data() + applied_count * sizeof(input_event), pending_bytes_);
+    return reported;
+  }
+
+  void ApplyEvent(input_event const& event) {
+    if (dropping_) {
+      if (event.type == EV_SYN && event.code == SYN_REPORT) {
+        dropping_ = false;
+        if (is_node_) {
+          this->Resync();
+        }
+      }
+      return;
+    }
+
+    DWORD const timestamp = static_cast<DWORD>(event.input_event_sec * 1000 + event.input_event_usec / 1000);
+
+    switch (event.type) {
+    case EV_ABS:
+      if (event.code < ABS_CNT) {
+        this->ApplyAbs(event.code, event.value, timestamp, true);
+      }
+      break;
+    case EV_KEY:
+      if (event.code < key_buttons_.size() && key_buttons_[event.code] >= 0) {
+        // 2 is autorepeat, still pressed.
+        this->SetButton(static_cast<DWORD>(key_buttons_[event.code]), event.value != 0 ? 0x80 : 0x00, timestamp, true);
+      }
+      break;
+    case EV_SYN:
+      if (event.code == SYN_DROPPED) {
+        // The kernel's buffer overflowed: events were lost, so have the context resynchronize from a snapshot.
+        // What follows up to the next `SYN_REPORT` is part of an incomplete report: skip it, then re-read the state of a node.
+        buffer_overflowed_ = true;
+        dropping_ = true;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  void ApplyAbs(uint16_t code, int32_t value, DWORD timestamp, bool buffer) {
+    AbsTarget const& target = abs_targets_[code];
+    switch (target.kind) {
+    case AbsTarget::Kind::kAxis: {
+      LONG scaled = 0;
+      if (target.maximum > target.minimum) {
+        int64_t const clamped = std::clamp<int64_t>(value, target.minimum, target.maximum);
+        scaled = static_cast<LONG>(
+          DirectInputContext::kAxisMin +
+          (clamped - target.minimum) * (int64_t(DirectInputContext::kAxisMax) - DirectInputContext::kAxisMin) / (int64_t(target.maximum) - target.minimum)
+        );
+      }
+      LONG& slot = reinterpret_cast<LONG*>(&state_)[target.target / sizeof(LONG)];
+      if (slot != scaled) {
+        slot = scaled;
+        if (buffer) {
+          this->Buffer(target.target, static_cast<DWORD>(scaled), timestamp);
+        }
+      }
+      break;
+    }
+    case AbsTarget::Kind::kHatX:
+    case AbsTarget::Kind::kHatY: {
+      int64_t const center = (int64_t(target.minimum) + target.maximum) / 2;
+      int8_t const direction = (value < center) ? -1 : (value > center) ? 1 : 0;
+      std::array<int8_t, 2>& hat = hats_[target.target];
+      hat[target.kind == AbsTarget::Kind::kHatX ? 0 : 1] = direction;
+      this->SetPov(target.target, timestamp, buffer);
+      break;
+    }
+    case AbsTarget::Kind::kNone:
+      break;
+    }
+  }
+
+  void SetPov(DWORD pov, DWORD timestamp, bool buffer) {
+    // Indexed by [y + 1][x + 1]; DirectInput measures clockwise from north, in hundredths of degrees.
+    static constexpr DWORD kAngles[3][3] = {
+      { 31500, 0, 4500 },
+      { 27000, 0xFFFFFFFF, 9000 },
+      { 22500, 18000, 13500 },
+    };
+    std::array<int8_t, 2> const& hat = hats_[pov];
+    DWORD const value = kAngles[hat[1] + 1][hat[0] + 1];
+    if (state_.rgdwPOV[pov] != value) {
+      state_.rgdwPOV[pov] = value;
+      if (buffer) {
+        this->Buffer(static_cast<DWORD>(DIJOFS_POV(pov)), value, timestamp);
+      }
+    }
+  }
+
+  void SetButton(DWORD button, BYTE value, DWORD timestamp, bool buffer) {
+    if (state_.rgbButtons[button] != value) {
+      state_.rgbButtons[button] = value;
+      if (buffer) {
+        this->Buffer(static_cast<DWORD>(DIJOFS_BUTTON(button)), value, timestamp);
+      }
+    }
+  }
+
+  void Buffer(DWORD offset, DWORD value, DWORD timestamp) {
+    if (buffer_size_ == 0) {
+      return;
+    }
+    if (buffer_.size() - buffer_read_index_ >= buffer_size_) {
+      buffer_overflowed_ = true;
+      return;
+    }
+    DIDEVICEOBJECTDATA& data = buffer_.emplace_back();
+    data.dwOfs = offset;
+    data.dwData = value;
+    data.dwTimeStamp = timestamp;
+    data.dwSequence = sequence_++;
+  }
+
+  void ReadKeyState() {
+    KeyBits key_bits {};
+    if (::ioctl(fd_, EVIOCGKEY(sizeof(key_bits)), key_bits.data()) < 0) {
+      return;
+    }
+    for (size_t code = 0; code < key_buttons_.size(); ++code) {
+      if (key_buttons_[code] >= 0) {
+        this->SetButton(static_cast<DWORD>(key_buttons_[code]), TestBit(key_bits, code) ? 0x80 : 0x00, 0, false);
+      }
+    }
+  }
+
+  /// Re-reads the current state of a device node, at the `SYN_REPORT` that ends the report a `SYN_DROPPED` cut short.
+  void Resync() {
+    for (uint16_t code = 0; code < ABS_CNT; ++code) {
+      input_absinfo info {};
+      if (abs_targets_[code].kind != AbsTarget::Kind::kNone && ::ioctl(fd_, EVIOCGABS(code), &info) >= 0) {
+        this->ApplyAbs(code, info.value, 0, false);
+      }
+    }
+    this->ReadKeyState();
+  }
+
+  EvdevBackend& backend_;
+  int fd_ = -1;
+  bool is_node_ = false;
+  DWORD buffer_size_ = 0;
+
+  std::array<AbsTarget, ABS_CNT> abs_targets_ {};
+  /// Indexed by key code: the button index, or -1.
+  std::vector<int16_t> key_buttons_;
+  /// x and y of each hat, in {-1, 0, 1}.
+  std::array<std::array<int8_t, 2>, kMaxPovs> hats_ {};
+
+  bool acquired_ = false;
+  bool lost_ = false;
+  DIJOYSTATE2 state_ {};
+
+  std::array<uint8_t, 64 * sizeof(input_event)> read_buffer_;
+  size_t pending_bytes_ = 0;
+  /// From `SYN_DROPPED` to the next `SYN_REPORT`.
+  bool dropping_ = false;
+
+  std::vector<DIDEVICEOBJECTDATA> buffer_;
+  size_t buffer_read_index_ = 0;
+  bool buffer_overflowed_ = false;
+  DWORD sequence_ = 0;
+};
+
+// ------------------------------------------------------------------------------------------------
+// EvdevBackend
+//
+
+EvdevBackend::EvdevBackend(std::string directory)
+  : directory_(std::move(directory))
+{
+}
+
+EvdevBackend::~EvdevBackend() noexcept {
+  this->Shutdown();
+}
+
+void EvdevBackend::AddStreamDevice(StreamDevice device) {
+  std::lock_guard lock(candidates_mutex_);
+  stream_devices_.push_back(std::move(device));
+}
+
+bool EvdevBackend::Initialize(DirectInputContext::Config const& config) {
+  buffer_size_ = config.buffered_input ? config.device_buffer_size : 0;
+
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  return epoll_fd_ >= 0;
+}
+
+void EvdevBackend::Shutdown() {
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+    epoll_fd_ = -1;
+  }
+  candidates_.clear();
+}
+
+void EvdevBackend::EnumerateDevices(std::vector<GUID>& out_guids) {
+  // Probing the nodes is slow; only publishing the result is under the lock that `OpenDevice` takes.
+  std::vector<Candidate> candidates;
+
+  std::error_code ec;
+  for (std::filesystem::directory_entry const& entry : std::filesystem::directory_iterator(directory_, ec)) {
+    std::string const filename = entry.path().filename().string();
+    if (!filename.starts_with("event")) {
+      continue;
+    }
+
+    int const fd = ::open(entry.path().c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      // Typically no permission: not in the `input` group.
+      continue;
+    }
+
+    input_id id {};
+    AbsBits abs_bits {};
+    KeyBits key_bits {};
+    bool const is_joystick =
+      ::ioctl(fd, EVIOCGID, &id) >= 0 &&
+      ::ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits.data()) >= 0 &&
+      ::ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits.data()) >= 0 &&
+      IsJoystick(abs_bits, key_bits);
+    ::close(fd);
+
+    if (is_joystick) {
+      uint32_t const node_number = static_cast<uint32_t>(std::strtoul(filename.c_str() + 5, nullptr, 10));
+      candidates.push_back(Candidate { .guid = MakeNodeGuid(node_number, id), .path = entry.path().string() });
+    }
+  }
+
+  std::lock_guard lock(candidates_mutex_);
+  for (size_t i = 0; i < stream_devices_.size(); ++i) {
+    candidates.push_back(Candidate { .guid = MakeStreamGuid(i), .path = stream_devices_[i].path, .stream_index = static_cast<int>(i) });
+  }
+
+  for (Candidate const& candidate : candidates) {
+    out_guids.push_back(candidate.guid);
+  }
+  candidates_ = std::move(candidates);
+}
+
+std::unique_ptr<DirectInputContext::DeviceSource> EvdevBackend::OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) {
+  using OpenStage = DirectInputContext::OpenStage;
+
+  // Copied, as `EnumerateDevices` may replace them meanwhile.
+  std::string path;
+  EvdevLayout layout;
+  bool is_node = true;
+  {
+    std::lock_guard lock(candidates_mutex_);
+    auto it = std::find_if(
+      candidates_.begin(), candidates_.end(),
+      [&guid](Candidate const& candidate) {
+        return candidate.guid == guid;
+      }
+    );
+    if (it == candidates_.end()) {
+      return nullptr;
+    }
+    path = it->path;
+    is_node = it->stream_index < 0;
+    if (!is_node) {
+      out_device.name = stream_devices_[it->stream_index].name;
+      layout = stream_devices_[it->stream_index].layout;
+    }
+  }
+
+  DirectInputContext::OpenTimings& timings = out_device.open_timings;
+  uint64_t stage_start = GetMonotonicTimeNs();
+
+  int const fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  timings.EndStage(OpenStage::kCreateDevice, stage_start);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  if (is_node) {
+    char name[256] = {};
+    if (::ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name) < 0) {
+      ::close(fd);
+      return nullptr;
+    }
+    out_device.name = name;
+    timings.EndStage(OpenStage::kProductName, stage_start);
+
+    if (!QueryLayout(fd, layout)) {
+      ::close(fd);
+      return nullptr;
+    }
+    timings.EndStage(OpenStage::kCapabilities, stage_start);
+  }
+
+  auto source = std::make_unique<EvdevDeviceSource>(*this, fd, is_node, buffer_size_);
+  source->Configure(layout, out_device);
+  this->RegisterSource(source.get());
+  timings.EndStage(OpenStage::kObjects, stage_start);
+
+  return source;
+}
+
+void EvdevBackend::RegisterSource(EvdevDeviceSource* source) {
+  std::lock_guard lock(sources_mutex_);
+
+  epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.ptr = source;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, source->GetFd(), &event) < 0) {
+    // `EPERM`: a regular file, which is always "readable", so just read it every time.
+    unwatched_sources_.push_back(source);
+  }
+}
+
+void EvdevBackend::UnregisterSource(EvdevDeviceSource* source) {
+  std::lock_guard lock(sources_mutex_);
+
+  std::erase(unwatched_sources_, source);
+  // Closing the descriptor also removes it from the `epoll` set.
+  ::close(source->GetFd());
+}
+
+void EvdevBackend::BeginPoll() {
+  std::lock_guard lock(sources_mutex_);
+
+  std::array<epoll_event, 64> events;
+  while (true) {
+    int const count = ::epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 0);
+    for (int i = 0; i < count; ++i) {
+      auto* source = static_cast<EvdevDeviceSource*>(events[i].data.ptr);
+      if (!source->ReadAvailable(false)) {
+        // Ended or unplugged: stop watching, or a hung-up descriptor would be reported on every wait.
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, source->GetFd(), nullptr);
+      }
+    }
+    if (count < static_cast<int>(events.size())) {
+      break;
+    }
+  }
+
+  // One report per round, or a whole recording would be applied at once.
+  std::erase_if(unwatched_sources_, [](EvdevDeviceSource* source) {
+    return !source->ReadAvailable(true);
+  });
+}
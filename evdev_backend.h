@@ -0,0 +1,93 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// The capabilities of an evdev device: which `EV_ABS` and `EV_KEY` codes it reports.
+struct EvdevLayout final {
+  struct AbsAxis final {
+    uint16_t code = 0;
+    int32_t minimum = 0;
+    int32_t maximum = 0;
+    /// Initial value.
+    int32_t value = 0;
+  };
+
+  std::vector<AbsAxis> abs_axes;
+  std::vector<uint16_t> keys;
+};
+
+/// Enumerates and opens the joysticks under `/dev/input` (`event*`) on Linux, mapping them onto the same model as DirectInput:
+///  - `ABS_X` to `ABS_RZ`, `ABS_THROTTLE` and `ABS_RUDDER` become the axes of the same names and the two sliders, and other absolute axes
+///    take whichever of those slots is left, all scaled to `[kAxisMin, kAxisMax]`;
+///  - `ABS_HAT0X`/`ABS_HAT0Y` to `ABS_HAT3X`/`ABS_HAT3Y` become POVs;
+///  - keys become buttons, joystick and gamepad buttons first, like SDL does.
+///
+/// Devices are read with non-blocking `read`s, only once `epoll` reports them readable, all in one batch before each round of polls
+/// (see `DirectInputContext::Backend::BeginPoll`). When no device has input, a round costs a single `epoll_wait`.
+///
+/// Besides device nodes, raw `input_event` streams can be read from files or pipes (e.g. recorded with `cat /dev/input/eventN > file`)
+/// through `AddStreamDevice`, to exercise the backend without hardware. A regular file is read one `SYN_REPORT` per round of polls,
+/// so that a recording replays report by report rather than all at once.
+class EvdevBackend final : public DirectInputContext::Backend {
+public:
+  struct StreamDevice final {
+    std::string name;
+    /// A file or a named pipe of `input_event`s.
+    std::string path;
+    /// What the stream reports, since it cannot be queried from a file.
+    EvdevLayout layout;
+  };
+
+  explicit EvdevBackend(std::string directory = "/dev/input");
+  ~EvdevBackend() noexcept override;
+
+  EvdevBackend(EvdevBackend const&) = delete;
+  EvdevBackend(EvdevBackend&&) = delete;
+  EvdevBackend& operator=(EvdevBackend const&) = delete;
+  EvdevBackend& operator=(EvdevBackend&&) = delete;
+
+  /// Enumerated along with the device nodes from then on. Call on the thread that calls `DirectInputContext::UpdateDetection`.
+  void AddStreamDevice(StreamDevice device);
+
+  bool Initialize(DirectInputContext::Config const& config) override;
+  void Shutdown() override;
+
+  void EnumerateDevices(std::vector<GUID>& out_guids) override;
+  std::unique_ptr<DirectInputContext::DeviceSource> OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) override;
+  void BeginPoll() override;
+
+  class EvdevDeviceSource;
+
+private:
+  struct Candidate final {
+    GUID guid {};
+    std::string path;
+    /// Index into `stream_devices_`, or -1 for a device node.
+    int stream_index = -1;
+  };
+
+  /// Watches `source` with `epoll`, or reads it on every `BeginPoll` if it cannot be watched.
+  void RegisterSource(EvdevDeviceSource* source);
+  /// Stops reading `source` and closes its descriptor.
+  void UnregisterSource(EvdevDeviceSource* source);
+
+  std::string directory_;
+  /// Guards `stream_devices_` and `candidates_`, as `OpenDevice` may run on another thread than `EnumerateDevices` (see `Config::async_device_open`).
+  std::mutex candidates_mutex_;
+  std::vector<StreamDevice> stream_devices_;
+  /// The result of the latest `EnumerateDevices`.
+  std::vector<Candidate> candidates_;
+
+  int epoll_fd_ = -1;
+  DWORD buffer_size_ = 0;
+
+  /// Sources are opened on the thread that calls `UpdateDetection`, but may be polled by the polling thread.
+  std::mutex sources_mutex_;
+  /// Sources that `epoll` cannot watch (regular files), read one report on every `BeginPoll` until their end.
+  std::vector<EvdevDeviceSource*> unwatched_sources_;
+};
@@ -0,0 +1,18 @@
+//
+// Headless data acquisition, without the example's window: see `HeadlessOptions`, e.g.
+//   direct_input_headless --headless --format=ndjson --rate=1000 --output=capture.ndjson
+//   direct_input_headless --headless --format=binary --synthetic=16 --duration=5000 > capture.dirc
+//
+
+#include "headless_stream.h"
+
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+  HeadlessOptions options;
+  if (ParseHeadlessOptions(argc, argv, options) != HeadlessParseResult::kHeadless) {
+    std::clog << "Usage: " << argv[0] << " --headless [--format=ndjson|binary] [--rate=<Hz> | --wait] [--output=<path>] [--duration=<ms>] [--flush-interval=<ms>] [--synthetic=<device count>] [--shared-memory=<name>] [--trace=<path>]" << std::endl;
+    return 1;
+  }
+  return RunHeadlessUntilInterrupted(options);
+}
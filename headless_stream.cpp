@@ -0,0 +1,278 @@
+#include "headless_stream.h"
+
+#include "direct_input_context.h"
+#include "input_recording.h"
+#include "ndjson_state_writer.h"
+#include "synthetic_backend.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+#if defined(_WIN32)
+# include <fcntl.h>
+# include <io.h>
+# include <timeapi.h>
+#endif
+
+namespace {
+
+std::atomic<bool> g_interrupted { false };
+
+void OnInterrupt(int) {
+  g_interrupted.store(true, std::memory_order_relaxed);
+}
+
+/// `true` and the text after `prefix` if `argument` starts with it.
+bool MatchOption(std::string_view argument, std::string_view prefix, std::string_view& out_value) {
+  if (!argument.starts_with(prefix)) {
+    return false;
+  }
+  out_value = argument.substr(prefix.size());
+  return true;
+}
+
+/// `true` and the number in `value` if it is only decimal digits, and fits.
+bool ParseUint(std::string_view value, uint32_t& out_value) {
+  if (value.empty() || value.front() < '0' || value.front() > '9') {
+    return false;
+  }
+  std::string const text(value);
+  char* end = nullptr;
+  errno = 0;
+  unsigned long const parsed = std::strtoul(text.c_str(), &end, 10);
+  if (end != text.c_str() + text.size() || errno == ERANGE || parsed > UINT32_MAX) {
+    return false;
+  }
+  out_value = static_cast<uint32_t>(parsed);
+  return true;
+}
+
+}
+
+HeadlessParseResult ParseHeadlessOptions(int argc, char* argv[], HeadlessOptions& out_options) {
+  bool headless = false;
+  bool valid = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const argument = argv[i];
+    std::string_view value;
+    auto ParseNumber = [&](uint32_t& out_number) {
+      if (!ParseUint(value, out_number)) {
+        std::clog << "Invalid number in \"" << argument << "\"." << std::endl;
+        valid = false;
+      }
+    };
+
+    if (argument == "--headless") {
+      headless = true;
+    }
+    else if (MatchOption(argument, "--format=", value)) {
+      if (value == "ndjson") {
+        out_options.format = HeadlessOptions::Format::kNdjson;
+      }
+      else if (value == "binary") {
+        out_options.format = HeadlessOptions::Format::kBinary;
+      }
+      else {
+        std::clog << "Unknown format \"" << value << "\"; expected \"ndjson\" or \"binary\"." << std::endl;
+        valid = false;
+      }
+    }
+    else if (MatchOption(argument, "--rate=", value)) {
+      ParseNumber(out_options.rate_hz);
+    }
+    else if (argument == "--wait") {
+      out_options.wait_for_input = true;
+    }
+    else if (MatchOption(argument, "--output=", value)) {
+      out_options.output_path = value;
+    }
+    else if (MatchOption(argument, "--duration=", value)) {
+      ParseNumber(out_options.duration_ms);
+    }
+    else if (MatchOption(argument, "--flush-interval=", value)) {
+      ParseNumber(out_options.flush_interval_ms);
+    }
+    else if (MatchOption(argument, "--synthetic=", value)) {
+      ParseNumber(out_options.synthetic_device_count);
+    }
+    else if (MatchOption(argument, "--shared-memory=", value)) {
+      out_options.shared_memory_name = value;
+    }
+    else if (MatchOption(argument, "--trace=", value)) {
+      out_options.trace_path = value;
+    }
+    else if (argument.starts_with("--")) {
+      // Most likely a misspelled option, which would otherwise be left at its default.
+      std::clog << "Unknown option \"" << argument << "\"." << std::endl;
+      valid = false;
+    }
+  }
+
+  if (!valid) {
+    return HeadlessParseResult::kInvalid;
+  }
+  return headless ? HeadlessParseResult::kHeadless : HeadlessParseResult::kNotHeadless;
+}
+
+int RunHeadless(HeadlessOptions const& options, std::atomic<bool> const& stop) {
+  using Clock = std::chrono::steady_clock;
+
+  if (options.rate_hz == 0 && !options.wait_for_input) {
+    std::clog << "The rate must be at least 1 Hz." << std::endl;
+    return 1;
+  }
+  if (!options.trace_path.empty() && !CONFIG_USE_TRACING) {
+    std::clog << "--trace requires a build with tracing (USE_TRACING)." << std::endl;
+    return 1;
+  }
+
+  TRACE_THREAD_NAME("Headless");
+
+  DirectInputContext::Config config {};
+  config.shared_memory_name = options.shared_memory_name;
+
+  DirectInputContext context;
+  bool const initialized = (options.synthetic_device_count > 0)
+    ? context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(options.synthetic_device_count)), config)
+    : context.Initialize(config);
+  if (!initialized) {
+    std::clog << "Failed to initialize the input context." << std::endl;
+    return 1;
+  }
+
+  std::ofstream file;
+  std::ostream* out = &std::cout;
+  if (!options.output_path.empty()) {
+    file.open(options.output_path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::clog << "Failed to open \"" << options.output_path << "\"." << std::endl;
+      return 1;
+    }
+    out = &file;
+  }
+  else {
+#if defined(_WIN32)
+    // Keep "\n" from becoming "\r\n", which would corrupt the binary format.
+    ::_setmode(::_fileno(stdout), _O_BINARY);
+#endif
+  }
+
+  // Only one of them is used. Both batch their writes.
+  std::unique_ptr<NdjsonStateWriter> ndjson_writer;
+  std::unique_ptr<InputRecorder> recorder;
+  if (options.format == HeadlessOptions::Format::kNdjson) {
+    ndjson_writer = std::make_unique<NdjsonStateWriter>(*out);
+  }
+  else {
+    recorder = std::make_unique<InputRecorder>(*out);
+  }
+
+#if defined(_WIN32)
+  // The default timer resolution (~15.6 ms) would cap us at 64 Hz.
+  ::timeBeginPeriod(1);
+#endif
+
+  auto const interval = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / std::max<uint32_t>(options.rate_hz, 1);
+  auto const flush_interval = std::chrono::milliseconds(options.flush_interval_ms);
+
+  Clock::time_point const start_time = Clock::now();
+  Clock::time_point const end_time = start_time + std::chrono::milliseconds(options.duration_ms);
+  Clock::time_point next_update_time = start_time;
+  Clock::time_point last_flush_time = start_time;
+  uint64_t update_count = 0;
+  uint64_t overrun_count = 0;
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    Clock::time_point now = Clock::now();
+    if (options.duration_ms > 0 && now >= end_time) {
+      break;
+    }
+
+    context.UpdateDetection();
+    if (options.wait_for_input) {
+      // Wake up at least to flush, and to stop.
+      Clock::duration timeout = std::max<Clock::duration>(last_flush_time + flush_interval - now, Clock::duration::zero());
+      if (options.duration_ms > 0) {
+        timeout = std::min(timeout, end_time - now);
+      }
+      context.WaitForInput(timeout);
+      // The wait may have lasted up to the whole timeout: stamp and flush as of when it returned.
+      now = Clock::now();
+    }
+    else {
+      context.UpdateState();
+    }
+
+    uint64_t const time_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - start_time).count());
+    {
+      TRACE_ZONE("Record");
+      if (ndjson_writer != nullptr) {
+        ndjson_writer->Record(context, time_us);
+      }
+      else {
+        recorder->Record(context, time_us);
+      }
+    }
+    ++update_count;
+
+    if (now - last_flush_time >= flush_interval) {
+      TRACE_ZONE("Flush");
+      if (ndjson_writer != nullptr) {
+        ndjson_writer->Flush();
+      }
+      else {
+        recorder->Flush();
+      }
+      last_flush_time = now;
+    }
+
+    if (options.wait_for_input) {
+      continue;
+    }
+    next_update_time += interval;
+    Clock::time_point const after = Clock::now();
+    if (after > next_update_time) {
+      // Don't try to catch up on missed updates; that would only update in a burst.
+      ++overrun_count;
+      next_update_time = after;
+      continue;
+    }
+    std::this_thread::sleep_until(next_update_time);
+  }
+
+#if defined(_WIN32)
+  ::timeEndPeriod(1);
+#endif
+
+  // Flushes the rest.
+  uint64_t const bytes_written = (ndjson_writer != nullptr) ? ndjson_writer->GetBytesWritten() : recorder->GetBytesWritten();
+  ndjson_writer.reset();
+  recorder.reset();
+
+  std::clog << "Headless: " << update_count << " updates (" << overrun_count << " overruns), " << bytes_written << " bytes written." << std::endl;
+
+  context.Shutdown();
+
+  if (!options.trace_path.empty() && !WriteChromeTrace(options.trace_path.c_str())) {
+    std::clog << "Failed to write \"" << options.trace_path << "\"." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int RunHeadlessUntilInterrupted(HeadlessOptions const& options) {
+  std::signal(SIGINT, OnInterrupt);
+  std::signal(SIGTERM, OnInterrupt);
+  return RunHeadless(options, g_interrupted);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/// Data acquisition without any window or rendering: polls devices at a fixed rate and streams their changes.
+struct HeadlessOptions final {
+  enum class Format {
+    /// `NdjsonStateWriter`.
+    kNdjson,
+    /// `InputRecorder`, which `InputReplayBackend` can play back.
+    kBinary,
+  };
+
+  Format format = Format::kNdjson;
+  /// How many times per second `UpdateState` is called and changes are written.
+  uint32_t rate_hz = 1000;
+  /// Instead of updating at `rate_hz`, block in `DirectInputContext::WaitForInput` and write each change as soon as a device signals it.
+  /// Uses next to no CPU while the devices are idle; devices that cannot signal are polled every `Config::wait_poll_interval_ms`.
+  bool wait_for_input = false;
+  /// Empty for stdout.
+  std::string output_path;
+  /// How long to run, or 0 to run until stopped.
+  uint32_t duration_ms = 0;
+  /// Writes are batched, but flushed at least this often so that a reader sees changes promptly.
+  uint32_t flush_interval_ms = 100;
+  /// If not 0, streams that many `SyntheticBackend` devices instead of the platform's devices.
+  uint32_t synthetic_device_count = 0;
+  /// If not empty, also publishes every device into a shared-memory region of this name; see `SharedStateReader`.
+  std::string shared_memory_name;
+  /// If not empty, the trace recorded meanwhile is written there on exit, as Chrome trace-event JSON (see `WriteChromeTrace`).
+  /// Only when built with `CONFIG_USE_TRACING`.
+  std::string trace_path;
+};
+
+enum class HeadlessParseResult {
+  /// `--headless` is not among the arguments.
+  kNotHeadless,
+  kHeadless,
+  /// An option is unknown or has a value it cannot take, which was reported to stderr: exit with a non-zero code rather than run.
+  kInvalid,
+};
+
+/// Tells whether `--headless` is among the arguments, and fills out `out_options` from the others:
+/// `--format=ndjson|binary`, `--rate=<Hz>`, `--wait`, `--output=<path>`, `--duration=<ms>`, `--flush-interval=<ms>`, `--synthetic=<device count>`, `--shared-memory=<name>` and `--trace=<path>`.
+/// Any other argument starting with `--` is rejected, as is a number that is not one.
+HeadlessParseResult ParseHeadlessOptions(int argc, char* argv[], HeadlessOptions& out_options);
+
+/// Runs until `options.duration_ms` has passed or `stop` is set, e.g. from a signal handler. Diagnostics go to stderr.
+/// Returns the process exit code.
+int RunHeadless(HeadlessOptions const& options, std::atomic<bool> const& stop);
+
+/// `RunHeadless`, stopped by Ctrl+C (`SIGINT`) or `SIGTERM`.
+int RunHeadlessUntilInterrupted(HeadlessOptions const& options);
@@ -0,0 +1,227 @@
+#include "input_coroutines.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/// The axes of `device` in `Device::axes` order, as of `state`.
+void ReadAxes(DirectInputContext::Device const& device, DIJOYSTATE2 const& state, std::array<LONG, PackedState::kMaxAxes>& out_axes) {
+  size_t const count = std::min(device.axes.size(), out_axes.size());
+  for (size_t i = 0; i < count; ++i) {
+    std::memcpy(&out_axes[i], reinterpret_cast<BYTE const*>(&state) + device.axes[i].offset, sizeof(LONG));
+  }
+}
+
+}
+
+InputScheduler::Awaiter::~Awaiter() noexcept {
+  // A coroutine destroyed while suspended, e.g. by `~InputScheduler`.
+  if (device_waits_ != nullptr || has_timer_) {
+    scheduler_->RemoveWait(*this);
+  }
+}
+
+bool InputScheduler::Awaiter::await_suspend(std::coroutine_handle<InputTask::promise_type> handle) {
+  handle_ = handle;
+  if (!scheduler_->AddWait(*this)) {
+    result_ = false;
+    return false;
+  }
+  return true;
+}
+
+InputScheduler::InputScheduler(DirectInputContext const& context)
+  : context_(context)
+{
+}
+
+InputScheduler::~InputScheduler() noexcept {
+  // Each suspended awaiter removes its wait as its coroutine is destroyed.
+  for (std::coroutine_handle<InputTask::promise_type> handle : tasks_) {
+    handle.destroy();
+  }
+}
+
+InputScheduler::Awaiter InputScheduler::NextPress(DeviceHandle device, DWORD button) {
+  return Awaiter(*this, WaitKind::kPress, device, button, 0, Direction::kRising);
+}
+
+InputScheduler::Awaiter InputScheduler::NextRelease(DeviceHandle device, DWORD button) {
+  return Awaiter(*this, WaitKind::kRelease, device, button, 0, Direction::kFalling);
+}
+
+InputScheduler::Awaiter InputScheduler::AxisCrosses(DeviceHandle device, DWORD axis, LONG threshold, Direction direction) {
+  WaitKind const kind = (direction == Direction::kFalling) ? WaitKind::kAxisFalling : WaitKind::kAxisRising;
+  return Awaiter(*this, kind, device, axis, threshold, direction);
+}
+
+InputScheduler::Awaiter InputScheduler::Delay(std::chrono::nanoseconds duration) {
+  return WithTimeout(Awaiter(*this, WaitKind::kDelay, DeviceHandle {}, 0, 0, Direction::kEither), duration);
+}
+
+InputScheduler::Awaiter InputScheduler::WithTimeout(Awaiter awaiter, std::chrono::nanoseconds timeout) {
+  awaiter.timeout_ns_ = static_cast<uint64_t>(std::max<int64_t>(timeout.count(), 0));
+  return awaiter;
+}
+
+void InputScheduler::Start(InputTask task) {
+  std::coroutine_handle<InputTask::promise_type> const handle = std::exchange(task.handle_, nullptr);
+  handle.promise().task_index = tasks_.size();
+  tasks_.push_back(handle);
+  this->Resume(handle);
+}
+
+void InputScheduler::Update() {
+  for (std::unique_ptr<DeviceWaits> const& entry_pointer : device_waits_) {
+    DeviceWaits& entry = *entry_pointer;
+
+    // Takes every wait in [first, last) out of `entry.waits`.
+    auto MakeRangeReady = [this](auto first, auto last, bool result) {
+      while (first != last) {
+        Awaiter& awaiter = *(first++)->second;
+        this->MakeReady(awaiter, result);
+      }
+    };
+
+    DirectInputContext::Device const* device = context_.GetDevice(entry.device);
+    if (device == nullptr) {
+      MakeRangeReady(entry.waits.begin(), entry.waits.end(), false);
+      continue;
+    }
+    if (device->LoadSampleTimes().last_change_ns == entry.last_change_ns) {
+      continue;
+    }
+
+    DirectInputContext::Sample const sample = device->LoadSample();
+    ButtonBits const down = PackButtons(sample.state.rgbButtons);
+    std::array<LONG, PackedState::kMaxAxes> axes = entry.axes;
+    ReadAxes(*device, sample.state, axes);
+
+    (down & ~entry.down).ForEach([&](DWORD index) {
+      auto const [first, last] = entry.waits.equal_range(InputKey { WaitKind::kPress, index, 0 });
+      MakeRangeReady(first, last, true);
+    });
+    (entry.down & ~down).ForEach([&](DWORD index) {
+      auto const [first, last] = entry.waits.equal_range(InputKey { WaitKind::kRelease, index, 0 });
+      MakeRangeReady(first, last, true);
+    });
+    // The thresholds an axis went past are contiguous in `entry.waits`.
+    for (DWORD i = 0; i < axes.size(); ++i) {
+      LONG const before = entry.axes[i];
+      LONG const after = axes[i];
+      if (after > before) {
+        MakeRangeReady(
+          entry.waits.lower_bound(InputKey { WaitKind::kAxisRising, i, before + 1 }),
+          entry.waits.upper_bound(InputKey { WaitKind::kAxisRising, i, after }),
+          true
+        );
+      }
+      else if (after < before) {
+        MakeRangeReady(
+          entry.waits.lower_bound(InputKey { WaitKind::kAxisFalling, i, after }),
+          entry.waits.lower_bound(InputKey { WaitKind::kAxisFalling, i, before }),
+          true
+        );
+      }
+    }
+
+    entry.last_change_ns = sample.times.last_change_ns;
+    entry.down = down;
+    entry.axes = axes;
+  }
+
+  uint64_t const now = GetMonotonicTimeNs();
+  while (!timers_.empty() && timers_.begin()->first <= now) {
+    this->MakeReady(*timers_.begin()->second, false);
+  }
+
+  // Resuming destroys the awaiter, so `handle_` is read first. A resumed coroutine may wait again, but never on an awaiter still in `ready_`.
+  for (Awaiter* awaiter : ready_) {
+    this->Resume(awaiter->handle_);
+  }
+  ready_.clear();
+
+  std::erase_if(device_waits_, [](std::unique_ptr<DeviceWaits> const& entry) { return entry->waits.empty(); });
+}
+
+InputScheduler::DeviceWaits* InputScheduler::GetDeviceWaits(DeviceHandle device) {
+  for (std::unique_ptr<DeviceWaits> const& entry : device_waits_) {
+    if (entry->device == device) {
+      return entry.get();
+    }
+  }
+
+  DirectInputContext::Device const* const connected = context_.GetDevice(device);
+  DirectInputContext::Sample const sample = connected->LoadSample();
+  auto entry = std::make_unique<DeviceWaits>();
+  entry->device = device;
+  entry->last_change_ns = sample.times.last_change_ns;
+  entry->down = PackButtons(sample.state.rgbButtons);
+  ReadAxes(*connected, sample.state, entry->axes);
+  device_waits_.push_back(std::move(entry));
+  return device_waits_.back().get();
+}
+
+bool InputScheduler::AddWait(Awaiter& awaiter) {
+  if (awaiter.kind_ != WaitKind::kDelay) {
+    DirectInputContext::Device const* const device = context_.GetDevice(awaiter.device_);
+    if (device == nullptr) {
+      return false;
+    }
+    bool const is_button = awaiter.kind_ == WaitKind::kPress || awaiter.kind_ == WaitKind::kRelease;
+    size_t const input_count = is_button ? device->buttons.size() : std::min<size_t>(device->axes.size(), PackedState::kMaxAxes);
+    if (awaiter.index_ >= input_count) {
+      return false;
+    }
+    DeviceWaits* const entry = this->GetDeviceWaits(awaiter.device_);
+
+    if (awaiter.direction_ == Direction::kEither && (awaiter.kind_ == WaitKind::kAxisRising || awaiter.kind_ == WaitKind::kAxisFalling)) {
+      // Compared against the value as of the previous `Update`, like every wait on the device.
+      awaiter.kind_ = (entry->axes[awaiter.index_] < awaiter.threshold_) ? WaitKind::kAxisRising : WaitKind::kAxisFalling;
+    }
+    awaiter.input_it_ = entry->waits.emplace(InputKey { awaiter.kind_, awaiter.index_, awaiter.threshold_ }, &awaiter);
+    awaiter.device_waits_ = entry;
+  }
+
+  if (awaiter.timeout_ns_ != UINT64_MAX) {
+    uint64_t const now = GetMonotonicTimeNs();
+    uint64_t const deadline = (awaiter.timeout_ns_ < UINT64_MAX - now) ? now + awaiter.timeout_ns_ : UINT64_MAX;
+    awaiter.timer_it_ = timers_.emplace(deadline, &awaiter);
+    awaiter.has_timer_ = true;
+  }
+
+  ++wait_count_;
+  return true;
+}
+
+void InputScheduler::RemoveWait(Awaiter& awaiter) {
+  if (awaiter.device_waits_ != nullptr) {
+    awaiter.device_waits_->waits.erase(awaiter.input_it_);
+    awaiter.device_waits_ = nullptr;
+  }
+  if (awaiter.has_timer_) {
+    timers_.erase(awaiter.timer_it_);
+    awaiter.has_timer_ = false;
+  }
+  --wait_count_;
+}
+
+void InputScheduler::MakeReady(Awaiter& awaiter, bool result) {
+  this->RemoveWait(awaiter);
+  awaiter.result_ = result;
+  ready_.push_back(&awaiter);
+}
+
+void InputScheduler::Resume(std::coroutine_handle<InputTask::promise_type> handle) {
+  handle.resume();
+  if (!handle.done()) {
+    return;
+  }
+
+  size_t const index = handle.promise().task_index;
+  tasks_[index] = tasks_.back();
+  tasks_[index].promise().task_index = index;
+  tasks_.pop_back();
+  handle.destroy();
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <array>
+#include <chrono>
+#include <compare>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// A coroutine run by an `InputScheduler`, which owns it from `InputScheduler::Start` on and destroys it once it returns.
+/// It may only `co_await` the awaitables of its scheduler, not another `InputTask`.
+class InputTask final {
+public:
+  struct promise_type final {
+    /// In `InputScheduler::tasks_`.
+    size_t task_index = 0;
+
+    InputTask get_return_object() {
+      return InputTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    /// Runs from `InputScheduler::Start`, and stays suspended once done for the scheduler to destroy it.
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_always final_suspend() noexcept {
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() {
+      std::terminate();
+    }
+  };
+
+  InputTask(InputTask&& other) noexcept
+    : handle_(std::exchange(other.handle_, nullptr))
+  {
+  }
+  InputTask& operator=(InputTask&&) = delete;
+  /// Destroys the coroutine if it was never started.
+  ~InputTask() noexcept {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+private:
+  friend class InputScheduler;
+
+  explicit InputTask(std::coroutine_handle<promise_type> handle)
+    : handle_(handle)
+  {
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/// Runs coroutines that wait for input, instead of state machines polled every frame against `Device::GetButtonValue` or `GetAxisValue`, e.g.
+///
+///   InputTask ArmSequence(InputScheduler& scheduler, DirectInputContext::DeviceHandle stick) {
+///     if (!co_await scheduler.NextPress(stick, 0)) {
+///       co_return; // Disconnected.
+///     }
+///     if (co_await InputScheduler::WithTimeout(scheduler.AxisCrosses(stick, 2, 16384), std::chrono::seconds(2))) {
+///       ...
+///     }
+///   }
+///
+///   InputScheduler scheduler(context);
+///   scheduler.Start(ArmSequence(scheduler, stick));
+///   ...
+///   context.UpdateState();
+///   scheduler.Update();
+///
+/// Waits are indexed by device and input: `Update` only looks at the devices some coroutine waits on and whose state changed since the previous call,
+/// and then only at the waits that the change satisfies, so thousands of suspended coroutines cost next to nothing while their inputs are idle.
+/// Changes are seen as of each `Update`: a press and release that both happen between two calls go unnoticed.
+/// Works with or without the polling thread, but must be used on the thread that calls `DirectInputContext::UpdateDetection`.
+class InputScheduler final {
+  enum class WaitKind : uint32_t {
+    kPress,
+    kRelease,
+    kAxisRising,
+    kAxisFalling,
+    kDelay,
+  };
+
+  /// Orders the waits on a device so that those a change satisfies are one range: e.g. every rising threshold an axis went past.
+  struct InputKey final {
+    WaitKind kind;
+    DWORD index;
+    LONG threshold;
+
+    auto operator<=>(InputKey const&) const = default;
+  };
+
+  struct DeviceWaits;
+
+public:
+  using DeviceHandle = DirectInputContext::DeviceHandle;
+
+  enum class Direction : uint32_t {
+    /// From below the threshold to at least the threshold.
+    kRising,
+    /// From above the threshold to at most the threshold.
+    kFalling,
+    /// `kRising` if the axis is below the threshold when awaited, `kFalling` otherwise.
+    kEither,
+  };
+
+  /// What a coroutine awaits. Resumes it with `true` once its condition is met, or with `false` if it timed out, or if its device was disconnected
+  /// or does not have the input.
+  class Awaiter final {
+  public:
+    Awaiter(Awaiter const&) = default;
+    Awaiter& operator=(Awaiter const&) = delete;
+    ~Awaiter() noexcept;
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+    /// Returns `false`, resuming right away, if the device is not connected or does not have the input.
+    bool await_suspend(std::coroutine_handle<InputTask::promise_type> handle);
+    bool await_resume() const noexcept {
+      return result_;
+    }
+
+  private:
+    friend class InputScheduler;
+
+    Awaiter(InputScheduler& scheduler, WaitKind kind, DeviceHandle device, DWORD index, LONG threshold, Direction direction)
+      : scheduler_(&scheduler), kind_(kind), device_(device), index_(index), threshold_(threshold), direction_(direction)
+    {
+    }
+
+    InputScheduler* scheduler_;
+    WaitKind kind_;
+    DeviceHandle device_;
+    DWORD index_;
+    LONG threshold_;
+    Direction direction_;
+    /// `UINT64_MAX` for none.
+    uint64_t timeout_ns_ = UINT64_MAX;
+
+    /// Set while suspended.
+    std::coroutine_handle<InputTask::promise_type> handle_;
+    bool result_ = false;
+    /// Where the wait is indexed, if it is: `input_it_` into `device_waits_->waits`, `timer_it_` into `InputScheduler::timers_`.
+    DeviceWaits* device_waits_ = nullptr;
+    std::multimap<InputKey, Awaiter*>::iterator input_it_;
+    bool has_timer_ = false;
+    std::multimap<uint64_t, Awaiter*>::iterator timer_it_;
+  };
+
+  explicit InputScheduler(DirectInputContext const& context);
+  /// Destroys the coroutines still suspended.
+  ~InputScheduler() noexcept;
+
+  InputScheduler(InputScheduler const&) = delete;
+  InputScheduler& operator=(InputScheduler const&) = delete;
+
+  /// Resumes once button `button` (in `Device::buttons` order) goes down, or up.
+  Awaiter NextPress(DeviceHandle device, DWORD button);
+  Awaiter NextRelease(DeviceHandle device, DWORD button);
+  /// Resumes once axis `axis` (in `Device::axes` order) crosses `threshold`, a raw value in [`DirectInputContext::kAxisMin`, `kAxisMax`], in `direction`.
+  Awaiter AxisCrosses(DeviceHandle device, DWORD axis, LONG threshold, Direction direction = Direction::kEither);
+  /// Resumes with `false` once `duration` has passed.
+  Awaiter Delay(std::chrono::nanoseconds duration);
+  /// `awaiter`, but resumed with `false` if it is still waiting `timeout` after being awaited.
+  static Awaiter WithTimeout(Awaiter awaiter, std::chrono::nanoseconds timeout);
+
+  /// Runs `task` until it first suspends.
+  void Start(InputTask task);
+  /// Resumes the coroutines whose waits are over: after every `DirectInputContext::UpdateState`, or more often for finer `Delay`s.
+  void Update();
+
+  /// Coroutines started and not finished yet.
+  size_t GetTaskCount() const {
+    return tasks_.size();
+  }
+  /// Suspended awaiters.
+  size_t GetWaitCount() const {
+    return wait_count_;
+  }
+
+private:
+  /// What the waits on one device were last compared against.
+  struct DeviceWaits final {
+    DeviceHandle device {};
+    uint64_t last_change_ns = 0;
+    ButtonBits down {};
+    std::array<LONG, PackedState::kMaxAxes> axes {};
+    std::multimap<InputKey, Awaiter*> waits;
+  };
+
+  /// Finds the entry of `device`, or adds it with the device's current state. `device` must be connected.
+  DeviceWaits* GetDeviceWaits(DeviceHandle device);
+  /// Adds the wait of `awaiter`, resolving `Direction::kEither`. Returns `false` if it can never be met.
+  bool AddWait(Awaiter& awaiter);
+  void RemoveWait(Awaiter& awaiter);
+  /// Takes `awaiter` out of every index, to be resumed with `result`.
+  void MakeReady(Awaiter& awaiter, bool result);
+  void Resume(std::coroutine_handle<InputTask::promise_type> handle);
+
+  DirectInputContext const& context_;
+  std::vector<std::coroutine_handle<InputTask::promise_type>> tasks_;
+  /// Only devices some coroutine waits on, until an `Update` finds no wait left on them. Not moved, as awaiters point to them.
+  std::vector<std::unique_ptr<DeviceWaits>> device_waits_;
+  std::multimap<uint64_t, Awaiter*> timers_;
+  size_t wait_count_ = 0;
+  /// Filled and emptied by `Update`.
+  std::vector<Awaiter*> ready_;
+};
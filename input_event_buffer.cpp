@@ -0,0 +1,108 @@
+#include "input_event_buffer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+InputEventRing::InputEventRing(size_t capacity)
+  : events_((capacity != 0) ? std::bit_ceil(capacity) : 0)
+{
+}
+
+bool InputEventRing::Push(BufferedInputEvent const& event) {
+  size_t const capacity = events_.size();
+  if (capacity == 0) {
+    return false;
+  }
+
+  events_[static_cast<size_t>(write_count_) & (capacity - 1)] = event;
+  ++write_count_;
+
+  return write_count_ > capacity;
+}
+
+size_t InputEventRing::Read(uint64_t& inout_cursor, std::span<BufferedInputEvent> out_events, uint64_t* out_lost_count) const {
+  size_t const capacity = events_.size();
+
+  uint64_t lost_count = 0;
+  uint64_t const oldest = (write_count_ > capacity) ? write_count_ - capacity : 0;
+  if (inout_cursor < oldest) {
+    lost_count = oldest - inout_cursor;
+    inout_cursor = oldest;
+  }
+  if (out_lost_count != nullptr) {
+    *out_lost_count = lost_count;
+  }
+
+  size_t const count = static_cast<size_t>(std::min<uint64_t>(write_count_ - inout_cursor, out_events.size()));
+  for (size_t i = 0; i < count; ++i) {
+    out_events[i] = events_[static_cast<size_t>(inout_cursor + i) & (capacity - 1)];
+  }
+  inout_cursor += count;
+
+  return count;
+}
+
+void ApplyInputEvent(DIJOYSTATE2& state, BufferedInputEvent const& event) {
+  // Buttons are single bytes.
+  if (event.offset >= DIJOFS_BUTTON(0) && event.offset < DIJOFS_BUTTON(128)) {
+    state.rgbButtons[event.offset - DIJOFS_BUTTON(0)] = static_cast<BYTE>(event.value);
+    return;
+  }
+
+  // Everything else (axes, POVs, and the velocity/acceleration/force axes) is a `LONG` or a `DWORD`.
+  if (event.offset % sizeof(DWORD) != 0 || event.offset + sizeof(DWORD) > sizeof(DIJOYSTATE2)) {
+    return;
+  }
+  std::memcpy(reinterpret_cast<BYTE*>(&state) + event.offset, &event.value, sizeof(DWORD));
+}
+
+HRESULT DrainInputEvents(BufferedInputSource& source, InputEventRing& ring, BufferedInputStats& stats, DIJOYSTATE2* state) {
+  static constexpr DWORD kChunkSize = 64;
+
+  bool overflowed = false;
+  uint64_t const start_write_count = ring.GetWriteCount();
+  HRESULT hr = DI_OK;
+  while (true) {
+    DIDEVICEOBJECTDATA data[kChunkSize];
+    DWORD count = kChunkSize;
+
+    hr = source.ReadBufferedEvents(data, count);
+    if (FAILED(hr)) {
+      return hr;
+    }
+    if (hr == DI_BUFFEROVERFLOW) {
+      overflowed = true;
+      ++stats.source_overflow_count;
+    }
+
+    for (DWORD i = 0; i < count; ++i) {
+      BufferedInputEvent const event {
+        .offset = data[i].dwOfs,
+        .value = data[i].dwData,
+        .timestamp = data[i].dwTimeStamp,
+        .sequence = data[i].dwSequence,
+      };
+
+      if (ring.Push(event)) {
+        ++stats.ring_overwrite_count;
+      }
+      if (state != nullptr) {
+        ApplyInputEvent(*state, event);
+      }
+    }
+    stats.event_count += count;
+
+    // A short read means the device buffer is empty.
+    if (count < kChunkSize) {
+      break;
+    }
+  }
+
+  if (ring.GetCapacity() != 0 && ring.GetWriteCount() - start_write_count > ring.GetCapacity()) {
+    overflowed = true;
+    ++stats.ring_overflow_count;
+  }
+
+  return overflowed ? DI_BUFFEROVERFLOW : hr;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "direct_input_compat.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// A single buffered change of one device object, as read from the device buffer (`IDirectInputDevice8::GetDeviceData`).
+struct BufferedInputEvent final {
+  /// Byte offset into `DIJOYSTATE2` of the object (POV, axis or button) that changed.
+  DWORD offset;
+  /// The new value: an axis position, a POV angle in hundredths of a degree, or a button state (0x80 when pressed).
+  DWORD value;
+  /// Milliseconds, as reported by the device source.
+  DWORD timestamp;
+  /// Increases monotonically across all devices of a source, so it can be used to order events that share a `timestamp`.
+  DWORD sequence;
+};
+
+/// Where buffered events come from.
+/// Implemented on top of `IDirectInputDevice8::GetDeviceData`, or by a synthetic source.
+class BufferedInputSource {
+public:
+  virtual ~BufferedInputSource() = default;
+
+  /// Removes up to `inout_count` events from the device buffer and writes them to `out_data`.
+  /// On return, `inout_count` holds the number of events written.
+  /// Same contract as `IDirectInputDevice8::GetDeviceData`: returns `DI_BUFFEROVERFLOW` if events were lost
+  /// because the device buffer filled up since the last read.
+  virtual HRESULT ReadBufferedEvents(DIDEVICEOBJECTDATA* out_data, DWORD& inout_count) = 0;
+};
+
+struct BufferedInputStats final {
+  /// Number of events read from the source.
+  uint64_t event_count = 0;
+  /// Number of reads on which the source reported `DI_BUFFEROVERFLOW`, i.e. events were lost before we read them.
+  uint64_t source_overflow_count = 0;
+  /// Number of events that were overwritten in the `InputEventRing` before the ring wrapped around.
+  uint64_t ring_overwrite_count = 0;
+  /// Number of reads that pushed more events than the `InputEventRing` holds, so that some of them were overwritten before anyone could read them.
+  uint64_t ring_overflow_count = 0;
+};
+
+/// Fixed-capacity ring of the most recent `BufferedInputEvent`s of a device.
+/// The oldest events get overwritten once the ring is full.
+/// Readers keep their own cursor, so any number of them can consume the same ring at their own pace.
+class InputEventRing final {
+public:
+  InputEventRing() = default;
+  /// `capacity` is rounded up to a power of two. A capacity of 0 allocates nothing, and every `Push` is dropped.
+  explicit InputEventRing(size_t capacity);
+
+  size_t GetCapacity() const { return events_.size(); }
+  /// Total number of events ever pushed. This is also the cursor value for "up to date".
+  uint64_t GetWriteCount() const { return write_count_; }
+
+  /// Returns `true` if an older event got overwritten.
+  bool Push(BufferedInputEvent const& event);
+
+  /// Copies the events pushed after `inout_cursor` into `out_events`, oldest first, and advances `inout_cursor`.
+  /// Returns the number of events copied.
+  /// If the ring has wrapped around past `inout_cursor`, the overwritten events are skipped and counted in `out_lost_count`.
+  size_t Read(uint64_t& inout_cursor, std::span<BufferedInputEvent> out_events, uint64_t* out_lost_count = nullptr) const;
+
+private:
+  std::vector<BufferedInputEvent> events_;
+  uint64_t write_count_ = 0;
+};
+
+/// Writes `event.value` into the field of `state` at `event.offset`.
+void ApplyInputEvent(DIJOYSTATE2& state, BufferedInputEvent const& event);
+
+/// Reads all pending events from `source` into `ring`, applying each to `state` (if not `nullptr`) in order.
+/// Returns the result of the last read, or `DI_BUFFEROVERFLOW` if any read reported an overflow, in which case `state` is missing some changes
+/// and should be resynchronized from a snapshot. Also returns `DI_BUFFEROVERFLOW` if more events were read than `ring` holds: `state` then has them
+/// all, but `ring` does not, so readers of `ring` cannot tell what happened either.
+HRESULT DrainInputEvents(BufferedInputSource& source, InputEventRing& ring, BufferedInputStats& stats, DIJOYSTATE2* state);
@@ -0,0 +1,153 @@
+#include "input_history.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+InputHistory::InputHistory(PackedStateLayout const& layout, size_t capacity, uint64_t retention_ns)
+  : layout_(layout)
+  , samples_((capacity > 0) ? std::bit_ceil(capacity) : 0)
+  , retention_ns_(retention_ns)
+{
+}
+
+uint64_t InputHistory::GetStartTime() const {
+  return (size_ > 0) ? this->At(0).time_ns : 0;
+}
+
+bool InputHistory::Record(uint64_t time_ns, uint64_t previous_seen_ns, PackedState const& state) {
+  size_t const capacity = samples_.size();
+  if (capacity == 0) {
+    return false;
+  }
+  if (size_ > 0 && std::memcmp(&this->At(size_ - 1).state, &state, sizeof(PackedState)) == 0) {
+    return false;
+  }
+
+  // Past the retention window, only the sample that was current at its start is still needed.
+  uint64_t const cutoff = (time_ns > retention_ns_) ? time_ns - retention_ns_ : 0;
+  while (size_ >= 2 && this->At(1).time_ns <= cutoff) {
+    head_ = (head_ + 1) & (capacity - 1);
+    --size_;
+  }
+
+  if (size_ == capacity) {
+    head_ = (head_ + 1) & (capacity - 1);
+    --size_;
+    ++overwrite_count_;
+  }
+
+  Sample& sample = samples_[(head_ + size_) & (capacity - 1)];
+  sample.time_ns = time_ns;
+  sample.previous_seen_ns = std::min(previous_seen_ns, time_ns);
+  sample.state = state;
+  ++size_;
+  return true;
+}
+
+void InputHistory::Clear() {
+  head_ = 0;
+  size_ = 0;
+}
+
+size_t InputHistory::UpperBound(uint64_t time_ns) const {
+  size_t first = 0;
+  size_t count = size_;
+  while (count > 0) {
+    size_t const step = count / 2;
+    if (this->At(first + step).time_ns <= time_ns) {
+      first += step + 1;
+      count -= step + 1;
+    }
+    else {
+      count = step;
+    }
+  }
+  return first;
+}
+
+InputHistory::Sample const* InputHistory::Find(uint64_t time_ns) const {
+  size_t const next = this->UpperBound(time_ns);
+  return (next > 0) ? &this->At(next - 1) : nullptr;
+}
+
+bool InputHistory::GetAxisValueAt(DWORD index, uint64_t time_ns, LONG& out_value) const {
+  size_t const next = this->UpperBound(time_ns);
+  if (next == 0 || index >= layout_.GetAxisCount()) {
+    return false;
+  }
+
+  auto Read = [this, index](Sample const& sample) {
+    int16_t value;
+    std::memcpy(&value, sample.state.bytes + layout_.GetAxisOffset(index), sizeof(value));
+    return PackedStateLayout::DecodeAxis(value);
+  };
+
+  LONG const value = Read(this->At(next - 1));
+  out_value = value;
+  if (next < size_) {
+    // The axis held `value` until `previous_seen_ns` of the next change, and moved to its value somewhere before that change's `time_ns`.
+    Sample const& after = this->At(next);
+    if (time_ns > after.previous_seen_ns) {
+      double const t = double(time_ns - after.previous_seen_ns) / double(after.time_ns - after.previous_seen_ns);
+      out_value = value + static_cast<LONG>(std::lround(t * double(Read(after) - value)));
+    }
+  }
+  return true;
+}
+
+bool InputHistory::GetPovValueAt(DWORD index, uint64_t time_ns, DWORD& out_value) const {
+  Sample const* sample = this->Find(time_ns);
+  if (sample == nullptr) {
+    return false;
+  }
+
+  uint16_t value;
+  std::memcpy(&value, sample->state.bytes + layout_.GetPovOffset(index), sizeof(value));
+  out_value = PackedStateLayout::DecodePov(value);
+  return true;
+}
+
+bool InputHistory::IsDown(size_t i, DWORD index) const {
+  return PackedStateLayout::DecodeButton(this->At(i).state.bytes[layout_.GetButtonOffset(index)], index) != 0;
+}
+
+bool InputHistory::IsButtonDownAt(DWORD index, uint64_t time_ns, bool& out_down) const {
+  size_t const next = this->UpperBound(time_ns);
+  if (next == 0) {
+    return false;
+  }
+  out_down = this->IsDown(next - 1, index);
+  return true;
+}
+
+uint32_t InputHistory::CountEdges(DWORD index, uint64_t from_ns, uint64_t to_ns, bool down) const {
+  // The oldest sample has nothing before it to compare with, so it is never an edge.
+  uint32_t count = 0;
+  for (size_t i = std::max<size_t>(this->UpperBound(from_ns), 1); i < size_ && this->At(i).time_ns <= to_ns; ++i) {
+    if (this->IsDown(i, index) == down && this->IsDown(i - 1, index) != down) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+uint32_t InputHistory::CountPresses(DWORD index, uint64_t from_ns, uint64_t to_ns) const {
+  return this->CountEdges(index, from_ns, to_ns, true);
+}
+
+uint32_t InputHistory::CountReleases(DWORD index, uint64_t from_ns, uint64_t to_ns) const {
+  return this->CountEdges(index, from_ns, to_ns, false);
+}
+
+bool InputHistory::WasDown(DWORD index, uint64_t from_ns, uint64_t to_ns) const {
+  // From the sample current at `from_ns` (or the oldest one), through every change until `to_ns`.
+  size_t const next = this->UpperBound(from_ns);
+  for (size_t i = (next > 0) ? next - 1 : 0; i < size_ && (i < next || this->At(i).time_ns <= to_ns); ++i) {
+    if (this->IsDown(i, index)) {
+      return true;
+    }
+  }
+  return false;
+}
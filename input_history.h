@@ -0,0 +1,76 @@
+#pragma once
+
+#include "packed_state.h"
+
+#include <cstdint>
+#include <vector>
+
+/// Fixed-capacity ring of a device's recent states, each recorded when it changed, for queries over time such as
+/// "was button 3 pressed within the last 150 ms" or "where was this axis at time t". Times are `GetMonotonicTimeNs` nanoseconds.
+///
+/// States are kept packed (see `PackedState`), so a sample is 56 bytes. All memory is allocated up front; recording and queries never allocate.
+/// Queries that look up a time are O(log n) in the number of samples kept, and windowed ones add one step per sample in the window.
+class InputHistory final {
+public:
+  struct Sample final {
+    /// When this state was first seen, i.e. the end of the poll that found it.
+    uint64_t time_ns = 0;
+    /// The latest time the previous state was still seen: the change happened somewhere in `(previous_seen_ns, time_ns]`.
+    uint64_t previous_seen_ns = 0;
+    PackedState state {};
+  };
+
+  InputHistory() = default;
+  /// `capacity` is rounded up to a power of two; 0 keeps no history. Samples more than `retention_ns` older than the latest one are dropped,
+  /// except the one that was still current back then, so that the state is known over the whole retention window.
+  InputHistory(PackedStateLayout const& layout, size_t capacity, uint64_t retention_ns);
+
+  size_t GetCapacity() const { return samples_.size(); }
+  size_t GetSize() const { return size_; }
+  /// The earliest time queries can answer for, or 0 if nothing was recorded.
+  uint64_t GetStartTime() const;
+  /// Number of samples overwritten because the ring was full before they fell out of the retention window.
+  uint64_t GetOverwriteCount() const { return overwrite_count_; }
+
+  /// Records `state`, seen at `time_ns`, unless it is the same as the latest one. `previous_seen_ns` is when the latest state was last seen, e.g. the previous poll.
+  /// Times must not decrease. Returns `true` if a sample was added.
+  bool Record(uint64_t time_ns, uint64_t previous_seen_ns, PackedState const& state);
+  void Clear();
+
+  /// The sample current at `time_ns`, i.e. the latest one at or before it, or `nullptr` if `time_ns` is before the history starts.
+  Sample const* Find(uint64_t time_ns) const;
+
+  /// These return `false` if `time_ns` is before the history starts.
+  /// Axis `index` at `time_ns`, linearly interpolated across a change (between its `previous_seen_ns` and `time_ns`).
+  bool GetAxisValueAt(DWORD index, uint64_t time_ns, LONG& out_value) const;
+  bool GetPovValueAt(DWORD index, uint64_t time_ns, DWORD& out_value) const;
+  bool IsButtonDownAt(DWORD index, uint64_t time_ns, bool& out_down) const;
+
+  /// Number of times button `index` went down, or up, in `(from_ns, to_ns]`. Only changes seen by a poll count:
+  /// a press that starts and ends between two polls is missed, unless it is replayed from `Config::buffered_input`.
+  uint32_t CountPresses(DWORD index, uint64_t from_ns, uint64_t to_ns) const;
+  uint32_t CountReleases(DWORD index, uint64_t from_ns, uint64_t to_ns) const;
+  bool WasPressed(DWORD index, uint64_t from_ns, uint64_t to_ns) const {
+    return this->CountPresses(index, from_ns, to_ns) > 0;
+  }
+  /// Button `index` was down at any time in `[from_ns, to_ns]`, as far as the history goes back.
+  bool WasDown(DWORD index, uint64_t from_ns, uint64_t to_ns) const;
+
+private:
+  /// The `i`-th sample, oldest first.
+  Sample const& At(size_t i) const {
+    return samples_[(head_ + i) & (samples_.size() - 1)];
+  }
+  /// The index of the first sample after `time_ns`, or `size_` if there is none.
+  size_t UpperBound(uint64_t time_ns) const;
+  bool IsDown(size_t i, DWORD index) const;
+  uint32_t CountEdges(DWORD index, uint64_t from_ns, uint64_t to_ns, bool down) const;
+
+  PackedStateLayout layout_;
+  std::vector<Sample> samples_;
+  uint64_t retention_ns_ = 0;
+  /// Of the oldest sample.
+  size_t head_ = 0;
+  size_t size_ = 0;
+  uint64_t overwrite_count_ = 0;
+};
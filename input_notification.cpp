@@ -0,0 +1,153 @@
+#include "input_notification.h"
+
+#include <algorithm>
+
+#if !defined(_WIN32)
+# include <ctime>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#if defined(__linux__)
+# include <sys/eventfd.h>
+#endif
+
+InputSignal::InputSignal() {
+#if defined(_WIN32)
+  handle_ = ::CreateEventA(nullptr, FALSE, FALSE, nullptr);
+#elif defined(__linux__)
+  handle_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+  int fds[2] = { -1, -1 };
+  if (::pipe(fds) == 0) {
+    for (int fd : fds) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+      ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    handle_ = fds[0];
+    write_fd_ = fds[1];
+  }
+#endif
+}
+
+InputSignal::~InputSignal() noexcept {
+  if (handle_ == kNoInputNotification) {
+    return;
+  }
+#if defined(_WIN32)
+  ::CloseHandle(handle_);
+#else
+  ::close(handle_);
+# if !defined(__linux__)
+  ::close(write_fd_);
+# endif
+#endif
+}
+
+void InputSignal::Set() {
+  if (handle_ == kNoInputNotification) {
+    return;
+  }
+#if defined(_WIN32)
+  ::SetEvent(handle_);
+#elif defined(__linux__)
+  uint64_t const value = 1;
+  [[maybe_unused]] ssize_t const written = ::write(handle_, &value, sizeof(value));
+#else
+  // A full pipe is signaled already.
+  char const value = 1;
+  [[maybe_unused]] ssize_t const written = ::write(write_fd_, &value, sizeof(value));
+#endif
+}
+
+void InputSignal::Reset() {
+  if (handle_ == kNoInputNotification) {
+    return;
+  }
+#if defined(_WIN32)
+  ::ResetEvent(handle_);
+#elif defined(__linux__)
+  uint64_t value = 0;
+  [[maybe_unused]] ssize_t const read = ::read(handle_, &value, sizeof(value));
+#else
+  char buffer[64];
+  while (::read(handle_, buffer, sizeof(buffer)) > 0) {
+  }
+#endif
+}
+
+bool InputWaitSet::SetHandles(std::span<InputNotificationHandle const> handles) {
+#if defined(_WIN32)
+  handles_.clear();
+  handles_.push_back(wake_.GetHandle());
+  bool complete = true;
+  for (HANDLE handle : handles) {
+    if (handle == kNoInputNotification) {
+      continue;
+    }
+    if (handles_.size() == MAXIMUM_WAIT_OBJECTS) {
+      complete = false;
+      break;
+    }
+    handles_.push_back(handle);
+  }
+  return complete;
+#else
+  poll_fds_.clear();
+  poll_fds_.push_back(pollfd { .fd = wake_.GetHandle(), .events = POLLIN, .revents = 0 });
+  for (int fd : handles) {
+    if (fd != kNoInputNotification) {
+      poll_fds_.push_back(pollfd { .fd = fd, .events = POLLIN, .revents = 0 });
+    }
+  }
+  return true;
+#endif
+}
+
+InputWaitSet::WaitResult InputWaitSet::Wait(std::chrono::nanoseconds timeout) {
+  timeout = std::max(timeout, std::chrono::nanoseconds(0));
+
+#if defined(_WIN32)
+  if (handles_.empty()) {
+    handles_.push_back(wake_.GetHandle());
+  }
+  // Rounded up, so that a short timeout does not turn into a busy loop.
+  DWORD const timeout_ms = static_cast<DWORD>(std::min<int64_t>((timeout.count() + 999'999) / 1'000'000, INFINITE - 1));
+  DWORD const result = ::WaitForMultipleObjects(static_cast<DWORD>(handles_.size()), handles_.data(), FALSE, timeout_ms);
+  if (result == WAIT_OBJECT_0) {
+    // `wake_` is an auto-reset event: waiting on it has consumed it.
+    return WaitResult::kWoken;
+  }
+  if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles_.size()) {
+    return WaitResult::kSignaled;
+  }
+  return WaitResult::kTimeout;
+#else
+  if (poll_fds_.empty()) {
+    poll_fds_.push_back(pollfd { .fd = wake_.GetHandle(), .events = POLLIN, .revents = 0 });
+  }
+
+  // Interrupted by a signal, this returns early as if it timed out; the caller waits again with what is left of its timeout.
+# if defined(__linux__)
+  timespec const ts {
+    .tv_sec = static_cast<time_t>(timeout.count() / 1'000'000'000),
+    .tv_nsec = static_cast<long>(timeout.count() % 1'000'000'000),
+  };
+  int const count = ::ppoll(poll_fds_.data(), poll_fds_.size(), &ts, nullptr);
+# else
+  int const count = ::poll(poll_fds_.data(), static_cast<nfds_t>(poll_fds_.size()), static_cast<int>(std::min<int64_t>((timeout.count() + 999'999) / 1'000'000, INT32_MAX)));
+# endif
+
+  if (count <= 0) {
+    return WaitResult::kTimeout;
+  }
+  if ((poll_fds_[0].revents & POLLIN) != 0) {
+    wake_.Reset();
+    return WaitResult::kWoken;
+  }
+  return WaitResult::kSignaled;
+#endif
+}
+
+void InputWaitSet::Wake() {
+  wake_.Set();
+}
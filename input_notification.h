@@ -0,0 +1,83 @@
+#pragma once
+
+#include "direct_input_compat.h"
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#if !defined(_WIN32)
+# include <poll.h>
+#endif
+
+/// What a device signals when it has new input: an event (`IDirectInputDevice8::SetEventNotification`) on Windows,
+/// a descriptor that polls readable on other platforms, e.g. an evdev node.
+#if defined(_WIN32)
+using InputNotificationHandle = HANDLE;
+inline constexpr InputNotificationHandle kNoInputNotification = nullptr;
+#else
+using InputNotificationHandle = int;
+inline constexpr InputNotificationHandle kNoInputNotification = -1;
+#endif
+
+/// A notification that is signaled by hand: an auto-reset event on Windows, an `eventfd` on Linux, a pipe on other platforms.
+/// `Set` can be called from any thread.
+class InputSignal final {
+public:
+  InputSignal();
+  ~InputSignal() noexcept;
+
+  InputSignal(InputSignal const&) = delete;
+  InputSignal& operator=(InputSignal const&) = delete;
+
+  /// `kNoInputNotification` if it could not be created.
+  InputNotificationHandle GetHandle() const {
+    return handle_;
+  }
+
+  void Set();
+  /// Unsignals it, so that waiting on it blocks again.
+  void Reset();
+
+private:
+  InputNotificationHandle handle_ = kNoInputNotification;
+#if !defined(_WIN32) && !defined(__linux__)
+  /// The write end of the pipe.
+  int write_fd_ = -1;
+#endif
+};
+
+/// Blocks until one of a set of notifications is signaled, or until `Wake` is called from another thread.
+/// On Windows, at most `MAXIMUM_WAIT_OBJECTS - 1` (63) handles are waited on; any past that are left out, which `SetHandles` reports.
+class InputWaitSet final {
+public:
+  enum class WaitResult : uint32_t {
+    kSignaled,
+    kWoken,
+    kTimeout,
+  };
+
+  InputWaitSet() = default;
+
+  InputWaitSet(InputWaitSet const&) = delete;
+  InputWaitSet& operator=(InputWaitSet const&) = delete;
+
+  /// Replaces the handles waited on. `kNoInputNotification` entries are skipped. Allocates only when the set grows.
+  /// Returns `false` if some handles were left out, as there were more than can be waited on: the caller has to poll what they stand for.
+  bool SetHandles(std::span<InputNotificationHandle const> handles);
+
+  /// A descriptor stays signaled until its input is read; a Windows auto-reset event that ends the wait is unsignaled by it.
+  WaitResult Wait(std::chrono::nanoseconds timeout);
+  /// Makes the current or next `Wait` return `kWoken`. Can be called from any thread.
+  void Wake();
+
+private:
+  InputSignal wake_;
+  /// `wake_` first.
+#if defined(_WIN32)
+  std::vector<HANDLE> handles_;
+#else
+  std::vector<pollfd> poll_fds_;
+#endif
+};
@@ -0,0 +1,513 @@
+#include "input_recording.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[4] = { 'D', 'I', 'R', 'C' };
+constexpr uint64_t kVersion = 1;
+
+enum RecordTag : uint8_t {
+  kFrame = 1,
+  kDeviceAdded = 2,
+  kDeviceRemoved = 3,
+  kDeviceState = 4,
+};
+
+constexpr uint64_t kAxisMaskShift = 0;
+constexpr uint64_t kPovMaskShift = 8;
+constexpr uint64_t kButtonsChangedBit = uint64_t(1) << 12;
+
+uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+LONG GetAxisWord(DIJOYSTATE2 const& state, uint8_t gather_index) {
+  return reinterpret_cast<LONG const*>(&state)[gather_index];
+}
+
+void SetAxisWord(DIJOYSTATE2& state, uint8_t gather_index, LONG value) {
+  reinterpret_cast<LONG*>(&state)[gather_index] = value;
+}
+
+}
+
+// ------------------------------------------------------------------------------------------------
+// InputRecorder
+//
+
+InputRecorder::InputRecorder(std::ostream& out, size_t buffer_size)
+  : out_(out), buffer_capacity_(std::max<size_t>(buffer_size, 256))
+{
+  buffer_.reserve(buffer_capacity_);
+
+  this->WriteBytes(kMagic, sizeof(kMagic));
+  this->WriteVarint(kVersion);
+}
+
+InputRecorder::~InputRecorder() noexcept {
+  this->Flush();
+}
+
+void InputRecorder::Flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  out_.write(reinterpret_cast<char const*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+  out_.flush();
+  bytes_written_ += buffer_.size();
+  buffer_.clear();
+}
+
+void InputRecorder::WriteByte(uint8_t value) {
+  if (buffer_.size() == buffer_capacity_) {
+    this->Flush();
+  }
+  buffer_.push_back(value);
+}
+
+void InputRecorder::WriteVarint(uint64_t value) {
+  while (value >= 0x80) {
+    this->WriteByte(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  this->WriteByte(static_cast<uint8_t>(value));
+}
+
+void InputRecorder::WriteBytes(void const* data, size_t size) {
+  uint8_t const* bytes = static_cast<uint8_t const*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    this->WriteByte(bytes[i]);
+  }
+}
+
+void InputRecorder::Record(DirectInputContext const& context, uint64_t time_us) {
+  this->WriteByte(kFrame);
+  this->WriteVarint(frame_count_ == 0 ? 0 : time_us - previous_time_us_);
+  previous_time_us_ = time_us;
+  ++frame_count_;
+
+  // Removals first, so that a reused id is free again by the time its new device is added.
+  for (uint32_t id = 0; id < tracked_.size(); ++id) {
+    TrackedDevice& tracked = tracked_[id];
+    if (tracked.handle == DirectInputContext::DeviceHandle {} || context.GetDevice(tracked.handle) != nullptr) {
+      continue;
+    }
+
+    this->WriteByte(kDeviceRemoved);
+    this->WriteVarint(id);
+    tracked.handle = {};
+  }
+
+  for (DirectInputContext::Device const& device : context.GetDevices()) {
+    uint32_t const id = device.handle.index;
+    if (id >= tracked_.size()) {
+      tracked_.resize(id + 1);
+    }
+
+    TrackedDevice& tracked = tracked_[id];
+    DIJOYSTATE2 const state = device.LoadState();
+
+    if (tracked.handle != device.handle) {
+      this->WriteDeviceAdded(id, device);
+      tracked.handle = device.handle;
+      // Record the initial state as a change from all zeros.
+      tracked.state = DIJOYSTATE2 {};
+    }
+
+    this->WriteDeviceState(id, device, tracked.state, state);
+    tracked.state = state;
+  }
+}
+
+void InputRecorder::WriteDeviceAdded(uint32_t id, DirectInputContext::Device const& device) {
+  this->WriteByte(kDeviceAdded);
+  this->WriteVarint(id);
+  this->WriteBytes(&device.guid, sizeof(GUID));
+  this->WriteVarint(device.name.size());
+  this->WriteBytes(device.name.data(), device.name.size());
+  this->WriteVarint(device.caps.dwPOVs);
+  this->WriteVarint(device.caps.dwAxes);
+  this->WriteVarint(device.caps.dwButtons);
+  this->WriteVarint(device.povs.size());
+  this->WriteVarint(device.buttons.size());
+  this->WriteVarint(device.axis_gather.size());
+  this->WriteBytes(device.axis_gather.data(), device.axis_gather.size());
+}
+
+void InputRecorder::WriteDeviceState(uint32_t id, DirectInputContext::Device const& device, DIJOYSTATE2 const& previous, DIJOYSTATE2 const& current) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < device.axis_gather.size(); ++i) {
+    if (GetAxisWord(current, device.axis_gather[i]) != GetAxisWord(previous, device.axis_gather[i])) {
+      mask |= uint64_t(1) << (kAxisMaskShift + i);
+    }
+  }
+  for (size_t i = 0; i < device.povs.size(); ++i) {
+    if (current.rgdwPOV[i] != previous.rgdwPOV[i]) {
+      mask |= uint64_t(1) << (kPovMaskShift + i);
+    }
+  }
+
+  ButtonBits const toggled = PackButtons(current.rgbButtons) ^ PackButtons(previous.rgbButtons);
+  if (toggled.Any()) {
+    mask |= kButtonsChangedBit;
+  }
+
+  if (mask == 0) {
+    return;
+  }
+
+  this->WriteByte(kDeviceState);
+  this->WriteVarint(id);
+  this->WriteVarint(mask);
+
+  for (size_t i = 0; i < device.axis_gather.size(); ++i) {
+    if ((mask >> (kAxisMaskShift + i)) & 1) {
+      int64_t const delta = int64_t(GetAxisWord(current, device.axis_gather[i])) - int64_t(GetAxisWord(previous, device.axis_gather[i]));
+      this->WriteVarint(ZigZagEncode(delta));
+    }
+  }
+  for (size_t i = 0; i < device.povs.size(); ++i) {
+    if ((mask >> (kPovMaskShift + i)) & 1) {
+      this->WriteVarint(static_cast<DWORD>(current.rgdwPOV[i] + 1));
+    }
+  }
+  if (mask & kButtonsChangedBit) {
+    this->WriteVarint(toggled.Count());
+    DWORD previous_index = 0;
+    toggled.ForEach([&](DWORD index) {
+      this->WriteVarint(index - previous_index);
+      previous_index = index;
+    });
+  }
+}
+
+// ------------------------------------------------------------------------------------------------
+// InputReplayBackend
+//
+
+struct InputReplayBackend::ReplayDevice final {
+  GUID guid {};
+  std::string name;
+  DIDEVCAPS caps {};
+  DWORD pov_count = 0;
+  DWORD button_count = 0;
+  std::vector<uint8_t> axis_gather;
+
+  bool attached = true;
+  /// Removed and added again in the same frame: left out of the next enumeration, so that the context closes the device it had open.
+  bool reappearing = false;
+  DIJOYSTATE2 state {};
+  /// Only filled with `Config::buffered_input`; drained by the context every `UpdateState`.
+  std::vector<DIDEVICEOBJECTDATA> events;
+  bool events_overflowed = false;
+};
+
+namespace {
+
+class ReplayDeviceSource final : public DirectInputContext::DeviceSource {
+public:
+  explicit ReplayDeviceSource(std::shared_ptr<InputReplayBackend::ReplayDevice> device) : device_(std::move(device)) {}
+
+  HRESULT Acquire() override {
+    return device_->attached ? DI_OK : DIERR_INPUTLOST;
+  }
+
+  HRESULT Poll() override {
+    return device_->attached ? DI_OK : DIERR_INPUTLOST;
+  }
+
+  HRESULT GetDeviceState(DIJOYSTATE2& out_state) override {
+    out_state = device_->state;
+    return DI_OK;
+  }
+
+  HRESULT ReadBufferedEvents(DIDEVICEOBJECTDATA* out_data, DWORD& inout_count) override {
+    std::vector<DIDEVICEOBJECTDATA>& events = device_->events;
+
+    DWORD const count = std::min<DWORD>(inout_count, static_cast<DWORD>(events.size()));
+    std::copy_n(events.begin(), count, out_data);
+    events.erase(events.begin(), events.begin() + count);
+    inout_count = count;
+
+    bool const overflowed = device_->events_overflowed;
+    device_->events_overflowed = false;
+    return overflowed ? DI_BUFFEROVERFLOW : DI_OK;
+  }
+
+private:
+  std::shared_ptr<InputReplayBackend::ReplayDevice> device_;
+};
+
+}
+
+InputReplayBackend::InputReplayBackend(std::istream& in)
+  : in_(in)
+{
+  char magic[sizeof(kMagic)] = {};
+  in_.read(magic, sizeof(magic));
+  if (!in_ || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    return;
+  }
+
+  uint64_t version = 0;
+  valid_ = this->ReadVarint(version) && version == kVersion;
+}
+
+bool InputReplayBackend::ReadByte(uint8_t& out_value) {
+  int const c = in_.get();
+  if (c == std::istream::traits_type::eof()) {
+    return false;
+  }
+  out_value = static_cast<uint8_t>(c);
+  return true;
+}
+
+bool InputReplayBackend::ReadVarint(uint64_t& out_value) {
+  out_value = 0;
+  for (uint32_t shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = 0;
+    if (!this->ReadByte(byte)) {
+      return false;
+    }
+    out_value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool InputReplayBackend::AdvanceFrame() {
+  if (!valid_) {
+    return false;
+  }
+
+  has_device_changes_ = false;
+  removed_guids_.clear();
+
+  uint8_t tag = 0;
+  uint64_t time_delta_us = 0;
+  if (!this->ReadByte(tag) || tag != kFrame || !this->ReadVarint(time_delta_us)) {
+    valid_ = false;
+    return false;
+  }
+  frame_time_us_ += time_delta_us;
+
+  // Everything up to the next frame belongs to this one.
+  while (in_.peek() != std::istream::traits_type::eof() && in_.peek() != kFrame) {
+    this->ReadByte(tag);
+
+    bool ok = false;
+    switch (tag) {
+    case kDeviceAdded: ok = this->ReadDeviceAdded(); break;
+    case kDeviceRemoved: ok = this->ReadDeviceRemoved(); break;
+    case kDeviceState: ok = this->ReadDeviceState(); break;
+    default: break;
+    }
+    if (!ok) {
+      valid_ = false;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool InputReplayBackend::ReadDeviceAdded() {
+  uint64_t id = 0;
+  if (!this->ReadVarint(id) || id > UINT32_MAX) {
+    return false;
+  }
+
+  auto device = std::make_shared<ReplayDevice>();
+
+  in_.read(reinterpret_cast<char*>(&device->guid), sizeof(GUID));
+
+  uint64_t name_size = 0;
+  if (!in_ || !this->ReadVarint(name_size) || name_size > 4096) {
+    return false;
+  }
+  device->name.resize(static_cast<size_t>(name_size));
+  in_.read(device->name.data(), static_cast<std::streamsize>(name_size));
+
+  uint64_t values[6] = {};
+  for (uint64_t& value : values) {
+    if (!this->ReadVarint(value)) {
+      return false;
+    }
+  }
+  uint64_t const axis_count = values[5];
+  if (values[3] > 4 || values[4] > 128 || axis_count > 8) {
+    return false;
+  }
+
+  device->caps.dwSize = sizeof(DIDEVCAPS);
+  device->caps.dwAxes = static_cast<DWORD>(values[1]);
+  device->caps.dwButtons = static_cast<DWORD>(values[2]);
+  device->caps.dwPOVs = static_cast<DWORD>(values[0]);
+  device->pov_count = static_cast<DWORD>(values[3]);
+  device->button_count = static_cast<DWORD>(values[4]);
+  device->axis_gather.resize(static_cast<size_t>(axis_count));
+  in_.read(reinterpret_cast<char*>(device->axis_gather.data()), static_cast<std::streamsize>(axis_count));
+  if (!in_) {
+    return false;
+  }
+  for (uint8_t gather_index : device->axis_gather) {
+    if (gather_index >= DIJOFS_POV(0) / sizeof(LONG)) {
+      return false;
+    }
+  }
+
+  device->reappearing = std::find(removed_guids_.begin(), removed_guids_.end(), device->guid) != removed_guids_.end();
+
+  if (id >= devices_.size()) {
+    devices_.resize(static_cast<size_t>(id) + 1);
+  }
+  devices_[static_cast<size_t>(id)] = std::move(device);
+  has_device_changes_ = true;
+  return true;
+}
+
+bool InputReplayBackend::ReadDeviceRemoved() {
+  uint64_t id = 0;
+  if (!this->ReadVarint(id) || id >= devices_.size() || devices_[static_cast<size_t>(id)] == nullptr) {
+    return false;
+  }
+
+  removed_guids_.push_back(devices_[static_cast<size_t>(id)]->guid);
+  devices_[static_cast<size_t>(id)]->attached = false;
+  devices_[static_cast<size_t>(id)].reset();
+  has_device_changes_ = true;
+  return true;
+}
+
+bool InputReplayBackend::ReadDeviceState() {
+  uint64_t id = 0;
+  uint64_t mask = 0;
+  if (!this->ReadVarint(id) || id >= devices_.size() || devices_[static_cast<size_t>(id)] == nullptr || !this->ReadVarint(mask)) {
+    return false;
+  }
+  ReplayDevice& device = *devices_[static_cast<size_t>(id)];
+
+  DWORD const timestamp = static_cast<DWORD>(frame_time_us_ / 1000);
+  auto PushEvent = [&](DWORD offset, DWORD value) {
+    if (buffer_size_ == 0) {
+      return;
+    }
+    if (device.events.size() >= buffer_size_) {
+      device.events_overflowed = true;
+      return;
+    }
+    DIDEVICEOBJECTDATA& event = device.events.emplace_back();
+    event.dwOfs = offset;
+    event.dwData = value;
+    event.dwTimeStamp = timestamp;
+    event.dwSequence = sequence_++;
+  };
+
+  for (size_t i = 0; i < device.axis_gather.size(); ++i) {
+    if ((mask >> (kAxisMaskShift + i)) & 1) {
+      uint64_t delta = 0;
+      if (!this->ReadVarint(delta)) {
+        return false;
+      }
+      LONG const value = static_cast<LONG>(GetAxisWord(device.state, device.axis_gather[i]) + ZigZagDecode(delta));
+      SetAxisWord(device.state, device.axis_gather[i], value);
+      PushEvent(static_cast<DWORD>(device.axis_gather[i] * sizeof(LONG)), static_cast<DWORD>(value));
+    }
+  }
+  for (DWORD i = 0; i < device.pov_count; ++i) {
+    if ((mask >> (kPovMaskShift + i)) & 1) {
+      uint64_t value = 0;
+      if (!this->ReadVarint(value)) {
+        return false;
+      }
+      device.state.rgdwPOV[i] = static_cast<DWORD>(value - 1);
+      PushEvent(static_cast<DWORD>(DIJOFS_POV(i)), device.state.rgdwPOV[i]);
+    }
+  }
+  if (mask & kButtonsChangedBit) {
+    uint64_t count = 0;
+    if (!this->ReadVarint(count) || count > 128) {
+      return false;
+    }
+    uint64_t index = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t delta = 0;
+      if (!this->ReadVarint(delta)) {
+        return false;
+      }
+      index += delta;
+      if (index >= 128) {
+        return false;
+      }
+      BYTE& button = device.state.rgbButtons[index];
+      button = (button & 0x80) ? 0x00 : 0x80;
+      PushEvent(static_cast<DWORD>(DIJOFS_BUTTON(index)), button);
+    }
+  }
+
+  return true;
+}
+
+bool InputReplayBackend::Initialize(DirectInputContext::Config const& config) {
+  buffer_size_ = config.buffered_input ? config.device_buffer_size : 0;
+  return valid_;
+}
+
+void InputReplayBackend::Shutdown() {
+  devices_.clear();
+}
+
+void InputReplayBackend::EnumerateDevices(std::vector<GUID>& out_guids) {
+  bool reappearing = false;
+  for (std::shared_ptr<ReplayDevice> const& device : devices_) {
+    if (device == nullptr) {
+      continue;
+    }
+    if (device->reappearing) {
+      device->reappearing = false;
+      reappearing = true;
+      continue;
+    }
+    out_guids.push_back(device->guid);
+  }
+  has_device_changes_ = reappearing;
+}
+
+std::unique_ptr<DirectInputContext::DeviceSource> InputReplayBackend::OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) {
+  using Input = DirectInputContext::Input;
+  using InputType = DirectInputContext::InputType;
+
+  auto it = std::find_if(
+    devices_.begin(), devices_.end(),
+    [&guid](std::shared_ptr<ReplayDevice> const& device) {
+      return device != nullptr && device->guid == guid;
+    }
+  );
+  if (it == devices_.end()) {
+    return nullptr;
+  }
+  ReplayDevice const& device = **it;
+
+  out_device.name = device.name;
+  out_device.caps = device.caps;
+  for (DWORD i = 0; i < device.pov_count; ++i) {
+    out_device.povs.push_back(Input { .type = InputType::kPOV, .index = i, .offset = static_cast<DWORD>(DIJOFS_POV(i)) });
+  }
+  for (DWORD i = 0; i < static_cast<DWORD>(device.axis_gather.size()); ++i) {
+    out_device.axes.push_back(Input { .type = InputType::kAxis, .index = i, .offset = static_cast<DWORD>(device.axis_gather[i] * sizeof(LONG)) });
+  }
+  for (DWORD i = 0; i < device.button_count; ++i) {
+    out_device.buttons.push_back(Input { .type = InputType::kButton, .index = i, .offset = static_cast<DWORD>(DIJOFS_BUTTON(i)) });
+  }
+
+  return std::make_unique<ReplayDeviceSource>(*it);
+}
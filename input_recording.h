@@ -0,0 +1,135 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//
+// Recording format (all integers are LEB128 varints unless noted otherwise):
+//
+//  Header:        "DIRC" (4 bytes), version
+//  Frame:         kFrame, time delta in microseconds since the previous frame
+//  Device added:  kDeviceAdded, id, GUID (16 bytes, as in memory), name length, name bytes,
+//                 caps.dwPOVs, caps.dwAxes, caps.dwButtons, POV count, button count, axis count, axis gather indices (1 byte each)
+//  Device removed: kDeviceRemoved, id
+//  Device state:  kDeviceState, id, change mask (bits 0-7: axes, 8-11: POVs, 12: buttons), then
+//                 per changed axis: zigzag delta from its previous value,
+//                 per changed POV: value + 1 (so that "centered", 0xFFFFFFFF, is 0),
+//                 if buttons changed: toggled count, then each toggled index as a delta from the previous one.
+//
+// Device records apply to the frame that precedes them. Ids are reused once a device is removed.
+// Only what changed is written, so an idle device costs nothing and a typical sample a handful of bytes.
+//
+
+/// Streams the changes of a `DirectInputContext` to `out`, in the format above.
+/// Memory use is bounded by the output buffer plus one state per connected device, no matter how long the session.
+class InputRecorder final {
+public:
+  explicit InputRecorder(std::ostream& out, size_t buffer_size = 64 * 1024);
+  ~InputRecorder() noexcept;
+
+  InputRecorder(InputRecorder const&) = delete;
+  InputRecorder(InputRecorder&&) = delete;
+  InputRecorder& operator=(InputRecorder const&) = delete;
+  InputRecorder& operator=(InputRecorder&&) = delete;
+
+  /// Appends a frame with every hot-plug and every state change since the previous call, typically right after `UpdateState`.
+  /// `time_us` is a monotonic timestamp in microseconds.
+  void Record(DirectInputContext const& context, uint64_t time_us);
+  void Flush();
+
+  uint64_t GetBytesWritten() const { return bytes_written_ + buffer_.size(); }
+  uint64_t GetFrameCount() const { return frame_count_; }
+
+private:
+  struct TrackedDevice final {
+    DirectInputContext::DeviceHandle handle {};
+    DIJOYSTATE2 state {};
+  };
+
+  void WriteByte(uint8_t value);
+  void WriteVarint(uint64_t value);
+  void WriteBytes(void const* data, size_t size);
+  void WriteDeviceAdded(uint32_t id, DirectInputContext::Device const& device);
+  void WriteDeviceState(uint32_t id, DirectInputContext::Device const& device, DIJOYSTATE2 const& previous, DIJOYSTATE2 const& current);
+
+  std::ostream& out_;
+  size_t buffer_capacity_ = 0;
+  std::vector<uint8_t> buffer_;
+  uint64_t bytes_written_ = 0;
+  uint64_t frame_count_ = 0;
+  uint64_t previous_time_us_ = 0;
+
+  /// Indexed by `DeviceHandle::index`, which doubles as the device id in the recording.
+  std::vector<TrackedDevice> tracked_;
+};
+
+/// Plays a recording back as a `DirectInputContext::Backend`, so that the same `Device` state and accessors are driven
+/// deterministically, without DirectInput, and as fast as the caller steps it.
+///
+/// Typical use:
+///   while (replay.AdvanceFrame()) {
+///     while (replay.HasDeviceChanges()) {
+///       context.NotifyDeviceChange();
+///       context.UpdateDetection();
+///     }
+///     context.UpdateState();
+///     ...
+///   }
+class InputReplayBackend final : public DirectInputContext::Backend {
+public:
+  /// `in` must outlive this backend. Reads the header right away; see `IsValid`.
+  explicit InputReplayBackend(std::istream& in);
+  ~InputReplayBackend() noexcept override = default;
+
+  InputReplayBackend(InputReplayBackend const&) = delete;
+  InputReplayBackend(InputReplayBackend&&) = delete;
+  InputReplayBackend& operator=(InputReplayBackend const&) = delete;
+  InputReplayBackend& operator=(InputReplayBackend&&) = delete;
+
+  /// `false` if `in` is not a recording of a supported version.
+  bool IsValid() const { return valid_; }
+
+  /// Applies the next frame of the recording. Returns `false` once the recording ends, or if it is malformed.
+  bool AdvanceFrame();
+  /// Timestamp of the current frame, in microseconds.
+  uint64_t GetFrameTime() const { return frame_time_us_; }
+  /// Whether the current frame added or removed devices that the context has not enumerated yet: call `DirectInputContext::NotifyDeviceChange`
+  /// and `UpdateDetection` until it has. A device removed and added again with the same GUID in one frame takes two enumerations,
+  /// as a single one would list it both before and after: the first leaves it out, so that the context closes it, and the second lists it again.
+  bool HasDeviceChanges() const { return has_device_changes_; }
+
+  bool Initialize(DirectInputContext::Config const& config) override;
+  void Shutdown() override;
+
+  void EnumerateDevices(std::vector<GUID>& out_guids) override;
+  std::unique_ptr<DirectInputContext::DeviceSource> OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) override;
+
+  struct ReplayDevice;
+
+private:
+  bool ReadByte(uint8_t& out_value);
+  bool ReadVarint(uint64_t& out_value);
+  bool ReadDeviceAdded();
+  bool ReadDeviceRemoved();
+  bool ReadDeviceState();
+
+  std::istream& in_;
+  bool valid_ = false;
+
+  uint64_t frame_time_us_ = 0;
+  bool has_device_changes_ = false;
+  DWORD buffer_size_ = 0;
+  DWORD sequence_ = 0;
+
+  /// Indexed by id. Shared with the `DeviceSource`s, so that a device keeps its state until the context closes it,
+  /// even if the recording already reused its id.
+  std::vector<std::shared_ptr<ReplayDevice>> devices_;
+  /// The GUIDs of the devices the current frame removed, to tell when it adds one of them again.
+  std::vector<GUID> removed_guids_;
+};
@@ -0,0 +1,47 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+
+LatencySummary LatencyHistogram::Summarize() const {
+  // Counts from both windows. They may change while this runs, which only makes the summary slightly off.
+  uint64_t counts[kBucketCount];
+  uint64_t total = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    counts[i] = uint64_t(windows_[0].counts[i].load(std::memory_order_relaxed)) + windows_[1].counts[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  LatencySummary summary {
+    .count = total,
+    .max_ns = std::max(windows_[0].max_ns.load(std::memory_order_relaxed), windows_[1].max_ns.load(std::memory_order_relaxed)),
+  };
+  if (total == 0) {
+    return summary;
+  }
+
+  uint64_t const p50_rank = (total * 50 + 99) / 100;
+  uint64_t const p99_rank = (total * 99 + 99) / 100;
+  uint64_t const p999_rank = (total * 999 + 999) / 1000;
+  uint64_t cumulative = 0;
+  bool found_p50 = false;
+  bool found_p99 = false;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    cumulative += counts[i];
+    if (!found_p50 && cumulative >= p50_rank) {
+      summary.p50_ns = std::min(GetBucketUpperBound(i), summary.max_ns);
+      found_p50 = true;
+    }
+    if (!found_p99 && cumulative >= p99_rank) {
+      summary.p99_ns = std::min(GetBucketUpperBound(i), summary.max_ns);
+      found_p99 = true;
+    }
+    if (cumulative >= p999_rank) {
+      summary.p999_ns = std::min(GetBucketUpperBound(i), summary.max_ns);
+      break;
+    }
+  }
+  return summary;
+}
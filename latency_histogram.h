@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/// Nanoseconds on the monotonic high-resolution clock that every sample timestamp uses.
+inline uint64_t GetMonotonicTimeNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct LatencySummary final {
+  uint64_t count = 0;
+  uint64_t p50_ns = 0;
+  uint64_t p99_ns = 0;
+  uint64_t p999_ns = 0;
+  uint64_t max_ns = 0;
+};
+
+/// Rolling histogram of durations, in log-linear buckets (8 per power of two, so within 12.5%).
+///
+/// `Record` is lock-free and allocation-free, but must only be called from one thread at a time;
+/// `Summarize` can be called from any thread, concurrently with it.
+/// The histogram covers the latest one to two `window`s: recording into one while the other holds the previous window,
+/// and clearing the older one whenever a window has elapsed.
+class LatencyHistogram final {
+public:
+  explicit LatencyHistogram(std::chrono::nanoseconds window = std::chrono::seconds(1))
+    : window_ns_(static_cast<uint64_t>(window.count()))
+  {
+  }
+
+  LatencyHistogram(LatencyHistogram const&) = delete;
+  LatencyHistogram& operator=(LatencyHistogram const&) = delete;
+
+  /// Records `value_ns`, measured at `now_ns` (see `GetMonotonicTimeNs`).
+  void Record(uint64_t value_ns, uint64_t now_ns) {
+    uint32_t current = current_.load(std::memory_order_relaxed);
+    if (now_ns - window_start_ns_ >= window_ns_) {
+      // Start a new window in place of the oldest one.
+      current ^= 1;
+      Window& window = windows_[current];
+      for (std::atomic<uint32_t>& count : window.counts) {
+        count.store(0, std::memory_order_relaxed);
+      }
+      window.max_ns.store(0, std::memory_order_relaxed);
+      current_.store(current, std::memory_order_release);
+      window_start_ns_ = now_ns;
+    }
+
+    Window& window = windows_[current];
+    window.counts[ToBucket(value_ns)].fetch_add(1, std::memory_order_relaxed);
+    if (value_ns > window.max_ns.load(std::memory_order_relaxed)) {
+      window.max_ns.store(value_ns, std::memory_order_relaxed);
+    }
+  }
+
+  /// Percentiles are the upper bound of the bucket they fall in.
+  LatencySummary Summarize() const;
+
+private:
+  static inline constexpr uint32_t kSubBucketBits = 3;
+  static inline constexpr uint32_t kSubBucketCount = 1 << kSubBucketBits;
+  /// Up to 2^40 ns (~18 minutes); longer is counted in the last bucket.
+  static inline constexpr size_t kBucketCount = (40 - kSubBucketBits + 2) * kSubBucketCount;
+
+  static size_t ToBucket(uint64_t value) {
+    if (value < kSubBucketCount) {
+      return static_cast<size_t>(value);
+    }
+    uint32_t const exponent = static_cast<uint32_t>(std::bit_width(value)) - 1;
+    size_t const bucket = (exponent - kSubBucketBits + 1) * kSubBucketCount + ((value >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1));
+    return bucket < kBucketCount ? bucket : kBucketCount - 1;
+  }
+
+  /// The largest value that falls in `bucket`.
+  static uint64_t GetBucketUpperBound(size_t bucket) {
+    if (bucket < kSubBucketCount) {
+      return bucket;
+    }
+    uint32_t const exponent = static_cast<uint32_t>(bucket / kSubBucketCount) + kSubBucketBits - 1;
+    uint64_t const sub_bucket = bucket % kSubBucketCount;
+    return ((kSubBucketCount + sub_bucket + 1) << (exponent - kSubBucketBits)) - 1;
+  }
+
+  struct Window final {
+    std::atomic<uint32_t> counts[kBucketCount] {};
+    std::atomic<uint64_t> max_ns { 0 };
+  };
+
+  uint64_t window_ns_ = 0;
+  /// Only accessed by the recording thread.
+  uint64_t window_start_ns_ = 0;
+  std::atomic<uint32_t> current_ { 0 };
+  Window windows_[2];
+};
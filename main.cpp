@@ -1,9 +1,13 @@
-
+#include "device_view_model.h"
 #include "direct_input_context.h"
+#include "trace.h"
+#if CONFIG_USE_HEADLESS
+# include "headless_stream.h"
+#endif
 
+#include <algorithm>
 #include <cinttypes>
 
-#include <optional>
 #include <format>
 
 // ------------------------------------------------------------------------------------------------
@@ -24,6 +28,20 @@
 
 // DirectInput Data
 DirectInputContext g_direct_input_context;
+DeviceViewModel g_device_view_model;
+// Sample ages are only measured when a polling thread samples the devices (`Config::polling_rate_hz`); otherwise the column is left out.
+static bool g_sample_age_measured = false;
+
+// Frame Pacing
+// Frames are only drawn when input or a window message changed something, plus this many more for Dear ImGui to settle
+// (layout and hover state take a frame to catch up).
+static constexpr int kSettleFrameCount = 3;
+// While idle, how often devices are polled for changes.
+static constexpr DWORD kIdlePollIntervalMs = 10;
+// While the Performance window is shown, it is redrawn at least this often, as its timings and ages change without any input.
+static constexpr uint64_t kPerformanceRefreshIntervalNs = 250'000'000;
+// Whether the Performance window was shown (not collapsed nor hidden) in the latest frame.
+static bool g_performance_window_visible = false;
 
 // DX11 Data
 static ID3D11Device*            g_pd3dDevice = nullptr;
@@ -63,6 +81,10 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
       return 0;
     }
     break;
+  case WM_DEVICECHANGE:
+    // Sent on `DBT_DEVNODES_CHANGED` whenever a device is plugged in or removed; re-enumerate game controllers only then.
+    g_direct_input_context.NotifyDeviceChange();
+    break;
   case WM_DESTROY:
     ::PostQuitMessage(0);
     return 0;
@@ -72,49 +94,38 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 }
 
 void UpdateFrame() {
-  static std::optional<GUID> s_opt_selected_guid;
-
-  g_direct_input_context.UpdateDetection();
-  g_direct_input_context.UpdateState();
-
-  std::vector<GUID> guids = g_direct_input_context.GetDeviceGuids();
+  // Generation-checked: resolves to `nullptr` once the selected device is disconnected.
+  static DirectInputContext::DeviceHandle s_selected_handle {};
 
-  // Reset selected GUID if it's no longer valid.
-  if (s_opt_selected_guid.has_value()) {
-    if (std::find(guids.begin(), guids.end(), s_opt_selected_guid.value()) == guids.end()) {
-      s_opt_selected_guid.reset();
-    }
-  }
+  TRACE_ZONE("UpdateFrame");
 
   ImGui::Begin("Direct Input Devices");
 
   if (ImGui::BeginTable("DevicesTable", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter)) {
+    TRACE_ZONE("DevicesTable");
     ImGui::TableNextColumn(); ImGui::Text("Name");
     ImGui::TableNextColumn(); ImGui::Text("Inst. GUID");
     ImGui::TableNextColumn(); ImGui::Text("# POVs");
     ImGui::TableNextColumn(); ImGui::Text("# Axes");
     ImGui::TableNextColumn(); ImGui::Text("# Buttons");
 
-    for (GUID const& guid : guids) {
-      DirectInputContext::Device const* device = g_direct_input_context.GetDevice(guid);
-
-      std::string const guid_str = device->GetGuidString();
-      ImGui::PushID(guid_str.c_str());
+    for (DeviceViewModel::DeviceRow const& row : g_device_view_model.GetRows()) {
+      ImGui::PushID(static_cast<int>(row.handle.index));
 
       ImGui::TableNextColumn();
-      if (ImGui::Selectable(device->name.c_str(), s_opt_selected_guid == guid, ImGuiSelectableFlags_None)) {
-        if (s_opt_selected_guid == guid) {
-          s_opt_selected_guid.reset();
+      if (ImGui::Selectable(row.name.c_str(), s_selected_handle == row.handle, ImGuiSelectableFlags_None)) {
+        if (s_selected_handle == row.handle) {
+          s_selected_handle = {};
         }
         else {
-          s_opt_selected_guid = guid;
+          s_selected_handle = row.handle;
         }
       }
 
-      ImGui::TableNextColumn(); ImGui::Text("%s", guid_str.c_str());
-      ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, device->caps.dwPOVs);
-      ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, device->caps.dwAxes);
-      ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, device->caps.dwButtons);
+      ImGui::TableNextColumn(); ImGui::TextUnformatted(row.guid.c_str());
+      ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, row.pov_count);
+      ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, row.axis_count);
+      ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, row.button_count);
 
       ImGui::PopID();
     }
@@ -122,60 +133,54 @@ void UpdateFrame() {
     ImGui::EndTable();
   }
 
-  if (s_opt_selected_guid.has_value()) {
-    GUID const& guid = s_opt_selected_guid.value();
-    DirectInputContext::Device const* device = g_direct_input_context.GetDevice(guid);
+  if (size_t const pending_count = g_device_view_model.GetPendingCount(); pending_count > 0) {
+    ImGui::Text("Connecting %zu device(s)...", pending_count);
+  }
 
-    std::string const guid_str = device->GetGuidString();
-    ImGui::PushID(guid_str.c_str());
+  if (DeviceViewModel::DeviceRow const* row = g_device_view_model.FindRow(s_selected_handle)) {
+    ImGui::PushID(static_cast<int>(row->handle.index));
 
-    ImGui::Text("Selected Device: \"%s\" (%s)", device->name.c_str(), guid_str.c_str());
+    ImGui::Text("Selected Device: \"%s\" (%s)", row->name.c_str(), row->guid.c_str());
 
-    if (device->caps.dwPOVs > 0) {
+    if (!row->povs.empty()) {
       if (ImGui::BeginTable("POVsTable", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter)) {
+        TRACE_ZONE("POVsTable");
         ImGui::TableNextColumn(); ImGui::Text("What");
         ImGui::TableNextColumn(); ImGui::Text("Value");
 
-        for (DWORD i = 0; i < device->caps.dwPOVs; ++i) {
-          // > The position is indicated in hundredths of a degree clockwise from north (away from the user).
-          DWORD const angle_deg = device->GetPovValue(i) / 100;
-
-          ImGui::TableNextColumn(); ImGui::Text("POV %" PRIu32, i);
-          ImGui::TableNextColumn(); ImGui::Text("%" PRIu32, angle_deg);
+        for (DeviceViewModel::PovRow const& pov : row->povs) {
+          ImGui::TableNextColumn(); ImGui::TextUnformatted(pov.label.c_str());
+          ImGui::TableNextColumn(); ImGui::TextUnformatted(pov.value_text.c_str());
         }
 
         ImGui::EndTable();
       }
     }
 
-    if (device->caps.dwAxes > 0) {
+    if (!row->axes.empty()) {
       if (ImGui::BeginTable("AxesTable", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter)) {
+        TRACE_ZONE("AxesTable");
         ImGui::TableNextColumn(); ImGui::Text("What");
         ImGui::TableNextColumn(); ImGui::Text("Value");
 
-        for (DWORD i = 0; i < device->caps.dwAxes; ++i) {
-          LONG const value = device->GetAxisValue(i);
-
-          float const gauge_value = static_cast<float>(value - DirectInputContext::kAxisMin) / static_cast<float>(DirectInputContext::kAxisMax - DirectInputContext::kAxisMin);
-
-          ImGui::TableNextColumn(); ImGui::Text("Axis %" PRIu32 " (%s)", i, device->GetAxisName(i));
-          ImGui::TableNextColumn(); ImGui::ProgressBar(gauge_value, ImVec2(-1, 0), std::format("{} ([{}, {}])", value, DirectInputContext::kAxisMin, DirectInputContext::kAxisMax).c_str());
+        for (DeviceViewModel::AxisRow const& axis : row->axes) {
+          ImGui::TableNextColumn(); ImGui::TextUnformatted(axis.label.c_str());
+          ImGui::TableNextColumn(); ImGui::ProgressBar(axis.gauge, ImVec2(-1, 0), axis.value_text.c_str());
         }
 
         ImGui::EndTable();
       }
     }
 
-    if (device->caps.dwButtons > 0) {
+    if (!row->buttons.empty()) {
       if (ImGui::BeginTable("ButtonsTable", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter)) {
+        TRACE_ZONE("ButtonsTable");
         ImGui::TableNextColumn(); ImGui::Text("What");
         ImGui::TableNextColumn(); ImGui::Text("Value");
 
-        for (DWORD i = 0; i < device->caps.dwButtons; ++i) {
-          bool const value = (device->GetButtonValue(i) & 0x80) != 0;
-
-          ImGui::TableNextColumn(); ImGui::Text("Button %" PRIu32, i);
-          ImGui::TableNextColumn(); ImGui::Text("%s", value ? "Pressed" : "Released");
+        for (DeviceViewModel::ButtonRow const& button : row->buttons) {
+          ImGui::TableNextColumn(); ImGui::TextUnformatted(button.label.c_str());
+          ImGui::TableNextColumn(); ImGui::TextUnformatted(button.pressed ? "Pressed" : "Released");
         }
 
         ImGui::EndTable();
@@ -186,12 +191,89 @@ void UpdateFrame() {
   }
 
   ImGui::End();
+
+  g_performance_window_visible = ImGui::Begin("Performance");
+
+  if (ImGui::BeginTable("PerformanceTable", g_sample_age_measured ? 5 : 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter)) {
+    TRACE_ZONE("PerformanceTable");
+    ImGui::TableNextColumn(); ImGui::Text("Name");
+    ImGui::TableNextColumn(); ImGui::Text("Open (ms)");
+    ImGui::TableNextColumn(); ImGui::Text("Poll (us) p50 / p99 / max");
+    if (g_sample_age_measured) {
+      ImGui::TableNextColumn(); ImGui::Text("Sample Age (us) p50 / p99 / max");
+    }
+    ImGui::TableNextColumn(); ImGui::Text("Last Change (ms ago)");
+
+    uint64_t const now = GetMonotonicTimeNs();
+    for (DirectInputContext::Device const& device : g_direct_input_context.GetDevices()) {
+      LatencySummary const poll = device.latency->poll_duration.Summarize();
+      uint64_t const last_change_ns = device.LoadSampleTimes().last_change_ns;
+
+      ImGui::TableNextColumn(); ImGui::Text("%s", device.name.c_str());
+      ImGui::TableNextColumn(); ImGui::Text("%.1f", (device.open_timings.end_ns - device.open_timings.start_ns) / 1e6);
+      ImGui::TableNextColumn(); ImGui::Text("%.1f / %.1f / %.1f", poll.p50_ns / 1e3, poll.p99_ns / 1e3, poll.max_ns / 1e3);
+      if (g_sample_age_measured) {
+        LatencySummary const age = device.latency->sample_age.Summarize();
+        ImGui::TableNextColumn();
+        if (age.count > 0) {
+          ImGui::Text("%.1f / %.1f / %.1f", age.p50_ns / 1e3, age.p99_ns / 1e3, age.max_ns / 1e3);
+        }
+        else {
+          ImGui::Text("-");
+        }
+      }
+      ImGui::TableNextColumn();
+      if (last_change_ns != 0) {
+        ImGui::Text("%.1f", (now > last_change_ns ? now - last_change_ns : 0) / 1e6);
+      }
+      else {
+        ImGui::Text("-");
+      }
+    }
+
+    ImGui::EndTable();
+  }
+
+  DirectInputContext::PollingStats const polling_stats = g_direct_input_context.GetPollingStats();
+  ImGui::Text(
+    "DIERR_INPUTLOST: %" PRIu64 ", DIERR_NOTACQUIRED: %" PRIu64 ", failed polls: %" PRIu64,
+    polling_stats.input_lost_count, polling_stats.not_acquired_count, polling_stats.failed_poll_count
+  );
+
+#if CONFIG_USE_TRACING
+  // The latest events of every thread, for chrome://tracing or Perfetto.
+  if (ImGui::Button("Save Trace")) {
+    WriteChromeTrace("direct_input_trace.json");
+  }
+#endif
+
+  ImGui::End();
 }
 
 int main(int argc, char* argv[]) {
-  if (!g_direct_input_context.Initialize()) {
+#if CONFIG_USE_HEADLESS
+  // No window, no rendering: just poll and stream.
+  HeadlessOptions headless_options;
+  switch (ParseHeadlessOptions(argc, argv, headless_options)) {
+  case HeadlessParseResult::kHeadless:
+    return RunHeadlessUntilInterrupted(headless_options);
+  case HeadlessParseResult::kInvalid:
     return 1;
+  case HeadlessParseResult::kNotHeadless:
+    break;
   }
+#endif
+
+  // Open hot-plugged devices in the background, so that the window keeps drawing meanwhile,
+  // and remember the layouts of the models seen, so that they open faster from then on.
+  DirectInputContext::Config const config {
+    .async_device_open = true,
+    .layout_cache_path = "device_layouts.dilc",
+  };
+  if (!g_direct_input_context.Initialize(config)) {
+    return 1;
+  }
+  g_sample_age_measured = (config.polling_rate_hz != 0);
 
   WNDCLASSEXW wc = {
     .cbSize = sizeof(wc),
@@ -252,11 +334,16 @@ int main(int argc, char* argv[]) {
 
   ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
+  TRACE_THREAD_NAME("Main");
+
   // Main loop
   bool done = false;
+  int frames_to_draw = kSettleFrameCount;
+  uint64_t last_draw_ns = 0;
   while (!done) {
     // Poll and handle messages (inputs, window resize, etc.)
     // See the WndProc() function below for our to dispatch events to the Win32 backend.
+    bool had_messages = false;
     MSG msg;
     while (::PeekMessage(&msg, nullptr, 0U, 0U, PM_REMOVE))
     {
@@ -265,11 +352,31 @@ int main(int argc, char* argv[]) {
       if (msg.message == WM_QUIT) {
         done = true;
       }
+      had_messages = true;
     }
     if (done) {
       break;
     }
 
+    g_direct_input_context.UpdateDetection();
+    g_direct_input_context.UpdateState();
+
+    if (g_device_view_model.Update(g_direct_input_context) || had_messages) {
+      frames_to_draw = kSettleFrameCount;
+    }
+    uint64_t const now_ns = GetMonotonicTimeNs();
+    if (g_performance_window_visible && now_ns - last_draw_ns >= kPerformanceRefreshIntervalNs) {
+      // Nothing to settle: one frame refreshes the figures.
+      frames_to_draw = std::max(frames_to_draw, 1);
+    }
+    if (frames_to_draw == 0) {
+      // Nothing changed: don't draw or present, just wait for a window message or the next poll.
+      ::MsgWaitForMultipleObjects(0, nullptr, FALSE, kIdlePollIntervalMs, QS_ALLINPUT);
+      continue;
+    }
+    --frames_to_draw;
+    last_draw_ns = now_ns;
+
     // Handle window being minimized or screen locked
     if (g_SwapChainOccluded && g_pSwapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED)
     {
@@ -318,102 +425,6 @@ int main(int argc, char* argv[]) {
   ::UnregisterClassW(wc.lpszClassName, wc.hInstance);
 
   g_direct_input_context.Shutdown();
-
-
-#if CONFIG_USE_FTXUI
-  while (true) {
-    using namespace ftxui;
-
-    if (kbhit()) {
-      int const ch = getch();
-
-      if (ch == 'q') {
-        break;
-      }
-    }
-
-    std::vector<Element> elements;
-    elements.emplace_back(text("Press 'q' to quit."));
-
-    for (auto const& [ guid, device ] : context.devices) {
-      if (device.pDevice == nullptr) {
-        continue;
-      }
-      
-      HRESULT hr = device.pDevice->Poll();
-      if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED) {
-        device.pDevice->Acquire();
-        hr = device.pDevice->Poll();
-        if (FAILED(hr)) {
-          continue;
-        }
-      }
-
-      DIJOYSTATE2 state {};
-      hr = device.pDevice->GetDeviceState(sizeof(DIJOYSTATE2), &state);
-      if (FAILED(hr)) {
-        continue;
-      }
-
-      for (DWORD i = 0; i < device.caps.dwPOVs; ++i) {
-        // > The position is indicated in hundredths of a degree clockwise from north (away from the user).
-        DWORD const angle_deg = state.rgdwPOV[i] / 100;
-        elements.emplace_back() = hbox({
-          text(std::format("POV {}: ", i)),
-          text(std::format("{}", angle_deg)) | flex
-        });
-      }
-
-      for (DWORD i = 0; i < device.caps.dwAxes; ++i) {
-        auto GetValue = [&state](DWORD index) -> LONG {
-          switch (index) {
-            case 0: return state.lX;
-            case 1: return state.lY;
-            case 2: return state.lZ;
-            case 3: return state.lRx;
-            case 4: return state.lRy;
-            case 5: return state.lRz;
-            case 6: return state.rglSlider[0];
-            case 7: return state.rglSlider[1];
-            default: return 0;
-          }
-        };
-
-        LONG const value = GetValue(i);
-
-        float const gauge_value = static_cast<float>(value - kAxisMin) / static_cast<float>(kAxisMax - kAxisMin);
-
-        elements.emplace_back() = hbox({
-          text(std::format("Axis {}: ", i)),
-          text(std::format("{} ([{}, {}])", value, kAxisMin, kAxisMax)),
-          gauge(gauge_value)
-        });
-      }
-
-      for (DWORD i = 0; i < device.caps.dwButtons; ++i) {
-        bool const value = (state.rgbButtons[i] & 0x80) != 0;
-
-        elements.emplace_back() = hbox({
-          text(std::format("Button {}: ", i)),
-          text(std::format("{}", value))
-        });
-      }
-    }
-
-    Element document =
-      vbox(elements) | vscroll_indicator | frame;
-
-    auto screen = Screen::Create(Dimension::Full(), Dimension::Fit(document));
-
-    Render(screen, document);
-    std::cout << reset_position << screen.ToString() << std::flush;
-    reset_position = screen.ResetPosition(false);
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(16));
-  }
-#endif
-
-
 }
 
 bool CreateDeviceD3D(HWND hWnd)
@@ -0,0 +1,174 @@
+#include "ndjson_state_writer.h"
+
+#include <algorithm>
+#include <charconv>
+
+NdjsonStateWriter::NdjsonStateWriter(std::ostream& out, size_t buffer_size)
+  : out_(out), buffer_capacity_(std::max<size_t>(buffer_size, 4096))
+{
+  // Lines are appended whole, so leave room for the longest one (a device with 128 changed buttons) past the capacity.
+  buffer_.reserve(buffer_capacity_ + 4096);
+}
+
+NdjsonStateWriter::~NdjsonStateWriter() noexcept {
+  this->Flush();
+}
+
+void NdjsonStateWriter::Flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  out_.flush();
+  bytes_written_ += buffer_.size();
+  buffer_.clear();
+}
+
+void NdjsonStateWriter::FlushIfFull() {
+  if (buffer_.size() >= buffer_capacity_) {
+    this->Flush();
+  }
+}
+
+void NdjsonStateWriter::AppendInteger(int64_t value) {
+  char digits[24];
+  std::to_chars_result const result = std::to_chars(std::begin(digits), std::end(digits), value);
+  buffer_.append(digits, result.ptr);
+}
+
+void NdjsonStateWriter::AppendString(std::string const& value) {
+  static constexpr char kHex[] = "0123456789abcdef";
+
+  buffer_ += '"';
+  for (char c : value) {
+    switch (c) {
+    case '"': buffer_ += "\\\""; break;
+    case '\\': buffer_ += "\\\\"; break;
+    case '\n': buffer_ += "\\n"; break;
+    case '\r': buffer_ += "\\r"; break;
+    case '\t': buffer_ += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        buffer_ += "\\u00";
+        buffer_ += kHex[(c >> 4) & 0xF];
+        buffer_ += kHex[c & 0xF];
+      }
+      else {
+        buffer_ += c;
+      }
+      break;
+    }
+  }
+  buffer_ += '"';
+}
+
+void NdjsonStateWriter::AppendLineStart(uint64_t time_us, char const* type, uint32_t id) {
+  buffer_ += "{\"t\":";
+  this->AppendInteger(static_cast<int64_t>(time_us));
+  buffer_ += ",\"type\":\"";
+  buffer_ += type;
+  buffer_ += "\",\"id\":";
+  this->AppendInteger(id);
+}
+
+void NdjsonStateWriter::Record(DirectInputContext const& context, uint64_t time_us) {
+  for (uint32_t id = 0; id < tracked_.size(); ++id) {
+    TrackedDevice& tracked = tracked_[id];
+    if (tracked.handle == DirectInputContext::DeviceHandle {} || context.GetDevice(tracked.handle) != nullptr) {
+      continue;
+    }
+
+    this->AppendLineStart(time_us, "removed", id);
+    buffer_ += "}\n";
+    this->FlushIfFull();
+    tracked.handle = {};
+  }
+
+  for (DirectInputContext::Device const& device : context.GetDevices()) {
+    uint32_t const id = device.handle.index;
+    if (id >= tracked_.size()) {
+      tracked_.resize(id + 1);
+    }
+
+    TrackedDevice& tracked = tracked_[id];
+    DIJOYSTATE2 const state = device.LoadState();
+
+    if (tracked.handle != device.handle) {
+      this->AppendLineStart(time_us, "added", id);
+      buffer_ += ",\"guid\":";
+      this->AppendString(device.GetGuidString());
+      buffer_ += ",\"name\":";
+      this->AppendString(device.name);
+      buffer_ += ",\"povs\":";
+      this->AppendInteger(device.povs.size());
+      buffer_ += ",\"axes\":";
+      this->AppendInteger(device.axes.size());
+      buffer_ += ",\"buttons\":";
+      this->AppendInteger(device.buttons.size());
+      buffer_ += "}\n";
+
+      // The initial state is reported as a change from a centered, released device.
+      tracked.handle = device.handle;
+      tracked.state = DIJOYSTATE2 {};
+      std::fill(std::begin(tracked.state.rgdwPOV), std::end(tracked.state.rgdwPOV), 0xFFFFFFFF);
+    }
+
+    this->AppendState(time_us, id, device, tracked.state, state);
+    tracked.state = state;
+    this->FlushIfFull();
+  }
+}
+
+void NdjsonStateWriter::AppendState(uint64_t time_us, uint32_t id, DirectInputContext::Device const& device, DIJOYSTATE2 const& previous, DIJOYSTATE2 const& current) {
+  size_t const line_start = buffer_.size();
+  bool changed = false;
+
+  this->AppendLineStart(time_us, "state", id);
+
+  auto AppendPairs = [&](char const* key, std::vector<DirectInputContext::Input> const& inputs, auto&& GetValue) {
+    bool first = true;
+    for (DirectInputContext::Input const& input : inputs) {
+      int64_t const value = GetValue(current, input.offset);
+      if (value == GetValue(previous, input.offset)) {
+        continue;
+      }
+      if (first) {
+        buffer_ += ",\"";
+        buffer_ += key;
+        buffer_ += "\":[";
+        first = false;
+      }
+      else {
+        buffer_ += ',';
+      }
+      buffer_ += '[';
+      this->AppendInteger(input.index);
+      buffer_ += ',';
+      this->AppendInteger(value);
+      buffer_ += ']';
+    }
+    if (!first) {
+      buffer_ += ']';
+      changed = true;
+    }
+  };
+
+  AppendPairs("axes", device.axes, [](DIJOYSTATE2 const& state, DWORD offset) -> int64_t {
+    return reinterpret_cast<LONG const*>(&state)[offset / sizeof(LONG)];
+  });
+  AppendPairs("povs", device.povs, [](DIJOYSTATE2 const& state, DWORD offset) -> int64_t {
+    DWORD const value = state.rgdwPOV[(offset - DIJOFS_POV(0)) / sizeof(DWORD)];
+    // Centered is reported as -1 rather than 4294967295.
+    return ((value & 0xFFFF) == 0xFFFF) ? -1 : static_cast<int64_t>(value);
+  });
+  AppendPairs("buttons", device.buttons, [](DIJOYSTATE2 const& state, DWORD offset) -> int64_t {
+    return (state.rgbButtons[offset - DIJOFS_BUTTON(0)] & 0x80) != 0 ? 1 : 0;
+  });
+
+  if (changed) {
+    buffer_ += "}\n";
+  }
+  else {
+    buffer_.resize(line_start);
+  }
+}
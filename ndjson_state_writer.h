@@ -0,0 +1,54 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Streams the changes of a `DirectInputContext` as newline-delimited JSON, one object per line:
+///
+///   {"t":1500,"type":"added","id":0,"guid":"{...}","name":"...","povs":1,"axes":4,"buttons":32}
+///   {"t":2500,"type":"state","id":0,"axes":[[0,-32767],[1,12]],"povs":[[0,9000]],"buttons":[[3,1]]}
+///   {"t":9000,"type":"removed","id":0}
+///
+/// `t` is the time in microseconds passed to `Record`, and `id` is reused once a device is removed, like in `InputRecorder`.
+/// State lines only list what changed, as `[index, value]` pairs; buttons are 1 (pressed) or 0 (released).
+/// Lines are batched in a buffer, written to `out` whenever it fills up or on `Flush`.
+class NdjsonStateWriter final {
+public:
+  explicit NdjsonStateWriter(std::ostream& out, size_t buffer_size = 64 * 1024);
+  ~NdjsonStateWriter() noexcept;
+
+  NdjsonStateWriter(NdjsonStateWriter const&) = delete;
+  NdjsonStateWriter(NdjsonStateWriter&&) = delete;
+  NdjsonStateWriter& operator=(NdjsonStateWriter const&) = delete;
+  NdjsonStateWriter& operator=(NdjsonStateWriter&&) = delete;
+
+  /// Appends a line for every hot-plug and every device whose state changed since the previous call, typically right after `UpdateState`.
+  void Record(DirectInputContext const& context, uint64_t time_us);
+  void Flush();
+
+  uint64_t GetBytesWritten() const { return bytes_written_ + buffer_.size(); }
+
+private:
+  struct TrackedDevice final {
+    DirectInputContext::DeviceHandle handle {};
+    DIJOYSTATE2 state {};
+  };
+
+  void FlushIfFull();
+  void AppendInteger(int64_t value);
+  void AppendString(std::string const& value);
+  void AppendLineStart(uint64_t time_us, char const* type, uint32_t id);
+  void AppendState(uint64_t time_us, uint32_t id, DirectInputContext::Device const& device, DIJOYSTATE2 const& previous, DIJOYSTATE2 const& current);
+
+  std::ostream& out_;
+  size_t buffer_capacity_ = 0;
+  std::string buffer_;
+  uint64_t bytes_written_ = 0;
+
+  /// Indexed by `DeviceHandle::index`.
+  std::vector<TrackedDevice> tracked_;
+};
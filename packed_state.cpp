@@ -0,0 +1,77 @@
+#include "packed_state.h"
+#include "axis_extraction.h"
+
+#include <algorithm>
+#include <cstring>
+
+PackedStateLayout::PackedStateLayout(std::span<DWORD const> axis_offsets, DWORD pov_count, DWORD button_count) {
+  axis_count_ = static_cast<uint8_t>(std::min<size_t>(axis_offsets.size(), PackedState::kMaxAxes));
+  pov_count_ = static_cast<uint8_t>(std::min(pov_count, PackedState::kMaxPovs));
+  button_count_ = static_cast<uint8_t>(std::min(button_count, PackedState::kMaxButtons));
+
+  for (DWORD i = 0; i < axis_count_; ++i) {
+    axis_gather_[i] = ToAxisGatherIndex(axis_offsets[i]);
+  }
+  pov_base_ = static_cast<uint8_t>(axis_count_ * sizeof(int16_t));
+  button_base_ = static_cast<uint8_t>(pov_base_ + pov_count_ * sizeof(uint16_t));
+  size_ = static_cast<uint8_t>(button_base_ + (button_count_ + 7) / 8);
+}
+
+void PackedStateLayout::Pack(DIJOYSTATE2 const& state, ButtonBits const& buttons, PackedState& out_packed) const {
+  out_packed = PackedState {};
+
+  // Like `GatherAxes`: `DIJOYSTATE2` starts with `LONG`s.
+  LONG const* words = reinterpret_cast<LONG const*>(&state);
+  for (DWORD i = 0; i < axis_count_; ++i) {
+    int16_t const value = static_cast<int16_t>(std::clamp<LONG>(words[axis_gather_[i]], INT16_MIN, INT16_MAX));
+    std::memcpy(out_packed.bytes + this->GetAxisOffset(i), &value, sizeof(value));
+  }
+
+  // Centered is `0xFFFFFFFF`, or at least has `0xFFFF` as its low word; anything else is at most 35999.
+  for (DWORD i = 0; i < pov_count_; ++i) {
+    uint16_t const value = static_cast<uint16_t>(state.rgdwPOV[i]);
+    std::memcpy(out_packed.bytes + this->GetPovOffset(i), &value, sizeof(value));
+  }
+
+  // `ButtonBits` already holds button `i` in bit `i % 8` of byte `i / 8`, on the little-endian targets DirectInput runs on.
+  size_t const button_bytes = (button_count_ + 7) / 8;
+  std::memcpy(out_packed.bytes + button_base_, buttons.words, button_bytes);
+  if (button_count_ % 8 != 0) {
+    // Keep the bytes past the last button zero, even if the backend left something beyond it.
+    out_packed.bytes[button_base_ + button_bytes - 1] &= static_cast<uint8_t>((1u << (button_count_ % 8)) - 1);
+  }
+}
+
+void PackedStateLayout::Unpack(PackedState const& packed, DIJOYSTATE2& out_state) const {
+  out_state = DIJOYSTATE2 {};
+  std::memset(out_state.rgdwPOV, 0xFF, sizeof(out_state.rgdwPOV));
+
+  LONG* words = reinterpret_cast<LONG*>(&out_state);
+  for (DWORD i = 0; i < axis_count_; ++i) {
+    int16_t value;
+    std::memcpy(&value, packed.bytes + this->GetAxisOffset(i), sizeof(value));
+    words[axis_gather_[i]] = DecodeAxis(value);
+  }
+
+  for (DWORD i = 0; i < pov_count_; ++i) {
+    uint16_t value;
+    std::memcpy(&value, packed.bytes + this->GetPovOffset(i), sizeof(value));
+    out_state.rgdwPOV[i] = DecodePov(value);
+  }
+
+  // Eight buttons at a time: spread the bits of a byte to one byte each, then turn each non-zero byte into `0x80`.
+  // Bits past the last button are zero (see `Pack`), so writing whole groups of eight is fine.
+  for (DWORD i = 0; i < button_count_; i += 8) {
+    uint64_t spread = (uint64_t(packed.bytes[this->GetButtonOffset(i)]) * 0x0101010101010101) & 0x8040201008040201;
+    spread = (spread | ((spread & 0x7F7F7F7F7F7F7F7F) + 0x7F7F7F7F7F7F7F7F)) & 0x8080808080808080;
+    std::memcpy(out_state.rgbButtons + i, &spread, sizeof(spread));
+  }
+}
+
+void PackedStateLayout::UnpackAxes(PackedState const& packed, LONG* out_values) const {
+  for (DWORD i = 0; i < axis_count_; ++i) {
+    int16_t value;
+    std::memcpy(&value, packed.bytes + this->GetAxisOffset(i), sizeof(value));
+    out_values[i] = DecodeAxis(value);
+  }
+}
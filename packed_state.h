@@ -0,0 +1,88 @@
+#pragma once
+
+#include "direct_input_compat.h"
+#include "button_bits.h"
+
+#include <cstdint>
+#include <span>
+
+/// A device's state with only the inputs it has: its axes as `int16_t`, then its POVs as `uint16_t`, then its buttons as bits.
+/// Where each one is depends on the device, see `PackedStateLayout`; bytes past `PackedStateLayout::GetSize` are zero.
+/// 40 bytes at most, against 272 for a `DIJOYSTATE2`, and typically 10 to 20.
+struct PackedState final {
+  static inline constexpr DWORD kMaxAxes = 8;
+  static inline constexpr DWORD kMaxPovs = 4;
+  static inline constexpr DWORD kMaxButtons = ButtonBits::kButtonCount;
+  static inline constexpr size_t kCapacity = kMaxAxes * sizeof(int16_t) + kMaxPovs * sizeof(uint16_t) + kMaxButtons / 8;
+
+  alignas(8) uint8_t bytes[kCapacity] = {};
+};
+
+/// Where a device's inputs are in its `PackedState`, and the conversions from and to `DIJOYSTATE2`, compiled once when the device is opened.
+///
+/// Nothing is lost for the inputs the device has: axes are in `[DirectInputContext::kAxisMin, kAxisMax]`, POVs in hundredths of a degree or centered,
+/// and only the high bit of a button is meaningful. Every field is 2-byte aligned, so none straddles two 8-byte words (see `SeqLock::LoadField`).
+class PackedStateLayout final {
+public:
+  PackedStateLayout() = default;
+  /// `axis_offsets` are the `DIJOYSTATE2` byte offsets of the device's axes, in order (see `DirectInputContext::Device::axes`).
+  /// POVs and buttons are always the first `pov_count` and `button_count` of `DIJOYSTATE2`. Each count is capped to what `PackedState` can hold.
+  PackedStateLayout(std::span<DWORD const> axis_offsets, DWORD pov_count, DWORD button_count);
+
+  /// How many bytes of `PackedState` are used.
+  uint32_t GetSize() const {
+    return size_;
+  }
+  DWORD GetAxisCount() const {
+    return axis_count_;
+  }
+  DWORD GetPovCount() const {
+    return pov_count_;
+  }
+  DWORD GetButtonCount() const {
+    return button_count_;
+  }
+
+  /// Byte offsets into `PackedState::bytes`.
+  uint32_t GetAxisOffset(DWORD index) const {
+    return index * sizeof(int16_t);
+  }
+  uint32_t GetPovOffset(DWORD index) const {
+    return pov_base_ + index * sizeof(uint16_t);
+  }
+  /// The byte holding button `index`, as bit `index % 8`.
+  uint32_t GetButtonOffset(DWORD index) const {
+    return button_base_ + index / 8;
+  }
+
+  /// `buttons` are `state.rgbButtons` as bits (see `PackButtons`), for a caller that already has them.
+  void Pack(DIJOYSTATE2 const& state, ButtonBits const& buttons, PackedState& out_packed) const;
+  void Pack(DIJOYSTATE2 const& state, PackedState& out_packed) const {
+    this->Pack(state, PackButtons(state.rgbButtons), out_packed);
+  }
+  /// Fills out the inputs of the device and zeroes everything else, with POVs centered, like a device at rest.
+  void Unpack(PackedState const& packed, DIJOYSTATE2& out_state) const;
+  /// Widens every axis, in order, like `GatherAxes` does from a `DIJOYSTATE2`.
+  void UnpackAxes(PackedState const& packed, LONG* out_values) const;
+
+  /// Converts a field read at one of the offsets above back to its `DIJOYSTATE2` value.
+  static LONG DecodeAxis(int16_t value) {
+    return value;
+  }
+  static DWORD DecodePov(uint16_t value) {
+    return (value == 0xFFFF) ? 0xFFFFFFFF : value;
+  }
+  static BYTE DecodeButton(uint8_t bits, DWORD index) {
+    return ((bits >> (index % 8)) & 1) != 0 ? 0x80 : 0;
+  }
+
+private:
+  /// `DIJOYSTATE2` offsets of the axes, as `LONG` indices (see `ToAxisGatherIndex`).
+  uint8_t axis_gather_[PackedState::kMaxAxes] = {};
+  uint8_t axis_count_ = 0;
+  uint8_t pov_count_ = 0;
+  uint8_t button_count_ = 0;
+  uint8_t pov_base_ = 0;
+  uint8_t button_base_ = 0;
+  uint8_t size_ = 0;
+};
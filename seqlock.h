@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/// Publishes a trivially copyable `T` from a single writer thread to any number of reader threads.
+/// The writer never waits. Readers never block the writer; they only retry if they raced with a `Store`, and never observe a torn value.
+///
+/// The value is kept in relaxed atomic words rather than as a plain `T`, so that the reads racing with a `Store` are not data races.
+template<typename T>
+class SeqLock final {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  SeqLock() = default;
+  explicit SeqLock(T const& value) { this->Store(value); }
+
+  SeqLock(SeqLock const&) = delete;
+  SeqLock& operator=(SeqLock const&) = delete;
+
+  /// Must only be called from one thread at a time.
+  void Store(T const& value) {
+    uint64_t words[kWordCount] = {};
+    std::memcpy(words, &value, sizeof(T));
+
+    uint64_t const sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < kWordCount; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  T Load() const {
+    uint64_t words[kWordCount];
+    while (true) {
+      uint64_t const before = sequence_.load(std::memory_order_acquire);
+      if ((before & 1) != 0) {
+        // A `Store` is in progress.
+        continue;
+      }
+
+      for (size_t i = 0; i < kWordCount; ++i) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before) {
+        break;
+      }
+    }
+
+    T value;
+    std::memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+  /// Reads a single field of `T` at byte `offset`.
+  /// The field must not straddle two 8-byte words, so it is read with one atomic load and never needs a retry.
+  template<typename Field>
+  Field LoadField(size_t offset) const {
+    static_assert(std::is_trivially_copyable_v<Field> && sizeof(Field) <= sizeof(uint64_t));
+    assert(offset + sizeof(Field) <= sizeof(T));
+    assert((offset % sizeof(uint64_t)) + sizeof(Field) <= sizeof(uint64_t));
+
+    uint64_t const word = words_[offset / sizeof(uint64_t)].load(std::memory_order_relaxed);
+
+    Field value;
+    std::memcpy(&value, reinterpret_cast<unsigned char const*>(&word) + (offset % sizeof(uint64_t)), sizeof(Field));
+    return value;
+  }
+
+  /// Even, and incremented by 2 on every `Store`.
+  uint64_t GetSequence() const {
+    return sequence_.load(std::memory_order_acquire);
+  }
+
+private:
+  static inline constexpr size_t kWordCount = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint64_t> sequence_ { 0 };
+  std::atomic<uint64_t> words_[kWordCount] {};
+};
@@ -0,0 +1,268 @@
+#include "shared_state.h"
+
+#include <iostream>
+#include <new>
+
+#if !defined(_WIN32)
+# include <cerrno>
+# include <cstring>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+SharedStateRegion::~SharedStateRegion() noexcept {
+  this->Close();
+}
+
+#if defined(_WIN32)
+
+bool SharedStateRegion::Create(std::string const& name, size_t size) {
+  this->Close();
+
+  HANDLE const mapping = ::CreateFileMappingA(
+    INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+    static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size & 0xFFFFFFFF),
+    name.c_str()
+  );
+  if (mapping == nullptr) {
+    std::clog << "SharedStateRegion: CreateFileMapping(\"" << name << "\") failed: " << ::GetLastError() << std::endl;
+    return false;
+  }
+
+  void* const data = ::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (data == nullptr) {
+    std::clog << "SharedStateRegion: MapViewOfFile(\"" << name << "\") failed: " << ::GetLastError() << std::endl;
+    ::CloseHandle(mapping);
+    return false;
+  }
+
+  name_ = name;
+  mapping_ = mapping;
+  data_ = data;
+  size_ = size;
+  owner_ = true;
+  return true;
+}
+
+bool SharedStateRegion::OpenReadOnly(std::string const& name) {
+  this->Close();
+
+  HANDLE const mapping = ::OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+  if (mapping == nullptr) {
+    return false;
+  }
+
+  void* const data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (data == nullptr) {
+    ::CloseHandle(mapping);
+    return false;
+  }
+
+  MEMORY_BASIC_INFORMATION info {};
+  ::VirtualQuery(data, &info, sizeof(info));
+
+  name_ = name;
+  mapping_ = mapping;
+  data_ = data;
+  size_ = info.RegionSize;
+  owner_ = false;
+  return true;
+}
+
+void SharedStateRegion::Close() {
+  if (data_ != nullptr) {
+    ::UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  if (mapping_ != nullptr) {
+    // The mapping, and its name, go away with the last handle to it.
+    ::CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  name_.clear();
+  size_ = 0;
+  owner_ = false;
+}
+
+#else
+
+bool SharedStateRegion::Create(std::string const& name, size_t size) {
+  this->Close();
+
+  std::string const path = "/" + name;
+
+  // A region left behind by a publisher that crashed is replaced rather than reused, so that its readers keep their (now frozen) mapping.
+  ::shm_unlink(path.c_str());
+  int const fd = ::shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    std::clog << "SharedStateRegion: shm_open(\"" << path << "\") failed: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    std::clog << "SharedStateRegion: ftruncate(\"" << path << "\") failed: " << std::strerror(errno) << std::endl;
+    ::close(fd);
+    ::shm_unlink(path.c_str());
+    return false;
+  }
+
+  void* const data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // The mapping stays valid without the descriptor.
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    std::clog << "SharedStateRegion: mmap(\"" << path << "\") failed: " << std::strerror(errno) << std::endl;
+    ::shm_unlink(path.c_str());
+    return false;
+  }
+
+  name_ = name;
+  data_ = data;
+  size_ = size;
+  owner_ = true;
+  return true;
+}
+
+bool SharedStateRegion::OpenReadOnly(std::string const& name) {
+  this->Close();
+
+  std::string const path = "/" + name;
+  int const fd = ::shm_open(path.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat status {};
+  if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  size_t const size = static_cast<size_t>(status.st_size);
+  void* const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  name_ = name;
+  data_ = data;
+  size_ = size;
+  owner_ = false;
+  return true;
+}
+
+void SharedStateRegion::Close() {
+  if (data_ != nullptr) {
+    ::munmap(data_, size_);
+    data_ = nullptr;
+  }
+  if (owner_) {
+    ::shm_unlink(("/" + name_).c_str());
+  }
+  name_.clear();
+  size_ = 0;
+  owner_ = false;
+}
+
+#endif
+
+bool SharedStatePublisher::Create(std::string const& name, uint32_t device_capacity) {
+  this->Close();
+
+  if (!region_.Create(name, GetSharedStateSize(device_capacity))) {
+    return false;
+  }
+
+  auto* const data = static_cast<unsigned char*>(region_.GetData());
+  header_ = new (data) SharedStateHeader {};
+  slots_ = new (data + sizeof(SharedStateHeader)) SharedDeviceSlot[device_capacity];
+  device_capacity_ = device_capacity;
+
+  header_->version = kSharedStateVersion;
+  header_->device_capacity = device_capacity;
+  header_->slot_size = sizeof(SharedDeviceSlot);
+  header_->magic.store(kSharedStateMagic, std::memory_order_release);
+  return true;
+}
+
+void SharedStatePublisher::Close() {
+  if (header_ != nullptr) {
+    // Readers that still have it mapped see every slot empty, rather than devices that look connected but never change.
+    for (uint32_t slot = 0; slot < device_capacity_; ++slot) {
+      if (slots_[slot].info.Load().generation != 0) {
+        this->ClearDevice(slot);
+      }
+    }
+  }
+
+  region_.Close();
+  header_ = nullptr;
+  slots_ = nullptr;
+  device_capacity_ = 0;
+}
+
+void SharedStatePublisher::SetDeviceInfo(uint32_t slot, SharedDeviceInfo const& info) {
+  slots_[slot].info.Store(info);
+  header_->layout_version.fetch_add(1, std::memory_order_release);
+}
+
+void SharedStatePublisher::ClearDevice(uint32_t slot) {
+  this->SetDeviceInfo(slot, SharedDeviceInfo {});
+}
+
+void SharedStatePublisher::SetDeviceState(uint32_t slot, SharedDeviceState const& state) {
+  slots_[slot].state.Store(state);
+}
+
+void SharedStatePublisher::SetHeartbeat(uint64_t now_ns) {
+  header_->heartbeat_ns.store(now_ns, std::memory_order_relaxed);
+}
+
+bool SharedStateReader::Open(std::string const& name) {
+  this->Close();
+
+  if (!region_.OpenReadOnly(name)) {
+    return false;
+  }
+
+  auto const* const data = static_cast<unsigned char const*>(region_.GetData());
+  auto const* const header = reinterpret_cast<SharedStateHeader const*>(data);
+  bool const valid =
+    region_.GetSize() >= sizeof(SharedStateHeader) &&
+    header->magic.load(std::memory_order_acquire) == kSharedStateMagic &&
+    header->version == kSharedStateVersion &&
+    header->slot_size == sizeof(SharedDeviceSlot) &&
+    region_.GetSize() >= GetSharedStateSize(header->device_capacity);
+  if (!valid) {
+    region_.Close();
+    return false;
+  }
+
+  header_ = header;
+  slots_ = reinterpret_cast<SharedDeviceSlot const*>(data + sizeof(SharedStateHeader));
+  return true;
+}
+
+void SharedStateReader::Close() {
+  region_.Close();
+  header_ = nullptr;
+  slots_ = nullptr;
+}
+
+bool SharedStateReader::ReadDeviceInfo(uint32_t slot, SharedDeviceInfo& out_info) const {
+  if (slot >= header_->device_capacity) {
+    return false;
+  }
+  out_info = slots_[slot].info.Load();
+  return out_info.generation != 0;
+}
+
+bool SharedStateReader::ReadDeviceState(uint32_t slot, uint32_t generation, SharedDeviceState& out_state) const {
+  if (slot >= header_->device_capacity || generation == 0) {
+    return false;
+  }
+  out_state = slots_[slot].state.Load();
+  return out_state.generation == generation;
+}
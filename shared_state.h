@@ -0,0 +1,113 @@
+#pragma once
+
+#include "shared_state_layout.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// A named shared-memory region laid out as described in `shared_state_layout.h`:
+/// POSIX shared memory (`shm_open`, e.g. `/dev/shm/<name>` on Linux), or a named file mapping on Windows.
+/// `name` is given without the leading '/' POSIX requires.
+class SharedStateRegion final {
+public:
+  SharedStateRegion() = default;
+  ~SharedStateRegion() noexcept;
+
+  SharedStateRegion(SharedStateRegion const&) = delete;
+  SharedStateRegion& operator=(SharedStateRegion const&) = delete;
+
+  /// Creates (or takes over a stale) region of `size` bytes, mapped read-write.
+  bool Create(std::string const& name, size_t size);
+  /// Maps an existing region read-only.
+  bool OpenReadOnly(std::string const& name);
+  /// Unmaps the region, and removes its name if it was created by `Create`. Readers keep their mappings.
+  void Close();
+
+  void* GetData() const {
+    return data_;
+  }
+
+  size_t GetSize() const {
+    return size_;
+  }
+
+private:
+  std::string name_;
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  bool owner_ = false;
+#if defined(_WIN32)
+  void* mapping_ = nullptr;
+#endif
+};
+
+/// Writes device layouts and states into a `SharedStateRegion`, for `SharedStateReader`s in other processes.
+/// `DirectInputContext` drives one when `Config::shared_memory_name` is set.
+///
+/// `SetDeviceInfo` and `ClearDevice` must be called from one thread, and `SetDeviceState` from one (possibly other) thread.
+class SharedStatePublisher final {
+public:
+  bool Create(std::string const& name, uint32_t device_capacity);
+  void Close();
+
+  bool IsOpen() const {
+    return header_ != nullptr;
+  }
+
+  uint32_t GetDeviceCapacity() const {
+    return device_capacity_;
+  }
+
+  /// Publishes the device now in `slot`, and bumps the layout version.
+  void SetDeviceInfo(uint32_t slot, SharedDeviceInfo const& info);
+  /// Marks `slot` empty, and bumps the layout version.
+  void ClearDevice(uint32_t slot);
+  void SetDeviceState(uint32_t slot, SharedDeviceState const& state);
+  /// Tells readers the publisher is alive as of `now_ns` (`GetMonotonicTimeNs`).
+  void SetHeartbeat(uint64_t now_ns);
+
+private:
+  SharedStateRegion region_;
+  SharedStateHeader* header_ = nullptr;
+  SharedDeviceSlot* slots_ = nullptr;
+  uint32_t device_capacity_ = 0;
+};
+
+/// Maps a `SharedStatePublisher`'s region read-only. After `Open`, every read is a handful of loads from the mapping:
+/// no system calls, no locks, no copies beyond the value returned.
+/// Reads never block the publisher, and never return a torn value.
+class SharedStateReader final {
+public:
+  /// Fails if there is no such region, or if it is not (yet) a complete region of this version.
+  bool Open(std::string const& name);
+  void Close();
+
+  bool IsOpen() const {
+    return header_ != nullptr;
+  }
+
+  uint32_t GetDeviceCapacity() const {
+    return header_->device_capacity;
+  }
+
+  /// Changes whenever a device is added to or removed from a slot; rescan the slots with `ReadDeviceInfo` only when it did.
+  uint64_t GetLayoutVersion() const {
+    return header_->layout_version.load(std::memory_order_acquire);
+  }
+
+  /// The publisher's latest `GetMonotonicTimeNs`. If it stops advancing, the publisher is gone (or stalled).
+  uint64_t GetHeartbeatNs() const {
+    return header_->heartbeat_ns.load(std::memory_order_relaxed);
+  }
+
+  /// Returns `false` if `slot` is empty.
+  bool ReadDeviceInfo(uint32_t slot, SharedDeviceInfo& out_info) const;
+  /// Returns `false` if `slot` does not (yet, or any more) hold the device of `generation`, as read from `ReadDeviceInfo`.
+  bool ReadDeviceState(uint32_t slot, uint32_t generation, SharedDeviceState& out_state) const;
+
+private:
+  SharedStateRegion region_;
+  SharedStateHeader const* header_ = nullptr;
+  SharedDeviceSlot const* slots_ = nullptr;
+};
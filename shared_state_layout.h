@@ -0,0 +1,67 @@
+#pragma once
+
+//
+// Layout of the shared-memory region that `SharedStatePublisher` writes and `SharedStateReader` maps read-only in other processes.
+//
+//   SharedStateHeader
+//   SharedDeviceSlot[device_capacity]
+//
+// A device occupies the slot of its `DirectInputContext::DeviceHandle::index` for as long as it is connected.
+// Everything that changes is behind a `SeqLock`, whose words are lock-free atomics and so work across processes:
+// readers never block the publisher and never observe a torn value.
+//
+
+#include "direct_input_compat.h"
+#include "seqlock.h"
+
+#include <atomic>
+#include <cstdint>
+
+inline constexpr uint32_t kSharedStateMagic = 0x4D534944; // "DISM"
+inline constexpr uint32_t kSharedStateVersion = 1;
+inline constexpr uint32_t kSharedDeviceNameSize = 128;
+
+struct SharedDeviceInfo final {
+  /// `DeviceHandle::generation` of the device in the slot, or 0 if the slot is empty.
+  uint32_t generation = 0;
+  uint32_t pov_count = 0;
+  uint32_t axis_count = 0;
+  uint32_t button_count = 0;
+  /// Byte offset into `DIJOYSTATE2` of each axis, in `Device::axes` order.
+  uint32_t axis_offsets[8] = {};
+  GUID guid {};
+  /// UTF-8, null-terminated, truncated if needed.
+  char name[kSharedDeviceNameSize] = {};
+};
+
+struct SharedDeviceState final {
+  /// Same as `SharedDeviceInfo::generation` once both are published; a reader that sees them differ raced with a hot-plug.
+  uint64_t generation = 0;
+  /// `DirectInputContext::SampleTimes` on the publisher's monotonic clock.
+  uint64_t poll_end_ns = 0;
+  uint64_t last_change_ns = 0;
+  DIJOYSTATE2 state {};
+};
+
+struct alignas(64) SharedDeviceSlot final {
+  SeqLock<SharedDeviceInfo> info;
+  SeqLock<SharedDeviceState> state;
+};
+
+struct alignas(64) SharedStateHeader final {
+  /// `kSharedStateMagic`, stored last when the region is created, so that a reader never maps a half-initialized region.
+  std::atomic<uint32_t> magic { 0 };
+  uint32_t version = 0;
+  uint32_t device_capacity = 0;
+  uint32_t slot_size = 0;
+  /// Incremented whenever a slot's `info` changes, so that readers only rescan the device table when it did.
+  std::atomic<uint64_t> layout_version { 0 };
+  /// Publisher's monotonic clock as of its latest publication, so that readers can tell it is still alive.
+  std::atomic<uint64_t> heartbeat_ns { 0 };
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free, "Cross-process atomics must be lock-free.");
+
+inline constexpr size_t GetSharedStateSize(uint32_t device_capacity) {
+  return sizeof(SharedStateHeader) + sizeof(SharedDeviceSlot) * device_capacity;
+}
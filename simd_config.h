@@ -0,0 +1,15 @@
+#pragma once
+
+/// 0: Scalar code only.
+/// 1: Use SSE2 (always available on x64).
+#if !defined(CONFIG_USE_SSE2)
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define CONFIG_USE_SSE2 (1)
+# else
+#  define CONFIG_USE_SSE2 (0)
+# endif
+#endif
+
+#if CONFIG_USE_SSE2
+# include <emmintrin.h>
+#endif
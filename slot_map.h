@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+/// Refers to a value in a `SlotMap`.
+/// Stays valid while the value is alive, and becomes (detectably) stale once it is erased, even if its slot gets reused.
+struct SlotMapHandle final {
+  uint32_t index = UINT32_MAX;
+  /// 0 is never a live generation, so a default-constructed handle is always invalid.
+  uint32_t generation = 0;
+
+  bool operator==(SlotMapHandle const&) const = default;
+};
+
+/// Values are kept densely packed in one contiguous array, in no particular order, so that iterating all of them touches contiguous memory only.
+/// They are addressed through generation-checked `SlotMapHandle`s.
+/// `Insert` and `Erase` are O(1); `Erase` moves the last value into the erased one's place.
+template<typename T>
+class SlotMap final {
+public:
+  using Handle = SlotMapHandle;
+
+  SlotMapHandle Insert(T&& value) {
+    uint32_t index = 0;
+    if (free_head_ != kNone) {
+      index = free_head_;
+      free_head_ = slots_[index].next_free;
+    }
+    else {
+      index = static_cast<uint32_t>(slots_.size());
+      slots_.push_back(Slot {});
+    }
+
+    Slot& slot = slots_[index];
+    slot.dense_index = static_cast<uint32_t>(values_.size());
+    slot.next_free = kNone;
+
+    values_.push_back(std::move(value));
+    dense_to_slot_.push_back(index);
+
+    return SlotMapHandle { .index = index, .generation = slot.generation };
+  }
+
+  bool Erase(SlotMapHandle handle) {
+    if (!this->Contains(handle)) {
+      return false;
+    }
+
+    Slot& slot = slots_[handle.index];
+    uint32_t const dense_index = slot.dense_index;
+    uint32_t const last_dense_index = static_cast<uint32_t>(values_.size() - 1);
+
+    // Move the last value into the hole.
+    if (dense_index != last_dense_index) {
+      values_[dense_index] = std::move(values_[last_dense_index]);
+      dense_to_slot_[dense_index] = dense_to_slot_[last_dense_index];
+      slots_[dense_to_slot_[dense_index]].dense_index = dense_index;
+    }
+    values_.pop_back();
+    dense_to_slot_.pop_back();
+
+    // Invalidate outstanding handles; skip 0 on wrap-around.
+    if (++slot.generation == 0) {
+      slot.generation = 1;
+    }
+    slot.dense_index = kNone;
+    slot.next_free = free_head_;
+    free_head_ = handle.index;
+
+    return true;
+  }
+
+  void Clear() {
+    while (!values_.empty()) {
+      this->Erase(this->GetHandle(values_.size() - 1));
+    }
+  }
+
+  bool Contains(SlotMapHandle handle) const {
+    return
+      handle.index < slots_.size() &&
+      slots_[handle.index].generation == handle.generation &&
+      slots_[handle.index].dense_index != kNone;
+  }
+
+  T* Get(SlotMapHandle handle) {
+    return this->Contains(handle) ? &values_[slots_[handle.index].dense_index] : nullptr;
+  }
+  T const* Get(SlotMapHandle handle) const {
+    return this->Contains(handle) ? &values_[slots_[handle.index].dense_index] : nullptr;
+  }
+
+  /// The handle of `GetValues()[dense_index]`.
+  SlotMapHandle GetHandle(size_t dense_index) const {
+    assert(dense_index < values_.size());
+    uint32_t const index = dense_to_slot_[dense_index];
+    return SlotMapHandle { .index = index, .generation = slots_[index].generation };
+  }
+
+  /// Invalidated by `Insert` and `Erase`.
+  std::span<T> GetValues() { return values_; }
+  std::span<T const> GetValues() const { return values_; }
+
+  size_t GetSize() const { return values_.size(); }
+  bool IsEmpty() const { return values_.empty(); }
+
+private:
+  static inline constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Slot final {
+    uint32_t generation = 1;
+    /// Index into `values_`, or `kNone` while the slot is free.
+    uint32_t dense_index = kNone;
+    uint32_t next_free = kNone;
+  };
+
+  std::vector<T> values_;
+  /// Parallel to `values_`.
+  std::vector<uint32_t> dense_to_slot_;
+  std::vector<Slot> slots_;
+  uint32_t free_head_ = kNone;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+/// A bounded queue of trivially copyable `T` from one producer thread to one consumer thread, without locks.
+/// Values are pushed and popped in batches: each `Push` or `Pop` touches the other thread's index at most once, however many values it moves.
+/// The two indices are on their own cache lines, and each side caches the other's, so that a thread that keeps up rarely reads a line the other one writes.
+template<typename T>
+class SpscQueue final {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  /// `capacity` is rounded up to a power of two.
+  explicit SpscQueue(size_t capacity)
+    : slots_(std::bit_ceil(std::max<size_t>(capacity, 1)))
+  {
+  }
+
+  SpscQueue(SpscQueue const&) = delete;
+  SpscQueue& operator=(SpscQueue const&) = delete;
+
+  size_t GetCapacity() const {
+    return slots_.size();
+  }
+
+  /// Producer only. Appends as many of `values` as fit, in order, and makes them visible to the consumer together. Returns how many.
+  size_t Push(std::span<T const> values) {
+    uint64_t const tail = tail_.load(std::memory_order_relaxed);
+    if (tail + values.size() - cached_head_ > slots_.size()) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    size_t const count = std::min<size_t>(values.size(), slots_.size() - static_cast<size_t>(tail - cached_head_));
+    if (count == 0) {
+      return 0;
+    }
+
+    size_t const mask = slots_.size() - 1;
+    for (size_t i = 0; i < count; ++i) {
+      slots_[(tail + i) & mask] = values[i];
+    }
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  /// Consumer only. Moves up to `out_values.size()` values out, oldest first. Returns how many.
+  size_t Pop(std::span<T> out_values) {
+    uint64_t const head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < out_values.size()) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    }
+    size_t const count = std::min<size_t>(out_values.size(), static_cast<size_t>(cached_tail_ - head));
+    if (count == 0) {
+      return 0;
+    }
+
+    size_t const mask = slots_.size() - 1;
+    for (size_t i = 0; i < count; ++i) {
+      out_values[i] = slots_[(head + i) & mask];
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+private:
+  std::vector<T> slots_;
+
+  /// Written by the consumer, along with its copy of `tail_`.
+  alignas(64) std::atomic<uint64_t> head_ { 0 };
+  uint64_t cached_tail_ = 0;
+
+  /// Written by the producer, along with its copy of `head_`.
+  alignas(64) std::atomic<uint64_t> tail_ { 0 };
+  uint64_t cached_head_ = 0;
+};
@@ -0,0 +1,363 @@
+#include "synthetic_backend.h"
+#include "device_layout_cache.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+/// Where `SyntheticBackend::SetDeviceState` leaves the state of an event-driven device for its source to pick up.
+struct SyntheticDeviceInbox final {
+  std::mutex mutex;
+  DIJOYSTATE2 state {};
+  InputSignal signal;
+};
+
+namespace {
+
+/// Arbitrary, but recognizable in `GetGuidString`.
+constexpr uint16_t kSyntheticGuidMarker = 0x5E7A;
+
+constexpr std::array<DWORD, 8> kAxisOffsets = {
+  DIJOFS_X, DIJOFS_Y, DIJOFS_Z, DIJOFS_RX, DIJOFS_RY, DIJOFS_RZ, DIJOFS_SLIDER(0), DIJOFS_SLIDER(1),
+};
+
+/// Small, fast and good enough to vary the population.
+uint32_t NextRandom(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+class SyntheticDeviceSource final : public DirectInputContext::DeviceSource {
+public:
+  SyntheticDeviceSource(
+    SyntheticBackend::DeviceSpec const& spec, uint32_t device_index, DWORD buffer_size, SyntheticDeviceInbox* inbox, std::atomic<bool> const& connected
+  )
+    : spec_(spec), device_index_(device_index), buffer_size_(buffer_size), inbox_(inbox), connected_(connected)
+    , random_(device_index * 2654435761u + 1)
+  {
+  }
+
+  HRESULT Acquire() override {
+    if (!connected_.load(std::memory_order_relaxed)) {
+      return DIERR_UNPLUGGED;
+    }
+    acquired_ = true;
+    return DI_OK;
+  }
+
+  HRESULT Poll() override {
+    if (!acquired_) {
+      return DIERR_NOTACQUIRED;
+    }
+    if (!connected_.load(std::memory_order_relaxed) ||
+        (spec_.input_lost_per_million > 0 && NextRandom(random_) % 1'000'000 < spec_.input_lost_per_million)) {
+      acquired_ = false;
+      return DIERR_INPUTLOST;
+    }
+
+    if (spec_.poll_latency.count() > 0) {
+      std::this_thread::sleep_for(spec_.poll_latency);
+    }
+
+    DIJOYSTATE2 const previous_state = state_;
+    if (inbox_ != nullptr) {
+      // Unsignal before reading, so that a state set meanwhile signals again.
+      inbox_->signal.Reset();
+      std::lock_guard lock(inbox_->mutex);
+      state_ = inbox_->state;
+    }
+    else {
+      this->Advance();
+    }
+
+    if (buffer_size_ > 0) {
+      this->BufferChanges(previous_state);
+    }
+
+    return DI_OK;
+  }
+
+  HRESULT GetDeviceState(DIJOYSTATE2& out_state) override {
+    if (!acquired_) {
+      return DIERR_NOTACQUIRED;
+    }
+
+    out_state = state_;
+    return DI_OK;
+  }
+
+  HRESULT ReadBufferedEvents(DIDEVICEOBJECTDATA* out_data, DWORD& inout_count) override {
+    if (!acquired_) {
+      inout_count = 0;
+      return DIERR_NOTACQUIRED;
+    }
+
+    DWORD const count = std::min<DWORD>(inout_count, static_cast<DWORD>(buffer_.size() - buffer_read_index_));
+    std::copy_n(buffer_.begin() + buffer_read_index_, count, out_data);
+    buffer_read_index_ += count;
+    inout_count = count;
+
+    if (buffer_read_index_ == buffer_.size()) {
+      buffer_.clear();
+      buffer_read_index_ = 0;
+    }
+
+    bool const overflowed = buffer_overflowed_;
+    buffer_overflowed_ = false;
+    return overflowed ? DI_BUFFEROVERFLOW : DI_OK;
+  }
+
+  InputNotificationHandle GetNotificationHandle() override {
+    return (inbox_ != nullptr) ? inbox_->signal.GetHandle() : kNoInputNotification;
+  }
+
+private:
+  void Advance() {
+    uint32_t const tick = tick_++;
+
+    LONG* axes = reinterpret_cast<LONG*>(&state_);
+    for (DWORD i = 0; i < spec_.axis_count; ++i) {
+      // Triangle wave over [kAxisMin, kAxisMax], each axis with its own phase.
+      uint32_t const phase = (tick * 97 + device_index_ * 131 + i * 4099) % 131068;
+      LONG value = static_cast<LONG>(phase < 65534 ? phase : 131068 - phase) + DirectInputContext::kAxisMin;
+      if (spec_.axis_noise > 0) {
+        LONG const noise = static_cast<LONG>(NextRandom(random_) % (2 * static_cast<uint32_t>(spec_.axis_noise) + 1)) - spec_.axis_noise;
+        value = std::clamp(value + noise, DirectInputContext::kAxisMin, DirectInputContext::kAxisMax);
+      }
+      axes[kAxisOffsets[i] / sizeof(LONG)] = value;
+    }
+
+    for (DWORD i = 0; i < spec_.pov_count; ++i) {
+      // Centered half of the time, otherwise one of the 8 directions.
+      uint32_t const step = (tick / 16 + i + device_index_) % 16;
+      state_.rgdwPOV[i] = (step < 8) ? step * 4500 : 0xFFFFFFFF;
+    }
+
+    for (DWORD i = 0; i < spec_.button_count; ++i) {
+      bool const pressed = (((tick + device_index_) >> (i % 8)) & 1) != 0 && ((tick / 64 + i) % 3) == 0;
+      state_.rgbButtons[i] = pressed ? 0x80 : 0x00;
+    }
+  }
+
+  /// Emulates the device buffer: one event per object that changed since `previous_state`.
+  void BufferChanges(DIJOYSTATE2 const& previous_state) {
+    auto Push = [this](DWORD offset, DWORD value) {
+      if (buffer_.size() - buffer_read_index_ >= buffer_size_) {
+        buffer_overflowed_ = true;
+        return;
+      }
+      DIDEVICEOBJECTDATA& data = buffer_.emplace_back();
+      data.dwOfs = offset;
+      data.dwData = value;
+      data.dwTimeStamp = tick_;
+      data.dwSequence = sequence_++;
+    };
+
+    for (DWORD i = 0; i < spec_.axis_count; ++i) {
+      DWORD const word = kAxisOffsets[i] / sizeof(LONG);
+      LONG const value = reinterpret_cast<LONG const*>(&state_)[word];
+      if (value != reinterpret_cast<LONG const*>(&previous_state)[word]) {
+        Push(kAxisOffsets[i], static_cast<DWORD>(value));
+      }
+    }
+    for (DWORD i = 0; i < spec_.pov_count; ++i) {
+      if (state_.rgdwPOV[i] != previous_state.rgdwPOV[i]) {
+        Push(static_cast<DWORD>(DIJOFS_POV(i)), state_.rgdwPOV[i]);
+      }
+    }
+    for (DWORD i = 0; i < spec_.button_count; ++i) {
+      if (state_.rgbButtons[i] != previous_state.rgbButtons[i]) {
+        Push(static_cast<DWORD>(DIJOFS_BUTTON(i)), state_.rgbButtons[i]);
+      }
+    }
+  }
+
+  SyntheticBackend::DeviceSpec const& spec_;
+  uint32_t device_index_ = 0;
+  DWORD buffer_size_ = 0;
+  SyntheticDeviceInbox* inbox_ = nullptr;
+  /// Owned by the backend, which outlives its sources.
+  std::atomic<bool> const& connected_;
+
+  uint32_t tick_ = 0;
+  /// For `DeviceSpec::axis_noise` and `DeviceSpec::input_lost_per_million`.
+  uint32_t random_ = 1;
+  bool acquired_ = false;
+  DIJOYSTATE2 state_ {};
+
+  std::vector<DIDEVICEOBJECTDATA> buffer_;
+  size_t buffer_read_index_ = 0;
+  bool buffer_overflowed_ = false;
+  DWORD sequence_ = 0;
+};
+
+}
+
+std::vector<SyntheticBackend::DeviceSpec> SyntheticBackend::MakePopulation(size_t device_count, uint32_t seed) {
+  uint32_t random = seed != 0 ? seed : 1;
+
+  std::vector<DeviceSpec> specs;
+  specs.reserve(device_count);
+  for (size_t i = 0; i < device_count; ++i) {
+    switch (NextRandom(random) % 4) {
+    case 0:
+      specs.push_back(DeviceSpec { .name = "Synthetic Stick", .pov_count = 1, .axis_count = 4, .button_count = 32 });
+      break;
+    case 1:
+      specs.push_back(DeviceSpec { .name = "Synthetic Pedals", .pov_count = 0, .axis_count = 3, .button_count = 0 });
+      break;
+    case 2:
+      specs.push_back(DeviceSpec { .name = "Synthetic Throttle", .pov_count = 2, .axis_count = 8, .button_count = 64 });
+      break;
+    default:
+      specs.push_back(DeviceSpec { .name = "Synthetic Button Box", .pov_count = 0, .axis_count = 0, .button_count = 128 });
+      break;
+    }
+  }
+  return specs;
+}
+
+GUID SyntheticBackend::MakeProductGuid(DeviceSpec const& spec) {
+  // Every device of the same model shares it, as with real products.
+  uint32_t hash = 0x811C9DC5;
+  for (char c : spec.name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x01000193;
+  }
+
+  GUID guid {};
+  guid.Data1 = hash;
+  guid.Data2 = kSyntheticGuidMarker;
+  guid.Data3 = static_cast<uint16_t>((spec.pov_count << 12) | (spec.axis_count << 8) | spec.button_count);
+  return guid;
+}
+
+GUID SyntheticBackend::MakeDeviceGuid(size_t index) {
+  GUID guid {};
+  guid.Data1 = static_cast<uint32_t>(index + 1);
+  guid.Data2 = kSyntheticGuidMarker;
+  return guid;
+}
+
+SyntheticBackend::SyntheticBackend(std::vector<DeviceSpec> specs)
+  : specs_(std::move(specs))
+  , connected_(std::make_unique<std::atomic<bool>[]>(specs_.size()))
+{
+  this->SetConnectedCount(specs_.size());
+
+  for (DeviceSpec& spec : specs_) {
+    spec.pov_count = std::min<DWORD>(spec.pov_count, 4);
+    spec.axis_count = std::min<DWORD>(spec.axis_count, static_cast<DWORD>(kAxisOffsets.size()));
+    spec.button_count = std::min<DWORD>(spec.button_count, 128);
+
+    std::unique_ptr<SyntheticDeviceInbox>& inbox = inboxes_.emplace_back();
+    if (spec.event_driven) {
+      inbox = std::make_unique<SyntheticDeviceInbox>();
+      std::memset(inbox->state.rgdwPOV, 0xFF, sizeof(inbox->state.rgdwPOV));
+    }
+  }
+}
+
+SyntheticBackend::~SyntheticBackend() noexcept = default;
+
+void SyntheticBackend::SetConnectedCount(size_t count) {
+  for (size_t i = 0; i < specs_.size(); ++i) {
+    connected_[i].store(i < count, std::memory_order_relaxed);
+  }
+}
+
+void SyntheticBackend::SetConnected(size_t index, bool connected) {
+  if (index < specs_.size()) {
+    connected_[index].store(connected, std::memory_order_relaxed);
+  }
+}
+
+void SyntheticBackend::SetDeviceState(size_t index, DIJOYSTATE2 const& state) {
+  SyntheticDeviceInbox* inbox = (index < inboxes_.size()) ? inboxes_[index].get() : nullptr;
+  if (inbox == nullptr) {
+    return;
+  }
+
+  {
+    std::lock_guard lock(inbox->mutex);
+    inbox->state = state;
+  }
+  inbox->signal.Set();
+}
+
+bool SyntheticBackend::Initialize(DirectInputContext::Config const& config) {
+  buffer_size_ = config.buffered_input ? config.device_buffer_size : 0;
+  return true;
+}
+
+void SyntheticBackend::Shutdown() {
+}
+
+void SyntheticBackend::EnumerateDevices(std::vector<GUID>& out_guids) {
+  for (size_t i = 0; i < specs_.size(); ++i) {
+    if (connected_[i].load(std::memory_order_relaxed)) {
+      out_guids.push_back(MakeDeviceGuid(i));
+    }
+  }
+}
+
+std::unique_ptr<DirectInputContext::DeviceSource> SyntheticBackend::OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) {
+  using Input = DirectInputContext::Input;
+  using InputType = DirectInputContext::InputType;
+
+  if (guid.Data2 != kSyntheticGuidMarker || guid.Data1 == 0 || guid.Data1 > specs_.size()) {
+    return nullptr;
+  }
+  uint32_t const device_index = guid.Data1 - 1;
+  DeviceSpec const& spec = specs_[device_index];
+
+  using OpenStage = DirectInputContext::OpenStage;
+  DirectInputContext::OpenTimings& timings = out_device.open_timings;
+
+  uint64_t stage_start = GetMonotonicTimeNs();
+  if (spec.open_latency.count() > 0) {
+    std::this_thread::sleep_for(spec.open_latency);
+  }
+  timings.EndStage(OpenStage::kCreateDevice, stage_start);
+
+  DIDEVCAPS caps {};
+  caps.dwSize = sizeof(DIDEVCAPS);
+  caps.dwAxes = spec.axis_count;
+  caps.dwButtons = spec.button_count;
+  caps.dwPOVs = spec.pov_count;
+  out_device.caps = caps;
+
+  GUID const product_guid = MakeProductGuid(spec);
+  if (layout_cache_ != nullptr && layout_cache_->Find(product_guid, caps, out_device)) {
+    timings.EndStage(OpenStage::kObjects, stage_start);
+    timings.layout_cached = true;
+    return std::make_unique<SyntheticDeviceSource>(spec, device_index, buffer_size_, inboxes_[device_index].get(), connected_[device_index]);
+  }
+
+  out_device.name = spec.name;
+  timings.EndStage(OpenStage::kProductName, stage_start);
+
+  if (spec.discovery_latency.count() > 0) {
+    std::this_thread::sleep_for(spec.discovery_latency);
+  }
+  // Already in offset order.
+  for (DWORD i = 0; i < spec.pov_count; ++i) {
+    out_device.povs.push_back(Input { .type = InputType::kPOV, .index = i, .offset = static_cast<DWORD>(DIJOFS_POV(i)) });
+  }
+  for (DWORD i = 0; i < spec.axis_count; ++i) {
+    out_device.axes.push_back(Input { .type = InputType::kAxis, .index = i, .offset = kAxisOffsets[i] });
+  }
+  for (DWORD i = 0; i < spec.button_count; ++i) {
+    out_device.buttons.push_back(Input { .type = InputType::kButton, .index = i, .offset = static_cast<DWORD>(DIJOFS_BUTTON(i)) });
+  }
+  timings.EndStage(OpenStage::kObjects, stage_start);
+
+  if (layout_cache_ != nullptr) {
+    layout_cache_->Store(product_guid, out_device);
+  }
+
+  return std::make_unique<SyntheticDeviceSource>(spec, device_index, buffer_size_, inboxes_[device_index].get(), connected_[device_index]);
+}
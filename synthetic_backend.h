@@ -0,0 +1,87 @@
+#pragma once
+
+#include "direct_input_context.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct SyntheticDeviceInbox;
+
+/// A `DirectInputContext::Backend` made of simulated devices, for benchmarking and exercising the context without hardware.
+/// Every `Poll` advances the device by one tick: axes sweep back and forth, POVs rotate and buttons toggle,
+/// deterministically given the device index and the tick (and so is the noise and the failures a `DeviceSpec` may add). With `Config::buffered_input`, each change is also buffered as an event.
+/// Devices with `DeviceSpec::event_driven` instead only change when told to, and notify it, like real devices do.
+class SyntheticBackend final : public DirectInputContext::Backend {
+public:
+  struct DeviceSpec final {
+    std::string name;
+    DWORD pov_count = 0;
+    /// At most 8: X, Y, Z, Rx, Ry, Rz, Slider 0 and Slider 1.
+    DWORD axis_count = 0;
+    /// At most 128.
+    DWORD button_count = 0;
+    /// How long each `Poll` blocks, like a driver waiting on the device might.
+    std::chrono::microseconds poll_latency { 0 };
+    /// How long `OpenDevice` blocks, like configuring a real device does (reported as `OpenStage::kCreateDevice`).
+    std::chrono::microseconds open_latency { 0 };
+    /// How long discovering the inputs blocks, like `EnumObjects` does (reported as `OpenStage::kObjects`).
+    /// Skipped when the layout is cached; see `Config::layout_cache_path`.
+    std::chrono::microseconds discovery_latency { 0 };
+    /// The device keeps its state until `SetDeviceState` changes it, and signals each change through a notification handle
+    /// (an `eventfd` on Linux; see `DeviceSource::GetNotificationHandle`), so that `WaitForInput` can block on it.
+    bool event_driven = false;
+    /// Added to every axis on every tick, uniformly in [-axis_noise, axis_noise], like the jitter of an analog sensor.
+    LONG axis_noise = 0;
+    /// The chance, in millionths, that a `Poll` fails with `DIERR_INPUTLOST` and leaves the device unacquired, like a flaky cable.
+    uint32_t input_lost_per_million = 0;
+  };
+
+  /// `device_count` devices with a varied mix of POVs, axes and buttons, e.g. sticks, pedals and button boxes.
+  static std::vector<DeviceSpec> MakePopulation(size_t device_count, uint32_t seed = 1);
+
+  /// The instance GUID `SyntheticBackend` gives the device at `index`.
+  static GUID MakeDeviceGuid(size_t index);
+  /// The product GUID of devices made from `spec`, which keys their layout in a `DeviceLayoutCache`.
+  static GUID MakeProductGuid(DeviceSpec const& spec);
+
+  explicit SyntheticBackend(std::vector<DeviceSpec> specs);
+  ~SyntheticBackend() noexcept override;
+
+  SyntheticBackend(SyntheticBackend const&) = delete;
+  SyntheticBackend(SyntheticBackend&&) = delete;
+  SyntheticBackend& operator=(SyntheticBackend const&) = delete;
+  SyntheticBackend& operator=(SyntheticBackend&&) = delete;
+
+  bool Initialize(DirectInputContext::Config const& config) override;
+  void Shutdown() override;
+
+  /// Simulates hot-plug: from the next `EnumerateDevices` on, only the first `count` devices are attached. All of them are by default.
+  /// Call `DirectInputContext::NotifyDeviceChange` after this, as `WM_DEVICECHANGE` would.
+  void SetConnectedCount(size_t count);
+  /// Simulates plugging in or unplugging the device at `index` alone. Until the context drops it, an unplugged device that is open fails like
+  /// a real one: `Poll` with `DIERR_INPUTLOST`, and `Acquire` with `DIERR_UNPLUGGED`. Can be called from any thread; see `SetConnectedCount`.
+  void SetConnected(size_t index, bool connected);
+  bool IsConnected(size_t index) const {
+    return index < specs_.size() && connected_[index].load(std::memory_order_relaxed);
+  }
+
+  /// Only for devices with `DeviceSpec::event_driven`: `state` is what the device at `index` reads from its next `Poll` on, and its notification is signaled.
+  /// Can be called from any thread.
+  void SetDeviceState(size_t index, DIJOYSTATE2 const& state);
+
+  void EnumerateDevices(std::vector<GUID>& out_guids) override;
+  std::unique_ptr<DirectInputContext::DeviceSource> OpenDevice(GUID const& guid, DirectInputContext::Device& out_device) override;
+
+private:
+  std::vector<DeviceSpec> specs_;
+  /// One per device, only set for those with `DeviceSpec::event_driven`. Shared with their sources, which the context releases before the backend.
+  std::vector<std::unique_ptr<SyntheticDeviceInbox>> inboxes_;
+  /// One per device.
+  std::unique_ptr<std::atomic<bool>[]> connected_;
+  /// `DIPROP_BUFFERSIZE` of each device; 0 unless `Config::buffered_input`.
+  DWORD buffer_size_ = 0;
+};
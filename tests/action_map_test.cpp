@@ -0,0 +1,347 @@
+//
+// `ActionMap` on synthetic devices, evaluated against states set by hand: how bindings resolve to devices, chords of modifiers,
+// axes and POVs read as buttons against their thresholds, and several bindings competing for one action.
+//
+
+#include "test.h"
+
+#include "action_map.h"
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using InputType = DirectInputContext::InputType;
+
+constexpr size_t kStick = 0;
+constexpr size_t kSecondStick = 1;
+constexpr size_t kThrottle = 2;
+
+/// Two units of the same stick and a throttle, with a state per device that the tests set, in place of what the devices report.
+class Fixture final {
+public:
+  Fixture() {
+    std::vector<SyntheticBackend::DeviceSpec> const specs = {
+      SyntheticBackend::DeviceSpec { .name = "Stick", .pov_count = 1, .axis_count = 4, .button_count = 32 },
+      SyntheticBackend::DeviceSpec { .name = "Stick", .pov_count = 1, .axis_count = 4, .button_count = 32 },
+      SyntheticBackend::DeviceSpec { .name = "Throttle", .pov_count = 0, .axis_count = 3, .button_count = 16 },
+    };
+    auto backend = std::make_unique<SyntheticBackend>(specs);
+    backend_ = backend.get();
+    initialized_ = context_.Initialize(std::move(backend), DirectInputContext::Config {});
+
+    for (size_t i = 0; i < specs.size(); ++i) {
+      DIJOYSTATE2& state = states_.emplace_back();
+      std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+    }
+  }
+
+  ~Fixture() {
+    context_.Shutdown();
+  }
+
+  bool IsInitialized() const {
+    return initialized_ && context_.GetDevices().size() == states_.size();
+  }
+
+  DirectInputContext& GetContext() {
+    return context_;
+  }
+
+  static ActionMap::InputRef Unit(size_t device, InputType type, DWORD index, float threshold = 0.5f) {
+    return ActionMap::InputRef { .device = { .guid = SyntheticBackend::MakeDeviceGuid(device) }, .type = type, .index = index, .threshold = threshold };
+  }
+
+  void SetButton(size_t device, DWORD index, bool down) {
+    states_[device].rgbButtons[index] = down ? 0x80 : 0x00;
+  }
+
+  /// `value` in [-1, 1].
+  void SetAxis(size_t device, DWORD index, float value) {
+    DirectInputContext::Device const* found = context_.GetDevice(SyntheticBackend::MakeDeviceGuid(device));
+    DWORD const offset = found->axes[index].offset;
+    reinterpret_cast<LONG*>(&states_[device])[offset / sizeof(LONG)] = static_cast<LONG>(value * DirectInputContext::kAxisMax);
+  }
+
+  void SetPov(size_t device, DWORD index, DWORD value) {
+    states_[device].rgdwPOV[index] = value;
+  }
+
+  void Disconnect(size_t device) {
+    backend_->SetConnected(device, false);
+    context_.NotifyDeviceChange();
+    context_.UpdateDetection();
+  }
+
+  /// Updates `actions` like a frame would, and evaluates it against the states set so far.
+  void Evaluate(ActionMap& actions) {
+    actions.Update(context_);
+    std::vector<DIJOYSTATE2> states;
+    for (DirectInputContext::DeviceHandle handle : actions.GetReferencedDevices()) {
+      DirectInputContext::Device const* device = context_.GetDevice(handle);
+      for (size_t i = 0; i < states_.size(); ++i) {
+        if (device->guid == SyntheticBackend::MakeDeviceGuid(i)) {
+          states.push_back(states_[i]);
+        }
+      }
+    }
+    actions.Evaluate(states);
+  }
+
+private:
+  DirectInputContext context_;
+  SyntheticBackend* backend_ = nullptr;
+  bool initialized_ = false;
+  std::vector<DIJOYSTATE2> states_;
+};
+
+}
+
+TEST_CASE(ButtonSetsDownAndEdges) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const fire = actions.AddAction("fire");
+  actions.AddBinding(ActionMap::Binding { .action = fire, .chord = { Fixture::Unit(kStick, InputType::kButton, 3) } });
+
+  fixture.Evaluate(actions);
+  CHECK_EQ(actions.GetInstructionCount(), 1);
+  CHECK(!actions.GetAction(fire).down);
+  CHECK(!actions.GetAction(fire).pressed);
+
+  fixture.SetButton(kStick, 3, true);
+  fixture.Evaluate(actions);
+  CHECK(actions.GetAction(fire).down);
+  CHECK(actions.GetAction(fire).pressed);
+  CHECK_EQ(actions.GetAction(fire).value, 1.0f);
+
+  fixture.Evaluate(actions);
+  CHECK(actions.GetAction(fire).down);
+  CHECK(!actions.GetAction(fire).pressed);
+
+  // The same button of the other unit is another input.
+  fixture.SetButton(kStick, 3, false);
+  fixture.SetButton(kSecondStick, 3, true);
+  fixture.Evaluate(actions);
+  CHECK(!actions.GetAction(fire).down);
+  CHECK(actions.GetAction(fire).released);
+  CHECK_EQ(actions.GetAction(fire).value, 0.0f);
+}
+
+TEST_CASE(ChordNeedsEveryModifierHeld) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const eject = actions.AddAction("eject");
+  // Two modifiers on two devices, one of them an axis pulled back, then the button itself.
+  actions.AddBinding(ActionMap::Binding {
+    .action = eject,
+    .chord = {
+      Fixture::Unit(kThrottle, InputType::kButton, 0),
+      Fixture::Unit(kThrottle, InputType::kAxis, 2, -0.5f),
+      Fixture::Unit(kStick, InputType::kButton, 1),
+    },
+  });
+
+  fixture.Evaluate(actions);
+  CHECK_EQ(actions.GetInstructionCount(), 3);
+  CHECK_EQ(actions.GetReferencedDevices().size(), 2);
+
+  fixture.SetButton(kStick, 1, true);
+  fixture.Evaluate(actions);
+  CHECK(!actions.GetAction(eject).down);
+
+  fixture.SetButton(kThrottle, 0, true);
+  fixture.Evaluate(actions);
+  CHECK(!actions.GetAction(eject).down);
+
+  fixture.SetAxis(kThrottle, 2, -0.75f);
+  fixture.Evaluate(actions);
+  CHECK(actions.GetAction(eject).down);
+  CHECK(actions.GetAction(eject).pressed);
+
+  // Modifiers held without the button do nothing.
+  fixture.SetButton(kStick, 1, false);
+  fixture.Evaluate(actions);
+  CHECK(!actions.GetAction(eject).down);
+  CHECK(actions.GetAction(eject).released);
+
+  // Releasing a modifier while the button is held releases the action too.
+  fixture.SetButton(kStick, 1, true);
+  fixture.Evaluate(actions);
+  CHECK(actions.GetAction(eject).down);
+  fixture.SetButton(kThrottle, 0, false);
+  fixture.Evaluate(actions);
+  CHECK(!actions.GetAction(eject).down);
+}
+
+TEST_CASE(AxisIsDownBeyondItsThreshold) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const climb = actions.AddAction("climb");
+  ActionMap::ActionId const dive = actions.AddAction("dive");
+  ActionMap::ActionId const pitch = actions.AddAction("pitch");
+  actions.AddBinding(ActionMap::Binding { .action = climb, .chord = { Fixture::Unit(kStick, InputType::kAxis, 1, 0.5f) } });
+  actions.AddBinding(ActionMap::Binding { .action = dive, .chord = { Fixture::Unit(kStick, InputType::kAxis, 1, -0.5f) } });
+  actions.AddBinding(ActionMap::Binding { .action = pitch, .chord = { Fixture::Unit(kStick, InputType::kAxis, 1) }, .scale = -1.0f });
+
+  struct Step final {
+    float axis;
+    bool climb;
+    bool dive;
+  };
+  constexpr Step kSteps[] = {
+    { 0.0f, false, false },
+    { 0.25f, false, false },
+    { 0.6f, true, false },
+    { 1.0f, true, false },
+    { -0.25f, false, false },
+    { -0.6f, false, true },
+    { -1.0f, false, true },
+  };
+  for (Step const& step : kSteps) {
+    fixture.SetAxis(kStick, 1, step.axis);
+    fixture.Evaluate(actions);
+    CHECK_EQ(actions.GetAction(climb).down, step.climb);
+    CHECK_EQ(actions.GetAction(dive).down, step.dive);
+    // The value is the axis either way, inverted by the scale.
+    CHECK(std::abs(actions.GetAction(climb).value - step.axis) < 1e-4f);
+    CHECK(std::abs(actions.GetAction(pitch).value + step.axis) < 1e-4f);
+  }
+}
+
+TEST_CASE(PovIsDownWithin45DegreesOfItsThreshold) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const right = actions.AddAction("right");
+  ActionMap::ActionId const up = actions.AddAction("up");
+  actions.AddBinding(ActionMap::Binding { .action = right, .chord = { Fixture::Unit(kStick, InputType::kPOV, 0, 9000.0f) } });
+  actions.AddBinding(ActionMap::Binding { .action = up, .chord = { Fixture::Unit(kStick, InputType::kPOV, 0, 0.0f) } });
+
+  struct Step final {
+    DWORD pov;
+    bool right;
+    bool up;
+  };
+  constexpr Step kSteps[] = {
+    { 0xFFFFFFFF, false, false },
+    { 0, false, true },
+    { 4500, true, true },
+    { 9000, true, false },
+    { 13500, true, false },
+    { 18000, false, false },
+    // Across north.
+    { 31500, false, true },
+    // Centered, as some drivers report it: only the low word set.
+    { 0xFFFF, false, false },
+  };
+  for (Step const& step : kSteps) {
+    fixture.SetPov(kStick, 0, step.pov);
+    fixture.Evaluate(actions);
+    CHECK_EQ(actions.GetAction(right).down, step.right);
+    CHECK_EQ(actions.GetAction(up).down, step.up);
+  }
+}
+
+TEST_CASE(ConflictingBindingsResolveToTheLargestValue) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const throttle = actions.AddAction("throttle");
+  ActionMap::ActionId const boost = actions.AddAction("boost");
+  // An axis, and a button pushing the same action at half scale the other way.
+  actions.AddBinding(ActionMap::Binding { .action = throttle, .chord = { Fixture::Unit(kThrottle, InputType::kAxis, 0) } });
+  actions.AddBinding(ActionMap::Binding { .action = throttle, .chord = { Fixture::Unit(kStick, InputType::kButton, 2) }, .scale = -0.5f });
+  // The same button, bound to another action as well.
+  actions.AddBinding(ActionMap::Binding { .action = boost, .chord = { Fixture::Unit(kStick, InputType::kButton, 2) } });
+
+  fixture.SetAxis(kThrottle, 0, 0.25f);
+  fixture.Evaluate(actions);
+  CHECK(std::abs(actions.GetAction(throttle).value - 0.25f) < 1e-4f);
+  CHECK(!actions.GetAction(throttle).down);
+  CHECK(!actions.GetAction(boost).down);
+
+  fixture.SetButton(kStick, 2, true);
+  fixture.Evaluate(actions);
+  CHECK_EQ(actions.GetAction(throttle).value, -0.5f);
+  CHECK(actions.GetAction(throttle).down);
+  CHECK(actions.GetAction(boost).down);
+
+  fixture.SetAxis(kThrottle, 0, 0.75f);
+  fixture.Evaluate(actions);
+  CHECK(std::abs(actions.GetAction(throttle).value - 0.75f) < 1e-4f);
+  // Down as long as any binding is.
+  fixture.SetButton(kStick, 2, false);
+  fixture.Evaluate(actions);
+  CHECK(actions.GetAction(throttle).down);
+  CHECK(!actions.GetAction(throttle).pressed);
+  CHECK(actions.GetAction(boost).released);
+}
+
+TEST_CASE(BindingsResolveByGuidOrProductName) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const any_stick = actions.AddAction("any stick");
+  ActionMap::ActionId const second_stick = actions.AddAction("second stick");
+  ActionMap::ActionId const missing = actions.AddAction("missing");
+  actions.AddBinding(ActionMap::Binding {
+    .action = any_stick,
+    .chord = { ActionMap::InputRef { .device = { .product_name = "Stick" }, .type = InputType::kButton, .index = 0 } },
+  });
+  actions.AddBinding(ActionMap::Binding { .action = second_stick, .chord = { Fixture::Unit(kSecondStick, InputType::kButton, 0) } });
+  // No such device, and no such button: neither compiles, nor does the chord that needs one of them.
+  actions.AddBinding(ActionMap::Binding {
+    .action = missing,
+    .chord = { ActionMap::InputRef { .device = { .product_name = "Wheel" }, .type = InputType::kButton, .index = 0 } },
+  });
+  actions.AddBinding(ActionMap::Binding {
+    .action = missing,
+    .chord = { Fixture::Unit(kStick, InputType::kButton, 0), Fixture::Unit(kThrottle, InputType::kButton, 16) },
+  });
+
+  fixture.SetButton(kStick, 0, true);
+  fixture.SetButton(kSecondStick, 0, true);
+  fixture.Evaluate(actions);
+  CHECK_EQ(actions.GetInstructionCount(), 2);
+  CHECK(actions.GetAction(any_stick).down);
+  CHECK(actions.GetAction(second_stick).down);
+  CHECK(!actions.GetAction(missing).down);
+
+  // The first unit by name; the second one only by its GUID.
+  fixture.SetButton(kStick, 0, false);
+  fixture.Evaluate(actions);
+  CHECK(!actions.GetAction(any_stick).down);
+  CHECK(actions.GetAction(second_stick).down);
+
+  // Once the first unit is gone, the name matches the one left, and the bindings are compiled again.
+  fixture.Disconnect(kStick);
+  CHECK(actions.Update(fixture.GetContext()));
+  fixture.Evaluate(actions);
+  CHECK_EQ(actions.GetInstructionCount(), 2);
+  CHECK_EQ(actions.GetReferencedDevices().size(), 1);
+  CHECK(actions.GetAction(any_stick).down);
+  CHECK(!actions.Update(fixture.GetContext()));
+}
+
+TEST_CASE(EvaluateReadsAGoneDeviceAsReleased) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  ActionMap actions;
+  ActionMap::ActionId const look = actions.AddAction("look");
+  actions.AddBinding(ActionMap::Binding { .action = look, .chord = { Fixture::Unit(kThrottle, InputType::kButton, 0) } });
+  REQUIRE(actions.Update(fixture.GetContext()));
+
+  // Without `Update`, the program still refers to the device.
+  fixture.Disconnect(kThrottle);
+  actions.Evaluate(fixture.GetContext());
+  CHECK_EQ(actions.GetInstructionCount(), 1);
+  CHECK(!actions.GetAction(look).down);
+  CHECK_EQ(actions.GetAction(look).value, 0.0f);
+}
@@ -0,0 +1,220 @@
+//
+// `AxisPipeline::Process` against `AxisPipeline::ProcessReference`, and the reference itself against values worked out by hand.
+// Built twice: as is, which takes the SSE2 path on x64, and as `axis_processing_test_scalar` with `CONFIG_USE_SSE2=0`, so that both paths
+// are held to the same reference. Axis counts are picked so that the last group of 4 lanes is only partly used.
+//
+
+#include "test.h"
+
+#include "axis_processing.h"
+#include "simd_config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+constexpr LONG kMin = -32767;
+constexpr LONG kMax = 32767;
+constexpr float kUpdateInterval = 0.001f;
+constexpr float kTolerance = 1e-4f;
+
+/// Every setting on its own, then all of them together, with and without each filter.
+std::vector<AxisProcessing> MakeAxes() {
+  std::vector<AxisProcessing> axes;
+  axes.emplace_back();
+
+  AxisProcessing& inverted = axes.emplace_back();
+  inverted.inverted = true;
+
+  AxisProcessing& pedal = axes.emplace_back();
+  pedal.normalization = AxisNormalization::kUnsigned;
+  pedal.inverted = true;
+
+  AxisProcessing& deadzones = axes.emplace_back();
+  deadzones.inner_deadzone = 0.1f;
+  deadzones.outer_deadzone = 0.05f;
+
+  AxisProcessing& cubic = axes.emplace_back();
+  cubic.cubic_blend = 0.6f;
+
+  AxisProcessing& curve = axes.emplace_back();
+  curve.curve_points = { 0.0f, 0.1f, 0.3f, 0.7f, 1.0f };
+
+  AxisProcessing& gain = axes.emplace_back();
+  gain.gain = 1.25f;
+
+  AxisProcessing& exponential = axes.emplace_back();
+  exponential.filter = AxisProcessing::Filter::kExponential;
+  exponential.min_cutoff_hz = 20.0f;
+
+  AxisProcessing& one_euro = axes.emplace_back();
+  one_euro.inner_deadzone = 0.08f;
+  one_euro.outer_deadzone = 0.02f;
+  one_euro.cubic_blend = 0.6f;
+  one_euro.filter = AxisProcessing::Filter::kOneEuro;
+  one_euro.min_cutoff_hz = 1.0f;
+  one_euro.beta = 0.05f;
+  one_euro.derivative_cutoff_hz = 1.0f;
+
+  AxisProcessing& everything = axes.emplace_back(one_euro);
+  everything.normalization = AxisNormalization::kUnsigned;
+  everything.inverted = true;
+  everything.curve_points = { 0.1f, 0.2f, 0.6f, 0.9f, 1.0f };
+  everything.gain = 0.8f;
+  everything.beta = 0.5f;
+
+  return axes;
+}
+
+std::vector<uint64_t> MakeKeys(size_t count, uint64_t first) {
+  std::vector<uint64_t> keys(count);
+  for (size_t i = 0; i < count; ++i) {
+    keys[i] = first + i;
+  }
+  return keys;
+}
+
+/// What axis `index` reads at `frame`: a sweep across the whole range at its own speed, with the odd jump, and a few frames pinned to each end.
+LONG MakeRawValue(size_t index, int frame) {
+  if (frame % 97 < 3) {
+    return (frame % 2 == 0) ? kMin : kMax;
+  }
+  double const phase = static_cast<double>(frame) * 0.01 * static_cast<double>(index + 1);
+  LONG value = static_cast<LONG>(std::lround(std::sin(phase) * kMax));
+  if (frame % 31 == 0) {
+    value = -value;
+  }
+  return value;
+}
+
+/// Runs `frames` updates through `pipeline` and through the reference, with `states` as the reference's filter states. Returns the largest difference.
+float CompareWithReference(AxisPipeline& pipeline, std::vector<AxisProcessing> const& axes, std::vector<AxisPipeline::FilterState>& states, int first_frame, int frames) {
+  std::vector<LONG> raw(axes.size());
+  std::vector<float> values(axes.size());
+  float max_error = 0.0f;
+  for (int frame = first_frame; frame < first_frame + frames; ++frame) {
+    for (size_t i = 0; i < axes.size(); ++i) {
+      raw[i] = MakeRawValue(i, frame);
+    }
+    pipeline.Process(raw, values, kUpdateInterval);
+    for (size_t i = 0; i < axes.size(); ++i) {
+      float const expected = AxisPipeline::ProcessReference(axes[i], raw[i], kMin, kMax, kUpdateInterval, states[i]);
+      max_error = std::max(max_error, std::abs(values[i] - expected));
+    }
+  }
+  return max_error;
+}
+
+float Reference(AxisProcessing const& axis, LONG raw_value) {
+  AxisPipeline::FilterState state;
+  return AxisPipeline::ProcessReference(axis, raw_value, kMin, kMax, kUpdateInterval, state);
+}
+
+bool Near(float actual, float expected) {
+  return std::abs(actual - expected) <= kTolerance;
+}
+
+}
+
+TEST_CASE(ReportsThePath) {
+  std::printf("CONFIG_USE_SSE2=%d\n", CONFIG_USE_SSE2);
+}
+
+TEST_CASE(ReferenceMatchesHandWorkedValues) {
+  AxisProcessing axis {};
+  CHECK(Near(Reference(axis, kMin), -1.0f));
+  CHECK(Near(Reference(axis, 0), 0.0f));
+  CHECK(Near(Reference(axis, kMax / 2), 0.5f));
+  CHECK(Near(Reference(axis, kMax), 1.0f));
+
+  axis.inverted = true;
+  CHECK(Near(Reference(axis, kMax / 2), -0.5f));
+
+  // Unsigned and inverted: a pedal at rest at `kMax`.
+  axis.normalization = AxisNormalization::kUnsigned;
+  CHECK(Near(Reference(axis, kMax), 0.0f));
+  CHECK(Near(Reference(axis, kMin), 1.0f));
+
+  axis = AxisProcessing {};
+  axis.inner_deadzone = 0.1f;
+  axis.outer_deadzone = 0.1f;
+  CHECK(Near(Reference(axis, kMax / 20), 0.0f));
+  CHECK(Near(Reference(axis, -kMax / 2), -0.5f));
+  CHECK(Near(Reference(axis, kMax * 19 / 20), 1.0f));
+
+  axis = AxisProcessing {};
+  axis.cubic_blend = 1.0f;
+  CHECK(Near(Reference(axis, kMax / 2), 0.125f));
+
+  axis = AxisProcessing {};
+  axis.curve_points = { 0.0f, 0.1f, 0.3f, 0.7f, 1.0f };
+  CHECK(Near(Reference(axis, kMax / 2), 0.3f));
+  CHECK(Near(Reference(axis, -kMax * 3 / 8), -0.2f));
+
+  // Saturates at full deflection.
+  axis = AxisProcessing {};
+  axis.gain = 2.0f;
+  CHECK(Near(Reference(axis, kMax / 4), 0.5f));
+  CHECK(Near(Reference(axis, kMax * 3 / 4), 1.0f));
+}
+
+TEST_CASE(ReferenceFiltersSmoothSteps) {
+  AxisProcessing axis {};
+  axis.filter = AxisProcessing::Filter::kExponential;
+  axis.min_cutoff_hz = 10.0f;
+  AxisPipeline::FilterState state;
+
+  // The first sample passes through, then a step is approached a little each update, without overshooting.
+  CHECK(Near(AxisPipeline::ProcessReference(axis, 0, kMin, kMax, kUpdateInterval, state), 0.0f));
+  float previous = 0.0f;
+  for (int frame = 0; frame < 100; ++frame) {
+    float const value = AxisPipeline::ProcessReference(axis, kMax, kMin, kMax, kUpdateInterval, state);
+    CHECK(value > previous);
+    CHECK(value < 1.0f);
+    previous = value;
+  }
+  // After 100 ms, well past the time constant of about 16 ms.
+  CHECK(previous > 0.99f);
+}
+
+TEST_CASE(ProcessMatchesReference) {
+  std::vector<AxisProcessing> const all_axes = MakeAxes();
+  // Every count up to all of them, so that each setting also lands in the last, partly used, group of lanes.
+  for (size_t count = 1; count <= all_axes.size(); ++count) {
+    std::vector<AxisProcessing> const axes(all_axes.begin(), all_axes.begin() + count);
+    AxisPipeline pipeline;
+    pipeline.Compile(axes, MakeKeys(count, 0), kMin, kMax);
+    CHECK_EQ(pipeline.GetAxisCount(), count);
+
+    // A second of updates, so that every filter has settled and every axis has swept its range.
+    std::vector<AxisPipeline::FilterState> states(count);
+    CHECK(CompareWithReference(pipeline, axes, states, 0, 1000) <= kTolerance);
+  }
+}
+
+TEST_CASE(RecompilingKeepsTheFilterStateOfKnownKeys) {
+  std::vector<AxisProcessing> axes = MakeAxes();
+  AxisPipeline pipeline;
+  pipeline.Compile(axes, MakeKeys(axes.size(), 0), kMin, kMax);
+  std::vector<AxisPipeline::FilterState> states(axes.size());
+  CHECK(CompareWithReference(pipeline, axes, states, 0, 200) <= kTolerance);
+
+  // As after a hot-plug: the first axis is gone and a new one comes last, so every other axis moves down a lane.
+  axes.erase(axes.begin());
+  states.erase(states.begin());
+  AxisProcessing const added = axes.back();
+  axes.push_back(added);
+  states.emplace_back();
+  std::vector<uint64_t> keys = MakeKeys(axes.size() - 1, 1);
+  keys.push_back(1000);
+  pipeline.Compile(axes, keys, kMin, kMax);
+  CHECK(CompareWithReference(pipeline, axes, states, 200, 200) <= kTolerance);
+
+  // Then every filter starts over.
+  pipeline.ResetFilters();
+  std::fill(states.begin(), states.end(), AxisPipeline::FilterState {});
+  CHECK(CompareWithReference(pipeline, axes, states, 400, 200) <= kTolerance);
+}
@@ -0,0 +1,242 @@
+//
+// `DeviceLayoutCache` (`Config::layout_cache_path`) with synthetic devices: a first run discovers every layout and saves the cache,
+// a second run finds them all in it and must end up with the same devices, and a damaged, truncated or other-version file must be ignored
+// rather than trusted. Layouts cached with other capabilities are not used either.
+//
+
+#include "test.h"
+
+#include "device_layout_cache.h"
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kDeviceCount = 16;
+
+bool SameInputs(std::vector<DirectInputContext::Input> const& lhs, std::vector<DirectInputContext::Input> const& rhs) {
+  return lhs.size() == rhs.size() && std::equal(
+    lhs.begin(), lhs.end(), rhs.begin(),
+    [](DirectInputContext::Input const& a, DirectInputContext::Input const& b) {
+      return a.type == b.type && a.index == b.index && a.offset == b.offset;
+    }
+  );
+}
+
+/// A cache file of its own per test, removed along with what `Save` leaves next to it.
+class CacheFile final {
+public:
+  explicit CacheFile(char const* name)
+    : path_((std::filesystem::temp_directory_path() / (std::string(name) + ".dilc")).string()) {
+    std::filesystem::remove(path_);
+  }
+
+  ~CacheFile() {
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+    std::filesystem::remove(path_ + ".tmp", ec);
+  }
+
+  std::string const& GetPath() const {
+    return path_;
+  }
+
+  uintmax_t GetSize() const {
+    std::error_code ec;
+    uintmax_t const size = std::filesystem::file_size(path_, ec);
+    return ec ? 0 : size;
+  }
+
+  /// Overwrites the bytes at `offset` with `bytes`.
+  void Patch(uintmax_t offset, void const* bytes, size_t size) const {
+    std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(static_cast<char const*>(bytes), static_cast<std::streamsize>(size));
+  }
+
+  void Truncate(uintmax_t size) const {
+    std::filesystem::resize_file(path_, size);
+  }
+
+private:
+  std::string path_;
+};
+
+/// A varied population, in which devices of the same model share a layout.
+std::vector<SyntheticBackend::DeviceSpec> MakeSpecs() {
+  return SyntheticBackend::MakePopulation(kDeviceCount);
+}
+
+size_t CountModels(std::vector<SyntheticBackend::DeviceSpec> const& specs) {
+  std::vector<GUID> models;
+  for (SyntheticBackend::DeviceSpec const& spec : specs) {
+    GUID const product_guid = SyntheticBackend::MakeProductGuid(spec);
+    if (std::find(models.begin(), models.end(), product_guid) == models.end()) {
+      models.push_back(product_guid);
+    }
+  }
+  return models.size();
+}
+
+bool Open(DirectInputContext& out_context, std::vector<SyntheticBackend::DeviceSpec> const& specs, std::string const& cache_path) {
+  DirectInputContext::Config config {};
+  config.layout_cache_path = cache_path;
+  return out_context.Initialize(std::make_unique<SyntheticBackend>(specs), config);
+}
+
+/// Checks the layouts of `actual` against `expected`, device by device. Returns how many came from the cache.
+size_t CheckLayouts(DirectInputContext const& expected, DirectInputContext const& actual) {
+  CHECK_EQ(actual.GetDevices().size(), expected.GetDevices().size());
+  size_t cached_count = 0;
+  for (DirectInputContext::Device const& device : expected.GetDevices()) {
+    DirectInputContext::Device const* other = actual.GetDevice(device.guid);
+    CHECK(other != nullptr);
+    if (other == nullptr) {
+      continue;
+    }
+    CHECK(other->name == device.name);
+    CHECK(SameInputs(other->povs, device.povs));
+    CHECK(SameInputs(other->axes, device.axes));
+    CHECK(SameInputs(other->buttons, device.buttons));
+    cached_count += other->open_timings.layout_cached ? 1 : 0;
+  }
+  return cached_count;
+}
+
+/// Opens `specs` without a cache, then once to fill `cache`, which is saved on `Shutdown`.
+void FillCache(DirectInputContext& out_reference, std::vector<SyntheticBackend::DeviceSpec> const& specs, CacheFile const& cache) {
+  REQUIRE(Open(out_reference, specs, ""));
+  DirectInputContext context;
+  REQUIRE(Open(context, specs, cache.GetPath()));
+  // The first device of each model is discovered, and the others already use its layout.
+  CHECK_EQ(CheckLayouts(out_reference, context), specs.size() - CountModels(specs));
+  context.Shutdown();
+  CHECK(cache.GetSize() > 0);
+}
+
+/// After `cache` was tampered with: the devices are discovered again, and the cache is rewritten.
+void CheckIgnored(DirectInputContext const& reference, std::vector<SyntheticBackend::DeviceSpec> const& specs, CacheFile const& cache) {
+  DeviceLayoutCache loaded;
+  CHECK(!loaded.Load(cache.GetPath()));
+  CHECK_EQ(loaded.GetSize(), 0);
+
+  DirectInputContext context;
+  REQUIRE(Open(context, specs, cache.GetPath()));
+  CHECK_EQ(CheckLayouts(reference, context), specs.size() - CountModels(specs));
+  context.Shutdown();
+
+  CHECK(loaded.Load(cache.GetPath()));
+  CHECK_EQ(loaded.GetSize(), CountModels(specs));
+}
+
+}
+
+TEST_CASE(WarmCacheMatchesDiscovery) {
+  CacheFile const cache("device_layout_cache_test_warm");
+  std::vector<SyntheticBackend::DeviceSpec> const specs = MakeSpecs();
+  DirectInputContext reference;
+  FillCache(reference, specs, cache);
+
+  DirectInputContext context;
+  REQUIRE(Open(context, specs, cache.GetPath()));
+  CHECK_EQ(CheckLayouts(reference, context), specs.size());
+  DeviceLayoutCache::Stats const stats = context.GetLayoutCache()->GetStats();
+  CHECK_EQ(stats.hit_count, specs.size());
+  CHECK_EQ(stats.miss_count, 0);
+  CHECK_EQ(stats.stale_count, 0);
+  // Nothing new to save.
+  CHECK(!context.GetLayoutCache()->IsDirty());
+  context.Shutdown();
+  reference.Shutdown();
+}
+
+TEST_CASE(DamagedCacheIsIgnored) {
+  CacheFile const cache("device_layout_cache_test_damaged");
+  std::vector<SyntheticBackend::DeviceSpec> const specs = MakeSpecs();
+  DirectInputContext reference;
+  FillCache(reference, specs, cache);
+
+  // One flipped bit, past the header: only the checksum tells.
+  uintmax_t const offset = cache.GetSize() / 2;
+  char byte = 0;
+  {
+    std::ifstream file(cache.GetPath(), std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(&byte, 1);
+  }
+  byte = static_cast<char>(byte ^ 0x40);
+  cache.Patch(offset, &byte, 1);
+  CheckIgnored(reference, specs, cache);
+  reference.Shutdown();
+}
+
+TEST_CASE(OtherVersionIsIgnored) {
+  CacheFile const cache("device_layout_cache_test_version");
+  std::vector<SyntheticBackend::DeviceSpec> const specs = MakeSpecs();
+  DirectInputContext reference;
+  FillCache(reference, specs, cache);
+
+  // The version follows the 4-byte magic.
+  uint32_t const version = DeviceLayoutCache::kVersion + 1;
+  cache.Patch(4, &version, sizeof(version));
+  CheckIgnored(reference, specs, cache);
+  reference.Shutdown();
+}
+
+TEST_CASE(TruncatedCacheIsIgnored) {
+  CacheFile const cache("device_layout_cache_test_truncated");
+  std::vector<SyntheticBackend::DeviceSpec> const specs = MakeSpecs();
+  DirectInputContext reference;
+  FillCache(reference, specs, cache);
+
+  cache.Truncate(cache.GetSize() - 1);
+  CheckIgnored(reference, specs, cache);
+  cache.Truncate(8);
+  CheckIgnored(reference, specs, cache);
+  reference.Shutdown();
+}
+
+TEST_CASE(LayoutWithOtherCapsIsStale) {
+  CacheFile const cache("device_layout_cache_test_stale");
+  std::vector<SyntheticBackend::DeviceSpec> const specs = MakeSpecs();
+  DirectInputContext reference;
+  REQUIRE(Open(reference, specs, ""));
+  DirectInputContext::Device const& device = reference.GetDevices()[0];
+  GUID const product = SyntheticBackend::MakeProductGuid(specs[0]);
+
+  DeviceLayoutCache stored;
+  CHECK(!stored.Load(cache.GetPath()));
+  stored.Store(product, device);
+  CHECK(stored.IsDirty());
+  REQUIRE(stored.Save());
+  CHECK(!stored.IsDirty());
+
+  DeviceLayoutCache loaded;
+  REQUIRE(loaded.Load(cache.GetPath()));
+  DirectInputContext::Device found;
+  CHECK(loaded.Find(product, device.caps, found));
+  CHECK(found.name == device.name);
+  CHECK(SameInputs(found.axes, device.axes));
+  CHECK(SameInputs(found.buttons, device.buttons));
+
+  // After a firmware update, say.
+  DIDEVCAPS caps = device.caps;
+  caps.dwFirmwareRevision += 1;
+  CHECK(!loaded.Find(product, caps, found));
+  GUID other_product = product;
+  other_product.Data1 ^= 0xFFFF;
+  CHECK(!loaded.Find(other_product, device.caps, found));
+
+  DeviceLayoutCache::Stats const stats = loaded.GetStats();
+  CHECK_EQ(stats.hit_count, 1);
+  CHECK_EQ(stats.stale_count, 1);
+  CHECK_EQ(stats.miss_count, 1);
+  reference.Shutdown();
+}
@@ -0,0 +1,174 @@
+//
+// `DeviceViewModel` on event-driven synthetic devices, whose states are set by hand: the rows it builds, the text it formats,
+// and which updates it reports as changes, including hot-plugs.
+//
+
+#include "test.h"
+
+#include "device_view_model.h"
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+
+constexpr size_t kStick = 0;
+constexpr size_t kPedals = 1;
+
+std::vector<SyntheticBackend::DeviceSpec> MakeSpecs() {
+  return {
+    SyntheticBackend::DeviceSpec { .name = "Stick", .pov_count = 1, .axis_count = 2, .button_count = 3, .event_driven = true },
+    SyntheticBackend::DeviceSpec { .name = "Pedals", .pov_count = 0, .axis_count = 3, .button_count = 0, .event_driven = true },
+  };
+}
+
+/// At rest: axes at 0, POVs pointing north, no button pressed.
+DIJOYSTATE2 MakeRestState() {
+  return DIJOYSTATE2 {};
+}
+
+void Reconnect(DirectInputContext& context, SyntheticBackend& backend, size_t device, bool connected) {
+  backend.SetConnected(device, connected);
+  context.NotifyDeviceChange();
+  context.UpdateDetection();
+  context.UpdateState();
+}
+
+}
+
+TEST_CASE(BuildsARowPerDevice) {
+  auto backend_owner = std::make_unique<SyntheticBackend>(MakeSpecs());
+  backend_owner->SetDeviceState(kStick, MakeRestState());
+  backend_owner->SetDeviceState(kPedals, MakeRestState());
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(backend_owner), DirectInputContext::Config {}));
+  context.UpdateState();
+
+  DeviceViewModel model;
+  CHECK(model.Update(context));
+  CHECK_EQ(model.GetVersion(), 1);
+  CHECK_EQ(model.GetPendingCount(), 0);
+  REQUIRE(model.GetRows().size() == 2);
+
+  DeviceViewModel::DeviceRow const& stick = model.GetRows()[0];
+  CHECK(stick.handle == context.GetDevices()[0].handle);
+  CHECK(stick.name == "Stick");
+  CHECK(stick.guid == context.GetDevices()[0].GetGuidString());
+  CHECK_EQ(stick.pov_count, 1);
+  CHECK_EQ(stick.axis_count, 2);
+  CHECK_EQ(stick.button_count, 3);
+  REQUIRE(stick.povs.size() == 1);
+  REQUIRE(stick.axes.size() == 2);
+  REQUIRE(stick.buttons.size() == 3);
+  CHECK(stick.povs[0].label == "POV 0");
+  CHECK(stick.povs[0].value_text == "0");
+  CHECK(stick.axes[0].label == "Axis 0 (X)");
+  CHECK(stick.axes[1].label == "Axis 1 (Y)");
+  CHECK(stick.axes[1].value_text == "0 ([-32767, 32767])");
+  CHECK(std::fabs(stick.axes[1].gauge - 0.5f) < 1e-6f);
+  CHECK(stick.buttons[2].label == "Button 2");
+  CHECK(!stick.buttons[2].pressed);
+
+  DeviceViewModel::DeviceRow const& pedals = model.GetRows()[1];
+  CHECK(pedals.name == "Pedals");
+  CHECK(pedals.povs.empty());
+  CHECK_EQ(pedals.axes.size(), 3);
+  CHECK(pedals.axes[2].label == "Axis 2 (Z)");
+  CHECK(pedals.buttons.empty());
+  CHECK(model.FindRow(pedals.handle) == &pedals);
+
+  context.Shutdown();
+}
+
+TEST_CASE(FormatsOnlyWhatChanged) {
+  auto backend_owner = std::make_unique<SyntheticBackend>(MakeSpecs());
+  SyntheticBackend& backend = *backend_owner;
+  backend.SetDeviceState(kStick, MakeRestState());
+  backend.SetDeviceState(kPedals, MakeRestState());
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(backend_owner), DirectInputContext::Config {}));
+  context.UpdateState();
+
+  DeviceViewModel model;
+  REQUIRE(model.Update(context));
+  // Nothing new: nothing to draw.
+  context.UpdateState();
+  CHECK(!model.Update(context));
+  CHECK_EQ(model.GetVersion(), 1);
+
+  DIJOYSTATE2 state = MakeRestState();
+  state.lX = DirectInputContext::kAxisMax;
+  state.lY = DirectInputContext::kAxisMin;
+  state.rgdwPOV[0] = 13500;
+  state.rgbButtons[1] = 0x80;
+  backend.SetDeviceState(kStick, state);
+  context.UpdateState();
+  CHECK(model.Update(context));
+  CHECK_EQ(model.GetVersion(), 2);
+
+  DeviceViewModel::DeviceRow const& stick = model.GetRows()[0];
+  CHECK(stick.povs[0].value_text == "135");
+  CHECK(stick.axes[0].value_text == "32767 ([-32767, 32767])");
+  CHECK_EQ(stick.axes[0].gauge, 1.0f);
+  CHECK(stick.axes[1].value_text == "-32767 ([-32767, 32767])");
+  CHECK_EQ(stick.axes[1].gauge, 0.0f);
+  CHECK(!stick.buttons[0].pressed);
+  CHECK(stick.buttons[1].pressed);
+  CHECK(!stick.buttons[2].pressed);
+  // The pedals did not change.
+  CHECK(model.GetRows()[1].axes[0].value_text == "0 ([-32767, 32767])");
+
+  // Inputs the device does not have are not shown, so changing them is no change.
+  state.rglSlider[1] = 1234;
+  state.rgbButtons[100] = 0x80;
+  backend.SetDeviceState(kStick, state);
+  context.UpdateState();
+  CHECK(!model.Update(context));
+  CHECK_EQ(model.GetVersion(), 2);
+
+  state.rgbButtons[1] = 0x00;
+  backend.SetDeviceState(kStick, state);
+  context.UpdateState();
+  CHECK(model.Update(context));
+  CHECK(!model.GetRows()[0].buttons[1].pressed);
+
+  context.Shutdown();
+}
+
+TEST_CASE(FollowsHotPlugs) {
+  auto backend_owner = std::make_unique<SyntheticBackend>(MakeSpecs());
+  SyntheticBackend& backend = *backend_owner;
+  DIJOYSTATE2 state = MakeRestState();
+  state.lZ = 1000;
+  backend.SetDeviceState(kStick, MakeRestState());
+  backend.SetDeviceState(kPedals, state);
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(backend_owner), DirectInputContext::Config {}));
+  context.UpdateState();
+
+  DeviceViewModel model;
+  REQUIRE(model.Update(context));
+  DirectInputContext::DeviceHandle const stick_handle = model.GetRows()[0].handle;
+  DirectInputContext::DeviceHandle const pedals_handle = model.GetRows()[1].handle;
+
+  Reconnect(context, backend, kPedals, false);
+  CHECK(model.Update(context));
+  REQUIRE(model.GetRows().size() == 1);
+  CHECK(model.GetRows()[0].handle == stick_handle);
+  CHECK(model.FindRow(pedals_handle) == nullptr);
+  CHECK(!model.Update(context));
+
+  // Back under a new handle, formatted from its state again.
+  Reconnect(context, backend, kPedals, true);
+  CHECK(model.Update(context));
+  REQUIRE(model.GetRows().size() == 2);
+  DeviceViewModel::DeviceRow const* pedals = model.FindRow(context.GetDevices()[1].handle);
+  REQUIRE(pedals != nullptr);
+  CHECK(pedals->handle != pedals_handle);
+  CHECK(pedals->axes[2].value_text == "1000 ([-32767, 32767])");
+  CHECK(model.FindRow(stick_handle) == &model.GetRows()[0]);
+
+  context.Shutdown();
+}
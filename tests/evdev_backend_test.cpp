@@ -0,0 +1,163 @@
+//
+// `EvdevBackend` on a captured `input_event` stream, added through `AddStreamDevice`: the state after each poll, one `SYN_REPORT` at a time,
+// and a `SYN_DROPPED`, after which the rest of its report is skipped, reported to the context as an overflow of the device's buffer.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "evdev_backend.h"
+
+#include <linux/input.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// What the test stream reports: two axes centered at 127, a hat, and three joystick buttons.
+EvdevLayout MakeLayout() {
+  EvdevLayout layout;
+  layout.abs_axes = {
+    EvdevLayout::AbsAxis { .code = ABS_X, .minimum = 0, .maximum = 254, .value = 127 },
+    EvdevLayout::AbsAxis { .code = ABS_Y, .minimum = 0, .maximum = 254, .value = 127 },
+    EvdevLayout::AbsAxis { .code = ABS_HAT0X, .minimum = -1, .maximum = 1, .value = 0 },
+    EvdevLayout::AbsAxis { .code = ABS_HAT0Y, .minimum = -1, .maximum = 1, .value = 0 },
+  };
+  layout.keys = { BTN_THUMB2, BTN_TRIGGER, BTN_THUMB };
+  return layout;
+}
+
+class StreamWriter final {
+public:
+  void Add(uint16_t type, uint16_t code, int32_t value) {
+    input_event event {};
+    event.input_event_sec = static_cast<decltype(event.input_event_sec)>(time_us_ / 1'000'000);
+    event.input_event_usec = static_cast<decltype(event.input_event_usec)>(time_us_ % 1'000'000);
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    events_.push_back(event);
+  }
+
+  void Report() {
+    this->Add(EV_SYN, SYN_REPORT, 0);
+    time_us_ += 4000;
+  }
+
+  void Write(std::string const& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<char const*>(events_.data()), static_cast<std::streamsize>(events_.size() * sizeof(input_event)));
+  }
+
+private:
+  std::vector<input_event> events_;
+  uint64_t time_us_ = 1'000'000;
+};
+
+/// Writes the test stream to `path`. Returns the states expected after each of its reports.
+std::vector<DIJOYSTATE2> WriteStream(std::string const& path) {
+  std::vector<DIJOYSTATE2> states;
+  DIJOYSTATE2 state {};
+  state.rgdwPOV[0] = 0xFFFFFFFF;
+
+  StreamWriter writer;
+  writer.Add(EV_ABS, ABS_X, 254);
+  writer.Add(EV_KEY, BTN_TRIGGER, 1);
+  writer.Report();
+  state.lX = DirectInputContext::kAxisMax;
+  state.rgbButtons[0] = 0x80;
+  states.push_back(state);
+
+  // Up-right, and autorepeat, which is still pressed.
+  writer.Add(EV_ABS, ABS_HAT0X, 1);
+  writer.Add(EV_ABS, ABS_HAT0Y, -1);
+  writer.Add(EV_KEY, BTN_THUMB2, 1);
+  writer.Add(EV_KEY, BTN_TRIGGER, 2);
+  writer.Report();
+  state.rgdwPOV[0] = 4500;
+  state.rgbButtons[2] = 0x80;
+  states.push_back(state);
+
+  // The rest of the report is incomplete, so it is skipped; and a stream cannot be queried for the state it dropped, so the state stays.
+  writer.Add(EV_SYN, SYN_DROPPED, 0);
+  writer.Add(EV_ABS, ABS_Y, 0);
+  writer.Add(EV_KEY, BTN_THUMB, 1);
+  writer.Report();
+  states.push_back(state);
+
+  writer.Add(EV_ABS, ABS_HAT0Y, 0);
+  writer.Add(EV_ABS, ABS_X, 0);
+  writer.Add(EV_KEY, BTN_TRIGGER, 0);
+  writer.Add(EV_KEY, BTN_THUMB, 1);
+  writer.Report();
+  state.rgdwPOV[0] = 9000;
+  state.lX = DirectInputContext::kAxisMin;
+  state.rgbButtons[0] = 0x00;
+  state.rgbButtons[1] = 0x80;
+  states.push_back(state);
+
+  writer.Write(path);
+  return states;
+}
+
+std::string MakeStreamPath() {
+  return (std::filesystem::temp_directory_path() / ("evdev_backend_test_" + std::to_string(::getpid()) + ".bin")).string();
+}
+
+void CheckStreamReplay(bool buffered_input) {
+  std::string const path = MakeStreamPath();
+  std::vector<DIJOYSTATE2> const states = WriteStream(path);
+
+  // No device nodes, only the stream.
+  auto backend = std::make_unique<EvdevBackend>(path + ".nodes");
+  backend->AddStreamDevice(EvdevBackend::StreamDevice { .name = "Captured Stick", .path = path, .layout = MakeLayout() });
+
+  DirectInputContext::Config config {};
+  config.buffered_input = buffered_input;
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(backend), config));
+  REQUIRE(context.GetDevices().size() == 1);
+  {
+    DirectInputContext::Device const& device = context.GetDevices()[0];
+    CHECK(device.name == "Captured Stick");
+    CHECK_EQ(device.caps.dwAxes, 2);
+    CHECK_EQ(device.caps.dwPOVs, 1);
+    CHECK_EQ(device.caps.dwButtons, 3);
+  }
+
+  // One report per poll, then the last state for good once the stream ends.
+  for (size_t poll = 0; poll <= states.size(); ++poll) {
+    context.UpdateState();
+    REQUIRE(context.GetDevices().size() == 1);
+    DirectInputContext::Device const& device = context.GetDevices()[0];
+    DIJOYSTATE2 const& expected = states[std::min(poll, states.size() - 1)];
+    CHECK(std::memcmp(&device.state, &expected, sizeof(DIJOYSTATE2)) == 0);
+
+    if (buffered_input) {
+      // Reported once its report is read, and resynchronized from the state.
+      CHECK_EQ(device.event_stats.source_overflow_count, (poll >= 2) ? 1 : 0);
+    }
+  }
+  if (buffered_input) {
+    CHECK(context.GetDevices()[0].event_stats.event_count > 0);
+  }
+
+  context.Shutdown();
+  std::filesystem::remove(path);
+}
+
+}
+
+TEST_CASE(StreamReplaysOneReportPerPoll) {
+  CheckStreamReplay(false);
+}
+
+TEST_CASE(BufferedStreamReportsDroppedEvents) {
+  CheckStreamReplay(true);
+}
@@ -0,0 +1,73 @@
+//
+// `ParseHeadlessOptions`: the options it fills out, and the arguments it rejects rather than run with defaults.
+//
+
+#include "test.h"
+
+#include "headless_stream.h"
+
+#include <vector>
+
+namespace {
+
+HeadlessParseResult Parse(std::vector<char const*> arguments, HeadlessOptions& out_options) {
+  arguments.insert(arguments.begin(), "direct_input_headless");
+  return ParseHeadlessOptions(static_cast<int>(arguments.size()), const_cast<char**>(arguments.data()), out_options);
+}
+
+}
+
+TEST_CASE(ParsesEveryOption) {
+  HeadlessOptions options;
+  REQUIRE(Parse({ "--headless", "--format=binary", "--rate=250", "--output=capture.dirc", "--duration=5000", "--flush-interval=20",
+                  "--synthetic=16", "--shared-memory=inputs", "--trace=trace.json" }, options) == HeadlessParseResult::kHeadless);
+  CHECK(options.format == HeadlessOptions::Format::kBinary);
+  CHECK_EQ(options.rate_hz, 250);
+  CHECK(!options.wait_for_input);
+  CHECK(options.output_path == "capture.dirc");
+  CHECK_EQ(options.duration_ms, 5000);
+  CHECK_EQ(options.flush_interval_ms, 20);
+  CHECK_EQ(options.synthetic_device_count, 16);
+  CHECK(options.shared_memory_name == "inputs");
+  CHECK(options.trace_path == "trace.json");
+
+  HeadlessOptions wait_options;
+  REQUIRE(Parse({ "--wait", "--format=ndjson", "--headless" }, wait_options) == HeadlessParseResult::kHeadless);
+  CHECK(wait_options.wait_for_input);
+  CHECK(wait_options.format == HeadlessOptions::Format::kNdjson);
+}
+
+TEST_CASE(NotHeadlessWithoutTheFlag) {
+  HeadlessOptions options;
+  CHECK(Parse({}, options) == HeadlessParseResult::kNotHeadless);
+  CHECK(Parse({ "--rate=100" }, options) == HeadlessParseResult::kNotHeadless);
+}
+
+TEST_CASE(RejectsAnUnknownFormat) {
+  HeadlessOptions options;
+  CHECK(Parse({ "--headless", "--format=csv" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--format=", "--headless" }, options) == HeadlessParseResult::kInvalid);
+}
+
+TEST_CASE(RejectsBadNumbers) {
+  HeadlessOptions options;
+  CHECK(Parse({ "--headless", "--rate=abc" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--headless", "--rate=" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--headless", "--duration=5s" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--headless", "--flush-interval=-1" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--headless", "--synthetic= 4" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--headless", "--duration=4294967296" }, options) == HeadlessParseResult::kInvalid);
+
+  HeadlessOptions largest;
+  REQUIRE(Parse({ "--headless", "--duration=4294967295", "--rate=0" }, largest) == HeadlessParseResult::kHeadless);
+  CHECK_EQ(largest.duration_ms, 4294967295u);
+  CHECK_EQ(largest.rate_hz, 0);
+}
+
+TEST_CASE(RejectsUnknownOptions) {
+  HeadlessOptions options;
+  CHECK(Parse({ "--headless", "--duraton=5000" }, options) == HeadlessParseResult::kInvalid);
+  // Options that take a value need it.
+  CHECK(Parse({ "--headless", "--rate" }, options) == HeadlessParseResult::kInvalid);
+  CHECK(Parse({ "--headless", "--wait=1" }, options) == HeadlessParseResult::kInvalid);
+}
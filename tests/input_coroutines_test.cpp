@@ -0,0 +1,246 @@
+//
+// `InputScheduler` coroutines against a scripted device (an event-driven `SyntheticBackend` device, whose state is set by hand):
+// sequences of presses, releases and axis crossings, timeouts and delays, thresholds resumed in bulk, disconnection, and destroying suspended coroutines.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "input_coroutines.h"
+#include "synthetic_backend.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using DeviceHandle = DirectInputContext::DeviceHandle;
+using Direction = InputScheduler::Direction;
+
+/// One device, driven by the tests through `SetDeviceState`.
+struct ScriptedDevice final {
+  SyntheticBackend* backend = nullptr;
+  DirectInputContext context;
+  DeviceHandle handle {};
+  DIJOYSTATE2 state {};
+
+  bool Initialize() {
+    std::vector<SyntheticBackend::DeviceSpec> specs = {
+      SyntheticBackend::DeviceSpec { .name = "Scripted Stick", .pov_count = 1, .axis_count = 4, .button_count = 16, .event_driven = true },
+    };
+    auto synthetic = std::make_unique<SyntheticBackend>(std::move(specs));
+    backend = synthetic.get();
+    if (!context.Initialize(std::move(synthetic), DirectInputContext::Config {})) {
+      return false;
+    }
+    handle = context.GetDevices()[0].handle;
+    std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+    backend->SetDeviceState(0, state);
+    context.UpdateState();
+    return true;
+  }
+
+  void SetButton(DWORD index, bool down) {
+    state.rgbButtons[index] = down ? 0x80 : 0;
+    backend->SetDeviceState(0, state);
+  }
+
+  /// Axes 0 to 3 are X, Y, Z and Rx.
+  void SetAxis(DWORD index, LONG value) {
+    (&state.lX)[index] = value;
+    backend->SetDeviceState(0, state);
+  }
+
+  /// Polls the device, then resumes the coroutines waiting on what changed.
+  void Frame(InputScheduler& scheduler) {
+    context.UpdateState();
+    scheduler.Update();
+  }
+};
+
+InputTask ArmSequence(InputScheduler& scheduler, DeviceHandle stick, std::vector<int>& trace) {
+  trace.push_back(co_await scheduler.NextPress(stick, 0) ? 1 : -1);
+  trace.push_back(co_await InputScheduler::WithTimeout(scheduler.AxisCrosses(stick, 0, 16384), std::chrono::seconds(2)) ? 2 : -2);
+  trace.push_back(co_await scheduler.NextRelease(stick, 0) ? 3 : -3);
+}
+
+InputTask AwaitOnce(InputScheduler::Awaiter awaiter, int& out_result) {
+  out_result = co_await awaiter ? 1 : 0;
+}
+
+/// Counts how many coroutine frames are alive.
+struct FrameCounter final {
+  int& count;
+  explicit FrameCounter(int& count) : count(count) { ++count; }
+  ~FrameCounter() { --count; }
+};
+
+InputTask PressForever(InputScheduler& scheduler, DeviceHandle device, DWORD button, int& frame_count, uint64_t& press_count) {
+  FrameCounter const counter(frame_count);
+  while (co_await scheduler.NextPress(device, button)) {
+    ++press_count;
+  }
+}
+
+}
+
+TEST_CASE(SequenceOfPressCrossingAndRelease) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  InputScheduler scheduler(device.context);
+
+  // Press, then an axis past 50% within 2 s, then release.
+  std::vector<int> trace;
+  scheduler.Start(ArmSequence(scheduler, device.handle, trace));
+  CHECK(trace.empty());
+  CHECK_EQ(scheduler.GetWaitCount(), 1);
+  device.Frame(scheduler);
+  CHECK(trace.empty());
+  device.SetButton(0, true);
+  device.Frame(scheduler);
+  CHECK(trace == std::vector<int>({ 1 }));
+  device.SetAxis(0, 10000);
+  device.Frame(scheduler);
+  CHECK_EQ(trace.size(), 1);
+  device.SetAxis(0, 20000);
+  device.Frame(scheduler);
+  CHECK(trace == std::vector<int>({ 1, 2 }));
+  device.SetAxis(0, 0);
+  device.Frame(scheduler);
+  CHECK_EQ(trace.size(), 2);
+  device.SetButton(0, false);
+  device.Frame(scheduler);
+  CHECK(trace == std::vector<int>({ 1, 2, 3 }));
+  CHECK_EQ(scheduler.GetTaskCount(), 0);
+  CHECK_EQ(scheduler.GetWaitCount(), 0);
+}
+
+TEST_CASE(PressAlreadyDownIsNotTheNextOne) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  InputScheduler scheduler(device.context);
+
+  device.SetButton(1, true);
+  device.Frame(scheduler);
+  int result = -1;
+  scheduler.Start(AwaitOnce(scheduler.NextPress(device.handle, 1), result));
+  device.Frame(scheduler);
+  CHECK_EQ(result, -1);
+  device.SetButton(1, false);
+  device.Frame(scheduler);
+  CHECK_EQ(result, -1);
+  device.SetButton(1, true);
+  device.Frame(scheduler);
+  CHECK_EQ(result, 1);
+}
+
+TEST_CASE(TimeoutsAndDelays) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  InputScheduler scheduler(device.context);
+
+  int result = -1;
+  scheduler.Start(AwaitOnce(InputScheduler::WithTimeout(scheduler.AxisCrosses(device.handle, 1, 1000, Direction::kRising), std::chrono::milliseconds(20)), result));
+  device.Frame(scheduler);
+  CHECK_EQ(result, -1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  device.Frame(scheduler);
+  CHECK_EQ(result, 0);
+  CHECK_EQ(scheduler.GetWaitCount(), 0);
+
+  result = -1;
+  uint64_t const delay_start = GetMonotonicTimeNs();
+  scheduler.Start(AwaitOnce(scheduler.Delay(std::chrono::milliseconds(10)), result));
+  while (result == -1) {
+    scheduler.Update();
+  }
+  CHECK_EQ(result, 0);
+  CHECK(GetMonotonicTimeNs() - delay_start >= 10'000'000);
+}
+
+TEST_CASE(EitherDirectionCrossesFromWhereTheAxisIs) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  InputScheduler scheduler(device.context);
+
+  int result = -1;
+  scheduler.Start(AwaitOnce(scheduler.AxisCrosses(device.handle, 2, -5000), result));
+  device.SetAxis(2, -3000);
+  device.Frame(scheduler);
+  CHECK_EQ(result, -1);
+  device.SetAxis(2, -6000);
+  device.Frame(scheduler);
+  CHECK_EQ(result, 1);
+
+  result = -1;
+  scheduler.Start(AwaitOnce(scheduler.AxisCrosses(device.handle, 2, -5000), result));
+  device.SetAxis(2, -4000);
+  device.Frame(scheduler);
+  CHECK_EQ(result, 1);
+}
+
+TEST_CASE(OneMoveResumesExactlyTheThresholdsItPassed) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  InputScheduler scheduler(device.context);
+
+  std::vector<int> results(300, -1);
+  for (size_t i = 0; i < results.size(); ++i) {
+    scheduler.Start(AwaitOnce(scheduler.AxisCrosses(device.handle, 3, static_cast<LONG>(i * 100 + 1), Direction::kRising), results[i]));
+  }
+  device.SetAxis(3, 15000);
+  device.Frame(scheduler);
+  for (size_t i = 0; i < results.size(); ++i) {
+    CHECK_EQ(results[i], (i * 100 + 1 <= 15000) ? 1 : -1);
+  }
+  CHECK_EQ(scheduler.GetWaitCount(), 150);
+  device.SetAxis(3, 32767);
+  device.Frame(scheduler);
+  CHECK_EQ(scheduler.GetWaitCount(), 0);
+}
+
+TEST_CASE(MissingInputsAndDisconnectionEndWaits) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  InputScheduler scheduler(device.context);
+
+  // The device has 16 buttons.
+  int result = -1;
+  scheduler.Start(AwaitOnce(scheduler.NextPress(device.handle, 16), result));
+  CHECK_EQ(result, 0);
+
+  result = -1;
+  scheduler.Start(AwaitOnce(InputScheduler::WithTimeout(scheduler.NextPress(device.handle, 5), std::chrono::seconds(10)), result));
+  device.backend->SetConnectedCount(0);
+  device.context.NotifyDeviceChange();
+  device.context.UpdateDetection();
+  device.Frame(scheduler);
+  CHECK_EQ(result, 0);
+  CHECK_EQ(scheduler.GetWaitCount(), 0);
+  CHECK_EQ(scheduler.GetTaskCount(), 0);
+
+  // Waiting on a device that is gone ends right away.
+  result = -1;
+  scheduler.Start(AwaitOnce(scheduler.NextPress(device.handle, 5), result));
+  CHECK_EQ(result, 0);
+}
+
+TEST_CASE(DestroyingTheSchedulerDestroysSuspendedCoroutines) {
+  ScriptedDevice device;
+  REQUIRE(device.Initialize());
+  int frame_count = 0;
+  uint64_t press_count = 0;
+  {
+    InputScheduler scheduler(device.context);
+    for (DWORD i = 0; i < 16; ++i) {
+      scheduler.Start(PressForever(scheduler, device.handle, i, frame_count, press_count));
+    }
+    device.SetButton(3, true);
+    device.Frame(scheduler);
+    CHECK_EQ(press_count, 1);
+    CHECK_EQ(frame_count, 16);
+    CHECK_EQ(scheduler.GetWaitCount(), 16);
+  }
+  CHECK_EQ(frame_count, 0);
+}
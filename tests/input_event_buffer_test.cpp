@@ -0,0 +1,233 @@
+//
+// `InputEventRing`, `DrainInputEvents`, and `Config::buffered_input` against snapshots of the same synthetic devices.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "input_event_buffer.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+BufferedInputEvent MakeEvent(DWORD offset, DWORD value, DWORD sequence) {
+  return BufferedInputEvent { .offset = offset, .value = value, .timestamp = sequence * 10, .sequence = sequence };
+}
+
+/// Hands out the events it was given, `DI_BUFFEROVERFLOW` on the first read after `overflowed` was set.
+class ScriptedSource final : public BufferedInputSource {
+public:
+  void Add(DWORD offset, DWORD value) {
+    DIDEVICEOBJECTDATA data {};
+    data.dwOfs = offset;
+    data.dwData = value;
+    data.dwSequence = next_sequence_++;
+    pending_.push_back(data);
+  }
+
+  HRESULT ReadBufferedEvents(DIDEVICEOBJECTDATA* out_data, DWORD& inout_count) override {
+    inout_count = std::min<DWORD>(inout_count, static_cast<DWORD>(pending_.size()));
+    std::copy_n(pending_.begin(), inout_count, out_data);
+    pending_.erase(pending_.begin(), pending_.begin() + inout_count);
+
+    bool const overflowed = overflowed_;
+    overflowed_ = false;
+    return overflowed ? DI_BUFFEROVERFLOW : DI_OK;
+  }
+
+  bool overflowed_ = false;
+
+private:
+  std::vector<DIDEVICEOBJECTDATA> pending_;
+  DWORD next_sequence_ = 1;
+};
+
+/// Polls the same synthetic devices buffered and not, and checks after each poll that replaying the events gave the snapshot.
+void CheckBufferedAgainstSnapshots(DWORD event_ring_capacity, uint64_t& out_ring_overflow_count) {
+  DirectInputContext::Config buffered_config {};
+  buffered_config.buffered_input = true;
+  buffered_config.event_ring_capacity = event_ring_capacity;
+
+  DirectInputContext buffered;
+  DirectInputContext snapshots;
+  REQUIRE(buffered.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(8)), buffered_config));
+  REQUIRE(snapshots.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(8)), DirectInputContext::Config {}));
+  REQUIRE(buffered.GetDevices().size() == 8);
+
+  for (int poll = 0; poll < 200; ++poll) {
+    buffered.UpdateState();
+    snapshots.UpdateState();
+    for (DirectInputContext::Device const& device : buffered.GetDevices()) {
+      DirectInputContext::Device const* snapshot = snapshots.GetDevice(device.guid);
+      REQUIRE(snapshot != nullptr);
+      CHECK(std::memcmp(&device.state, &snapshot->state, sizeof(DIJOYSTATE2)) == 0);
+    }
+  }
+
+  out_ring_overflow_count = 0;
+  for (DirectInputContext::Device const& device : buffered.GetDevices()) {
+    CHECK(device.event_stats.event_count > 0);
+    out_ring_overflow_count += device.event_stats.ring_overflow_count;
+  }
+  buffered.Shutdown();
+  snapshots.Shutdown();
+}
+
+}
+
+TEST_CASE(RingRoundsCapacityUpToAPowerOfTwo) {
+  CHECK_EQ(InputEventRing(5).GetCapacity(), 8);
+  CHECK_EQ(InputEventRing(8).GetCapacity(), 8);
+  CHECK_EQ(InputEventRing(1).GetCapacity(), 1);
+}
+
+TEST_CASE(RingOfNoCapacityAllocatesNothing) {
+  InputEventRing ring(0);
+  CHECK_EQ(ring.GetCapacity(), 0);
+  CHECK(!ring.Push(MakeEvent(DIJOFS_X, 1, 1)));
+  CHECK_EQ(ring.GetWriteCount(), 0);
+
+  uint64_t cursor = 0;
+  uint64_t lost_count = 1;
+  BufferedInputEvent events[4];
+  CHECK_EQ(ring.Read(cursor, events, &lost_count), 0);
+  CHECK_EQ(lost_count, 0);
+}
+
+TEST_CASE(RingReadsInOrderAndCountsOverwrittenEvents) {
+  InputEventRing ring(4);
+  for (DWORD i = 0; i < 4; ++i) {
+    CHECK(!ring.Push(MakeEvent(DIJOFS_BUTTON(i), 0x80, i)));
+  }
+  CHECK(ring.Push(MakeEvent(DIJOFS_BUTTON(4), 0x80, 4)));
+  CHECK(ring.Push(MakeEvent(DIJOFS_BUTTON(5), 0x80, 5)));
+
+  // A reader at the start missed the two oldest events.
+  uint64_t cursor = 0;
+  uint64_t lost_count = 0;
+  BufferedInputEvent events[8];
+  REQUIRE(ring.Read(cursor, events, &lost_count) == 4);
+  CHECK_EQ(lost_count, 2);
+  CHECK_EQ(cursor, 6);
+  for (DWORD i = 0; i < 4; ++i) {
+    CHECK_EQ(events[i].sequence, i + 2);
+  }
+
+  // An up-to-date reader reads nothing, and one that reads in small steps gets the rest.
+  CHECK_EQ(ring.Read(cursor, events, &lost_count), 0);
+  ring.Push(MakeEvent(DIJOFS_X, 1, 6));
+  ring.Push(MakeEvent(DIJOFS_X, 2, 7));
+  CHECK_EQ(ring.Read(cursor, std::span(events, 1), &lost_count), 1);
+  CHECK_EQ(events[0].sequence, 6);
+  CHECK_EQ(ring.Read(cursor, events, &lost_count), 1);
+  CHECK_EQ(events[0].sequence, 7);
+  CHECK_EQ(lost_count, 0);
+}
+
+TEST_CASE(ApplyInputEventWritesTheFieldAtItsOffset) {
+  DIJOYSTATE2 state {};
+  ApplyInputEvent(state, MakeEvent(DIJOFS_Y, static_cast<DWORD>(-1234), 1));
+  ApplyInputEvent(state, MakeEvent(DIJOFS_SLIDER(1), 65535, 2));
+  ApplyInputEvent(state, MakeEvent(DIJOFS_POV(2), 27000, 3));
+  ApplyInputEvent(state, MakeEvent(DIJOFS_BUTTON(127), 0x80, 4));
+  CHECK_EQ(state.lY, -1234);
+  CHECK_EQ(state.rglSlider[1], 65535);
+  CHECK_EQ(state.rgdwPOV[2], 27000);
+  CHECK_EQ(state.rgbButtons[127], 0x80);
+
+  // Misaligned or out-of-range offsets are ignored.
+  DIJOYSTATE2 const before = state;
+  ApplyInputEvent(state, MakeEvent(DIJOFS_X + 1, 1, 5));
+  ApplyInputEvent(state, MakeEvent(sizeof(DIJOYSTATE2), 1, 6));
+  CHECK(std::memcmp(&state, &before, sizeof(DIJOYSTATE2)) == 0);
+}
+
+TEST_CASE(DrainAppliesEveryEventInOrder) {
+  ScriptedSource source;
+  // More than one read's worth, with the same button pressed and released in between.
+  for (DWORD i = 0; i < 150; ++i) {
+    source.Add(DIJOFS_X, i);
+  }
+  source.Add(DIJOFS_BUTTON(3), 0x80);
+  source.Add(DIJOFS_BUTTON(3), 0);
+
+  InputEventRing ring(256);
+  BufferedInputStats stats;
+  DIJOYSTATE2 state {};
+  CHECK_EQ(DrainInputEvents(source, ring, stats, &state), DI_OK);
+  CHECK_EQ(stats.event_count, 152);
+  CHECK_EQ(stats.source_overflow_count, 0);
+  CHECK_EQ(stats.ring_overflow_count, 0);
+  CHECK_EQ(state.lX, 149);
+  CHECK_EQ(state.rgbButtons[3], 0);
+
+  uint64_t cursor = 150;
+  BufferedInputEvent events[4];
+  REQUIRE(ring.Read(cursor, events) == 2);
+  CHECK_EQ(events[0].value, 0x80);
+  CHECK_EQ(events[1].value, 0);
+}
+
+TEST_CASE(DrainReportsSourceOverflow) {
+  ScriptedSource source;
+  source.Add(DIJOFS_Z, 7);
+  source.overflowed_ = true;
+
+  InputEventRing ring(16);
+  BufferedInputStats stats;
+  DIJOYSTATE2 state {};
+  CHECK_EQ(DrainInputEvents(source, ring, stats, &state), DI_BUFFEROVERFLOW);
+  CHECK_EQ(stats.source_overflow_count, 1);
+  CHECK_EQ(state.lZ, 7);
+
+  CHECK_EQ(DrainInputEvents(source, ring, stats, &state), DI_OK);
+}
+
+TEST_CASE(DrainReportsRingOverflow) {
+  ScriptedSource source;
+  for (DWORD i = 0; i < 5; ++i) {
+    source.Add(DIJOFS_BUTTON(i), 0x80);
+  }
+
+  InputEventRing ring(4);
+  BufferedInputStats stats;
+  DIJOYSTATE2 state {};
+  CHECK_EQ(DrainInputEvents(source, ring, stats, &state), DI_BUFFEROVERFLOW);
+  CHECK_EQ(stats.ring_overflow_count, 1);
+  CHECK_EQ(stats.ring_overwrite_count, 1);
+  CHECK_EQ(state.rgbButtons[4], 0x80);
+
+  // Overwriting events of earlier reads is how a ring works, not an overflow.
+  for (DWORD i = 0; i < 4; ++i) {
+    source.Add(DIJOFS_BUTTON(i), 0);
+  }
+  CHECK_EQ(DrainInputEvents(source, ring, stats, &state), DI_OK);
+  CHECK_EQ(stats.ring_overflow_count, 1);
+}
+
+TEST_CASE(BufferedStateMatchesSnapshots) {
+  uint64_t ring_overflow_count = 0;
+  CheckBufferedAgainstSnapshots(1024, ring_overflow_count);
+  CHECK_EQ(ring_overflow_count, 0);
+}
+
+TEST_CASE(RingOverflowResynchronizesFromSnapshots) {
+  uint64_t ring_overflow_count = 0;
+  CheckBufferedAgainstSnapshots(1, ring_overflow_count);
+  CHECK(ring_overflow_count > 0);
+}
+
+TEST_CASE(UnbufferedDevicesHaveNoRing) {
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(4)), DirectInputContext::Config {}));
+  context.UpdateState();
+  for (DirectInputContext::Device const& device : context.GetDevices()) {
+    CHECK_EQ(device.events.GetCapacity(), 0);
+    CHECK_EQ(device.event_stats.event_count, 0);
+  }
+  context.Shutdown();
+}
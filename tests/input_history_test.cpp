@@ -0,0 +1,230 @@
+//
+// `InputHistory` (`Config::input_history_capacity`) against synthetic timelines.
+// A scripted timeline covers the documented cases (edges inside and outside a window, interpolation across a change, retention and overwriting).
+// A random one, polled every millisecond, compares every query against a brute-force scan of all polls.
+// Finally, the history a `DirectInputContext` records over synthetic devices must end with each device's current state.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "input_history.h"
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kMs = 1'000'000;
+
+/// Two axes (X and Y), one POV and 16 buttons.
+PackedStateLayout MakeLayout() {
+  DWORD const axis_offsets[] = { DIJOFS_X, DIJOFS_Y };
+  return PackedStateLayout(axis_offsets, 1, 16);
+}
+
+struct Poll final {
+  uint64_t time_ns = 0;
+  PackedState state {};
+};
+
+bool ButtonDown(PackedStateLayout const& layout, PackedState const& state, DWORD index) {
+  return PackedStateLayout::DecodeButton(state.bytes[layout.GetButtonOffset(index)], index) != 0;
+}
+
+LONG AxisValue(PackedStateLayout const& layout, PackedState const& state, DWORD index) {
+  int16_t value;
+  std::memcpy(&value, state.bytes + layout.GetAxisOffset(index), sizeof(value));
+  return value;
+}
+
+void SetButton(PackedStateLayout const& layout, PackedState& state, DWORD index, bool down) {
+  uint8_t& bits = state.bytes[layout.GetButtonOffset(index)];
+  bits = down ? (bits | (1 << (index % 8))) : (bits & ~(1 << (index % 8)));
+}
+
+void SetAxis(PackedStateLayout const& layout, PackedState& state, DWORD index, int16_t value) {
+  std::memcpy(state.bytes + layout.GetAxisOffset(index), &value, sizeof(value));
+}
+
+/// Records `polls` the way `DirectInputContext` does: every poll is offered, and each one's predecessor is when the previous state was last seen.
+void RecordPolls(InputHistory& history, std::vector<Poll> const& polls) {
+  for (size_t i = 0; i < polls.size(); ++i) {
+    history.Record(polls[i].time_ns, (i > 0) ? polls[i - 1].time_ns : polls[i].time_ns, polls[i].state);
+  }
+}
+
+void CheckRandomTimeline(size_t capacity, uint32_t seed) {
+  PackedStateLayout const layout = MakeLayout();
+  uint64_t const retention_ns = 2000 * kMs;
+  InputHistory history(layout, capacity, retention_ns);
+
+  // Every millisecond, each input changes with a small probability: a few presses and moves per second.
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> axis(-32767, 32767);
+  std::vector<Poll> polls;
+  PackedState state {};
+  for (uint64_t t = 1; t <= 10000; ++t) {
+    for (DWORD i = 0; i < 16; ++i) {
+      if (percent(random) == 0) {
+        SetButton(layout, state, i, !ButtonDown(layout, state, i));
+      }
+    }
+    if (percent(random) < 2) {
+      SetAxis(layout, state, static_cast<DWORD>(percent(random) % 2), static_cast<int16_t>(axis(random)));
+    }
+    polls.push_back(Poll { .time_ns = t * kMs, .state = state });
+  }
+  RecordPolls(history, polls);
+
+  uint64_t const end = polls.back().time_ns;
+  uint64_t const start = history.GetStartTime();
+  CHECK(start <= end - std::min(end, retention_ns) || history.GetOverwriteCount() > 0);
+
+  // Brute force: the latest poll at or before `time_ns`.
+  auto PollAt = [&](uint64_t time_ns) {
+    return static_cast<size_t>(std::upper_bound(polls.begin(), polls.end(), time_ns, [](uint64_t t, Poll const& p) { return t < p.time_ns; }) - polls.begin()) - 1;
+  };
+
+  // The first query that disagrees ends the test, rather than report every one after it.
+  std::uniform_int_distribution<uint64_t> time(start, end + 5 * kMs);
+  std::uniform_int_distribution<uint64_t> window(0, 300 * kMs);
+  for (int query = 0; query < 20000; ++query) {
+    uint64_t const t = time(random);
+    size_t const p = PollAt(t);
+
+    DWORD const button = static_cast<DWORD>(query % 16);
+    bool down = false;
+    REQUIRE(history.IsButtonDownAt(button, t, down) && down == ButtonDown(layout, polls[p].state, button));
+
+    DWORD const axis_index = static_cast<DWORD>(query % 2);
+    LONG expected = AxisValue(layout, polls[p].state, axis_index);
+    if (p + 1 < polls.size() && t > polls[p].time_ns) {
+      double const f = double(t - polls[p].time_ns) / double(polls[p + 1].time_ns - polls[p].time_ns);
+      expected += static_cast<LONG>(std::lround(f * double(AxisValue(layout, polls[p + 1].state, axis_index) - expected)));
+    }
+    LONG value = 0;
+    REQUIRE(history.GetAxisValueAt(axis_index, t, value) && value == expected);
+
+    uint64_t const from = t;
+    uint64_t const to = t + window(random);
+    uint32_t presses = 0;
+    uint32_t releases = 0;
+    bool was_down = ButtonDown(layout, polls[p].state, button);
+    for (size_t i = p + 1; i < polls.size() && polls[i].time_ns <= to; ++i) {
+      bool const now_down = ButtonDown(layout, polls[i].state, button);
+      bool const before = ButtonDown(layout, polls[i - 1].state, button);
+      presses += (now_down && !before) ? 1 : 0;
+      releases += (!now_down && before) ? 1 : 0;
+      was_down = was_down || now_down;
+    }
+    REQUIRE(history.CountPresses(button, from, to) == presses);
+    REQUIRE(history.CountReleases(button, from, to) == releases);
+    REQUIRE(history.WasDown(button, from, to) == was_down);
+  }
+}
+
+}
+
+TEST_CASE(ScriptedTimeline) {
+  PackedStateLayout const layout = MakeLayout();
+  InputHistory history(layout, 64, 1000 * kMs);
+
+  // Polled every 10 ms from 10 ms on. Button 3 is down in [150, 200) ms, axis 0 goes from 0 to 1000 between the 300 and 310 ms polls.
+  std::vector<Poll> polls;
+  PackedState state {};
+  for (uint64_t t = 10; t <= 500; t += 10) {
+    SetButton(layout, state, 3, t >= 150 && t < 200);
+    SetAxis(layout, state, 0, (t >= 310) ? 1000 : 0);
+    polls.push_back(Poll { .time_ns = t * kMs, .state = state });
+  }
+  RecordPolls(history, polls);
+
+  CHECK_EQ(history.GetSize(), 4);
+  CHECK_EQ(history.GetStartTime(), 10 * kMs);
+  CHECK(history.Find(5 * kMs) == nullptr);
+  REQUIRE(history.Find(155 * kMs) != nullptr);
+  CHECK_EQ(history.Find(155 * kMs)->time_ns, 150 * kMs);
+
+  CHECK(history.WasPressed(3, 100 * kMs, 150 * kMs));
+  CHECK(!history.WasPressed(3, 150 * kMs, 300 * kMs));
+  CHECK_EQ(history.CountReleases(3, 150 * kMs, 300 * kMs), 1);
+  CHECK(history.WasDown(3, 190 * kMs, 195 * kMs));
+  CHECK(!history.WasDown(3, 200 * kMs, 500 * kMs));
+  CHECK(!history.WasPressed(4, 0, 500 * kMs));
+
+  bool down = false;
+  CHECK(history.IsButtonDownAt(3, 160 * kMs, down) && down);
+  CHECK(history.IsButtonDownAt(3, 200 * kMs, down) && !down);
+  CHECK(!history.IsButtonDownAt(3, 0, down));
+
+  LONG value = 0;
+  CHECK(history.GetAxisValueAt(0, 250 * kMs, value) && value == 0);
+  CHECK(history.GetAxisValueAt(0, 300 * kMs, value) && value == 0);
+  CHECK(history.GetAxisValueAt(0, 305 * kMs, value) && value == 500);
+  CHECK(history.GetAxisValueAt(0, 310 * kMs, value) && value == 1000);
+  CHECK(history.GetAxisValueAt(0, 900 * kMs, value) && value == 1000);
+
+  DWORD pov = 0;
+  CHECK(history.GetPovValueAt(0, 100 * kMs, pov) && pov == 0);
+
+  // An idle second later, only the sample current at the start of the retention window is left, along with the new one.
+  SetButton(layout, state, 5, true);
+  CHECK(history.Record(1500 * kMs, 1490 * kMs, state));
+  CHECK_EQ(history.GetSize(), 2);
+  CHECK_EQ(history.GetStartTime(), 310 * kMs);
+  CHECK(history.WasPressed(5, 1400 * kMs, 1500 * kMs));
+  CHECK(history.GetAxisValueAt(0, 1495 * kMs, value) && value == 1000);
+}
+
+TEST_CASE(OverwritesTheOldestSamplesWhenFull) {
+  PackedStateLayout const layout = MakeLayout();
+  PackedState state {};
+
+  // Toggling faster than the capacity allows overwrites the oldest samples, and the history starts later.
+  InputHistory small(layout, 8, 1000 * kMs);
+  for (uint64_t t = 1; t <= 20; ++t) {
+    SetButton(layout, state, 0, t % 2 == 0);
+    small.Record(t * kMs, (t - 1) * kMs, state);
+  }
+  CHECK_EQ(small.GetSize(), 8);
+  CHECK_EQ(small.GetOverwriteCount(), 12);
+  CHECK_EQ(small.GetStartTime(), 13 * kMs);
+  CHECK_EQ(small.CountPresses(0, 0, 20 * kMs), 4);
+
+  // The same state is not recorded twice.
+  CHECK(!small.Record(21 * kMs, 20 * kMs, state));
+}
+
+TEST_CASE(RandomTimelinesMatchAScanOfEveryPoll) {
+  for (uint32_t seed = 1; seed <= 4; ++seed) {
+    // Large enough to hold the whole retention window, then too small for it.
+    CheckRandomTimeline(1024, seed);
+    CheckRandomTimeline(64, seed);
+  }
+}
+
+TEST_CASE(RecordedHistoryEndsWithTheCurrentState) {
+  DirectInputContext context;
+  DirectInputContext::Config config {};
+  config.input_history_capacity = 1024;
+  REQUIRE(context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(8)), config));
+
+  for (int poll = 0; poll < 2000; ++poll) {
+    context.UpdateState();
+    for (DirectInputContext::Device const& device : context.GetDevices()) {
+      PackedState expected {};
+      device.packed_layout.Pack(device.state, expected);
+      InputHistory::Sample const* latest = device.history.Find(device.times.poll_end_ns);
+      REQUIRE(latest != nullptr);
+      REQUIRE(std::memcmp(&latest->state, &expected, sizeof(PackedState)) == 0);
+      REQUIRE(latest->time_ns == device.times.last_change_ns || device.times.last_change_ns == 0);
+    }
+  }
+  context.Shutdown();
+}
@@ -0,0 +1,178 @@
+//
+// `InputRecorder` and `InputReplayBackend` round trips: a session of synthetic devices, with hot-plugs, is recorded, then replayed into
+// another context, which must see the same devices with bit-identical states after every frame, buffered or not.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "input_recording.h"
+#include "synthetic_backend.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kDeviceCount = 6;
+constexpr size_t kFrameCount = 300;
+
+struct DeviceSnapshot final {
+  GUID guid {};
+  DIJOYSTATE2 state {};
+};
+
+struct Session final {
+  std::string recording;
+  std::vector<std::vector<DeviceSnapshot>> frames;
+  uint64_t first_time_us = 0;
+  uint64_t last_time_us = 0;
+};
+
+void UpdateDetection(DirectInputContext& context) {
+  context.NotifyDeviceChange();
+  context.UpdateDetection();
+}
+
+/// Records `kFrameCount` frames of a synthetic population, and what the context saw after each.
+/// Device 2 is unplugged for a while, device 3 is unplugged and plugged back within one frame, and device 0 is unplugged for good.
+void RecordSession(Session& out_session) {
+  std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(kDeviceCount, 7);
+  for (SyntheticBackend::DeviceSpec& spec : specs) {
+    spec.axis_noise = 300;
+  }
+  auto backend_owner = std::make_unique<SyntheticBackend>(std::move(specs));
+  SyntheticBackend& backend = *backend_owner;
+
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(backend_owner), DirectInputContext::Config {}));
+  REQUIRE(context.GetDevices().size() == kDeviceCount);
+
+  std::ostringstream out;
+  Session& session = out_session;
+  {
+    InputRecorder recorder(out, 256);
+    for (size_t frame = 0; frame < kFrameCount; ++frame) {
+      switch (frame) {
+      case 50:
+        backend.SetConnected(2, false);
+        UpdateDetection(context);
+        break;
+      case 80:
+        backend.SetConnected(2, true);
+        UpdateDetection(context);
+        break;
+      case 120:
+        backend.SetConnected(3, false);
+        UpdateDetection(context);
+        backend.SetConnected(3, true);
+        UpdateDetection(context);
+        break;
+      case 200:
+        backend.SetConnected(0, false);
+        UpdateDetection(context);
+        break;
+      default:
+        break;
+      }
+      context.UpdateState();
+
+      // Irregular steps, some of them large.
+      session.last_time_us += 1000 + (frame % 7) * 333 + ((frame % 50 == 0) ? 1'000'000 : 0);
+      recorder.Record(context, session.last_time_us);
+      if (frame == 0) {
+        session.first_time_us = session.last_time_us;
+      }
+
+      std::vector<DeviceSnapshot>& snapshots = session.frames.emplace_back();
+      for (DirectInputContext::Device const& device : context.GetDevices()) {
+        snapshots.push_back(DeviceSnapshot { .guid = device.guid, .state = device.LoadState() });
+      }
+    }
+    recorder.Flush();
+    CHECK_EQ(recorder.GetFrameCount(), kFrameCount);
+    CHECK_EQ(recorder.GetBytesWritten(), out.str().size());
+  }
+  context.Shutdown();
+
+  session.recording = out.str();
+}
+
+void CheckReplay(Session const& session, bool buffered_input) {
+  std::istringstream in(session.recording);
+  auto replay_owner = std::make_unique<InputReplayBackend>(in);
+  InputReplayBackend& replay = *replay_owner;
+  REQUIRE(replay.IsValid());
+
+  DirectInputContext::Config config {};
+  config.buffered_input = buffered_input;
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(replay_owner), config));
+  CHECK(context.GetDevices().empty());
+
+  size_t frame = 0;
+  DirectInputContext::DeviceHandle reappearing_handle {};
+  while (replay.AdvanceFrame()) {
+    REQUIRE(frame < session.frames.size());
+    // A device removed and added again in the same frame takes two enumerations; more would be stuck.
+    size_t enumeration_count = 0;
+    while (replay.HasDeviceChanges() && enumeration_count < 4) {
+      UpdateDetection(context);
+      ++enumeration_count;
+    }
+    CHECK(!replay.HasDeviceChanges());
+    context.UpdateState();
+
+    std::vector<DeviceSnapshot> const& snapshots = session.frames[frame];
+    CHECK_EQ(context.GetDevices().size(), snapshots.size());
+    for (DeviceSnapshot const& snapshot : snapshots) {
+      DirectInputContext::Device const* device = context.GetDevice(snapshot.guid);
+      REQUIRE(device != nullptr);
+      DIJOYSTATE2 const state = device->LoadState();
+      CHECK(std::memcmp(&state, &snapshot.state, sizeof(DIJOYSTATE2)) == 0);
+    }
+
+    // The device plugged back in was reopened, rather than left as it was.
+    DirectInputContext::Device const* reappearing = context.GetDevice(SyntheticBackend::MakeDeviceGuid(3));
+    REQUIRE(reappearing != nullptr);
+    if (frame == 119) {
+      reappearing_handle = reappearing->handle;
+    }
+    else if (frame == 120) {
+      CHECK(reappearing->handle != reappearing_handle);
+      CHECK_EQ(enumeration_count, 2);
+    }
+    ++frame;
+  }
+  CHECK_EQ(frame, session.frames.size());
+  // Frame times start at 0.
+  CHECK_EQ(replay.GetFrameTime(), session.last_time_us - session.first_time_us);
+  context.Shutdown();
+}
+
+}
+
+TEST_CASE(ReplayMatchesRecordingFrameByFrame) {
+  Session session;
+  RecordSession(session);
+  REQUIRE(session.frames.size() == kFrameCount);
+  CHECK_EQ(session.frames[60].size(), kDeviceCount - 1);
+  CHECK_EQ(session.frames[120].size(), kDeviceCount);
+  CHECK_EQ(session.frames[kFrameCount - 1].size(), kDeviceCount - 1);
+  CheckReplay(session, false);
+}
+
+TEST_CASE(BufferedReplayMatchesRecordingFrameByFrame) {
+  Session session;
+  RecordSession(session);
+  CheckReplay(session, true);
+}
+
+TEST_CASE(ReplayRejectsOtherStreams) {
+  std::istringstream in("not a recording");
+  InputReplayBackend replay(in);
+  CHECK(!replay.IsValid());
+  CHECK(!replay.AdvanceFrame());
+}
@@ -0,0 +1,162 @@
+//
+// `PackedStateLayout` round trips: a hand-made layout at the edges of every input's range, the caps on how many inputs fit,
+// and, over many polls of synthetic devices, every input surviving packing and unpacking, and the `Get*Value` accessors
+// reading the same values from a published packed sample as from `Device::state`.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "packed_state.h"
+#include "seqlock.h"
+#include "synthetic_backend.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+DIJOYSTATE2 MakeCenteredState() {
+  DIJOYSTATE2 state {};
+  std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+  return state;
+}
+
+/// `unpacked` must match `device.state` on every input of the device, and be zero or centered elsewhere.
+bool MatchesDevice(DirectInputContext::Device const& device, DIJOYSTATE2 const& unpacked) {
+  DIJOYSTATE2 expected = MakeCenteredState();
+  for (DirectInputContext::Input const& input : device.axes) {
+    std::memcpy(reinterpret_cast<BYTE*>(&expected) + input.offset, reinterpret_cast<BYTE const*>(&device.state) + input.offset, sizeof(LONG));
+  }
+  for (DirectInputContext::Input const& input : device.povs) {
+    expected.rgdwPOV[input.index] = device.state.rgdwPOV[input.index];
+  }
+  for (DirectInputContext::Input const& input : device.buttons) {
+    expected.rgbButtons[input.index] = (device.state.rgbButtons[input.index] & 0x80) != 0 ? 0x80 : 0;
+  }
+  return std::memcmp(&expected, &unpacked, sizeof(DIJOYSTATE2)) == 0;
+}
+
+/// Reads every input of `device` from `published` the way the `Get*Value` accessors do with the polling thread.
+bool FieldsMatchDevice(DirectInputContext::Device const& device, SeqLock<DirectInputContext::PackedSample> const& published) {
+  PackedStateLayout const& layout = device.packed_layout;
+  for (DWORD i = 0; i < device.axes.size(); ++i) {
+    if (PackedStateLayout::DecodeAxis(published.LoadField<int16_t>(layout.GetAxisOffset(i))) != device.GetAxisValue(i)) {
+      return false;
+    }
+  }
+  for (DWORD i = 0; i < device.povs.size(); ++i) {
+    if (PackedStateLayout::DecodePov(published.LoadField<uint16_t>(layout.GetPovOffset(i))) != device.GetPovValue(i)) {
+      return false;
+    }
+  }
+  for (DWORD i = 0; i < device.buttons.size(); ++i) {
+    if (PackedStateLayout::DecodeButton(published.LoadField<uint8_t>(layout.GetButtonOffset(i)), i) != (device.GetButtonValue(i) & 0x80)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+TEST_CASE(HandMadeLayoutRoundTrips) {
+  // X and the second slider, out of `DIJOYSTATE2` order, one POV and 13 buttons: 2 * 2 + 2 + 2 bytes.
+  DWORD const axis_offsets[] = { DIJOFS_SLIDER(1), DIJOFS_X };
+  PackedStateLayout const layout(axis_offsets, 1, 13);
+  CHECK_EQ(layout.GetAxisCount(), 2);
+  CHECK_EQ(layout.GetPovCount(), 1);
+  CHECK_EQ(layout.GetButtonCount(), 13);
+  CHECK_EQ(layout.GetSize(), 8);
+  CHECK_EQ(layout.GetAxisOffset(1), 2);
+  CHECK_EQ(layout.GetPovOffset(0), 4);
+  CHECK_EQ(layout.GetButtonOffset(12), 7);
+
+  DIJOYSTATE2 state = MakeCenteredState();
+  state.rglSlider[1] = DirectInputContext::kAxisMin;
+  state.lX = DirectInputContext::kAxisMax;
+  state.rgdwPOV[0] = 35900;
+  // Only the high bit counts.
+  state.rgbButtons[0] = 0x80;
+  state.rgbButtons[1] = 0x7F;
+  state.rgbButtons[8] = 0xFF;
+  state.rgbButtons[12] = 0x80;
+  // Inputs the layout does not have are left out.
+  state.lY = 1234;
+  state.rgdwPOV[1] = 9000;
+  state.rgbButtons[13] = 0x80;
+
+  PackedState packed;
+  layout.Pack(state, packed);
+  for (size_t i = layout.GetSize(); i < PackedState::kCapacity; ++i) {
+    CHECK_EQ(packed.bytes[i], 0);
+  }
+  CHECK_EQ(PackedStateLayout::DecodeButton(packed.bytes[layout.GetButtonOffset(8)], 8), 0x80);
+  CHECK_EQ(PackedStateLayout::DecodeButton(packed.bytes[layout.GetButtonOffset(1)], 1), 0);
+
+  DIJOYSTATE2 expected = MakeCenteredState();
+  expected.rglSlider[1] = DirectInputContext::kAxisMin;
+  expected.lX = DirectInputContext::kAxisMax;
+  expected.rgdwPOV[0] = 35900;
+  expected.rgbButtons[0] = 0x80;
+  expected.rgbButtons[8] = 0x80;
+  expected.rgbButtons[12] = 0x80;
+  DIJOYSTATE2 unpacked;
+  layout.Unpack(packed, unpacked);
+  CHECK(std::memcmp(&unpacked, &expected, sizeof(DIJOYSTATE2)) == 0);
+
+  LONG axes[2] = {};
+  layout.UnpackAxes(packed, axes);
+  CHECK_EQ(axes[0], DirectInputContext::kAxisMin);
+  CHECK_EQ(axes[1], DirectInputContext::kAxisMax);
+
+  // Centered survives too.
+  state.rgdwPOV[0] = 0xFFFFFFFF;
+  layout.Pack(state, packed);
+  layout.Unpack(packed, unpacked);
+  CHECK_EQ(unpacked.rgdwPOV[0], 0xFFFFFFFF);
+}
+
+TEST_CASE(CountsAreCappedToWhatFits) {
+  DWORD const axis_offsets[] = {
+    DIJOFS_X, DIJOFS_Y, DIJOFS_Z, DIJOFS_RX, DIJOFS_RY, DIJOFS_RZ, DIJOFS_SLIDER(0), DIJOFS_SLIDER(1),
+  };
+  PackedStateLayout const layout(axis_offsets, 6, 200);
+  CHECK_EQ(layout.GetAxisCount(), PackedState::kMaxAxes);
+  CHECK_EQ(layout.GetPovCount(), PackedState::kMaxPovs);
+  CHECK_EQ(layout.GetButtonCount(), PackedState::kMaxButtons);
+  CHECK_EQ(layout.GetSize(), PackedState::kCapacity);
+
+  // Every button pressed: the last byte is full.
+  DIJOYSTATE2 state = MakeCenteredState();
+  std::memset(state.rgbButtons, 0x80, sizeof(state.rgbButtons));
+  PackedState packed;
+  layout.Pack(state, packed);
+  CHECK_EQ(packed.bytes[PackedState::kCapacity - 1], 0xFF);
+
+  PackedStateLayout const empty;
+  CHECK_EQ(empty.GetSize(), 0);
+}
+
+TEST_CASE(SyntheticDevicesRoundTripEveryPoll) {
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(16)), DirectInputContext::Config {}));
+
+  // The synthetic devices go through every axis value, POV direction and button combination over a few thousand polls.
+  // The first mismatch ends the test, rather than report every poll after it.
+  SeqLock<DirectInputContext::PackedSample> published;
+  for (int poll = 0; poll < 4096; ++poll) {
+    context.UpdateState();
+    for (DirectInputContext::Device const& device : context.GetDevices()) {
+      DirectInputContext::PackedSample sample { .times = device.times };
+      device.packed_layout.Pack(device.state, sample.state);
+      published.Store(sample);
+
+      DIJOYSTATE2 unpacked;
+      device.packed_layout.Unpack(published.Load().state, unpacked);
+      REQUIRE(MatchesDevice(device, unpacked));
+      REQUIRE(FieldsMatchDevice(device, published));
+    }
+  }
+  context.Shutdown();
+}
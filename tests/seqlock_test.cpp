@@ -0,0 +1,221 @@
+//
+// `SeqLock` under contention: readers check that every value they load is one the writer stored, whole, and that values never go back.
+// Then the same through the polling thread's publish path (`Config::polling_rate_hz`), read with `Device::LoadSample`.
+// Prints the latency of `SeqLock::Store` while readers hammer it, and how old the samples readers get are.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "latency_histogram.h"
+#include "seqlock.h"
+#include "synthetic_backend.h"
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kReaderCount = 3;
+constexpr auto kStressDuration = std::chrono::milliseconds(300);
+
+/// As large as what the polling thread publishes, with every word stamped with the number of the `Store`.
+struct StampedValue final {
+  uint64_t words[sizeof(DirectInputContext::PackedSample) / sizeof(uint64_t)];
+};
+
+void PrintLatency(char const* label, LatencySummary const& latency) {
+  std::printf(
+    "%s: %" PRIu64 " samples, p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p99.9 %" PRIu64 " ns, max %" PRIu64 " ns\n",
+    label, latency.count, latency.p50_ns, latency.p99_ns, latency.p999_ns, latency.max_ns
+  );
+}
+
+/// Every axis is `value`, every button pressed if `value` is odd, and the POV at `value % 36` tens of degrees.
+DIJOYSTATE2 MakeUniformState(LONG value) {
+  DIJOYSTATE2 state {};
+  LONG* axes = &state.lX;
+  for (size_t i = 0; i < 8; ++i) {
+    axes[i] = value;
+  }
+  state.rgdwPOV[0] = static_cast<DWORD>(value % 36) * 1000;
+  for (size_t i = 0; i < 128; ++i) {
+    state.rgbButtons[i] = ((value & 1) != 0) ? 0x80 : 0;
+  }
+  return state;
+}
+
+bool IsUniformState(DIJOYSTATE2 const& state, DWORD button_count) {
+  LONG const value = state.lX;
+  LONG const* axes = &state.lX;
+  for (size_t i = 1; i < 8; ++i) {
+    if (axes[i] != value) {
+      return false;
+    }
+  }
+  if (state.rgdwPOV[0] != static_cast<DWORD>(value % 36) * 1000) {
+    return false;
+  }
+  for (size_t i = 0; i < button_count; ++i) {
+    if (state.rgbButtons[i] != (((value & 1) != 0) ? 0x80 : 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+TEST_CASE(SeqLockReadsAreNeverTorn) {
+  SeqLock<StampedValue> lock;
+  std::atomic<bool> stop { false };
+  std::atomic<uint64_t> torn_count { 0 };
+  std::atomic<uint64_t> backwards_count { 0 };
+  std::atomic<uint64_t> read_count { 0 };
+
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < kReaderCount; ++r) {
+    readers.emplace_back([&]() {
+      uint64_t last = 0;
+      uint64_t reads = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        StampedValue const value = lock.Load();
+        for (uint64_t word : value.words) {
+          if (word != value.words[0]) {
+            torn_count.fetch_add(1, std::memory_order_relaxed);
+            break;
+          }
+        }
+        if (value.words[0] < last) {
+          backwards_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        last = value.words[0];
+        ++reads;
+      }
+      read_count.fetch_add(reads, std::memory_order_relaxed);
+    });
+  }
+
+  LatencyHistogram store_latency(std::chrono::hours(1));
+  uint64_t stamp = 0;
+  uint64_t const end_ns = GetMonotonicTimeNs() + static_cast<uint64_t>(std::chrono::nanoseconds(kStressDuration).count());
+  for (uint64_t now = GetMonotonicTimeNs(); now < end_ns; ) {
+    StampedValue value;
+    ++stamp;
+    for (uint64_t& word : value.words) {
+      word = stamp;
+    }
+    lock.Store(value);
+    uint64_t const stored = GetMonotonicTimeNs();
+    store_latency.Record(stored - now, stored);
+    now = stored;
+  }
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+
+  std::printf("%" PRIu64 " stores, %" PRIu64 " loads by %zu readers\n", stamp, read_count.load(), kReaderCount);
+  PrintLatency("SeqLock::Store", store_latency.Summarize());
+  CHECK_EQ(torn_count.load(), 0);
+  CHECK_EQ(backwards_count.load(), 0);
+  CHECK(read_count.load() > 0);
+  CHECK_EQ(lock.GetSequence(), stamp * 2);
+  CHECK_EQ(lock.Load().words[0], stamp);
+}
+
+TEST_CASE(SeqLockLoadFieldReadsTheLatestStore) {
+  SeqLock<StampedValue> lock;
+  StampedValue value {};
+  value.words[1] = 0x1122334455667788;
+  lock.Store(value);
+  CHECK_EQ(lock.LoadField<uint64_t>(sizeof(uint64_t)), 0x1122334455667788u);
+  CHECK_EQ(lock.LoadField<uint16_t>(sizeof(uint64_t) + 2), 0x5566);
+  CHECK_EQ(lock.LoadField<uint8_t>(sizeof(uint64_t) + 7), 0x11);
+}
+
+TEST_CASE(PublishedSamplesAreNeverTorn) {
+  SyntheticBackend::DeviceSpec spec {};
+  spec.name = "Uniform";
+  spec.pov_count = 1;
+  spec.axis_count = 8;
+  spec.button_count = 128;
+  spec.event_driven = true;
+  auto backend_owner = std::make_unique<SyntheticBackend>(std::vector<SyntheticBackend::DeviceSpec> { spec, spec });
+  SyntheticBackend& backend = *backend_owner;
+  // Before the first poll, rather than with centered POVs.
+  backend.SetDeviceState(0, MakeUniformState(0));
+  backend.SetDeviceState(1, MakeUniformState(0));
+
+  DirectInputContext::Config config {};
+  config.polling_rate_hz = 10000;
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::move(backend_owner), config));
+  REQUIRE(context.GetDevices().size() == 2);
+
+  std::atomic<bool> stop { false };
+  std::atomic<uint64_t> torn_count { 0 };
+  std::atomic<uint64_t> backwards_count { 0 };
+  std::atomic<uint64_t> read_count { 0 };
+  std::vector<LatencySummary> sample_ages(kReaderCount);
+
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < kReaderCount; ++r) {
+    readers.emplace_back([&, r]() {
+      LatencyHistogram sample_age(std::chrono::hours(1));
+      std::vector<LONG> last_values(context.GetDevices().size(), 0);
+      uint64_t reads = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (size_t d = 0; d < context.GetDevices().size(); ++d) {
+          DirectInputContext::Device const& device = context.GetDevices()[d];
+          DirectInputContext::Sample const sample = device.LoadSample();
+          uint64_t const now = GetMonotonicTimeNs();
+          if (!IsUniformState(sample.state, device.packed_layout.GetButtonCount()) ||
+              sample.times.poll_start_ns > sample.times.poll_end_ns || sample.times.last_change_ns > sample.times.poll_end_ns) {
+            torn_count.fetch_add(1, std::memory_order_relaxed);
+          }
+          if (sample.state.lX < last_values[d]) {
+            backwards_count.fetch_add(1, std::memory_order_relaxed);
+          }
+          last_values[d] = sample.state.lX;
+          if (sample.times.poll_end_ns != 0 && now > sample.times.poll_end_ns) {
+            sample_age.Record(now - sample.times.poll_end_ns, now);
+          }
+          ++reads;
+        }
+      }
+      read_count.fetch_add(reads, std::memory_order_relaxed);
+      sample_ages[r] = sample_age.Summarize();
+    });
+  }
+
+  // Every device counts up, a little faster than it is polled, so that most polls publish a change.
+  LONG value = 0;
+  auto const end = std::chrono::steady_clock::now() + kStressDuration;
+  while (std::chrono::steady_clock::now() < end && value < DirectInputContext::kAxisMax) {
+    ++value;
+    DIJOYSTATE2 const state = MakeUniformState(value);
+    backend.SetDeviceState(0, state);
+    backend.SetDeviceState(1, state);
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  DirectInputContext::PollingStats const stats = context.GetPollingStats();
+  context.Shutdown();
+
+  std::printf("%" PRIu64 " polls, %d changes per device, %" PRIu64 " samples read by %zu readers\n", stats.poll_count, value, read_count.load(), kReaderCount);
+  for (LatencySummary const& sample_age : sample_ages) {
+    PrintLatency("Sample age when read", sample_age);
+  }
+  CHECK_EQ(torn_count.load(), 0);
+  CHECK_EQ(backwards_count.load(), 0);
+  CHECK(stats.poll_count > 0);
+  CHECK(read_count.load() > 0);
+}
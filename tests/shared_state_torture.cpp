@@ -0,0 +1,271 @@
+//
+// Hammers the shared-memory state publication from several reader processes at once, and fails if any of them ever reads a torn value.
+//
+// Usage: shared_state_torture [reader count] [duration ms] [device capacity]
+// Defaults to 4 readers, 2000 ms and 16 slots. POSIX only (`fork`).
+//
+// Two phases, each with its own region:
+//  - "pattern": the parent publishes states whose every byte encodes the same counter, as fast as it can, and replugs a random slot every so often.
+//    Readers check that each state is uniform, that each slot's counter never goes back within a generation, and that each info matches its generation.
+//  - "context": a `DirectInputContext` with synthetic devices and a polling thread publishes through `Config::shared_memory_name`.
+//    Readers check that every device's state is readable and that its samples never go back in time.
+//
+
+#include "direct_input_context.h"
+#include "latency_histogram.h"
+#include "shared_state.h"
+#include "synthetic_backend.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ReaderCounts final {
+  uint64_t info_reads = 0;
+  uint64_t state_reads = 0;
+  /// State reads that raced with a replug, i.e. found another generation's state. Expected, and not an error.
+  uint64_t stale_reads = 0;
+  uint64_t errors = 0;
+};
+
+/// A deterministic info for `generation`, so that a reader can tell a torn one.
+SharedDeviceInfo MakePatternInfo(uint32_t generation) {
+  SharedDeviceInfo info {
+    .generation = generation,
+    .pov_count = generation % 5,
+    .axis_count = generation % 9,
+    .button_count = generation % 129,
+  };
+  for (uint32_t i = 0; i < std::size(info.axis_offsets); ++i) {
+    info.axis_offsets[i] = generation + i;
+  }
+  info.guid.Data1 = generation;
+  std::memset(info.name, 'a' + static_cast<char>(generation % 26), 1 + generation % (sizeof(info.name) - 1));
+  return info;
+}
+
+bool IsPatternInfo(SharedDeviceInfo const& info) {
+  SharedDeviceInfo const expected = MakePatternInfo(info.generation);
+  return std::memcmp(&info, &expected, sizeof(SharedDeviceInfo)) == 0;
+}
+
+SharedDeviceState MakePatternState(uint32_t generation, uint64_t counter) {
+  SharedDeviceState state {
+    .generation = generation,
+    .poll_end_ns = counter,
+    .last_change_ns = counter,
+  };
+  std::memset(&state.state, static_cast<int>(counter & 0xFF), sizeof(DIJOYSTATE2));
+  return state;
+}
+
+bool IsPatternState(SharedDeviceState const& state) {
+  SharedDeviceState const expected = MakePatternState(static_cast<uint32_t>(state.generation), state.poll_end_ns);
+  return std::memcmp(&state, &expected, sizeof(SharedDeviceState)) == 0;
+}
+
+ReaderCounts ReadPattern(SharedStateReader const& reader, Clock::time_point end_time) {
+  ReaderCounts counts;
+  uint32_t const capacity = reader.GetDeviceCapacity();
+  std::vector<uint32_t> generations(capacity);
+  std::vector<uint64_t> counters(capacity);
+  uint64_t layout_version = 0;
+
+  while (Clock::now() < end_time) {
+    uint64_t const version = reader.GetLayoutVersion();
+    if (version < layout_version) {
+      ++counts.errors;
+    }
+    layout_version = version;
+
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+      SharedDeviceInfo info;
+      ++counts.info_reads;
+      if (!reader.ReadDeviceInfo(slot, info)) {
+        continue;
+      }
+      if (!IsPatternInfo(info)) {
+        ++counts.errors;
+        continue;
+      }
+      if (info.generation != generations[slot]) {
+        generations[slot] = info.generation;
+        counters[slot] = 0;
+      }
+
+      SharedDeviceState state;
+      ++counts.state_reads;
+      if (!reader.ReadDeviceState(slot, info.generation, state)) {
+        ++counts.stale_reads;
+        continue;
+      }
+      if (!IsPatternState(state) || state.poll_end_ns < counters[slot]) {
+        ++counts.errors;
+      }
+      counters[slot] = state.poll_end_ns;
+    }
+  }
+  return counts;
+}
+
+ReaderCounts ReadContext(SharedStateReader const& reader, Clock::time_point end_time) {
+  ReaderCounts counts;
+  uint32_t const capacity = reader.GetDeviceCapacity();
+  std::vector<uint64_t> poll_ends(capacity);
+
+  while (Clock::now() < end_time) {
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+      SharedDeviceInfo info;
+      ++counts.info_reads;
+      if (!reader.ReadDeviceInfo(slot, info)) {
+        continue;
+      }
+
+      SharedDeviceState state;
+      ++counts.state_reads;
+      if (!reader.ReadDeviceState(slot, info.generation, state)) {
+        // Not polled yet.
+        ++counts.stale_reads;
+        continue;
+      }
+      if (state.poll_end_ns < poll_ends[slot] || state.last_change_ns > state.poll_end_ns) {
+        ++counts.errors;
+      }
+      for (uint32_t i = 0; i < info.axis_count && i < std::size(info.axis_offsets); ++i) {
+        LONG value;
+        std::memcpy(&value, reinterpret_cast<BYTE const*>(&state.state) + info.axis_offsets[i], sizeof(LONG));
+        if (value < DirectInputContext::kAxisMin || value > DirectInputContext::kAxisMax) {
+          ++counts.errors;
+        }
+      }
+      poll_ends[slot] = state.poll_end_ns;
+    }
+  }
+  return counts;
+}
+
+/// Forks `reader_count` processes that each run `read` against the region `name` until `end_time`, opening it as soon as it exists.
+/// The parent runs `publish` meanwhile, then collects the readers. Forking first keeps the children from inheriting any of the publisher's threads. Returns `true` if no reader found an error.
+template<typename Read, typename Publish>
+bool RunPhase(char const* phase, std::string const& name, int reader_count, Clock::time_point end_time, Read&& read, Publish&& publish) {
+  std::vector<pid_t> readers;
+  for (int i = 0; i < reader_count; ++i) {
+    pid_t const pid = ::fork();
+    if (pid < 0) {
+      std::perror("fork");
+      break;
+    }
+    if (pid == 0) {
+      SharedStateReader reader;
+      while (!reader.Open(name) && Clock::now() < end_time) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      if (!reader.IsOpen()) {
+        std::fprintf(stderr, "%s reader %d: failed to open \"%s\"\n", phase, i, name.c_str());
+        std::_Exit(2);
+      }
+      ReaderCounts const counts = read(reader, end_time);
+      std::printf(
+        "%s reader %d: %llu info reads, %llu state reads (%llu stale), %llu errors\n", phase, i,
+        static_cast<unsigned long long>(counts.info_reads), static_cast<unsigned long long>(counts.state_reads),
+        static_cast<unsigned long long>(counts.stale_reads), static_cast<unsigned long long>(counts.errors)
+      );
+      std::fflush(stdout);
+      std::_Exit(counts.errors == 0 ? 0 : 1);
+    }
+    readers.push_back(pid);
+  }
+
+  publish();
+
+  bool passed = static_cast<int>(readers.size()) == reader_count;
+  for (pid_t const pid : readers) {
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    passed = passed && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  std::printf("%s: %s\n", phase, passed ? "passed" : "FAILED");
+  // Before the next phase forks.
+  std::fflush(stdout);
+  return passed;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  int const reader_count = (argc > 1) ? std::atoi(argv[1]) : 4;
+  auto const duration = std::chrono::milliseconds((argc > 2) ? std::atoi(argv[2]) : 2000);
+  uint32_t const capacity = (argc > 3) ? static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)) : 16;
+
+  std::string const name_prefix = "direct_input_torture_" + std::to_string(::getpid());
+  bool passed = true;
+
+  {
+    std::string const name = name_prefix + "_pattern";
+    SharedStatePublisher publisher;
+    if (!publisher.Create(name, capacity)) {
+      return 1;
+    }
+    std::vector<uint32_t> generations(capacity);
+    uint32_t next_generation = 1;
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+      generations[slot] = next_generation++;
+      publisher.SetDeviceInfo(slot, MakePatternInfo(generations[slot]));
+    }
+
+    Clock::time_point const end_time = Clock::now() + duration;
+    passed &= RunPhase("pattern", name, reader_count, end_time, ReadPattern, [&]() {
+      std::mt19937 random(1);
+      uint64_t counter = 0;
+      uint64_t replug_count = 0;
+      while (Clock::now() < end_time) {
+        for (uint32_t slot = 0; slot < capacity; ++slot) {
+          publisher.SetDeviceState(slot, MakePatternState(generations[slot], ++counter));
+        }
+        publisher.SetHeartbeat(GetMonotonicTimeNs());
+
+        if ((counter / capacity) % 64 == 0) {
+          uint32_t const slot = random() % capacity;
+          publisher.ClearDevice(slot);
+          generations[slot] = next_generation++;
+          publisher.SetDeviceInfo(slot, MakePatternInfo(generations[slot]));
+          ++replug_count;
+        }
+      }
+      std::printf("pattern publisher: %llu states, %llu replugs\n", static_cast<unsigned long long>(counter), static_cast<unsigned long long>(replug_count));
+    });
+  }
+
+  {
+    std::string const name = name_prefix + "_context";
+    Clock::time_point const end_time = Clock::now() + duration;
+    passed &= RunPhase("context", name, reader_count, end_time, ReadContext, [&]() {
+      DirectInputContext context;
+      DirectInputContext::Config config {};
+      config.polling_rate_hz = 1000;
+      config.shared_memory_name = name;
+      config.shared_memory_device_capacity = capacity;
+      if (!context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(capacity)), config)) {
+        return;
+      }
+      std::this_thread::sleep_until(end_time);
+      DirectInputContext::PollingStats const stats = context.GetPollingStats();
+      std::printf("context publisher: %llu polls\n", static_cast<unsigned long long>(stats.poll_count));
+      context.Shutdown();
+    });
+  }
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+//
+// `PackButtons`, `GatherAxes`, `NarrowAxes` and `NormalizeAxes` on synthetic `DIJOYSTATE2`s, against plain scalar references.
+// Built twice: as is, which takes the SSE2 paths on x64, and as `simd_extraction_test_scalar` with `CONFIG_USE_SSE2=0`, so that both paths
+// are held to the same references. Counts are picked so that the SIMD loops leave a scalar tail.
+//
+
+#include "test.h"
+
+#include "axis_extraction.h"
+#include "button_bits.h"
+#include "simd_config.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr DWORD kAxisOffsets[] = {
+  DIJOFS_X, DIJOFS_Y, DIJOFS_Z, DIJOFS_RX, DIJOFS_RY, DIJOFS_RZ, DIJOFS_SLIDER(0), DIJOFS_SLIDER(1),
+};
+
+/// Centered POVs are all ones, right before `rgbButtons`, and so is the field after it: a load that strays out of `rgbButtons` reads pressed buttons.
+DIJOYSTATE2 MakeState() {
+  DIJOYSTATE2 state {};
+  std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+  state.lVX = -1;
+  return state;
+}
+
+ButtonBits PackButtonsReference(BYTE const* buttons) {
+  ButtonBits bits;
+  for (DWORD i = 0; i < ButtonBits::kButtonCount; ++i) {
+    if ((buttons[i] & 0x80) != 0) {
+      bits.words[i / 64] |= uint64_t(1) << (i % 64);
+    }
+  }
+  return bits;
+}
+
+int16_t NarrowReference(LONG value) {
+  return static_cast<int16_t>(std::clamp<LONG>(value, INT16_MIN, INT16_MAX));
+}
+
+float NormalizeReference(LONG value, LONG min, LONG max, AxisNormalization normalization) {
+  double const unit = (static_cast<double>(value) - min) / (static_cast<double>(max) - min);
+  double const normalized = (normalization == AxisNormalization::kSigned) ? unit * 2.0 - 1.0 : unit;
+  return static_cast<float>(std::clamp(normalized, (normalization == AxisNormalization::kSigned) ? -1.0 : 0.0, 1.0));
+}
+
+/// Boundary values of `LONG`, of `int16_t` and of DirectInput's usual ranges, and a few in between.
+std::vector<LONG> MakeAxisValues(size_t count) {
+  static constexpr LONG kValues[] = {
+    0, 1, -1, 32767, -32767, 32768, -32768, 32769, -32769, 65535, 65536, INT_MAX, INT_MIN, INT_MIN + 1, 12345, -23456,
+  };
+  std::vector<LONG> values(count);
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = kValues[(i * 7) % std::size(kValues)];
+  }
+  return values;
+}
+
+}
+
+TEST_CASE(ReportsThePath) {
+  std::printf("CONFIG_USE_SSE2=%d\n", CONFIG_USE_SSE2);
+}
+
+TEST_CASE(PackButtonsIgnoresCenteredPovsAndWhatFollows) {
+  DIJOYSTATE2 const state = MakeState();
+  ButtonBits const bits = PackButtons(state.rgbButtons);
+  CHECK(!bits.Any());
+  CHECK_EQ(bits.FindFirst(), ButtonBits::kButtonCount);
+}
+
+TEST_CASE(PackButtonsMatchesReferenceForEveryButtonCount) {
+  // A device with `count` buttons, all pressed, then every other one pressed, with values that only differ in their high bit.
+  for (DWORD count = 0; count <= ButtonBits::kButtonCount; ++count) {
+    DIJOYSTATE2 state = MakeState();
+    for (DWORD i = 0; i < count; ++i) {
+      state.rgbButtons[i] = 0x80;
+    }
+    ButtonBits bits = PackButtons(state.rgbButtons);
+    CHECK(bits == PackButtonsReference(state.rgbButtons));
+    CHECK_EQ(bits.Count(), count);
+    CHECK_EQ(bits.FindFirst(), (count != 0) ? 0 : ButtonBits::kButtonCount);
+
+    for (DWORD i = 0; i < count; ++i) {
+      state.rgbButtons[i] = ((i % 2) != 0) ? 0xFF : 0x7F;
+    }
+    bits = PackButtons(state.rgbButtons);
+    CHECK(bits == PackButtonsReference(state.rgbButtons));
+    CHECK_EQ(bits.Count(), count / 2);
+  }
+}
+
+TEST_CASE(ButtonEdgesFindPressesAndReleases) {
+  DIJOYSTATE2 previous = MakeState();
+  DIJOYSTATE2 current = MakeState();
+  // Across the word boundary, and the last button of a 13-button device.
+  for (DWORD i : { 3u, 63u, 64u }) {
+    previous.rgbButtons[i] = 0x80;
+  }
+  for (DWORD i : { 3u, 12u, 64u, 127u }) {
+    current.rgbButtons[i] = 0x80;
+  }
+
+  ButtonEdges const edges = ComputeButtonEdges(PackButtons(previous.rgbButtons), PackButtons(current.rgbButtons));
+  CHECK(edges.down == PackButtonsReference(current.rgbButtons));
+  CHECK_EQ(edges.pressed.Count(), 2);
+  CHECK_EQ(edges.pressed.FindFirst(), 12);
+  CHECK(edges.pressed.Test(127));
+  CHECK_EQ(edges.released.Count(), 1);
+  CHECK(edges.released.Test(63));
+
+  std::vector<DWORD> changed;
+  edges.GetChanged().ForEach([&changed](DWORD index) { changed.push_back(index); });
+  CHECK((changed == std::vector<DWORD> { 12, 63, 127 }));
+
+  ButtonEdges const idle = ComputeButtonEdges(edges.down, PackButtons(current.rgbButtons));
+  CHECK(!idle.GetChanged().Any());
+  CHECK(idle.down.Any());
+}
+
+TEST_CASE(GatherAxesFollowsTheTable) {
+  DIJOYSTATE2 state = MakeState();
+  LONG* axes = &state.lX;
+  for (size_t i = 0; i < std::size(kAxisOffsets); ++i) {
+    axes[i] = static_cast<LONG>(i + 1) * 1000;
+  }
+
+  // Out of order, as an application's own layout might be, and skipping some.
+  uint8_t const table[] = {
+    ToAxisGatherIndex(DIJOFS_SLIDER(1)), ToAxisGatherIndex(DIJOFS_X), ToAxisGatherIndex(DIJOFS_RZ), ToAxisGatherIndex(DIJOFS_Y),
+    ToAxisGatherIndex(DIJOFS_SLIDER(0)),
+  };
+  LONG values[std::size(table)] = {};
+  GatherAxes(state, table, values);
+  CHECK_EQ(values[0], 8000);
+  CHECK_EQ(values[1], 1000);
+  CHECK_EQ(values[2], 6000);
+  CHECK_EQ(values[3], 2000);
+  CHECK_EQ(values[4], 7000);
+}
+
+TEST_CASE(NarrowAxesMatchesReference) {
+  for (size_t count : { 0, 1, 3, 7, 8, 9, 13, 16, 17, 64 }) {
+    std::vector<LONG> const values = MakeAxisValues(count);
+    // One more than needed, which must be left alone.
+    std::vector<int16_t> narrowed(count + 1, 0x5A5A);
+    NarrowAxes(values, narrowed);
+    for (size_t i = 0; i < count; ++i) {
+      CHECK_EQ(narrowed[i], NarrowReference(values[i]));
+    }
+    CHECK_EQ(narrowed[count], 0x5A5A);
+  }
+}
+
+TEST_CASE(NormalizeAxesMatchesReference) {
+  struct Range final {
+    LONG min;
+    LONG max;
+  };
+  constexpr Range kRanges[] = { { -32767, 32767 }, { 0, 65535 }, { -1, 1 }, { 100, 200 } };
+
+  for (Range const& range : kRanges) {
+    for (AxisNormalization normalization : { AxisNormalization::kSigned, AxisNormalization::kUnsigned }) {
+      for (size_t count : { 2, 3, 4, 5, 8, 11, 16, 31 }) {
+        std::vector<LONG> values = MakeAxisValues(count);
+        // Both ends of the range, besides values far outside of it.
+        values[0] = range.min;
+        values[count - 1] = range.max;
+
+        std::vector<float> normalized(count);
+        NormalizeAxes(values, normalized, range.min, range.max, normalization);
+        for (size_t i = 0; i < count; ++i) {
+          CHECK(std::fabs(normalized[i] - NormalizeReference(values[i], range.min, range.max, normalization)) <= 1e-5f);
+        }
+      }
+    }
+  }
+}
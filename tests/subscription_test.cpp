@@ -0,0 +1,406 @@
+//
+// `SpscQueue` between two threads, and `DirectInputContext::Subscribe` against scripted devices (event-driven `SyntheticBackend` devices,
+// whose state is set by hand): what each filter selects, axis thresholds, drops once a queue is full, and, with consumer threads draining
+// hundreds of subscriptions while the main thread polls, each subscription ending up with the values of the inputs it follows.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "spsc_queue.h"
+#include "synthetic_backend.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using InputType = DirectInputContext::InputType;
+using InputChange = DirectInputContext::InputChange;
+
+uint32_t TypeBit(InputType type) {
+  return 1u << static_cast<uint32_t>(type);
+}
+
+/// Two devices with a POV, 4 axes and 16 buttons each, driven by the tests through `SetDeviceState`.
+class ScriptedDevices final {
+public:
+  ScriptedDevices() {
+    std::vector<SyntheticBackend::DeviceSpec> specs;
+    for (char const* name : { "Scripted Stick", "Scripted Throttle" }) {
+      specs.push_back(SyntheticBackend::DeviceSpec { .name = name, .pov_count = 1, .axis_count = 4, .button_count = 16, .event_driven = true });
+    }
+    auto backend = std::make_unique<SyntheticBackend>(std::move(specs));
+    backend_ = backend.get();
+    initialized_ = context_.Initialize(std::move(backend), DirectInputContext::Config {});
+    for (DIJOYSTATE2& state : states_) {
+      state = DIJOYSTATE2 {};
+      std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+    }
+    for (size_t i = 0; i < 2; ++i) {
+      backend_->SetDeviceState(i, states_[i]);
+    }
+    context_.UpdateState();
+  }
+
+  ~ScriptedDevices() {
+    context_.Shutdown();
+  }
+
+  bool IsInitialized() const {
+    return initialized_ && context_.GetDevices().size() == 2;
+  }
+
+  DirectInputContext& GetContext() {
+    return context_;
+  }
+
+  DirectInputContext::Device const& GetDevice(size_t index) const {
+    return *context_.GetDevice(SyntheticBackend::MakeDeviceGuid(index));
+  }
+
+  /// Axes 0 to 3 are X, Y, Z and Rx.
+  void SetAxis(size_t device, DWORD index, LONG value) {
+    (&states_[device].lX)[index] = value;
+    backend_->SetDeviceState(device, states_[device]);
+  }
+
+  void SetPov(size_t device, DWORD value) {
+    states_[device].rgdwPOV[0] = value;
+    backend_->SetDeviceState(device, states_[device]);
+  }
+
+  void SetButton(size_t device, DWORD index, bool down) {
+    states_[device].rgbButtons[index] = down ? 0x80 : 0;
+    backend_->SetDeviceState(device, states_[device]);
+  }
+
+private:
+  DirectInputContext context_;
+  SyntheticBackend* backend_ = nullptr;
+  DIJOYSTATE2 states_[2];
+  bool initialized_ = false;
+};
+
+std::vector<InputChange> DrainAll(DirectInputContext::Subscription& subscription) {
+  std::vector<InputChange> changes;
+  InputChange batch[16];
+  for (size_t count; (count = subscription.Drain(batch)) > 0;) {
+    changes.insert(changes.end(), batch, batch + count);
+  }
+  return changes;
+}
+
+bool IsChange(InputChange const& change, DirectInputContext::Device const& device, InputType type, DWORD index, LONG value) {
+  return change.device == device.handle && change.type == type && change.index == index && change.value == value && change.time_ns == device.times.poll_end_ns;
+}
+
+/// A mix of what subsystems ask for: everything from one device, every button, two axes of one device with a threshold, and the first POVs and buttons.
+DirectInputContext::SubscriptionFilter MakeFilter(size_t i, std::span<DirectInputContext::Device const> devices) {
+  DirectInputContext::Device const& device = devices[(i / 4) % devices.size()];
+  DirectInputContext::SubscriptionFilter filter {};
+  switch (i % 4) {
+  case 0:
+    filter.device = device.handle;
+    break;
+  case 1:
+    filter.input_types = TypeBit(InputType::kButton);
+    break;
+  case 2:
+    filter.guid = device.guid;
+    filter.input_types = TypeBit(InputType::kAxis);
+    filter.indices = ButtonBits { { 0b11, 0 } };
+    filter.axis_threshold = 1024;
+    break;
+  default:
+    filter.input_types = TypeBit(InputType::kPOV) | TypeBit(InputType::kButton);
+    filter.indices = ButtonBits { { 0xFF, 0 } };
+    break;
+  }
+  return filter;
+}
+
+/// Calls `f(type, index, value)` for every input of `device` that `filter` selects.
+template<typename F>
+void ForEachSelectedInput(DirectInputContext::SubscriptionFilter const& filter, DirectInputContext::Device const& device, F&& f) {
+  bool const matches = (filter.device != DirectInputContext::DeviceHandle {}) ? filter.device == device.handle : (filter.guid == GUID {} || filter.guid == device.guid);
+  if (!matches) {
+    return;
+  }
+  auto Selected = [&](InputType type, DWORD index) {
+    return (filter.input_types & TypeBit(type)) != 0 && filter.indices.Test(index);
+  };
+  for (DWORD i = 0; i < device.povs.size(); ++i) {
+    if (Selected(InputType::kPOV, i)) {
+      f(InputType::kPOV, i, static_cast<LONG>(device.GetPovValue(i)));
+    }
+  }
+  for (DWORD i = 0; i < device.axes.size(); ++i) {
+    if (Selected(InputType::kAxis, i)) {
+      f(InputType::kAxis, i, device.GetAxisValue(i));
+    }
+  }
+  for (DWORD i = 0; i < device.buttons.size(); ++i) {
+    if (Selected(InputType::kButton, i)) {
+      f(InputType::kButton, i, static_cast<LONG>(device.GetButtonValue(i)));
+    }
+  }
+}
+
+uint64_t MakeKey(DirectInputContext::DeviceHandle device, InputType type, DWORD index) {
+  return (uint64_t(device.index) << 32) | (uint64_t(type) << 16) | index;
+}
+
+}
+
+TEST_CASE(QueuePushesWhatFits) {
+  SpscQueue<int> queue(5);
+  CHECK_EQ(queue.GetCapacity(), 8);
+
+  int const values[] = { 1, 2, 3, 4, 5, 6 };
+  CHECK_EQ(queue.Push(values), 6);
+  CHECK_EQ(queue.Push(values), 2);
+  CHECK_EQ(queue.Push(values), 0);
+
+  int out[16] = {};
+  CHECK_EQ(queue.Pop(std::span(out, 3)), 3);
+  CHECK_EQ(out[2], 3);
+  CHECK_EQ(queue.Pop(out), 5);
+  CHECK_EQ(out[0], 4);
+  CHECK_EQ(out[3], 1);
+  CHECK_EQ(out[4], 2);
+  CHECK_EQ(queue.Pop(out), 0);
+}
+
+TEST_CASE(QueueKeepsOrderAcrossThreads) {
+  // Batches of every size up to more than the queue holds, so that the indices wrap many times and the producer often finds it full.
+  constexpr uint64_t kValueCount = 200'000;
+  SpscQueue<uint64_t> queue(64);
+  std::thread producer([&]() {
+    uint64_t batch[100];
+    for (uint64_t next = 0, size = 1; next < kValueCount; size = size % 100 + 1) {
+      size_t const count = static_cast<size_t>(std::min(size, kValueCount - next));
+      for (size_t i = 0; i < count; ++i) {
+        batch[i] = next + i;
+      }
+      for (size_t pushed = 0; pushed < count; ) {
+        size_t const batch_pushed = queue.Push(std::span<uint64_t const>(batch + pushed, count - pushed));
+        if (batch_pushed == 0) {
+          std::this_thread::yield();
+        }
+        pushed += batch_pushed;
+      }
+      next += count;
+    }
+  });
+
+  uint64_t expected = 0;
+  uint64_t out_of_order_count = 0;
+  uint64_t out[37];
+  while (expected < kValueCount) {
+    size_t const count = queue.Pop(out);
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    for (size_t i = 0; i < count; ++i, ++expected) {
+      out_of_order_count += (out[i] == expected) ? 0 : 1;
+    }
+  }
+  producer.join();
+  CHECK_EQ(out_of_order_count, 0);
+  CHECK_EQ(queue.Pop(out), 0);
+}
+
+TEST_CASE(FiltersSelectDevicesTypesAndIndices) {
+  ScriptedDevices devices;
+  REQUIRE(devices.IsInitialized());
+  DirectInputContext& context = devices.GetContext();
+  DirectInputContext::Device const& stick = devices.GetDevice(0);
+  DirectInputContext::Device const& throttle = devices.GetDevice(1);
+
+  DirectInputContext::Subscription* const everything = context.Subscribe(DirectInputContext::SubscriptionFilter {});
+  DirectInputContext::Subscription* const stick_only = context.Subscribe(DirectInputContext::SubscriptionFilter { .device = stick.handle });
+  DirectInputContext::Subscription* const throttle_buttons = context.Subscribe(
+    DirectInputContext::SubscriptionFilter { .guid = throttle.guid, .input_types = TypeBit(InputType::kButton), .indices = ButtonBits { { 0b1010, 0 } } }
+  );
+
+  // Nothing changed yet.
+  context.UpdateState();
+  CHECK(DrainAll(*everything).empty());
+
+  devices.SetAxis(0, 1, -20000);
+  devices.SetPov(0, 9000);
+  devices.SetButton(0, 3, true);
+  devices.SetButton(1, 1, true);
+  devices.SetButton(1, 2, true);
+  context.UpdateState();
+
+  // One change per input, axes first, then POVs, then buttons.
+  std::vector<InputChange> changes = DrainAll(*stick_only);
+  REQUIRE(changes.size() == 3);
+  CHECK(IsChange(changes[0], stick, InputType::kAxis, 1, -20000));
+  CHECK(IsChange(changes[1], stick, InputType::kPOV, 0, 9000));
+  CHECK(IsChange(changes[2], stick, InputType::kButton, 3, 0x80));
+
+  changes = DrainAll(*throttle_buttons);
+  REQUIRE(changes.size() == 1);
+  CHECK(IsChange(changes[0], throttle, InputType::kButton, 1, 0x80));
+
+  CHECK_EQ(DrainAll(*everything).size(), 5);
+
+  // Releases and centering are changes too.
+  devices.SetPov(0, 0xFFFFFFFF);
+  devices.SetButton(1, 1, false);
+  context.UpdateState();
+  changes = DrainAll(*stick_only);
+  REQUIRE(changes.size() == 1);
+  CHECK(IsChange(changes[0], stick, InputType::kPOV, 0, -1));
+  changes = DrainAll(*throttle_buttons);
+  REQUIRE(changes.size() == 1);
+  CHECK(IsChange(changes[0], throttle, InputType::kButton, 1, 0));
+  CHECK_EQ(DrainAll(*everything).size(), 2);
+
+  // Once unsubscribed, the others still receive their changes.
+  context.Unsubscribe(stick_only);
+  devices.SetButton(0, 0, true);
+  context.UpdateState();
+  CHECK_EQ(DrainAll(*everything).size(), 1);
+  CHECK(DrainAll(*throttle_buttons).empty());
+}
+
+TEST_CASE(AxisThresholdHoldsBackSmallMoves) {
+  ScriptedDevices devices;
+  REQUIRE(devices.IsInitialized());
+  DirectInputContext& context = devices.GetContext();
+  DirectInputContext::Device const& stick = devices.GetDevice(0);
+  DirectInputContext::Subscription* const subscription = context.Subscribe(
+    DirectInputContext::SubscriptionFilter { .device = stick.handle, .axis_threshold = 1000 }
+  );
+
+  // Each move is measured from the value last reported, not from the previous poll.
+  LONG const values[] = { 400, 800, 1200, 2100, 2300, 1300 };
+  bool const reported[] = { false, false, true, false, true, true };
+  for (size_t i = 0; i < std::size(values); ++i) {
+    devices.SetAxis(0, 0, values[i]);
+    context.UpdateState();
+    std::vector<InputChange> const changes = DrainAll(*subscription);
+    CHECK_EQ(changes.size(), reported[i] ? 1 : 0);
+    if (reported[i] && changes.size() == 1) {
+      CHECK(IsChange(changes[0], stick, InputType::kAxis, 0, values[i]));
+    }
+  }
+
+  // Buttons are not held back.
+  devices.SetButton(0, 0, true);
+  context.UpdateState();
+  CHECK_EQ(DrainAll(*subscription).size(), 1);
+}
+
+TEST_CASE(FullQueueCountsWhatItDrops) {
+  ScriptedDevices devices;
+  REQUIRE(devices.IsInitialized());
+  DirectInputContext& context = devices.GetContext();
+  DirectInputContext::Device const& stick = devices.GetDevice(0);
+  DirectInputContext::Subscription* const subscription = context.Subscribe(
+    DirectInputContext::SubscriptionFilter { .device = stick.handle, .input_types = TypeBit(InputType::kButton) }, 4
+  );
+
+  // 6 presses in one poll: the first 4 fit.
+  for (DWORD i = 0; i < 6; ++i) {
+    devices.SetButton(0, i, true);
+  }
+  context.UpdateState();
+  CHECK_EQ(subscription->GetDroppedCount(), 2);
+  std::vector<InputChange> changes = DrainAll(*subscription);
+  REQUIRE(changes.size() == 4);
+  CHECK(IsChange(changes[3], stick, InputType::kButton, 3, 0x80));
+
+  // With room again, what follows is delivered.
+  devices.SetButton(0, 0, false);
+  context.UpdateState();
+  changes = DrainAll(*subscription);
+  REQUIRE(changes.size() == 1);
+  CHECK(IsChange(changes[0], stick, InputType::kButton, 0, 0));
+  CHECK_EQ(subscription->GetDroppedCount(), 2);
+}
+
+TEST_CASE(ConsumerThreadsEndUpWithTheDeviceState) {
+  // Synthetic devices change on every poll, so nearly every subscription gets a batch each time.
+  constexpr size_t kSubscriptionCount = 256;
+  constexpr size_t kThreadCount = 4;
+  constexpr size_t kPollCount = 1000;
+  DirectInputContext context;
+  REQUIRE(context.Initialize(std::make_unique<SyntheticBackend>(SyntheticBackend::MakePopulation(16)), DirectInputContext::Config {}));
+  std::span<DirectInputContext::Device const> const devices = context.GetDevices();
+
+  /// What a subscriber knows of the inputs it follows, keyed by `MakeKey`, starting from the state when it subscribed.
+  struct Mirror final {
+    DirectInputContext::Subscription* subscription = nullptr;
+    std::unordered_map<uint64_t, LONG> values;
+  };
+  std::vector<Mirror> mirrors(kSubscriptionCount);
+  for (size_t s = 0; s < kSubscriptionCount; ++s) {
+    DirectInputContext::SubscriptionFilter const filter = MakeFilter(s, devices);
+    mirrors[s].subscription = context.Subscribe(filter, 1 << 14);
+    for (DirectInputContext::Device const& device : devices) {
+      ForEachSelectedInput(filter, device, [&](InputType type, DWORD index, LONG value) {
+        mirrors[s].values[MakeKey(device.handle, type, index)] = value;
+      });
+    }
+  }
+
+  std::atomic<bool> stop { false };
+  std::vector<std::thread> consumers;
+  for (size_t t = 0; t < kThreadCount; ++t) {
+    consumers.emplace_back([&, t]() {
+      InputChange changes[256];
+      while (true) {
+        bool const stopping = stop.load(std::memory_order_acquire);
+        for (size_t s = t; s < mirrors.size(); s += kThreadCount) {
+          Mirror& mirror = mirrors[s];
+          for (size_t count; (count = mirror.subscription->Drain(changes)) > 0;) {
+            for (size_t i = 0; i < count; ++i) {
+              mirror.values[MakeKey(changes[i].device, changes[i].type, changes[i].index)] = changes[i].value;
+            }
+          }
+        }
+        if (stopping) {
+          // Everything pushed before `stop` was set has been drained.
+          break;
+        }
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (size_t i = 0; i < kPollCount; ++i) {
+    context.UpdateState();
+  }
+  stop.store(true, std::memory_order_release);
+  for (std::thread& consumer : consumers) {
+    consumer.join();
+  }
+
+  size_t mismatch_count = 0;
+  for (Mirror const& mirror : mirrors) {
+    CHECK_EQ(mirror.subscription->GetDroppedCount(), 0);
+    DirectInputContext::SubscriptionFilter const& filter = mirror.subscription->GetFilter();
+    for (DirectInputContext::Device const& device : devices) {
+      ForEachSelectedInput(filter, device, [&](InputType type, DWORD index, LONG value) {
+        LONG const seen = mirror.values.at(MakeKey(device.handle, type, index));
+        // An axis that moved less than the threshold since it was last reported is not reported again.
+        LONG const threshold = (type == InputType::kAxis) ? filter.axis_threshold : 0;
+        mismatch_count += (seen != value && std::abs(seen - value) >= threshold) ? 1 : 0;
+      });
+    }
+  }
+  CHECK_EQ(mismatch_count, 0);
+
+  for (Mirror const& mirror : mirrors) {
+    context.Unsubscribe(mirror.subscription);
+  }
+  context.Shutdown();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+//
+// Minimal test harness shared by the tests in this directory, registered with CTest (see `add_unit_test` in CMakeLists.txt).
+// `TEST_CASE` defines a test; `CHECK` and `CHECK_EQ` report a failed expectation and carry on, `REQUIRE` also ends the test.
+// `test_main.cpp` runs the tests of an executable, or those whose name contains its first argument, and exits with 1 if one failed.
+//
+
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct TestCase final {
+  char const* name;
+  void (*function)();
+};
+
+/// Every `TEST_CASE` of the executable, in definition order within each file.
+std::vector<TestCase>& GetTestCases();
+/// Fails the running test.
+void ReportTestFailure(char const* file, int line, std::string const& message);
+
+struct TestRegistration final {
+  TestRegistration(char const* name, void (*function)()) {
+    GetTestCases().push_back(TestCase { name, function });
+  }
+};
+
+template<typename A, typename B>
+bool CheckEqual(A const& actual, B const& expected, char const* expression, char const* file, int line) {
+  constexpr bool kIntegers = std::is_integral_v<A> && std::is_integral_v<B> && !std::is_same_v<A, bool> && !std::is_same_v<B, bool>;
+  bool equal = false;
+  if constexpr (kIntegers) {
+    equal = std::cmp_equal(actual, expected);
+  }
+  else {
+    equal = (actual == expected);
+  }
+  if (equal) {
+    return true;
+  }
+
+  if constexpr (kIntegers || (std::is_arithmetic_v<A> && std::is_arithmetic_v<B>)) {
+    ReportTestFailure(file, line, std::string(expression) + " (" + std::to_string(actual) + " vs " + std::to_string(expected) + ")");
+  }
+  else {
+    ReportTestFailure(file, line, expression);
+  }
+  return false;
+}
+
+#define TEST_CONCAT_IMPL(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_IMPL(a, b)
+
+#define TEST_CASE(name) \
+  static void name(); \
+  static TestRegistration const TEST_CONCAT(name, _registration)(#name, &name); \
+  static void name()
+
+#define CHECK(condition) \
+  ((condition) ? static_cast<void>(0) : ReportTestFailure(__FILE__, __LINE__, #condition))
+#define CHECK_EQ(actual, expected) \
+  static_cast<void>(CheckEqual((actual), (expected), #actual " == " #expected, __FILE__, __LINE__))
+#define REQUIRE(condition) \
+  do { \
+    if (!(condition)) { \
+      ReportTestFailure(__FILE__, __LINE__, #condition); \
+      return; \
+    } \
+  } while (false)
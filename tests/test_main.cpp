@@ -0,0 +1,41 @@
+#include "test.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+bool g_test_failed = false;
+
+}
+
+std::vector<TestCase>& GetTestCases() {
+  static std::vector<TestCase> test_cases;
+  return test_cases;
+}
+
+void ReportTestFailure(char const* file, int line, std::string const& message) {
+  std::fprintf(stderr, "%s:%d: Failed: %s\n", file, line, message.c_str());
+  g_test_failed = true;
+}
+
+int main(int argc, char* argv[]) {
+  char const* filter = (argc > 1) ? argv[1] : "";
+
+  size_t run_count = 0;
+  size_t failure_count = 0;
+  for (TestCase const& test_case : GetTestCases()) {
+    if (std::strstr(test_case.name, filter) == nullptr) {
+      continue;
+    }
+
+    g_test_failed = false;
+    test_case.function();
+    std::printf("%-8s %s\n", g_test_failed ? "FAILED" : "OK", test_case.name);
+    ++run_count;
+    failure_count += g_test_failed ? 1 : 0;
+  }
+
+  std::printf("%zu of %zu tests passed\n", run_count - failure_count, run_count);
+  return (failure_count == 0 && run_count != 0) ? 0 : 1;
+}
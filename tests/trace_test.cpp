@@ -0,0 +1,245 @@
+//
+// `WriteChromeTrace` read back: zones, counters and thread names as Chrome trace events, a buffer that wraps around keeping its latest
+// `kTraceBufferCapacity` events, an exited thread's buffer going to the next thread, and a trace dumped while threads record more zones
+// than their buffers hold, which must only hold intact zones, and then each thread's latest ones, in order.
+// `RecordTraceZone` records with or without `CONFIG_USE_TRACING`, which only decides what the `TRACE_*` macros expand to.
+//
+
+#include "test.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr char const* kWriterNames[] = { "Writer 0", "Writer 1", "Writer 2", "Writer 3" };
+constexpr uint64_t kMinZonesPerWriter = kTraceBufferCapacity + kTraceBufferCapacity / 2;
+
+/// Zone `index` starts at `index` us and lasts `index % 1000` ns, so that a zone is known from its timestamps alone.
+uint64_t GetZoneStartNs(uint64_t index) {
+  return index * 1000;
+}
+uint64_t GetZoneDurationNs(uint64_t index) {
+  return index % 1000;
+}
+
+void RecordIndexedZone(char const* name, uint64_t index) {
+  RecordTraceZone(name, GetZoneStartNs(index), GetZoneStartNs(index) + GetZoneDurationNs(index));
+}
+
+/// A trace file of its own per test, removed at the end.
+class TraceFile final {
+public:
+  explicit TraceFile(char const* name)
+    : path_((std::filesystem::temp_directory_path() / (std::string(name) + ".json")).string()) {
+  }
+
+  ~TraceFile() {
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+  }
+
+  char const* GetPath() const {
+    return path_.c_str();
+  }
+
+  std::vector<std::string> ReadLines() const {
+    std::ifstream file(path_);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(file, line);) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+private:
+  std::string path_;
+};
+
+struct IndexedZones final {
+  uint64_t count = 0;
+  uint64_t first = UINT64_MAX;
+  uint64_t last = 0;
+  bool in_order = true;
+  /// Zones whose duration does not go with their start: parts of two different zones.
+  uint64_t torn_count = 0;
+};
+
+/// Reads back the zones named `zone_name` recorded by `RecordIndexedZone`, by thread name, from a trace with one event per line.
+std::map<std::string, IndexedZones> ReadIndexedZones(TraceFile const& trace, char const* zone_name) {
+  std::map<uint32_t, std::string> thread_names;
+  std::map<uint32_t, std::vector<std::pair<double, double>>> zones;
+  std::string const zone_prefix = std::string("\"name\": \"") + zone_name + "\", \"ph\": \"X\"";
+  for (std::string const& line : trace.ReadLines()) {
+    unsigned tid = 0;
+    size_t const tid_at = line.find("\"tid\": ");
+    if (tid_at == std::string::npos || std::sscanf(line.c_str() + tid_at, "\"tid\": %u", &tid) != 1) {
+      continue;
+    }
+    if (line.find("\"ph\": \"M\"") != std::string::npos) {
+      size_t const name_start = line.find("\"args\": {\"name\": \"") + std::strlen("\"args\": {\"name\": \"");
+      thread_names[tid] = line.substr(name_start, line.find('"', name_start) - name_start);
+    }
+    else if (line.find(zone_prefix) != std::string::npos) {
+      double ts = -1.0;
+      double dur = -1.0;
+      std::sscanf(line.c_str() + line.find("\"ts\": "), "\"ts\": %lf, \"dur\": %lf", &ts, &dur);
+      zones[tid].emplace_back(ts, dur);
+    }
+  }
+
+  std::map<std::string, IndexedZones> result;
+  for (auto const& [tid, thread_zones] : zones) {
+    IndexedZones& indexed = result[thread_names[tid]];
+    for (auto const& [ts, dur] : thread_zones) {
+      uint64_t const index = static_cast<uint64_t>(ts + 0.5);
+      if (ts < 0.0 || dur < 0.0 || GetZoneStartNs(index) != static_cast<uint64_t>(ts * 1e3 + 0.5) || GetZoneDurationNs(index) != static_cast<uint64_t>(dur * 1e3 + 0.5)) {
+        ++indexed.torn_count;
+        continue;
+      }
+      indexed.in_order = indexed.in_order && (indexed.count == 0 || index == indexed.last + 1);
+      indexed.first = std::min(indexed.first, index);
+      indexed.last = index;
+      ++indexed.count;
+    }
+  }
+  return result;
+}
+
+bool HasLineWith(std::vector<std::string> const& lines, std::string const& text) {
+  return std::any_of(lines.begin(), lines.end(), [&](std::string const& line) { return line.find(text) != std::string::npos; });
+}
+
+}
+
+TEST_CASE(WritesZonesCountersAndThreadNames) {
+  TraceFile const trace("trace_test_events");
+  std::thread thread([]() {
+    SetTraceThreadName("Events Thread");
+    RecordTraceZone("EventsZone", 1'234'567, 1'235'067);
+    RecordTraceCounter("EventsCounter", -42);
+  });
+  thread.join();
+
+  // The thread's buffer is kept until another thread records.
+  REQUIRE(WriteChromeTrace(trace.GetPath()));
+  std::vector<std::string> const lines = trace.ReadLines();
+  REQUIRE(!lines.empty());
+  CHECK(lines.front() == "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+  CHECK(lines.back() == "]}");
+  CHECK(HasLineWith(lines, "\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "));
+  CHECK(HasLineWith(lines, "\"args\": {\"name\": \"Events Thread\"}}"));
+  CHECK(HasLineWith(lines, "\"name\": \"EventsZone\", \"ph\": \"X\", \"pid\": 1, \"tid\": "));
+  CHECK(HasLineWith(lines, "\"ts\": 1234.567, \"dur\": 0.500}"));
+  CHECK(HasLineWith(lines, "\"name\": \"EventsCounter\", \"ph\": \"C\", \"pid\": 1, \"tid\": "));
+  CHECK(HasLineWith(lines, "\"args\": {\"value\": -42}}"));
+}
+
+TEST_CASE(FullBufferKeepsTheLatestEvents) {
+  TraceFile const trace("trace_test_wrap");
+  std::thread thread([]() {
+    SetTraceThreadName("Wrapping Thread");
+    for (uint64_t index = 0; index < kMinZonesPerWriter; ++index) {
+      RecordIndexedZone("WrappingZone", index);
+    }
+  });
+  thread.join();
+
+  REQUIRE(WriteChromeTrace(trace.GetPath()));
+  std::map<std::string, IndexedZones> const zones = ReadIndexedZones(trace, "WrappingZone");
+  REQUIRE(zones.size() == 1);
+  IndexedZones const& indexed = zones.begin()->second;
+  CHECK(zones.begin()->first == "Wrapping Thread");
+  CHECK_EQ(indexed.count, kTraceBufferCapacity);
+  CHECK_EQ(indexed.first, kMinZonesPerWriter - kTraceBufferCapacity);
+  CHECK_EQ(indexed.last, kMinZonesPerWriter - 1);
+  CHECK(indexed.in_order);
+  CHECK_EQ(indexed.torn_count, 0);
+}
+
+TEST_CASE(ExitedThreadsBufferGoesToTheNextThread) {
+  TraceFile const trace("trace_test_reuse");
+  std::thread exited([]() {
+    SetTraceThreadName("Exited Thread");
+    for (uint64_t index = 0; index < 3; ++index) {
+      RecordIndexedZone("ReusedZone", index);
+    }
+  });
+  exited.join();
+  REQUIRE(WriteChromeTrace(trace.GetPath()));
+  CHECK_EQ(ReadIndexedZones(trace, "ReusedZone")["Exited Thread"].count, 3);
+
+  // Its events are gone, rather than attributed to the next one.
+  std::thread next([]() {
+    SetTraceThreadName("Next Thread");
+    RecordIndexedZone("ReusedZone", 10);
+  });
+  next.join();
+  REQUIRE(WriteChromeTrace(trace.GetPath()));
+  std::map<std::string, IndexedZones> const zones = ReadIndexedZones(trace, "ReusedZone");
+  REQUIRE(zones.size() == 1);
+  CHECK(zones.begin()->first == "Next Thread");
+  CHECK_EQ(zones.begin()->second.count, 1);
+  CHECK_EQ(zones.begin()->second.first, 10);
+  CHECK(!HasLineWith(trace.ReadLines(), "Exited Thread"));
+}
+
+TEST_CASE(DumpsWhileThreadsRecordHoldOnlyIntactZones) {
+  TraceFile const trace("trace_test_concurrent");
+  constexpr size_t kWriterCount = std::size(kWriterNames);
+
+  // Writers wrap around their buffers while the trace is dumped over and over.
+  std::atomic<bool> stop { false };
+  std::atomic<size_t> running { kWriterCount };
+  std::vector<uint64_t> zone_counts(kWriterCount);
+  std::vector<std::thread> writers;
+  for (size_t t = 0; t < kWriterCount; ++t) {
+    writers.emplace_back([&stop, &running, &zone_counts, t]() {
+      SetTraceThreadName(kWriterNames[t]);
+      uint64_t index = 0;
+      for (; index < kMinZonesPerWriter || !stop.load(std::memory_order_relaxed); ++index) {
+        RecordIndexedZone("WriterZone", index);
+      }
+      zone_counts[t] = index;
+      running.fetch_sub(1, std::memory_order_release);
+      // An exited writer's buffer would go to a writer started after it.
+      while (running.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+      }
+    });
+  }
+
+  for (int dump = 0; dump < 4; ++dump) {
+    CHECK(WriteChromeTrace(trace.GetPath()));
+    for (auto const& [name, indexed] : ReadIndexedZones(trace, "WriterZone")) {
+      CHECK_EQ(indexed.torn_count, 0);
+      CHECK(indexed.count <= kTraceBufferCapacity);
+    }
+  }
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+
+  // Once they are done, each one's latest zones are all there.
+  REQUIRE(WriteChromeTrace(trace.GetPath()));
+  std::map<std::string, IndexedZones> zones = ReadIndexedZones(trace, "WriterZone");
+  for (size_t t = 0; t < kWriterCount; ++t) {
+    IndexedZones const& indexed = zones[kWriterNames[t]];
+    CHECK_EQ(indexed.count, kTraceBufferCapacity);
+    CHECK_EQ(indexed.first, zone_counts[t] - kTraceBufferCapacity);
+    CHECK_EQ(indexed.last, zone_counts[t] - 1);
+    CHECK(indexed.in_order);
+    CHECK_EQ(indexed.torn_count, 0);
+  }
+}
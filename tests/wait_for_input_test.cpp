@@ -0,0 +1,180 @@
+//
+// `WaitForInput` against event-driven synthetic devices (`SyntheticBackend::DeviceSpec::event_driven`, signaled through an `eventfd` on Linux):
+// an idle wait lasts its timeout, a change wakes the wait with the changed device and its new state, whether it was set before or during
+// the wait, devices without a notification handle are still polled, and `InterruptWaitForInput` and `NotifyDeviceChange` end a wait.
+//
+
+#include "test.h"
+
+#include "direct_input_context.h"
+#include "synthetic_backend.h"
+
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr size_t kDeviceCount = 8;
+
+/// A population whose devices all signal their changes, but for `polled_count` of them at the end.
+class Fixture final {
+public:
+  explicit Fixture(size_t polled_count = 0) {
+    std::vector<SyntheticBackend::DeviceSpec> specs = SyntheticBackend::MakePopulation(kDeviceCount);
+    for (size_t i = 0; i < specs.size(); ++i) {
+      specs[i].event_driven = (i + polled_count < specs.size());
+    }
+    auto backend = std::make_unique<SyntheticBackend>(std::move(specs));
+    backend_ = backend.get();
+    initialized_ = context_.Initialize(std::move(backend), DirectInputContext::Config {});
+    context_.UpdateState();
+  }
+
+  ~Fixture() {
+    context_.Shutdown();
+  }
+
+  bool IsInitialized() const {
+    return initialized_ && context_.GetDevices().size() == kDeviceCount;
+  }
+
+  DirectInputContext& GetContext() {
+    return context_;
+  }
+
+  /// Every device in the population has an X axis or a button; `value` goes in both, as a press if odd.
+  void SetState(size_t index, LONG value) {
+    DIJOYSTATE2 state {};
+    std::memset(state.rgdwPOV, 0xFF, sizeof(state.rgdwPOV));
+    state.lX = value;
+    state.rgbButtons[0] = ((value % 2) != 0) ? 0x80 : 0;
+    backend_->SetDeviceState(index, state);
+  }
+
+  /// Whether the wait returned exactly device `index`, with the state `SetState(index, value)` set.
+  bool ReturnedDevice(std::span<DirectInputContext::DeviceHandle const> changed, size_t index, LONG value) {
+    if (changed.size() != 1) {
+      return false;
+    }
+    DirectInputContext::Device const* device = context_.GetDevice(changed[0]);
+    return
+      device != nullptr && device->guid == SyntheticBackend::MakeDeviceGuid(index) &&
+      (device->axes.empty() || device->axes[0].offset != DIJOFS_X || device->GetAxisValue(0) == value) &&
+      (device->buttons.empty() || device->GetButtonValue(0) == (((value % 2) != 0) ? 0x80 : 0));
+  }
+
+private:
+  DirectInputContext context_;
+  SyntheticBackend* backend_ = nullptr;
+  bool initialized_ = false;
+};
+
+double GetSecondsSince(uint64_t start_ns) {
+  return static_cast<double>(GetMonotonicTimeNs() - start_ns) / 1e9;
+}
+
+}
+
+TEST_CASE(IdleWaitLastsItsTimeout) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  uint64_t const start = GetMonotonicTimeNs();
+  CHECK(fixture.GetContext().WaitForInput(std::chrono::milliseconds(100)).empty());
+  CHECK(GetSecondsSince(start) >= 0.09);
+}
+
+TEST_CASE(ChangeBeforeTheWaitReturnsRightAway) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  fixture.SetState(3, 1001);
+  uint64_t const start = GetMonotonicTimeNs();
+  std::span<DirectInputContext::DeviceHandle const> const changed = fixture.GetContext().WaitForInput(std::chrono::seconds(5));
+  CHECK(GetSecondsSince(start) < 1.0);
+  CHECK(fixture.ReturnedDevice(changed, 3, 1001));
+  // Nothing new since.
+  CHECK(fixture.GetContext().WaitForInput(std::chrono::milliseconds(20)).empty());
+}
+
+TEST_CASE(ChangesDuringTheWaitWakeItWithTheChangedDevice) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+
+  // Another thread changes one device at a time, at random intervals, and waits for the waiting thread to see it before the next one.
+  constexpr size_t kChangeCount = 200;
+  std::vector<size_t> indices(kChangeCount);
+  std::mt19937 random(1);
+  for (size_t& index : indices) {
+    index = random() % kDeviceCount;
+  }
+  std::atomic<size_t> seen_count { 0 };
+  std::thread changer([&]() {
+    std::uniform_int_distribution<int> delay_us(50, 500);
+    for (size_t i = 0; i < kChangeCount; ++i) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us(random)));
+      fixture.SetState(indices[i], static_cast<LONG>(i) + 1);
+      while (seen_count.load(std::memory_order_acquire) <= i) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  // A wait that times out is retried, up to a point; a wrong device ends the test once the changer is released.
+  size_t timeout_count = 0;
+  size_t mismatch_count = 0;
+  for (size_t i = 0; i < kChangeCount && timeout_count < 5; ) {
+    std::span<DirectInputContext::DeviceHandle const> const changed = fixture.GetContext().WaitForInput(std::chrono::seconds(1));
+    if (changed.empty()) {
+      ++timeout_count;
+      continue;
+    }
+    mismatch_count += fixture.ReturnedDevice(changed, indices[i], static_cast<LONG>(i) + 1) ? 0 : 1;
+    seen_count.store(++i, std::memory_order_release);
+  }
+  seen_count.store(kChangeCount, std::memory_order_release);
+  changer.join();
+  CHECK_EQ(timeout_count, 0);
+  CHECK_EQ(mismatch_count, 0);
+}
+
+TEST_CASE(DevicesWithoutNotificationAreStillPolled) {
+  // The last device animates on every poll, and signals nothing.
+  Fixture fixture(1);
+  REQUIRE(fixture.IsInitialized());
+  uint64_t const start = GetMonotonicTimeNs();
+  std::span<DirectInputContext::DeviceHandle const> const changed = fixture.GetContext().WaitForInput(std::chrono::seconds(5));
+  CHECK(GetSecondsSince(start) < 1.0);
+  REQUIRE(changed.size() == 1);
+  CHECK(fixture.GetContext().GetDevice(changed[0])->guid == SyntheticBackend::MakeDeviceGuid(kDeviceCount - 1));
+}
+
+TEST_CASE(InterruptAndDeviceChangeEndTheWait) {
+  Fixture fixture;
+  REQUIRE(fixture.IsInitialized());
+  DirectInputContext& context = fixture.GetContext();
+
+  for (int which = 0; which < 2; ++which) {
+    std::thread waker([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      if (which == 0) {
+        context.InterruptWaitForInput();
+      }
+      else {
+        context.NotifyDeviceChange();
+      }
+    });
+    uint64_t const start = GetMonotonicTimeNs();
+    CHECK(context.WaitForInput(std::chrono::seconds(5)).empty());
+    CHECK(GetSecondsSince(start) < 1.0);
+    waker.join();
+    context.UpdateDetection();
+  }
+
+  // An interrupt before the wait ends the next one.
+  context.InterruptWaitForInput();
+  uint64_t const start = GetMonotonicTimeNs();
+  context.WaitForInput(std::chrono::seconds(5));
+  CHECK(GetSecondsSince(start) < 1.0);
+}
@@ -0,0 +1,191 @@
+#include "trace.h"
+
+#include <atomic>
+#include <bit>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+static_assert(std::has_single_bit(kTraceBufferCapacity));
+
+enum class TraceEventKind : uint32_t {
+  kZone,
+  kCounter,
+};
+
+/// One event, in relaxed atomic fields so that a dump can read it while its thread overwrites it: `sequence` tells whether it did.
+struct TraceSlot final {
+  /// The index of the event in its buffer plus one once written, 0 while being written.
+  std::atomic<uint64_t> sequence { 0 };
+  std::atomic<char const*> name { nullptr };
+  std::atomic<uint64_t> time_ns { 0 };
+  /// The duration of a zone, or the value of a counter.
+  std::atomic<int64_t> value { 0 };
+  std::atomic<TraceEventKind> kind { TraceEventKind::kZone };
+};
+
+/// Written by its thread only; read by `WriteChromeTrace` under `TraceRegistry::mutex`.
+struct TraceBuffer final {
+  explicit TraceBuffer(uint32_t thread_id)
+    : thread_id(thread_id), slots(std::make_unique<TraceSlot[]>(kTraceBufferCapacity))
+  {
+  }
+
+  uint32_t thread_id;
+  std::atomic<char const*> thread_name { nullptr };
+  /// Number of events written, of which the latest `kTraceBufferCapacity` are in `slots`.
+  std::atomic<uint64_t> written { 0 };
+  std::unique_ptr<TraceSlot[]> slots;
+};
+
+struct TraceRegistry final {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers;
+  /// Of exited threads, to be reused.
+  std::vector<TraceBuffer*> free_buffers;
+  uint32_t next_thread_id = 1;
+};
+
+TraceRegistry& GetTraceRegistry() {
+  // Never destroyed, as threads may still record while static objects are destroyed.
+  static TraceRegistry* const registry = new TraceRegistry();
+  return *registry;
+}
+
+thread_local TraceBuffer* t_trace_buffer = nullptr;
+
+/// Hands the calling thread's buffer back to the registry when the thread exits.
+/// Apart from `t_trace_buffer`, which is faster to get to, as it has no destructor to register on first use.
+struct TraceBufferRelease final {
+  TraceBuffer* buffer = nullptr;
+
+  ~TraceBufferRelease() noexcept {
+    t_trace_buffer = nullptr;
+    if (buffer != nullptr) {
+      TraceRegistry& registry = GetTraceRegistry();
+      std::lock_guard lock(registry.mutex);
+      registry.free_buffers.push_back(buffer);
+    }
+  }
+};
+
+thread_local TraceBufferRelease t_trace_buffer_release;
+
+/// The only part of recording that locks or allocates, once per thread.
+TraceBuffer& RegisterTraceBuffer() {
+  TraceRegistry& registry = GetTraceRegistry();
+  {
+    std::lock_guard lock(registry.mutex);
+    if (!registry.free_buffers.empty()) {
+      // The previous thread's events are gone, rather than attributed to this one.
+      t_trace_buffer = registry.free_buffers.back();
+      registry.free_buffers.pop_back();
+      t_trace_buffer->thread_id = registry.next_thread_id++;
+      t_trace_buffer->thread_name.store(nullptr, std::memory_order_relaxed);
+      t_trace_buffer->written.store(0, std::memory_order_relaxed);
+    }
+    else {
+      registry.buffers.push_back(std::make_unique<TraceBuffer>(registry.next_thread_id++));
+      t_trace_buffer = registry.buffers.back().get();
+    }
+  }
+  // Outside of the lock, as this first use registers the destructor.
+  t_trace_buffer_release.buffer = t_trace_buffer;
+  return *t_trace_buffer;
+}
+
+TraceBuffer& GetTraceBuffer() {
+  TraceBuffer* const buffer = t_trace_buffer;
+  return (buffer != nullptr) ? *buffer : RegisterTraceBuffer();
+}
+
+void RecordTraceEvent(TraceEventKind kind, char const* name, uint64_t time_ns, int64_t value) {
+  TraceBuffer& buffer = GetTraceBuffer();
+  uint64_t const index = buffer.written.load(std::memory_order_relaxed);
+  TraceSlot& slot = buffer.slots[index & (kTraceBufferCapacity - 1)];
+
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.time_ns.store(time_ns, std::memory_order_relaxed);
+  slot.value.store(value, std::memory_order_relaxed);
+  slot.kind.store(kind, std::memory_order_relaxed);
+
+  slot.sequence.store(index + 1, std::memory_order_release);
+  buffer.written.store(index + 1, std::memory_order_release);
+}
+
+}
+
+void RecordTraceZone(char const* name, uint64_t start_ns, uint64_t end_ns) {
+  RecordTraceEvent(TraceEventKind::kZone, name, start_ns, static_cast<int64_t>(end_ns - start_ns));
+}
+
+void RecordTraceCounter(char const* name, int64_t value) {
+  RecordTraceEvent(TraceEventKind::kCounter, name, GetMonotonicTimeNs(), value);
+}
+
+void SetTraceThreadName(char const* name) {
+  GetTraceBuffer().thread_name.store(name, std::memory_order_relaxed);
+}
+
+bool WriteChromeTrace(char const* path) {
+  FILE* file = std::fopen(path, "w");
+  if (file == nullptr) {
+    return false;
+  }
+
+  // Timestamps are in microseconds, with nanoseconds as decimals.
+  std::fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  char const* separator = "";
+
+  TraceRegistry& registry = GetTraceRegistry();
+  std::lock_guard lock(registry.mutex);
+  for (std::unique_ptr<TraceBuffer> const& buffer : registry.buffers) {
+    uint32_t const tid = buffer->thread_id;
+    if (char const* thread_name = buffer->thread_name.load(std::memory_order_relaxed)) {
+      std::fprintf(file, "%s  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %" PRIu32 ", \"args\": {\"name\": \"%s\"}}", separator, tid, thread_name);
+      separator = ",\n";
+    }
+
+    uint64_t const written = buffer->written.load(std::memory_order_acquire);
+    uint64_t const first = (written > kTraceBufferCapacity) ? written - kTraceBufferCapacity : 0;
+    for (uint64_t index = first; index < written; ++index) {
+      TraceSlot const& slot = buffer->slots[index & (kTraceBufferCapacity - 1)];
+      if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+        continue;
+      }
+      char const* const name = slot.name.load(std::memory_order_relaxed);
+      uint64_t const time_ns = slot.time_ns.load(std::memory_order_relaxed);
+      int64_t const value = slot.value.load(std::memory_order_relaxed);
+      TraceEventKind const kind = slot.kind.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != index + 1) {
+        // Overwritten meanwhile.
+        continue;
+      }
+
+      if (kind == TraceEventKind::kZone) {
+        std::fprintf(
+          file, "%s  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %" PRIu32 ", \"ts\": %.3f, \"dur\": %.3f}",
+          separator, name, tid, static_cast<double>(time_ns) / 1e3, static_cast<double>(value) / 1e3
+        );
+      }
+      else {
+        std::fprintf(
+          file, "%s  {\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %" PRIu32 ", \"ts\": %.3f, \"args\": {\"value\": %" PRId64 "}}",
+          separator, name, tid, static_cast<double>(time_ns) / 1e3, value
+        );
+      }
+      separator = ",\n";
+    }
+  }
+
+  std::fprintf(file, "\n]}\n");
+  return std::fclose(file) == 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "latency_histogram.h"
+
+#include <cstdint>
+
+/// 0: The `TRACE_*` macros expand to nothing, so instrumented code is exactly as without them.
+/// 1: They record into the calling thread's trace buffer, which `WriteChromeTrace` dumps.
+#if !defined(CONFIG_USE_TRACING)
+# define CONFIG_USE_TRACING (0)
+#endif
+
+/// Events kept per thread: once a thread has recorded that many, each new event overwrites its oldest one.
+inline constexpr uint64_t kTraceBufferCapacity = uint64_t(1) << 16;
+
+/// Records that the zone `name` ran from `start_ns` to `end_ns` (see `GetMonotonicTimeNs`) on the calling thread.
+///
+/// Recording is lock-free and allocation-free: each thread writes into its own ring buffer, which it allocates and registers on its first event.
+/// `name` is kept as is, so it must outlive every dump (a string literal) and need no escaping in JSON.
+void RecordTraceZone(char const* name, uint64_t start_ns, uint64_t end_ns);
+/// Records that the counter `name` is `value` as of now, e.g. a running total of failures.
+void RecordTraceCounter(char const* name, int64_t value);
+/// Names the calling thread in the trace. Same requirements on `name` as `RecordTraceZone`.
+void SetTraceThreadName(char const* name);
+
+/// Writes the events currently held by every thread's buffer as Chrome trace-event JSON, which `chrome://tracing` and Perfetto open:
+/// zones as complete ("X") events, counters as "C" events and thread names as metadata.
+/// Can be called from any thread at any time; threads keep recording meanwhile, and an event overwritten while it is read is left out.
+/// A thread's buffer is reused by the next thread started after it exited, so exited threads' events are only kept until then.
+bool WriteChromeTrace(char const* path);
+
+/// Times the rest of the enclosing scope. Use `TRACE_ZONE` rather than this, so that it is compiled out without `CONFIG_USE_TRACING`.
+class TraceZone final {
+public:
+  explicit TraceZone(char const* name)
+    : name_(name), start_ns_(GetMonotonicTimeNs())
+  {
+  }
+  ~TraceZone() noexcept {
+    RecordTraceZone(name_, start_ns_, GetMonotonicTimeNs());
+  }
+
+  TraceZone(TraceZone const&) = delete;
+  TraceZone& operator=(TraceZone const&) = delete;
+
+private:
+  char const* name_;
+  uint64_t start_ns_;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#if CONFIG_USE_TRACING
+# define TRACE_ZONE(name) TraceZone const TRACE_CONCAT(trace_zone_, __LINE__)(name)
+# define TRACE_COUNTER(name, value) RecordTraceCounter((name), static_cast<int64_t>(value))
+# define TRACE_THREAD_NAME(name) SetTraceThreadName(name)
+#else
+// The arguments are not evaluated.
+# define TRACE_ZONE(name) static_cast<void>(0)
+# define TRACE_COUNTER(name, value) static_cast<void>(0)
+# define TRACE_THREAD_NAME(name) static_cast<void>(0)
+#endif
@@ -0,0 +1,85 @@
+#include "worker_pool.h"
+
+#include "trace.h"
+
+WorkerPool::WorkerPool(size_t worker_count) {
+  workers_.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(&WorkerPool::WorkerMain, this);
+  }
+}
+
+WorkerPool::~WorkerPool() noexcept {
+  exit_.store(true, std::memory_order_relaxed);
+  job_.fetch_add(1, std::memory_order_release);
+  job_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void WorkerPool::Run(uint32_t count, JobFunction function, void* argument) {
+  if (count == 0) {
+    return;
+  }
+  if (workers_.empty()) {
+    for (uint32_t i = 0; i < count; ++i) {
+      function(argument, i);
+    }
+    return;
+  }
+
+  uint32_t const job = static_cast<uint32_t>(job_.load(std::memory_order_relaxed) + 1);
+  job_function_.store(function, std::memory_order_relaxed);
+  job_argument_.store(argument, std::memory_order_relaxed);
+  remaining_.store(count, std::memory_order_relaxed);
+  claim_.store((uint64_t(job) << 32) | count, std::memory_order_release);
+
+  job_.store(job, std::memory_order_release);
+  job_.notify_all();
+
+  // Rather than just waiting, help.
+  this->RunIterations(job, function, argument);
+
+  for (uint32_t remaining = remaining_.load(std::memory_order_acquire); remaining != 0; remaining = remaining_.load(std::memory_order_acquire)) {
+    remaining_.wait(remaining, std::memory_order_acquire);
+  }
+}
+
+void WorkerPool::WorkerMain() {
+  TRACE_THREAD_NAME("Worker");
+
+  uint64_t seen_job = 0;
+  while (true) {
+    job_.wait(seen_job, std::memory_order_acquire);
+    if (exit_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    seen_job = job_.load(std::memory_order_acquire);
+    // If this is already a later job's function, the job `seen_job` is over, and no iteration of it is left to claim.
+    JobFunction const function = job_function_.load(std::memory_order_relaxed);
+    void* const argument = job_argument_.load(std::memory_order_relaxed);
+    this->RunIterations(static_cast<uint32_t>(seen_job), function, argument);
+  }
+}
+
+void WorkerPool::RunIterations(uint32_t job, JobFunction function, void* argument) {
+  uint64_t claim = claim_.load(std::memory_order_acquire);
+  while (true) {
+    uint32_t const left = static_cast<uint32_t>(claim);
+    if (static_cast<uint32_t>(claim >> 32) != job || left == 0) {
+      return;
+    }
+    if (!claim_.compare_exchange_weak(claim, claim - 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+      continue;
+    }
+
+    function(argument, left - 1);
+
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      remaining_.notify_all();
+    }
+    claim = claim_.load(std::memory_order_acquire);
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// A fixed set of persistent threads that run the iterations of a loop together with the calling thread, e.g. to poll devices concurrently
+/// (see `DirectInputContext::Config::polling_worker_count`).
+/// Idle workers sleep on an atomic wait; each `ParallelFor` wakes them, hands out iterations one at a time, and returns once all of them are done.
+class WorkerPool final {
+public:
+  explicit WorkerPool(size_t worker_count);
+  ~WorkerPool() noexcept;
+
+  WorkerPool(WorkerPool const&) = delete;
+  WorkerPool& operator=(WorkerPool const&) = delete;
+
+  size_t GetWorkerCount() const {
+    return workers_.size();
+  }
+
+  /// Calls `f(size_t index)` for every index in `[0, count)`, in no particular order, spread over the workers and the calling thread.
+  /// Returns once every call has returned. Does not allocate. Must not be called from more than one thread at a time.
+  template<typename F>
+  void ParallelFor(size_t count, F&& f) {
+    this->Run(
+      static_cast<uint32_t>(count),
+      [](void* argument, size_t index) {
+        (*static_cast<std::remove_reference_t<F>*>(argument))(index);
+      },
+      const_cast<void*>(static_cast<void const*>(&f))
+    );
+  }
+
+private:
+  using JobFunction = void (*)(void* argument, size_t index);
+
+  void Run(uint32_t count, JobFunction function, void* argument);
+  void WorkerMain();
+  /// Runs iterations of `job` until there are none left to claim.
+  void RunIterations(uint32_t job, JobFunction function, void* argument);
+
+  std::vector<std::thread> workers_;
+
+  /// The current job's id. Workers wait for it to change.
+  std::atomic<uint64_t> job_ { 0 };
+  std::atomic<JobFunction> job_function_ { nullptr };
+  std::atomic<void*> job_argument_ { nullptr };
+  /// The job's id in the high half, and how many iterations are left to claim in the low half (they are claimed from the last one down).
+  /// Tagging claims with the job keeps a worker that is late for one job from claiming an iteration of the next one.
+  std::atomic<uint64_t> claim_ { 0 };
+  /// Iterations claimed but not finished yet, or not claimed yet.
+  std::atomic<uint32_t> remaining_ { 0 };
+  std::atomic<bool> exit_ { false };
+};